@@ -0,0 +1,202 @@
+/**
+ * @file    ast.c
+ * @brief   The abstract syntax tree of a SIMPL-2021 subroutine body.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+#include "error.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+#define INITIAL_NODES 256
+#define NARRAYS       5
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void arrays(Ast *t, NodeArray *a[]);
+static Node alloc_node(NodeArray *a);
+
+/* --- tree interface ------------------------------------------------------- */
+
+void init_ast(Ast *t)
+{
+	NodeArray *a[NARRAYS];
+	unsigned int i;
+
+	t->exprs.size = sizeof(Expr);
+	t->stmts.size = sizeof(Stmt);
+	t->names.size = sizeof(Name);
+	t->vars.size = sizeof(Var);
+	t->args.size = sizeof(Arg);
+	arrays(t, a);
+	for (i = 0; i < NARRAYS; i++) {
+		a[i]->nodes = NULL;
+		a[i]->count = a[i]->capacity = 0;
+		alloc_node(a[i]);
+	}
+}
+
+Node new_expr(Ast *t, ExprKind kind, SourcePos pos, SourcePos start)
+{
+	Node n;
+	Expr *e;
+
+	n = alloc_node(&t->exprs);
+	e = ast_expr(t, n);
+	e->kind = kind;
+	e->pos = pos;
+	e->start = start;
+
+	return n;
+}
+
+Node new_stmt(Ast *t, StmtKind kind, SourcePos pos)
+{
+	Node n;
+	Stmt *s;
+
+	n = alloc_node(&t->stmts);
+	s = ast_stmt(t, n);
+	s->kind = kind;
+	s->pos = pos;
+
+	return n;
+}
+
+Node new_name(Ast *t, char *id, SourcePos pos)
+{
+	Node n;
+	Name *m;
+
+	n = alloc_node(&t->names);
+	m = ast_name(t, n);
+	m->id = id;
+	m->pos = pos;
+
+	return n;
+}
+
+Node new_var(Ast *t, char *id, ValType type, SourcePos pos)
+{
+	Node n;
+	Var *v;
+
+	n = alloc_node(&t->vars);
+	v = ast_var(t, n);
+	v->id = id;
+	v->type = type;
+	v->pos = pos;
+
+	return n;
+}
+
+Node new_arg(Ast *t, Node expr, char *string)
+{
+	Node n;
+	Arg *a;
+
+	n = alloc_node(&t->args);
+	a = ast_arg(t, n);
+	a->expr = expr;
+	a->string = string;
+
+	return n;
+}
+
+Expr *ast_expr(Ast *t, Node n)
+{
+	return (Expr *) t->exprs.nodes + n;
+}
+
+Stmt *ast_stmt(Ast *t, Node n)
+{
+	return (Stmt *) t->stmts.nodes + n;
+}
+
+Name *ast_name(Ast *t, Node n)
+{
+	return (Name *) t->names.nodes + n;
+}
+
+Var *ast_var(Ast *t, Node n)
+{
+	return (Var *) t->vars.nodes + n;
+}
+
+Arg *ast_arg(Ast *t, Node n)
+{
+	return (Arg *) t->args.nodes + n;
+}
+
+void reset_ast(Ast *t)
+{
+	NodeArray *a[NARRAYS];
+	unsigned int i;
+
+	/* the walks steal the strings they keep, and clear them in the tree */
+	for (i = 1; i < t->names.count; i++) {
+		efree(ast_name(t, i)->id);
+	}
+	for (i = 1; i < t->vars.count; i++) {
+		efree(ast_var(t, i)->id);
+	}
+	for (i = 1; i < t->args.count; i++) {
+		efree(ast_arg(t, i)->string);
+	}
+	arrays(t, a);
+	for (i = 0; i < NARRAYS; i++) {
+		a[i]->count = 1;
+	}
+}
+
+void release_ast(Ast *t)
+{
+	NodeArray *a[NARRAYS];
+	unsigned int i;
+
+	reset_ast(t);
+	arrays(t, a);
+	for (i = 0; i < NARRAYS; i++) {
+		efree(a[i]->nodes);
+		a[i]->nodes = NULL;
+		a[i]->count = a[i]->capacity = 0;
+	}
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * Lists the node arrays of a tree.
+ *
+ * @param[in]  t the tree.
+ * @param[out] a the array of NARRAYS pointers to fill in.
+ */
+static void arrays(Ast *t, NodeArray *a[])
+{
+	a[0] = &t->exprs;
+	a[1] = &t->stmts;
+	a[2] = &t->names;
+	a[3] = &t->vars;
+	a[4] = &t->args;
+}
+
+/**
+ * Appends a cleared node to an array, growing the array if it is full.
+ *
+ * @param[in,out] a the array.
+ * @return          the index of the new node.
+ */
+static Node alloc_node(NodeArray *a)
+{
+	if (a->count == a->capacity) {
+		a->capacity = (a->capacity == 0 ? INITIAL_NODES : a->capacity * 2);
+		a->nodes = erealloc(a->nodes, a->capacity * a->size);
+	}
+	memset((char *) a->nodes + a->count * a->size, 0, a->size);
+
+	return a->count++;
+}
@@ -0,0 +1,292 @@
+/**
+ * @file    ast.h
+ * @brief   The abstract syntax tree of a SIMPL-2021 subroutine body.
+ *
+ * The parser builds the tree of one body at a time, and has each piece type
+ * checked as soon as it is complete, after which the body is translated to
+ * code in a walk of its own.  Nodes are kept
+ * in typed arrays, one for each kind of node, and refer to one another by
+ * index rather than by pointer, so that the arrays may grow while the tree is
+ * built, and can be reused for the next body once the tree has been walked.
+ * Index 0 of each array is reserved, so that <code>NO_NODE</code> can denote
+ * an absent child.
+ *
+ * Since an array may move when a node is added, a pointer obtained from one
+ * of the accessors is only valid until the next node of the same kind is
+ * created.  The arrays belong to a tree context, so that several trees may be
+ * built at once.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef AST_H
+#define AST_H
+
+#include "error.h"
+#include "symboltable.h"
+#include "token.h"
+#include "valtypes.h"
+
+/** the index of a node in the array for its kind */
+typedef unsigned int Node;
+
+/** the absent node */
+#define NO_NODE 0
+
+/** the kinds of expression */
+typedef enum {
+	EXPR_VAR,          /**< a variable                                */
+	EXPR_INDEX,        /**< an array element                          */
+	EXPR_CALL,         /**< a function call                           */
+	EXPR_NUM,          /**< a number literal                          */
+	EXPR_TRUE,         /**< the literal true                          */
+	EXPR_FALSE,        /**< the literal false                         */
+	EXPR_NOT,          /**< a logical negation                        */
+	EXPR_NEG,          /**< an arithmetic negation                    */
+	EXPR_BINARY        /**< a relational, additive, or multiplicative */
+} ExprKind;
+
+/** the kinds of statement */
+typedef enum {
+	STMT_EXIT,         /**< an exit, with an optional expression      */
+	STMT_IF,           /**< an if, with its guard and statements      */
+	STMT_ELSIF,        /**< an elsif, with its guard and statements   */
+	STMT_ELSE,         /**< an else, with its statements              */
+	STMT_CALL,         /**< a procedure call                          */
+	STMT_ASSIGN,       /**< an assignment of an expression            */
+	STMT_ALLOC,        /**< an array allocation                       */
+	STMT_READ,         /**< a read into a variable                    */
+	STMT_WHILE,        /**< a while loop                              */
+	STMT_WRITE         /**< a write of strings and expressions        */
+} StmtKind;
+
+/** an expression */
+typedef struct {
+	ExprKind   kind;   /**< the kind of expression                        */
+	TokenType  op;     /**< the operator of a binary expression           */
+	ValType    type;   /**< the type, once the expression is checked      */
+	SourcePos  pos;    /**< the position of the operator or primary       */
+	SourcePos  start;  /**< the position of the first token               */
+	int        value;  /**< the value of a number literal                 */
+	Node       name;   /**< the variable or function, if any              */
+	Node       left;   /**< the operand, or the left operand              */
+	Node       right;  /**< the right operand, or the index               */
+	Node       args;   /**< the arguments of a call                       */
+} Expr;
+
+/** a statement */
+typedef struct {
+	StmtKind   kind;   /**< the kind of statement                         */
+	SourcePos  pos;    /**< the position of the keyword or identifier     */
+	SourcePos  at;     /**< the position of the assigned value            */
+	Node       name;   /**< the variable or procedure, if any             */
+	Node       index;  /**< the index expression, if any                  */
+	Node       expr;   /**< the guard, value, size, or exit expression    */
+	Node       args;   /**< the arguments of a call, or items of a write  */
+	Node       body;   /**< the statements under a guard, or of an else   */
+	Node       alt;    /**< the next elsif or else of an if               */
+	Node       next;   /**< the next statement                            */
+} Stmt;
+
+/** a use of an identifier */
+typedef struct {
+	char      *id;     /**< the identifier                                */
+	IDprop    *prop;   /**< the properties, once the name is resolved     */
+	SourcePos  pos;    /**< the position of the identifier                */
+} Name;
+
+/** a variable definition */
+typedef struct {
+	char      *id;     /**< the identifier                                */
+	ValType    type;   /**< the declared type                             */
+	SourcePos  pos;    /**< the position of the identifier                */
+	Node       next;   /**< the next variable                             */
+} Var;
+
+/**
+ * An argument of a call, or an item of a write statement.  For an argument,
+ * the position is that of the comma or parenthesis that follows it; for an
+ * item, it is that of the "write" or "&" that precedes it.
+ */
+typedef struct {
+	Node       expr;   /**< the expression, if any                        */
+	char      *string; /**< the string of a write item, if any            */
+	SourcePos  pos;    /**< the position of the adjacent separator        */
+	Node       next;   /**< the next argument or item                     */
+} Arg;
+
+/** a subroutine body */
+typedef struct {
+	Node       vars;   /**< the variable definitions                      */
+	Node       stmts;  /**< the statements                                */
+} BodyTree;
+
+/** a growable array of the nodes of one kind */
+typedef struct {
+	void          *nodes;     /**< the array of nodes                     */
+	size_t         size;      /**< the size of one node                   */
+	unsigned int   count;     /**< the number of nodes in use, including 0 */
+	unsigned int   capacity;  /**< the number of nodes allocated          */
+} NodeArray;
+
+/** the node arrays of a tree */
+typedef struct {
+	NodeArray  exprs;  /**< the expressions                           */
+	NodeArray  stmts;  /**< the statements                            */
+	NodeArray  names;  /**< the uses of identifiers                   */
+	NodeArray  vars;   /**< the variable definitions                  */
+	NodeArray  args;   /**< the arguments and write items             */
+} Ast;
+
+/**
+ * Initialises the node arrays of a tree.
+ *
+ * @param[out]  t
+ *     the tree
+ */
+void init_ast(Ast *t);
+
+/**
+ * Creates an expression node, with all other fields cleared.
+ *
+ * @param[in,out] t
+ *     the tree
+ * @param[in]   kind
+ *     the kind of expression
+ * @param[in]   pos
+ *     the position of the operator or primary
+ * @param[in]   start
+ *     the position of the first token of the expression
+ * @return      the new node
+ */
+Node new_expr(Ast *t, ExprKind kind, SourcePos pos, SourcePos start);
+
+/**
+ * Creates a statement node, with all other fields cleared.
+ *
+ * @param[in,out] t
+ *     the tree
+ * @param[in]   kind
+ *     the kind of statement
+ * @param[in]   pos
+ *     the position of the keyword or identifier
+ * @return      the new node
+ */
+Node new_stmt(Ast *t, StmtKind kind, SourcePos pos);
+
+/**
+ * Creates a name node.  This function "steals" the <code>id</code> pointer.
+ *
+ * @param[in,out] t
+ *     the tree
+ * @param[in]   id
+ *     the identifier
+ * @param[in]   pos
+ *     the position of the identifier
+ * @return      the new node
+ */
+Node new_name(Ast *t, char *id, SourcePos pos);
+
+/**
+ * Creates a variable definition node.  This function "steals" the
+ * <code>id</code> pointer.
+ *
+ * @param[in,out] t
+ *     the tree
+ * @param[in]   id
+ *     the identifier
+ * @param[in]   type
+ *     the declared type
+ * @param[in]   pos
+ *     the position of the identifier
+ * @return      the new node
+ */
+Node new_var(Ast *t, char *id, ValType type, SourcePos pos);
+
+/**
+ * Creates an argument or write item node.  This function "steals" the
+ * <code>string</code> pointer.
+ *
+ * @param[in,out] t
+ *     the tree
+ * @param[in]   expr
+ *     the expression, or <code>NO_NODE</code>
+ * @param[in]   string
+ *     the string, or <code>NULL</code>
+ * @return      the new node
+ */
+Node new_arg(Ast *t, Node expr, char *string);
+
+/**
+ * Returns the expression at the specified node.
+ *
+ * @param[in]   t
+ *     the tree
+ * @param[in]   n
+ *     the node
+ * @return      a pointer to the expression
+ */
+Expr *ast_expr(Ast *t, Node n);
+
+/**
+ * Returns the statement at the specified node.
+ *
+ * @param[in]   t
+ *     the tree
+ * @param[in]   n
+ *     the node
+ * @return      a pointer to the statement
+ */
+Stmt *ast_stmt(Ast *t, Node n);
+
+/**
+ * Returns the name at the specified node.
+ *
+ * @param[in]   t
+ *     the tree
+ * @param[in]   n
+ *     the node
+ * @return      a pointer to the name
+ */
+Name *ast_name(Ast *t, Node n);
+
+/**
+ * Returns the variable definition at the specified node.
+ *
+ * @param[in]   t
+ *     the tree
+ * @param[in]   n
+ *     the node
+ * @return      a pointer to the variable definition
+ */
+Var *ast_var(Ast *t, Node n);
+
+/**
+ * Returns the argument or write item at the specified node.
+ *
+ * @param[in]   t
+ *     the tree
+ * @param[in]   n
+ *     the node
+ * @return      a pointer to the argument or write item
+ */
+Arg *ast_arg(Ast *t, Node n);
+
+/**
+ * Discards all nodes, keeping the arrays for the next tree.
+ *
+ * @param[in,out] t
+ *     the tree
+ */
+void reset_ast(Ast *t);
+
+/**
+ * Releases the node arrays.
+ *
+ * @param[in,out] t
+ *     the tree
+ */
+void release_ast(Ast *t);
+
+#endif /* AST_H */
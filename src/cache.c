@@ -0,0 +1,715 @@
+/**
+ * @file    cache.c
+ * @brief   An on-disk cache of the generated code of subroutines.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include "boolean.h"
+#include "cache.h"
+#include "code.h"
+#include "codegen.h"
+#include "error.h"
+#include "simplc.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME        0x100000001b3ULL
+
+/* the magic numbers that start entries, which also version their layout */
+#define CODE_MAGIC       "SIMPLC\0\1"
+#define PROG_MAGIC       "SIMPLP\0\1"
+#define MAGIC_LEN        8
+#define CODE_EXT         ".code"
+#define PROG_EXT         ".prog"
+
+/* the slash and the hexadecimal key that name an entry */
+#define KEY_NAME_LEN     17
+
+/* the file that counts the lookups of programs */
+#define STATS_NAME       "/stats"
+
+/* the bounds of an entry that is read back */
+#define MAX_CODE_SIZE    (1 << 24)
+
+typedef struct {
+	const unsigned char *p;    /**< the next byte to read                  */
+	const unsigned char *end;  /**< the end of the bytes                   */
+	Boolean              ok;   /**< whether every read so far succeeded    */
+} Reader;
+
+typedef struct {
+	char                *path; /**< the path of the entry                  */
+	off_t                size; /**< the size of the entry                  */
+	time_t               used; /**< when the entry was last used           */
+} EntryFile;
+
+/* --- function prototypes -------------------------------------------------- */
+
+static char *entry_path(const char *dir, CacheKey key, const char *ext);
+static char *open_entry(const char *path, Reader *r, const char *magic,
+		CacheKey key);
+static char *read_entry(const char *path, size_t *lenp);
+static FILE *create_entry(const char *path, char **tmp);
+static void commit_entry(FILE *file, const char *path, char *tmp);
+static unsigned long list_entries(const char *dir, EntryFile **files,
+		unsigned int *nfiles);
+static int compare_entries(const void *a, const void *b);
+static int read_int(Reader *r);
+static char *read_string(Reader *r, size_t *lenp);
+static void write_int(FILE *file, int n);
+static void write_string(FILE *file, const char *s, size_t len);
+static void free_code(struct code_s *code, int n);
+
+/* --- hashing -------------------------------------------------------------- */
+
+void init_key(CacheKey *key)
+{
+	*key = FNV_OFFSET_BASIS;
+}
+
+void hash_bytes(CacheKey *key, const void *data, size_t n)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		*key ^= p[i];
+		*key *= FNV_PRIME;
+	}
+}
+
+void hash_int(CacheKey *key, int n)
+{
+	hash_bytes(key, &n, sizeof(int));
+}
+
+void hash_string(CacheKey *key, const char *s)
+{
+	hash_bytes(key, s, strlen(s) + 1);
+}
+
+/* --- cache interface ------------------------------------------------------ */
+
+/* An entry of a subroutine is the magic number, the key, the maximum stack
+ * depth, the width of the variables, the number of labels, and the number of
+ * code entries, followed by the code entries.  Each code entry is its type,
+ * followed by its label, opcode, array type, or integer, or by the length and
+ * the bytes of its string.  Integers are written in host order, since a cache
+ * is not shared between machines.
+ */
+
+Boolean fetch_code(const char *dir, CacheKey key, struct code_s **code,
+		int *ip, int *max_stack_depth, int *variables_width,
+		unsigned int *nlabels)
+{
+	Reader r;
+	Code *c;
+	char *path, *buf;
+	int i, n;
+
+	path = entry_path(dir, key, CODE_EXT);
+	buf = open_entry(path, &r, CODE_MAGIC, key);
+	c = NULL;
+	n = 0;
+	if (r.ok) {
+		*max_stack_depth = read_int(&r);
+		*variables_width = read_int(&r);
+		*nlabels = (unsigned int) read_int(&r);
+		n = read_int(&r);
+		r.ok = r.ok && n > 0 && n <= MAX_CODE_SIZE;
+	}
+	if (r.ok) {
+		c = emalloc(n * sizeof(Code));
+		for (i = 0; i < n && r.ok; i++) {
+			c[i].type = (CodeType) (read_int(&r) & ~MASK_ALLOCATION);
+			c[i].string = NULL;
+			switch (c[i].type & MASK_TYPE) {
+				case CODE_LABEL:
+				case CODE_LABEL | CODE_OPERAND:
+					c[i].label = (Label) read_int(&r);
+					r.ok = r.ok && c[i].label < *nlabels;
+					break;
+				case CODE_INSTRUCTION:
+					c[i].code = (Bytecode) read_int(&r);
+					break;
+				case CODE_OPERAND:
+					switch (c[i].type & MASK_DATA_TYPE) {
+						case CODE_ARRAY_TYPE:
+							c[i].atype = (JVMatype) read_int(&r);
+							break;
+						case CODE_INTEGER:
+							c[i].num = read_int(&r);
+							break;
+						case CODE_REFERENCE:
+						case CODE_STRING:
+							/* the strings of a fetched body are its own */
+							c[i].type |= CODE_ALLOCATED;
+							c[i].string = read_string(&r, NULL);
+							break;
+						default:
+							r.ok = FALSE;
+							break;
+					}
+					break;
+				default:
+					r.ok = FALSE;
+					break;
+			}
+		}
+		r.ok = r.ok && r.p == r.end;
+		if (!r.ok) {
+			free_code(c, i);
+		}
+	}
+	efree(buf);
+
+	if (r.ok) {
+		/* a used entry is the last to be trimmed */
+		utime(path, NULL);
+		*code = c;
+		*ip = n;
+	}
+	efree(path);
+
+	return r.ok;
+}
+
+Boolean probe_code(const char *dir, CacheKey key)
+{
+	char *path;
+	Boolean found;
+
+	path = entry_path(dir, key, CODE_EXT);
+	found = (access(path, R_OK) == 0);
+	efree(path);
+
+	return found;
+}
+
+void store_code(const char *dir, CacheKey key, const struct code_s *code,
+		int ip, int max_stack_depth, int variables_width, Label first,
+		unsigned int nlabels)
+{
+	FILE *file;
+	char *path, *tmp;
+	int i;
+
+	path = entry_path(dir, key, CODE_EXT);
+	if ((file = create_entry(path, &tmp)) == NULL) {
+		efree(path);
+		return;
+	}
+
+	fwrite(CODE_MAGIC, 1, MAGIC_LEN, file);
+	fwrite(&key, sizeof(CacheKey), 1, file);
+	write_int(file, max_stack_depth);
+	write_int(file, variables_width);
+	write_int(file, (int) nlabels);
+	write_int(file, ip);
+	for (i = 0; i < ip; i++) {
+		write_int(file, (int) (code[i].type & ~MASK_ALLOCATION));
+		switch (code[i].type & MASK_TYPE) {
+			case CODE_LABEL:
+			case CODE_LABEL | CODE_OPERAND:
+				write_int(file, (int) (code[i].label - first));
+				break;
+			case CODE_INSTRUCTION:
+				write_int(file, (int) code[i].code);
+				break;
+			default:
+				switch (code[i].type & MASK_DATA_TYPE) {
+					case CODE_ARRAY_TYPE:
+						write_int(file, (int) code[i].atype);
+						break;
+					case CODE_INTEGER:
+						write_int(file, code[i].num);
+						break;
+					default:
+						write_string(file, code[i].string,
+								strlen(code[i].string));
+						break;
+				}
+				break;
+		}
+	}
+
+	commit_entry(file, path, tmp);
+	efree(path);
+}
+
+/* An entry of a program is the magic number and the key, followed by the name
+ * of the class, the class file, the interface, and the Jasmin code, and by the
+ * number of diagnostics and the severity, position, and message of each.
+ */
+
+Boolean fetch_program(const char *dir, CacheKey key, CachedProgram *prog)
+{
+	Reader r;
+	SimplDiagnostic *d;
+	char *path, *buf;
+	unsigned int i;
+	int n;
+
+	memset(prog, 0, sizeof(CachedProgram));
+	path = entry_path(dir, key, PROG_EXT);
+	buf = open_entry(path, &r, PROG_MAGIC, key);
+	prog->class_name = read_string(&r, NULL);
+	prog->class_file = read_string(&r, &prog->class_len);
+	prog->interface = read_string(&r, &prog->interface_len);
+	prog->code = read_string(&r, &prog->code_len);
+	n = read_int(&r);
+	if (r.ok && n > 0 && n <= r.end - r.p) {
+		prog->diagnostics = emalloc(n * sizeof(SimplDiagnostic));
+		for (i = 0; i < (unsigned int) n && r.ok; i++) {
+			d = &prog->diagnostics[i];
+			d->severity = (SimplSeverity) read_int(&r);
+			d->line = read_int(&r);
+			d->col = read_int(&r);
+			if ((d->message = read_string(&r, NULL)) != NULL) {
+				prog->ndiagnostics++;
+			}
+		}
+	}
+	r.ok = r.ok && n >= 0 && r.p == r.end;
+	efree(buf);
+
+	if (r.ok) {
+		utime(path, NULL);
+	} else {
+		release_program(prog);
+	}
+	efree(path);
+
+	return r.ok;
+}
+
+void store_program(const char *dir, CacheKey key, const CachedProgram *prog)
+{
+	FILE *file;
+	char *path, *tmp;
+	const SimplDiagnostic *d;
+	unsigned int i;
+
+	path = entry_path(dir, key, PROG_EXT);
+	if ((file = create_entry(path, &tmp)) == NULL) {
+		efree(path);
+		return;
+	}
+
+	fwrite(PROG_MAGIC, 1, MAGIC_LEN, file);
+	fwrite(&key, sizeof(CacheKey), 1, file);
+	write_string(file, prog->class_name, strlen(prog->class_name));
+	write_string(file, prog->class_file, prog->class_len);
+	write_string(file, prog->interface, prog->interface_len);
+	write_string(file, prog->code, prog->code_len);
+	write_int(file, (int) prog->ndiagnostics);
+	for (i = 0; i < prog->ndiagnostics; i++) {
+		d = &prog->diagnostics[i];
+		write_int(file, (int) d->severity);
+		write_int(file, d->line);
+		write_int(file, d->col);
+		write_string(file, d->message, strlen(d->message));
+	}
+
+	commit_entry(file, path, tmp);
+	efree(path);
+}
+
+void release_program(CachedProgram *prog)
+{
+	unsigned int i;
+
+	for (i = 0; i < prog->ndiagnostics; i++) {
+		efree(prog->diagnostics[i].message);
+	}
+	efree(prog->diagnostics);
+	efree(prog->class_name);
+	efree(prog->class_file);
+	efree(prog->interface);
+	efree(prog->code);
+	memset(prog, 0, sizeof(CachedProgram));
+}
+
+/* The lookups are counted in a small text file, which is locked while it is
+ * updated, since compilations that share the directory update it at once.
+ * The counts only grow, so that the file need never be truncated.
+ */
+
+void count_lookup(const char *dir, Boolean hit)
+{
+	FILE *file;
+	char *path;
+	unsigned long hits, misses;
+	int fd;
+
+	path = emalloc(strlen(dir) + sizeof(STATS_NAME));
+	strcpy(path, dir);
+	strcat(path, STATS_NAME);
+	fd = open(path, O_RDWR | O_CREAT, 0666);
+	efree(path);
+	if (fd < 0) {
+		return;
+	}
+	if (flock(fd, LOCK_EX) != 0 || (file = fdopen(fd, "r+")) == NULL) {
+		close(fd);
+		return;
+	}
+	if (fscanf(file, "%lu %lu", &hits, &misses) != 2) {
+		hits = misses = 0;
+	}
+	if (hit) {
+		hits++;
+	} else {
+		misses++;
+	}
+	rewind(file);
+	fprintf(file, "%lu %lu\n", hits, misses);
+	fclose(file);
+}
+
+void get_cache_stats(const char *dir, CacheStats *stats)
+{
+	FILE *file;
+	EntryFile *files;
+	char *path;
+	unsigned int i, n;
+
+	memset(stats, 0, sizeof(CacheStats));
+	path = emalloc(strlen(dir) + sizeof(STATS_NAME));
+	strcpy(path, dir);
+	strcat(path, STATS_NAME);
+	if ((file = fopen(path, "r")) != NULL) {
+		flock(fileno(file), LOCK_SH);
+		if (fscanf(file, "%lu %lu", &stats->hits, &stats->misses) != 2) {
+			stats->hits = stats->misses = 0;
+		}
+		fclose(file);
+	}
+	efree(path);
+
+	stats->bytes = list_entries(dir, &files, &n);
+	stats->entries = n;
+	for (i = 0; i < n; i++) {
+		efree(files[i].path);
+	}
+	efree(files);
+}
+
+void trim_cache(const char *dir, unsigned long limit)
+{
+	EntryFile *files;
+	unsigned long total;
+	unsigned int i, n;
+
+	total = list_entries(dir, &files, &n);
+	if (total > limit) {
+		qsort(files, n, sizeof(EntryFile), compare_entries);
+		for (i = 0; i < n && total > limit; i++) {
+			if (unlink(files[i].path) == 0) {
+				total -= files[i].size;
+			}
+		}
+	}
+	for (i = 0; i < n; i++) {
+		efree(files[i].path);
+	}
+	efree(files);
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * Returns the path of the file of an entry.
+ *
+ * @param[in] dir the cache directory.
+ * @param[in] key the key of the entry.
+ * @param[in] ext the extension of the file.
+ * @return the path, allocated with emalloc.
+ */
+static char *entry_path(const char *dir, CacheKey key, const char *ext)
+{
+	char *path;
+
+	path = emalloc(strlen(dir) + KEY_NAME_LEN + strlen(ext) + 1);
+	sprintf(path, "%s/%016llx%s", dir, (unsigned long long) key, ext);
+
+	return path;
+}
+
+/**
+ * Reads the file of an entry, and checks its magic number and its key.
+ *
+ * @param[in]  path  the path of the file.
+ * @param[out] r     the reader of the rest of the entry, which is not ok if
+ *     the entry could not be read or is not the one asked for.
+ * @param[in]  magic the magic number of the entry.
+ * @param[in]  key   the key of the entry.
+ * @return the bytes of the file, which the caller must free.
+ */
+static char *open_entry(const char *path, Reader *r, const char *magic,
+		CacheKey key)
+{
+	char *buf;
+	size_t len;
+	CacheKey found;
+
+	r->p = r->end = NULL;
+	r->ok = FALSE;
+	if ((buf = read_entry(path, &len)) == NULL) {
+		return NULL;
+	}
+	r->p = (const unsigned char *) buf;
+	r->end = r->p + len;
+	if (len >= MAGIC_LEN + sizeof(CacheKey)
+			&& memcmp(buf, magic, MAGIC_LEN) == 0) {
+		memcpy(&found, buf + MAGIC_LEN, sizeof(CacheKey));
+		r->p += MAGIC_LEN + sizeof(CacheKey);
+		r->ok = (found == key);
+	}
+
+	return buf;
+}
+
+/**
+ * Reads the file of an entry into memory.
+ *
+ * @param[in]  path the path of the file.
+ * @param[out] lenp the length of the file.
+ * @return the bytes of the file, allocated with emalloc, or NULL if the file
+ *     could not be read.
+ */
+static char *read_entry(const char *path, size_t *lenp)
+{
+	FILE *file;
+	char *buf;
+	size_t len, cap, n;
+
+	if ((file = fopen(path, "rb")) == NULL) {
+		return NULL;
+	}
+	len = 0;
+	cap = BUFSIZ;
+	buf = emalloc(cap);
+	while ((n = fread(buf + len, 1, cap - len, file)) > 0) {
+		len += n;
+		if (len == cap) {
+			cap *= 2;
+			buf = erealloc(buf, cap);
+		}
+	}
+	if (ferror(file)) {
+		efree(buf);
+		buf = NULL;
+	}
+	fclose(file);
+
+	*lenp = len;
+	return buf;
+}
+
+/**
+ * Creates the temporary file to which an entry is written.
+ *
+ * @param[in]  path the path of the entry.
+ * @param[out] tmp  the path of the temporary file, allocated with emalloc.
+ * @return the temporary file, or NULL if it could not be created.
+ */
+static FILE *create_entry(const char *path, char **tmp)
+{
+	FILE *file;
+	int fd;
+
+	*tmp = emalloc(strlen(path) + sizeof(".XXXXXX"));
+	strcpy(*tmp, path);
+	strcat(*tmp, ".XXXXXX");
+	if ((fd = mkstemp(*tmp)) < 0) {
+		efree(*tmp);
+		return NULL;
+	}
+	if ((file = fdopen(fd, "wb")) == NULL) {
+		close(fd);
+		unlink(*tmp);
+		efree(*tmp);
+		return NULL;
+	}
+
+	return file;
+}
+
+/**
+ * Closes the temporary file of an entry, and puts it in place of the entry,
+ * but only if it was written completely.
+ *
+ * @param[in] file the temporary file.
+ * @param[in] path the path of the entry.
+ * @param[in] tmp  the path of the temporary file, which is freed.
+ */
+static void commit_entry(FILE *file, const char *path, char *tmp)
+{
+	Boolean ok;
+
+	ok = !ferror(file);
+	if (fclose(file) != 0) {
+		ok = FALSE;
+	}
+	if (!ok || rename(tmp, path) != 0) {
+		unlink(tmp);
+	}
+	efree(tmp);
+}
+
+/**
+ * Lists the entries in a cache directory.
+ *
+ * @param[in]  dir    the cache directory.
+ * @param[out] files  the entries, allocated with emalloc.
+ * @param[out] nfiles the number of entries.
+ * @return the total size of the entries.
+ */
+static unsigned long list_entries(const char *dir, EntryFile **files,
+		unsigned int *nfiles)
+{
+	DIR *d;
+	struct dirent *e;
+	struct stat st;
+	EntryFile *f;
+	unsigned long total;
+	unsigned int n, cap;
+	size_t len;
+	char *path;
+
+	*files = NULL;
+	*nfiles = n = cap = 0;
+	total = 0;
+	if ((d = opendir(dir)) == NULL) {
+		return 0;
+	}
+	while ((e = readdir(d)) != NULL) {
+		/* temporary files and anything else in the directory are left alone */
+		len = strlen(e->d_name);
+		if (len != KEY_NAME_LEN - 1 + strlen(CODE_EXT)
+				|| (strcmp(e->d_name + KEY_NAME_LEN - 1, CODE_EXT) != 0
+					&& strcmp(e->d_name + KEY_NAME_LEN - 1, PROG_EXT) != 0)) {
+			continue;
+		}
+		path = emalloc(strlen(dir) + len + 2);
+		sprintf(path, "%s/%s", dir, e->d_name);
+		if (stat(path, &st) != 0) {
+			efree(path);
+			continue;
+		}
+		if (n == cap) {
+			cap = (cap ? 2 * cap : 64);
+			*files = erealloc(*files, cap * sizeof(EntryFile));
+		}
+		f = &(*files)[n++];
+		f->path = path;
+		f->size = st.st_size;
+		f->used = st.st_mtime;
+		total += st.st_size;
+	}
+	closedir(d);
+
+	*nfiles = n;
+	return total;
+}
+
+/**
+ * Orders entries from the least to the most recently used.
+ *
+ * @param[in] a the first entry.
+ * @param[in] b the second entry.
+ * @return the order of the entries.
+ */
+static int compare_entries(const void *a, const void *b)
+{
+	const EntryFile *e = (const EntryFile *) a;
+	const EntryFile *f = (const EntryFile *) b;
+
+	if (e->used != f->used) {
+		return (e->used < f->used ? -1 : 1);
+	}
+	return strcmp(e->path, f->path);
+}
+
+static int read_int(Reader *r)
+{
+	int n;
+
+	if (!r->ok || (size_t) (r->end - r->p) < sizeof(int)) {
+		r->ok = FALSE;
+		return 0;
+	}
+	memcpy(&n, r->p, sizeof(int));
+	r->p += sizeof(int);
+
+	return n;
+}
+
+/**
+ * Reads a string, or any bytes, which are terminated all the same.
+ *
+ * @param[in,out] r    the reader.
+ * @param[out]    lenp the length of the string, if not NULL.
+ * @return the string, allocated with emalloc, or NULL if it could not be read.
+ */
+static char *read_string(Reader *r, size_t *lenp)
+{
+	char *s;
+	int len;
+
+	len = read_int(r);
+	if (!r->ok || len < 0 || r->end - r->p < len) {
+		r->ok = FALSE;
+		return NULL;
+	}
+	s = emalloc(len + 1);
+	memcpy(s, r->p, len);
+	s[len] = '\0';
+	r->p += len;
+	if (lenp != NULL) {
+		*lenp = len;
+	}
+
+	return s;
+}
+
+static void write_int(FILE *file, int n)
+{
+	fwrite(&n, sizeof(int), 1, file);
+}
+
+static void write_string(FILE *file, const char *s, size_t len)
+{
+	write_int(file, (int) len);
+	fwrite(s, 1, len, file);
+}
+
+/**
+ * Frees a code array that was partly read, with its strings.
+ *
+ * @param[in] code the code array.
+ * @param[in] n    the number of entries that were read.
+ */
+static void free_code(struct code_s *code, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (code[i].type & CODE_ALLOCATED) {
+			efree(code[i].string);
+		}
+	}
+	efree(code);
+}
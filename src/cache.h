@@ -0,0 +1,231 @@
+/**
+ * @file    cache.h
+ * @brief   An on-disk cache of the generated code of subroutines.
+ *
+ * Each entry of the cache holds the finished code of one subroutine, that is,
+ * its code array, the maximum depth of its operand stack, and the width of
+ * its local variables, under a key that hashes everything that the code was
+ * generated from.  The key is built up by the compiler, which hashes the
+ * tokens of the subroutine and the signatures of the routines that it calls;
+ * the cache neither knows nor cares what went into it.
+ *
+ * The cache also holds whole programs, for the driver: the class file, the
+ * interface, the Jasmin code, and the diagnostics of a successful compilation,
+ * under a key that hashes the source, the version of the compiler, and the
+ * options that the output depends on.  A program that is in the cache need
+ * not be compiled or assembled at all.  The lookups of programs are counted in
+ * the cache directory, for all the compilations that share it.
+ *
+ * An entry lives in a file of its own in the cache directory, named after its
+ * key, and is written to a temporary file first and then renamed, so that
+ * compilations that share a directory never see half an entry.  An entry is
+ * touched when it is used, and the cache is trimmed to a size by removing the
+ * entries that were used least recently.  The cache is only an accelerator: an
+ * entry that cannot be read is a miss, and one that cannot be written is
+ * dropped, without failing the compilation.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "boolean.h"
+#include "codegen.h"
+#include "simplc.h"
+
+/** the key of a cache entry, a 64-bit FNV-1a hash */
+typedef uint64_t CacheKey;
+
+/** a compiled program, as kept in the cache */
+typedef struct {
+	char            *class_name;    /**< the name of the class             */
+	char            *class_file;    /**< the bytes of the class file       */
+	size_t           class_len;     /**< the length of the class file      */
+	char            *interface;     /**< the binary interface              */
+	size_t           interface_len; /**< the length of the interface       */
+	char            *code;          /**< the Jasmin code                   */
+	size_t           code_len;      /**< the length of the code            */
+	SimplDiagnostic *diagnostics;   /**< the diagnostics, in order         */
+	unsigned int     ndiagnostics;  /**< the number of diagnostics         */
+} CachedProgram;
+
+/** the statistics of a cache directory */
+typedef struct {
+	unsigned long    hits;          /**< the programs found in the cache   */
+	unsigned long    misses;        /**< the programs not found            */
+	unsigned long    entries;       /**< the entries in the cache          */
+	unsigned long    bytes;         /**< the total size of the entries     */
+} CacheStats;
+
+/**
+ * Initialises a key, before anything has been hashed into it.
+ *
+ * @param[out]  key
+ *     the key
+ */
+void init_key(CacheKey *key);
+
+/**
+ * Hashes bytes into a key.
+ *
+ * @param[in,out] key
+ *     the key
+ * @param[in]   data
+ *     the bytes
+ * @param[in]   n
+ *     the number of bytes
+ */
+void hash_bytes(CacheKey *key, const void *data, size_t n);
+
+/**
+ * Hashes an integer into a key.
+ *
+ * @param[in,out] key
+ *     the key
+ * @param[in]   n
+ *     the integer
+ */
+void hash_int(CacheKey *key, int n);
+
+/**
+ * Hashes a string into a key, including its terminator, so that consecutive
+ * strings cannot run into each other.
+ *
+ * @param[in,out] key
+ *     the key
+ * @param[in]   s
+ *     the string
+ */
+void hash_string(CacheKey *key, const char *s);
+
+/**
+ * Fetches the code of a subroutine from the cache.
+ *
+ * @param[in]   dir
+ *     the cache directory
+ * @param[in]   key
+ *     the key of the entry
+ * @param[out]  code
+ *     the code array, allocated with <code>emalloc</code>, of which every
+ *     string is allocated too
+ * @param[out]  ip
+ *     the number of code entries
+ * @param[out]  max_stack_depth
+ *     the maximum depth of the operand stack
+ * @param[out]  variables_width
+ *     the width of the local variables
+ * @param[out]  nlabels
+ *     the number of labels of the code, which are numbered from zero
+ * @return      whether the entry was found, in which case the outputs are set
+ */
+Boolean fetch_code(const char *dir, CacheKey key, struct code_s **code,
+		int *ip, int *max_stack_depth, int *variables_width,
+		unsigned int *nlabels);
+
+/**
+ * Returns whether the cache holds an entry, without reading it.
+ *
+ * @param[in]   dir
+ *     the cache directory
+ * @param[in]   key
+ *     the key of the entry
+ * @return      whether the entry is there
+ */
+Boolean probe_code(const char *dir, CacheKey key);
+
+/**
+ * Stores the code of a subroutine in the cache, replacing any entry under the
+ * same key.
+ *
+ * @param[in]   dir
+ *     the cache directory, which must exist
+ * @param[in]   key
+ *     the key of the entry
+ * @param[in]   code
+ *     the code array
+ * @param[in]   ip
+ *     the number of code entries
+ * @param[in]   max_stack_depth
+ *     the maximum depth of the operand stack
+ * @param[in]   variables_width
+ *     the width of the local variables
+ * @param[in]   first
+ *     the first label of the code, which is stored as label zero
+ * @param[in]   nlabels
+ *     the number of labels of the code
+ */
+void store_code(const char *dir, CacheKey key, const struct code_s *code,
+		int ip, int max_stack_depth, int variables_width, Label first,
+		unsigned int nlabels);
+
+/**
+ * Fetches a program from the cache.
+ *
+ * @param[in]   dir
+ *     the cache directory
+ * @param[in]   key
+ *     the key of the entry
+ * @param[out]  prog
+ *     the program, of which the contents are allocated with
+ *     <code>emalloc</code>, and must be released with
+ *     <code>release_program</code>
+ * @return      whether the entry was found, in which case the program is set
+ */
+Boolean fetch_program(const char *dir, CacheKey key, CachedProgram *prog);
+
+/**
+ * Stores a program in the cache, replacing any entry under the same key.
+ *
+ * @param[in]   dir
+ *     the cache directory, which must exist
+ * @param[in]   key
+ *     the key of the entry
+ * @param[in]   prog
+ *     the program
+ */
+void store_program(const char *dir, CacheKey key, const CachedProgram *prog);
+
+/**
+ * Releases the contents of a program that was fetched from the cache.
+ *
+ * @param[in,out] prog
+ *     the program
+ */
+void release_program(CachedProgram *prog);
+
+/**
+ * Counts a lookup of a program in the statistics of a cache directory.
+ *
+ * @param[in]   dir
+ *     the cache directory
+ * @param[in]   hit
+ *     whether the program was found
+ */
+void count_lookup(const char *dir, Boolean hit);
+
+/**
+ * Retrieves the statistics of a cache directory.
+ *
+ * @param[in]   dir
+ *     the cache directory
+ * @param[out]  stats
+ *     the statistics
+ */
+void get_cache_stats(const char *dir, CacheStats *stats);
+
+/**
+ * Trims a cache directory to a size, by removing the entries that were used
+ * least recently.
+ *
+ * @param[in]   dir
+ *     the cache directory
+ * @param[in]   limit
+ *     the size, in bytes, that the entries may take up together
+ */
+void trim_cache(const char *dir, unsigned long limit);
+
+#endif /* CACHE_H */
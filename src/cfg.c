@@ -0,0 +1,1199 @@
+/**
+ * @file    cfg.c
+ * @brief   The control-flow graph of the generated code of a subroutine.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boolean.h"
+#include "cfg.h"
+#include "code.h"
+#include "codegen.h"
+#include "error.h"
+#include "jvm.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+#define INITIAL_BLOCKS 64
+
+#define IS_LABEL(c)    (((c).type & MASK_TYPE) == CODE_LABEL)
+#define IS_OPERAND(c)  ((c).type & CODE_OPERAND)
+#define IS_JUMP(op)    ((op) == JVM_GOTO || (op) == JVM_IFEQ \
+		|| (op) == JVM_IFNE || ((op) >= JVM_IF_ICMPEQ && (op) <= JVM_IF_ICMPNE))
+#define IS_INSTRUCTION(c, op) \
+		(((c).type & MASK_TYPE) == CODE_INSTRUCTION && (c).code == (op))
+#define IS_LOCAL(op)   ((op) == JVM_ILOAD || (op) == JVM_ISTORE \
+		|| (op) == JVM_ALOAD || (op) == JVM_ASTORE || (op) == JVM_IINC)
+#define IS_STORE(op)   ((op) == JVM_ISTORE || (op) == JVM_ASTORE)
+
+/* the bits of a word of a set of slots */
+#define WORD_BITS      (CHAR_BIT * sizeof(unsigned int))
+#define HAS_SLOT(w, s) ((w)[(s) / WORD_BITS] & (1u << ((s) % WORD_BITS)))
+#define ADD_SLOT(w, s) ((w)[(s) / WORD_BITS] |= 1u << ((s) % WORD_BITS))
+#define DEL_SLOT(w, s) ((w)[(s) / WORD_BITS] &= ~(1u << ((s) % WORD_BITS)))
+
+/* how the jump at the end of a block is rewritten by dead-code removal */
+#define KEEP_JUMP   0
+#define DROP_JUMP   1
+#define INVERT_JUMP 2
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void reserve(Cfg *g, unsigned int nblocks);
+static void map_labels(Cfg *g);
+static void split_blocks(Cfg *g);
+static void link_blocks(Cfg *g);
+static unsigned int successors(const Cfg *g, unsigned int b,
+		unsigned int s[2]);
+static void find_order(Cfg *g);
+static void find_dominators(Cfg *g);
+static unsigned int intersect(Cfg *g, unsigned int b1, unsigned int b2);
+static void find_loops(Cfg *g);
+static Boolean falls_to(const Cfg *g, unsigned int b, unsigned int next);
+static Boolean jumps_to_next(const Cfg *g, unsigned int b);
+static Boolean jumps_over_goto(const Cfg *g, unsigned int b);
+static Bytecode invert_jump(Bytecode op);
+static Boolean drop_entry(Code *c);
+static unsigned int remove_dead_code(Cfg *g, CodeGen *cg);
+static void enter_block(Cfg *g, unsigned int b, int height, const char *name);
+static void find_live_slots(Cfg *g, size_t nwords);
+static void live_out(Cfg *g, unsigned int b, size_t nwords, unsigned int *out);
+static void find_ranges(Cfg *g, int width, size_t nwords);
+static void extend_range(Cfg *g, unsigned int s, int i);
+static unsigned int pack_ranges(Cfg *g, unsigned int nfixed,
+		unsigned int width);
+static int by_start(const void *a, const void *b);
+static int by_end(const void *a, const void *b);
+static void dump_block(const Cfg *g, const char *name, unsigned int b,
+		FILE *file);
+static void dump_escaped(const char *s, FILE *file);
+
+/* --- control-flow graph interface ----------------------------------------- */
+
+void init_cfg(Cfg *g)
+{
+	g->code = NULL;
+	g->ncode = 0;
+	g->blocks = NULL;
+	g->nblocks = 0;
+	g->preds = g->order = g->scratch = NULL;
+	g->nreachable = 0;
+	g->capacity = 0;
+	g->labels = NULL;
+	g->base = 0;
+	g->nlabels = 0;
+	g->live = NULL;
+	g->nlive = 0;
+	g->ranges = NULL;
+	g->sorted = NULL;
+	g->free = NULL;
+	g->nranges = 0;
+}
+
+void build_cfg(Cfg *g, const struct code_s *code, int ncode)
+{
+	g->code = code;
+	g->ncode = ncode;
+	g->nblocks = g->nreachable = 0;
+
+	map_labels(g);
+	split_blocks(g);
+	link_blocks(g);
+	find_order(g);
+	find_dominators(g);
+	find_loops(g);
+}
+
+unsigned int get_label_block(const Cfg *g, Label label)
+{
+	return g->labels[label - g->base];
+}
+
+Boolean dominates(const Cfg *g, unsigned int b1, unsigned int b2)
+{
+	/* an immediate dominator comes before the block in reverse postorder */
+	while (g->blocks[b2].rpo > g->blocks[b1].rpo) {
+		b2 = g->blocks[b2].idom;
+	}
+
+	return (b1 == b2);
+}
+
+void dump_cfg(const Cfg *g, const char *name, FILE *file)
+{
+	const CfgBlock *block;
+	unsigned int b;
+
+	fprintf(file, "\tsubgraph \"cluster_%s\" {\n", name);
+	fprintf(file, "\t\tlabel=\"%s\";\n", name);
+	for (b = 0; b < g->nblocks; b++) {
+		dump_block(g, name, b, file);
+	}
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		if (block->jump != NO_BLOCK) {
+			fprintf(file, "\t\t\"%s.B%u\" -> \"%s.B%u\"", name, b, name,
+					block->jump);
+			if (block->reachable && dominates(g, block->jump, b)) {
+				fprintf(file, " [style=bold%s]",
+						(block->fall != NO_BLOCK ? ", label=\"T\"" : ""));
+			} else if (block->fall != NO_BLOCK) {
+				fprintf(file, " [label=\"T\"]");
+			}
+			fprintf(file, ";\n");
+		}
+		if (block->fall != NO_BLOCK) {
+			fprintf(file, "\t\t\"%s.B%u\" -> \"%s.B%u\"%s;\n", name, b, name,
+					block->fall,
+					(block->jump != NO_BLOCK ? " [label=\"F\"]" : ""));
+		}
+	}
+	fprintf(file, "\t}\n");
+}
+
+unsigned int eliminate_dead_code(Cfg *g, CodeGen *cg)
+{
+	unsigned int removed;
+	int ip;
+
+	removed = 0;
+	do {
+		ip = cg->ip;
+		build_cfg(g, cg->code, cg->ip);
+		removed += remove_dead_code(g, cg);
+	} while (cg->ip < ip);
+
+	return removed;
+}
+
+int find_max_stack(Cfg *g, const char *name)
+{
+	CfgBlock *block;
+	unsigned int k, b;
+	int i, height, max, pop, push;
+
+	if (g->nreachable == 0) {
+		return 0;
+	}
+
+	/* in reverse postorder, every block but the entry comes after one of its
+	 * predecessors, so that its height is known by the time that it is
+	 * visited */
+	max = 0;
+	g->blocks[0].height = 0;
+	for (k = 0; k < g->nreachable; k++) {
+		b = g->order[k];
+		block = &g->blocks[b];
+		height = block->height;
+		for (i = block->start; i <= block->last; i++) {
+			if ((g->code[i].type & MASK_TYPE) != CODE_INSTRUCTION) {
+				continue;
+			}
+			get_stack_effect(&g->code[i], &pop, &push);
+			if (height < pop) {
+				eprintf("operand stack underflow in '%s'", name);
+			}
+			height += push - pop;
+			if (height > max) {
+				max = height;
+			}
+		}
+		if (block->fall != NO_BLOCK) {
+			enter_block(g, block->fall, height, name);
+		}
+		if (block->jump != NO_BLOCK) {
+			enter_block(g, block->jump, height, name);
+		}
+	}
+
+	return max;
+}
+
+int share_slots(Cfg *g, CodeGen *cg, int nfixed, int width)
+{
+	Code *code;
+	unsigned int s, shared;
+	size_t nwords;
+	int i;
+
+	if (width <= nfixed || g->nreachable == 0) {
+		return width;
+	}
+
+	/* one set for each block, and one more to work in */
+	nwords = (width + WORD_BITS - 1) / WORD_BITS;
+	if ((g->nblocks + 1) * nwords > g->nlive) {
+		g->nlive = (g->nblocks + 1) * nwords;
+		g->live = erealloc(g->live, g->nlive * sizeof(unsigned int));
+	}
+	if ((unsigned int) width > g->nranges) {
+		g->nranges = width;
+		g->ranges = erealloc(g->ranges, g->nranges * sizeof(CfgRange));
+		g->sorted = erealloc(g->sorted, 2 * g->nranges * sizeof(CfgRange *));
+		g->free = erealloc(g->free, 2 * g->nranges * sizeof(unsigned int));
+	}
+
+	find_live_slots(g, nwords);
+	find_ranges(g, width, nwords);
+	shared = pack_ranges(g, nfixed, width);
+
+	code = cg->code;
+	for (i = 0; i < cg->ip; i++) {
+		if ((code[i].type & MASK_TYPE) == CODE_INSTRUCTION
+				&& IS_LOCAL(code[i].code)
+				&& (s = code[i + 1].num) >= (unsigned int) nfixed) {
+			code[i + 1].num = g->ranges[s].slot;
+		}
+	}
+
+	return shared;
+}
+
+void release_cfg(Cfg *g)
+{
+	efree(g->blocks);
+	efree(g->preds);
+	efree(g->order);
+	efree(g->scratch);
+	efree(g->labels);
+	efree(g->live);
+	efree(g->ranges);
+	efree(g->sorted);
+	efree(g->free);
+	init_cfg(g);
+}
+
+/* --- building ------------------------------------------------------------- */
+
+/**
+ * Maps every label of the code to the block that it starts, which is filled in
+ * as the blocks are split.  The labels of a subroutine are handed out in a run,
+ * so that the map is indexed from the first label of the code.
+ *
+ * @param[in,out] g the graph.
+ */
+static void map_labels(Cfg *g)
+{
+	Label first, last;
+	unsigned int n;
+	int i;
+
+	first = last = 0;
+	for (i = 0, n = 0; i < g->ncode; i++) {
+		if (!(g->code[i].type & CODE_LABEL)) {
+			continue;
+		}
+		if (n++ == 0) {
+			first = last = g->code[i].label;
+		} else if (g->code[i].label < first) {
+			first = g->code[i].label;
+		} else if (g->code[i].label > last) {
+			last = g->code[i].label;
+		}
+	}
+	n = (n > 0 ? last - first + 1 : 0);
+	if (n > g->nlabels) {
+		g->labels = erealloc(g->labels, n * sizeof(unsigned int));
+		g->nlabels = n;
+	}
+	g->base = first;
+}
+
+/**
+ * Splits the code into blocks.  A block starts at the start of the code, at a
+ * label that does not directly follow another, and after every jump and
+ * return.
+ *
+ * @param[in,out] g the graph.
+ */
+static void split_blocks(Cfg *g)
+{
+	CfgBlock *block;
+	Boolean open;
+	int i, j;
+
+	block = NULL;
+	open = FALSE;
+	for (i = 0; i < g->ncode; i = j) {
+		j = i + 1;
+		if (!open || (IS_LABEL(g->code[i]) && block->last >= 0)) {
+			if (block != NULL) {
+				block->end = i;
+			}
+			reserve(g, g->nblocks + 1);
+			block = &g->blocks[g->nblocks++];
+			memset(block, 0, sizeof(CfgBlock));
+			block->start = i;
+			block->last = -1;
+			open = TRUE;
+		}
+		if (IS_LABEL(g->code[i])) {
+			g->labels[g->code[i].label - g->base] = g->nblocks - 1;
+			continue;
+		}
+		while (j < g->ncode && IS_OPERAND(g->code[j])) {
+			j++;
+		}
+		block->last = i;
+		switch (g->code[i].code) {
+			case JVM_GOTO:
+			case JVM_IFEQ:
+			case JVM_IFNE:
+			case JVM_IF_ICMPEQ:
+			case JVM_IF_ICMPGE:
+			case JVM_IF_ICMPGT:
+			case JVM_IF_ICMPLE:
+			case JVM_IF_ICMPLT:
+			case JVM_IF_ICMPNE:
+			case JVM_ARETURN:
+			case JVM_IRETURN:
+			case JVM_RETURN:
+				open = FALSE;
+				break;
+			default:
+				break;
+		}
+	}
+	if (block != NULL) {
+		block->end = g->ncode;
+	}
+}
+
+/**
+ * Finds the successors of every block, from its last instruction.
+ *
+ * @param[in,out] g the graph.
+ */
+static void link_blocks(Cfg *g)
+{
+	CfgBlock *block;
+	unsigned int b, next;
+	Bytecode op;
+
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		next = (b + 1 < g->nblocks ? b + 1 : NO_BLOCK);
+		block->fall = next;
+		block->jump = NO_BLOCK;
+		if (block->last < 0) {
+			continue;
+		}
+		op = g->code[block->last].code;
+		if (op == JVM_ARETURN || op == JVM_IRETURN || op == JVM_RETURN) {
+			block->fall = NO_BLOCK;
+		} else if (IS_JUMP(op)) {
+			block->jump = get_label_block(g, g->code[block->last + 1].label);
+			if (op == JVM_GOTO) {
+				block->fall = NO_BLOCK;
+			}
+		}
+	}
+}
+
+static unsigned int successors(const Cfg *g, unsigned int b,
+		unsigned int s[2])
+{
+	unsigned int n;
+
+	n = 0;
+	if (g->blocks[b].jump != NO_BLOCK) {
+		s[n++] = g->blocks[b].jump;
+	}
+	if (g->blocks[b].fall != NO_BLOCK) {
+		s[n++] = g->blocks[b].fall;
+	}
+
+	return n;
+}
+
+/**
+ * Finds the reachable blocks by a depth-first walk from the entry, numbers
+ * them in reverse postorder, and collects the reachable predecessors of every
+ * block, in block order.  The stack of the walk holds pairs of a block and the
+ * number of its successors visited so far.
+ *
+ * @param[in,out] g the graph.
+ */
+static void find_order(Cfg *g)
+{
+	CfgBlock *block;
+	unsigned int top, b, s, k, n, succ[2], *stack;
+
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		block->reachable = block->header = FALSE;
+		block->npreds = block->depth = 0;
+		block->height = -1;
+		block->idom = block->loop = block->rpo = NO_BLOCK;
+	}
+	if (g->nblocks == 0) {
+		return;
+	}
+
+	stack = g->scratch;
+	k = g->nblocks;
+	g->blocks[0].reachable = TRUE;
+	stack[0] = 0;
+	stack[1] = 0;
+	top = 1;
+	while (top > 0) {
+		b = stack[2 * (top - 1)];
+		n = successors(g, b, succ);
+		if (stack[2 * (top - 1) + 1] < n) {
+			s = succ[stack[2 * (top - 1) + 1]++];
+			if (!g->blocks[s].reachable) {
+				g->blocks[s].reachable = TRUE;
+				stack[2 * top] = s;
+				stack[2 * top + 1] = 0;
+				top++;
+			}
+		} else {
+			g->order[--k] = b;
+			top--;
+		}
+	}
+
+	/* move the reverse postorder to the front */
+	g->nreachable = g->nblocks - k;
+	memmove(g->order, g->order + k, g->nreachable * sizeof(unsigned int));
+	for (k = 0; k < g->nreachable; k++) {
+		g->blocks[g->order[k]].rpo = k;
+	}
+
+	/* count the predecessors, and then fill them in */
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		if (block->reachable) {
+			if (block->fall != NO_BLOCK) {
+				g->blocks[block->fall].npreds++;
+			}
+			if (block->jump != NO_BLOCK) {
+				g->blocks[block->jump].npreds++;
+			}
+		}
+	}
+	for (n = 0, b = 0; b < g->nblocks; b++) {
+		g->blocks[b].preds = n;
+		n += g->blocks[b].npreds;
+		g->blocks[b].npreds = 0;
+	}
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		if (block->reachable) {
+			if (block->fall != NO_BLOCK) {
+				s = block->fall;
+				g->preds[g->blocks[s].preds + g->blocks[s].npreds++] = b;
+			}
+			if (block->jump != NO_BLOCK) {
+				s = block->jump;
+				g->preds[g->blocks[s].preds + g->blocks[s].npreds++] = b;
+			}
+		}
+	}
+}
+
+/**
+ * Finds the immediate dominator of every reachable block.  The entry is its
+ * own immediate dominator.
+ *
+ * @param[in,out] g the graph.
+ */
+static void find_dominators(Cfg *g)
+{
+	CfgBlock *block;
+	unsigned int k, j, p, idom;
+	Boolean changed;
+
+	if (g->nreachable == 0) {
+		return;
+	}
+	g->blocks[0].idom = 0;
+	do {
+		changed = FALSE;
+		for (k = 1; k < g->nreachable; k++) {
+			block = &g->blocks[g->order[k]];
+			idom = NO_BLOCK;
+			for (j = 0; j < block->npreds; j++) {
+				p = g->preds[block->preds + j];
+				if (g->blocks[p].idom != NO_BLOCK) {
+					idom = (idom == NO_BLOCK ? p : intersect(g, idom, p));
+				}
+			}
+			if (block->idom != idom) {
+				block->idom = idom;
+				changed = TRUE;
+			}
+		}
+	} while (changed);
+}
+
+static unsigned int intersect(Cfg *g, unsigned int b1, unsigned int b2)
+{
+	while (b1 != b2) {
+		while (g->blocks[b1].rpo > g->blocks[b2].rpo) {
+			b1 = g->blocks[b1].idom;
+		}
+		while (g->blocks[b2].rpo > g->blocks[b1].rpo) {
+			b2 = g->blocks[b2].idom;
+		}
+	}
+
+	return b1;
+}
+
+/**
+ * Finds the natural loops, innermost first.  Since a header dominates the
+ * headers of the loops nested in it, the headers are visited in reverse of
+ * reverse postorder, and the body of each loop is found by walking back from
+ * the sources of its back edges to the header.  A block already claimed by an
+ * inner loop stands for that loop, of which the header is then nested in the
+ * loop at hand.  While walking, the scratch array holds the outermost loop
+ * found so far for each block, followed by the worklist, onto which each block
+ * pushes its predecessors at most once per loop.
+ *
+ * @param[in,out] g the graph.
+ */
+static void find_loops(Cfg *g)
+{
+	CfgBlock *block;
+	unsigned int *up, *work, top, k, j, h, b, p;
+
+	up = g->scratch;
+	work = g->scratch + g->nblocks;
+	for (b = 0; b < g->nblocks; b++) {
+		up[b] = NO_BLOCK;
+	}
+	for (k = g->nreachable; k-- > 0; ) {
+		h = g->order[k];
+		block = &g->blocks[h];
+		top = 0;
+		for (j = 0; j < block->npreds; j++) {
+			p = g->preds[block->preds + j];
+			if (dominates(g, h, p)) {
+				block->header = TRUE;
+				work[top++] = p;
+			}
+		}
+		while (top > 0) {
+			b = work[--top];
+			while (up[b] != NO_BLOCK) {
+				b = up[b];
+			}
+			if (b == h) {
+				continue;
+			}
+			up[b] = h;
+			block = &g->blocks[b];
+			for (j = 0; j < block->npreds; j++) {
+				work[top++] = g->preds[block->preds + j];
+			}
+		}
+	}
+
+	/* nest the loops, outermost first */
+	for (k = 0; k < g->nreachable; k++) {
+		block = &g->blocks[b = g->order[k]];
+		if (block->header) {
+			block->loop = b;
+			block->depth = (up[b] == NO_BLOCK ? 0 : g->blocks[up[b]].depth) + 1;
+		} else if (up[b] != NO_BLOCK) {
+			block->loop = up[b];
+			block->depth = g->blocks[up[b]].depth;
+		}
+	}
+}
+
+/* --- dead code ------------------------------------------------------------ */
+
+/* The code of the blocks that cannot be reached is removed, and so is a jump to
+ * where control would flow anyway, with only unreachable or empty blocks in
+ * between.  Such a conditional jump still pops its operands, and becomes a
+ * pop of them, unless they were simply pushed, in which case they are left
+ * out too.  A conditional jump over a lone goto, which is what an empty branch
+ * of an if becomes, is turned around to jump where the goto does.  Then, a
+ * label that no jump is left to refer to is removed.  Since each of these may
+ * expose another, for example a label that stood between a jump and its
+ * target, they are removed pass after pass.
+ */
+
+/**
+ * Returns whether a block is followed by another, with only unreachable or
+ * empty blocks in between.
+ *
+ * @param[in] g the graph.
+ * @param[in] b the block.
+ * @param[in] next the block that may follow it.
+ * @return whether control falls from the one to the other.
+ */
+static Boolean falls_to(const Cfg *g, unsigned int b, unsigned int next)
+{
+	unsigned int k;
+
+	for (k = b + 1; k < next; k++) {
+		if (g->blocks[k].reachable && g->blocks[k].last >= 0) {
+			return FALSE;
+		}
+	}
+
+	return (k == next);
+}
+
+/**
+ * Returns whether a reachable block ends in a jump to where it would fall
+ * through to if it did not jump.
+ *
+ * @param[in] g the graph.
+ * @param[in] b the block.
+ * @return whether its jump can be left out.
+ */
+static Boolean jumps_to_next(const Cfg *g, unsigned int b)
+{
+	const CfgBlock *block;
+
+	block = &g->blocks[b];
+	if (block->last < 0 || !IS_JUMP(g->code[block->last].code)) {
+		return FALSE;
+	}
+
+	return falls_to(g, b, block->jump);
+}
+
+/**
+ * Returns whether a reachable block ends in a conditional jump over a block
+ * that holds nothing but a goto, and that is entered only from it.
+ *
+ * @param[in] g the graph.
+ * @param[in] b the block.
+ * @return whether its jump can be inverted to go where the goto goes.
+ */
+static Boolean jumps_over_goto(const Cfg *g, unsigned int b)
+{
+	const CfgBlock *block, *fall;
+	int i;
+
+	block = &g->blocks[b];
+	if (block->last < 0 || !IS_JUMP(g->code[block->last].code)
+			|| g->code[block->last].code == JVM_GOTO) {
+		return FALSE;
+	}
+	fall = &g->blocks[block->fall];
+	if (fall->npreds != 1 || fall->last < 0
+			|| g->code[fall->last].code != JVM_GOTO) {
+		return FALSE;
+	}
+	for (i = fall->start; i < fall->last; i++) {
+		if (!IS_LABEL(g->code[i])) {
+			return FALSE;
+		}
+	}
+
+	return falls_to(g, block->fall, block->jump);
+}
+
+/**
+ * Returns the conditional jump that jumps exactly when another does not.
+ *
+ * @param[in] op the conditional jump.
+ * @return the inverted jump.
+ */
+static Bytecode invert_jump(Bytecode op)
+{
+	switch (op) {
+		case JVM_IFEQ:      return JVM_IFNE;
+		case JVM_IFNE:      return JVM_IFEQ;
+		case JVM_IF_ICMPEQ: return JVM_IF_ICMPNE;
+		case JVM_IF_ICMPNE: return JVM_IF_ICMPEQ;
+		case JVM_IF_ICMPGE: return JVM_IF_ICMPLT;
+		case JVM_IF_ICMPLT: return JVM_IF_ICMPGE;
+		case JVM_IF_ICMPGT: return JVM_IF_ICMPLE;
+		case JVM_IF_ICMPLE: return JVM_IF_ICMPGT;
+		default:            return op;
+	}
+}
+
+/**
+ * Removes a code entry, freeing its string if it owns one.
+ *
+ * @param[in,out] c the entry.
+ * @return whether it was an instruction.
+ */
+static Boolean drop_entry(Code *c)
+{
+	if (c->type & CODE_ALLOCATED) {
+		efree(c->string);
+	}
+
+	return ((c->type & MASK_TYPE) == CODE_INSTRUCTION);
+}
+
+/**
+ * Makes one pass of removing dead code.  The code is compacted in place, and
+ * the strings of the operands that are removed are freed.  Once the jumps to
+ * keep are known, the map from labels to blocks is no longer needed, and it
+ * marks the labels that are kept instead.
+ *
+ * @param[in,out] g  the graph of the code, which is stale once this returns.
+ * @param[in,out] cg the code generator, of which the subroutine is open.
+ * @return the number of instructions removed.
+ */
+static unsigned int remove_dead_code(Cfg *g, CodeGen *cg)
+{
+	CfgBlock *block;
+	Code *code;
+	Bytecode op;
+	unsigned int *rewrite, b, removed, npops;
+	Label target;
+	int i, w;
+
+	code = cg->code;
+	rewrite = g->scratch;
+	for (b = 0; b < g->nblocks; b++) {
+		rewrite[b] = (g->blocks[b].reachable && jumps_to_next(g, b)
+				? DROP_JUMP : KEEP_JUMP);
+	}
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		if (block->reachable && rewrite[b] == KEEP_JUMP
+				&& jumps_over_goto(g, b)
+				&& rewrite[block->fall] == KEEP_JUMP) {
+			rewrite[b] = INVERT_JUMP;
+			rewrite[block->fall] = DROP_JUMP;
+		}
+	}
+
+	if (g->nlabels > 0) {
+		memset(g->labels, 0, g->nlabels * sizeof(unsigned int));
+	}
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		if (!block->reachable || block->jump == NO_BLOCK) {
+			continue;
+		}
+		if (rewrite[b] == KEEP_JUMP) {
+			target = code[block->last + 1].label;
+		} else if (rewrite[b] == INVERT_JUMP) {
+			target = code[g->blocks[block->fall].last + 1].label;
+		} else {
+			continue;
+		}
+		g->labels[target - g->base] = TRUE;
+	}
+
+	removed = 0;
+	w = 0;
+	for (b = 0; b < g->nblocks; b++) {
+		block = &g->blocks[b];
+		for (i = block->start; i < block->end; i++) {
+			if (!block->reachable
+					|| (rewrite[b] == DROP_JUMP && i > block->last)) {
+				removed += drop_entry(&code[i]);
+			} else if (IS_LABEL(code[i])) {
+				if (g->labels[code[i].label - g->base]) {
+					code[w++] = code[i];
+				}
+			} else if (rewrite[b] == DROP_JUMP && i == block->last) {
+				/* the operands of a conditional jump are popped, unless
+				 * the instructions that push them can go as well */
+				op = code[i].code;
+				npops = (op == JVM_GOTO ? 0
+						: op == JVM_IFEQ || op == JVM_IFNE ? 1 : 2);
+				while (npops > 0 && w >= 2 && IS_OPERAND(code[w - 1])
+						&& (IS_INSTRUCTION(code[w - 2], JVM_LDC)
+							|| IS_INSTRUCTION(code[w - 2], JVM_ILOAD)
+							|| IS_INSTRUCTION(code[w - 2], JVM_ALOAD))) {
+					drop_entry(&code[w - 1]);
+					removed += drop_entry(&code[w - 2]);
+					w -= 2;
+					npops--;
+				}
+				if (npops > 0) {
+					code[w].type = CODE_INSTRUCTION;
+					code[w++].code = (npops == 1 ? JVM_POP : JVM_POP2);
+				}
+				removed++;
+			} else if (rewrite[b] == INVERT_JUMP && i == block->last) {
+				code[w] = code[i];
+				code[w++].code = invert_jump(code[i].code);
+				code[w] = code[++i];
+				code[w++].label =
+					code[g->blocks[block->fall].last + 1].label;
+			} else {
+				code[w++] = code[i];
+			}
+		}
+	}
+	cg->ip = w;
+
+	return removed;
+}
+
+/* --- stack heights ------------------------------------------------------- */
+
+/**
+ * Brings a stack height to a block along an edge, checking it against the
+ * height that another edge brought, if any.
+ *
+ * @param[in,out] g the graph.
+ * @param[in] b the block entered.
+ * @param[in] height the height of the stack along the edge.
+ * @param[in] name the name of the subroutine.
+ */
+static void enter_block(Cfg *g, unsigned int b, int height, const char *name)
+{
+	CfgBlock *block;
+
+	block = &g->blocks[b];
+	if (block->height < 0) {
+		block->height = height;
+	} else if (block->height != height) {
+		eprintf("stack heights %d and %d meet at block B%u of '%s'",
+				block->height, height, b, name);
+	}
+}
+
+/* --- local slots --------------------------------------------------------- */
+
+/**
+ * Finds the slots live on entry to every reachable block, going over the
+ * blocks in postorder until nothing changes.
+ *
+ * @param[in,out] g the graph.
+ * @param[in] nwords the number of words of a set of slots.
+ */
+static void find_live_slots(Cfg *g, size_t nwords)
+{
+	const CfgBlock *block;
+	unsigned int *in, *out, k, b, s;
+	Boolean changed;
+	int i;
+
+	memset(g->live, 0, (g->nblocks + 1) * nwords * sizeof(unsigned int));
+	out = g->live + g->nblocks * nwords;
+	do {
+		changed = FALSE;
+		for (k = g->nreachable; k-- > 0;) {
+			b = g->order[k];
+			block = &g->blocks[b];
+			live_out(g, b, nwords, out);
+			for (i = block->last; i >= block->start; i--) {
+				if ((g->code[i].type & MASK_TYPE) != CODE_INSTRUCTION
+						|| !IS_LOCAL(g->code[i].code)) {
+					continue;
+				}
+				s = g->code[i + 1].num;
+				if (IS_STORE(g->code[i].code)) {
+					DEL_SLOT(out, s);
+				} else {
+					ADD_SLOT(out, s);
+				}
+			}
+			in = g->live + b * nwords;
+			if (memcmp(in, out, nwords * sizeof(unsigned int)) != 0) {
+				memcpy(in, out, nwords * sizeof(unsigned int));
+				changed = TRUE;
+			}
+		}
+	} while (changed);
+}
+
+/**
+ * Finds the slots live on exit from a block, which are those live on entry to
+ * its successors.
+ *
+ * @param[in] g the graph.
+ * @param[in] b the block.
+ * @param[in] nwords the number of words of a set of slots.
+ * @param[out] out the set of slots.
+ */
+static void live_out(Cfg *g, unsigned int b, size_t nwords, unsigned int *out)
+{
+	unsigned int succ[2], n, k;
+	size_t w;
+
+	memset(out, 0, nwords * sizeof(unsigned int));
+	n = successors(g, b, succ);
+	for (k = 0; k < n; k++) {
+		for (w = 0; w < nwords; w++) {
+			out[w] |= g->live[succ[k] * nwords + w];
+		}
+	}
+}
+
+/**
+ * Finds the live range of every slot.  A slot that is live at some entry of
+ * a block is either live on entry or set before it, and either live on exit or
+ * read after it, so that the range from the first to the last of these points
+ * takes in every entry at which the slot is live.
+ *
+ * @param[in,out] g the graph.
+ * @param[in] width the number of slots.
+ * @param[in] nwords the number of words of a set of slots.
+ */
+static void find_ranges(Cfg *g, int width, size_t nwords)
+{
+	const CfgBlock *block;
+	unsigned int *in, *out, k, b, s;
+	int i;
+
+	for (s = 0; s < (unsigned int) width; s++) {
+		g->ranges[s].start = g->ranges[s].end = -1;
+		g->ranges[s].reference = FALSE;
+		g->ranges[s].slot = s;
+	}
+	out = g->live + g->nblocks * nwords;
+	for (k = 0; k < g->nreachable; k++) {
+		b = g->order[k];
+		block = &g->blocks[b];
+		in = g->live + b * nwords;
+		live_out(g, b, nwords, out);
+		for (s = 0; s < (unsigned int) width; s++) {
+			if (HAS_SLOT(in, s)) {
+				extend_range(g, s, block->start);
+			}
+			if (HAS_SLOT(out, s)) {
+				extend_range(g, s, block->end - 1);
+			}
+		}
+		for (i = block->start; i <= block->last; i++) {
+			if ((g->code[i].type & MASK_TYPE) == CODE_INSTRUCTION
+					&& IS_LOCAL(g->code[i].code)) {
+				s = g->code[i + 1].num;
+				extend_range(g, s, i);
+				g->ranges[s].reference = (g->code[i].code == JVM_ALOAD
+						|| g->code[i].code == JVM_ASTORE);
+			}
+		}
+	}
+}
+
+/**
+ * Extends the live range of a slot to take in a code entry.
+ *
+ * @param[in,out] g the graph.
+ * @param[in] s the slot.
+ * @param[in] i the code entry.
+ */
+static void extend_range(Cfg *g, unsigned int s, int i)
+{
+	CfgRange *r;
+
+	r = &g->ranges[s];
+	if (r->start < 0) {
+		r->start = r->end = i;
+	} else if (i < r->start) {
+		r->start = i;
+	} else if (i > r->end) {
+		r->end = i;
+	}
+}
+
+/**
+ * Packs the live ranges of the slots that may move into as few slots as it
+ * can, scanning them in the order in which they start.  A slot is freed once
+ * the range that holds it has ended, and it is handed out again to the next
+ * range of the same kind that starts.
+ *
+ * @param[in,out] g the graph.
+ * @param[in] nfixed the number of slots that stay where they are.
+ * @param[in] width the number of slots.
+ * @return the number of slots in use once they are packed.
+ */
+static unsigned int pack_ranges(Cfg *g, unsigned int nfixed,
+		unsigned int width)
+{
+	CfgRange **start, **end, *r;
+	unsigned int *pool[2], nfree[2], n, k, e, next;
+
+	start = g->sorted;
+	end = g->sorted + width;
+	pool[0] = g->free;
+	pool[1] = g->free + width;
+	for (n = 0, k = nfixed; k < width; k++) {
+		if (g->ranges[k].start >= 0) {
+			start[n] = end[n] = &g->ranges[k];
+			n++;
+		}
+	}
+	qsort(start, n, sizeof(CfgRange *), by_start);
+	qsort(end, n, sizeof(CfgRange *), by_end);
+
+	nfree[0] = nfree[1] = 0;
+	next = nfixed;
+	for (k = 0, e = 0; k < n; k++) {
+		r = start[k];
+		for (; e < n && end[e]->end < r->start; e++) {
+			pool[end[e]->reference][nfree[end[e]->reference]++] = end[e]->slot;
+		}
+		if (nfree[r->reference] > 0) {
+			r->slot = pool[r->reference][--nfree[r->reference]];
+		} else {
+			r->slot = next++;
+		}
+	}
+
+	return next;
+}
+
+/**
+ * Orders live ranges by where they start, and then by slot.
+ *
+ * @param[in] a the first range.
+ * @param[in] b the second range.
+ * @return the order of the ranges.
+ */
+static int by_start(const void *a, const void *b)
+{
+	const CfgRange *r1 = *(const CfgRange * const *) a;
+	const CfgRange *r2 = *(const CfgRange * const *) b;
+
+	if (r1->start != r2->start) {
+		return (r1->start < r2->start ? -1 : 1);
+	}
+	return (r1 < r2 ? -1 : r1 > r2);
+}
+
+/**
+ * Orders live ranges by where they end, and then by slot.
+ *
+ * @param[in] a the first range.
+ * @param[in] b the second range.
+ * @return the order of the ranges.
+ */
+static int by_end(const void *a, const void *b)
+{
+	const CfgRange *r1 = *(const CfgRange * const *) a;
+	const CfgRange *r2 = *(const CfgRange * const *) b;
+
+	if (r1->end != r2->end) {
+		return (r1->end < r2->end ? -1 : 1);
+	}
+	return (r1 < r2 ? -1 : r1 > r2);
+}
+
+/* --- dumping -------------------------------------------------------------- */
+
+/**
+ * Writes a block as a node of which the label lists its code.  Unreachable
+ * blocks are dashed.
+ *
+ * @param[in] g    the graph.
+ * @param[in] name the name of the subroutine.
+ * @param[in] b    the block.
+ * @param[in] file the stream to write to.
+ */
+static void dump_block(const Cfg *g, const char *name, unsigned int b,
+		FILE *file)
+{
+	const CfgBlock *block;
+	const Code *c;
+	int i;
+
+	block = &g->blocks[b];
+	fprintf(file, "\t\t\"%s.B%u\" [label=\"B%u", name, b, b);
+	if (!block->reachable) {
+		fprintf(file, "  unreachable");
+	} else {
+		if (b != 0) {
+			fprintf(file, "  idom B%u", block->idom);
+		}
+		if (block->header) {
+			fprintf(file, "  loop header");
+		}
+		if (block->depth > 0) {
+			fprintf(file, "  depth %u", block->depth);
+		}
+		if (block->height >= 0) {
+			fprintf(file, "  stack %d", block->height);
+		}
+	}
+	fprintf(file, "\\l");
+	for (i = block->start; i < block->end; i++) {
+		c = &g->code[i];
+		switch (c->type & MASK_TYPE) {
+			case CODE_LABEL:
+				fprintf(file, "L%u:\\l", c->label);
+				break;
+			case CODE_LABEL | CODE_OPERAND:
+				fprintf(file, " L%u", c->label);
+				break;
+			case CODE_INSTRUCTION:
+				fprintf(file, "%s  %s", (i > block->start
+							&& !IS_LABEL(c[-1]) ? "\\l" : ""),
+						get_opcode_string(c->code));
+				break;
+			case CODE_OPERAND:
+				switch (c->type & MASK_DATA_TYPE) {
+					case CODE_ARRAY_TYPE:
+						fprintf(file, " %s", get_atype_string(c->atype));
+						break;
+					case CODE_INTEGER:
+						fprintf(file, " %d", c->num);
+						break;
+					case CODE_REFERENCE:
+						fputc(' ', file);
+						dump_escaped(c->string, file);
+						break;
+					case CODE_STRING:
+						fputs(" \\\"", file);
+						dump_escaped(c->string, file);
+						fputs("\\\"", file);
+						break;
+					default:
+						break;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	if (block->last >= 0) {
+		fprintf(file, "\\l");
+	}
+	fprintf(file, "\"%s];\n", (block->reachable ? "" : ", style=dashed"));
+}
+
+/**
+ * Writes a string inside a quoted DOT string.
+ *
+ * @param[in] s    the string.
+ * @param[in] file the stream to write to.
+ */
+static void dump_escaped(const char *s, FILE *file)
+{
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', file);
+		}
+		fputc(*s, file);
+	}
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * Grows the arrays that are kept per block, so that they can hold at least the
+ * specified number of blocks.
+ *
+ * @param[in,out] g       the graph.
+ * @param[in]     nblocks the number of blocks.
+ */
+static void reserve(Cfg *g, unsigned int nblocks)
+{
+	if (nblocks <= g->capacity) {
+		return;
+	}
+	if (g->capacity == 0) {
+		g->capacity = INITIAL_BLOCKS;
+	}
+	while (nblocks > g->capacity) {
+		g->capacity *= 2;
+	}
+	g->blocks = erealloc(g->blocks, g->capacity * sizeof(CfgBlock));
+	g->order = erealloc(g->order, g->capacity * sizeof(unsigned int));
+	g->preds = erealloc(g->preds, 2 * g->capacity * sizeof(unsigned int));
+	g->scratch = erealloc(g->scratch, 3 * g->capacity * sizeof(unsigned int));
+}
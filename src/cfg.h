@@ -0,0 +1,205 @@
+/**
+ * @file    cfg.h
+ * @brief   The control-flow graph of the generated code of a subroutine.
+ *
+ * The code is split into basic blocks at its labels, and after every jump and
+ * return.  A run of labels starts a single block, and a block that ends in a
+ * conditional jump has two successors: the block that it falls through to, and
+ * the block of the label that it jumps to.
+ *
+ * Once the blocks are linked, the graph is ordered by a depth-first walk from
+ * the entry, which finds the reachable blocks, and then the dominators of the
+ * reachable blocks are found by the iterative algorithm of Cooper, Harvey, and
+ * Kennedy.  An edge to a block that dominates its source is a back edge, and
+ * closes the natural loop of which that block is the header; the loops are
+ * nested by the headers that they contain.
+ *
+ * The graph refers to the code that it was built from, and must be rebuilt
+ * once the code changes.  It is also used to remove the dead code of a
+ * subroutine, which changes the code, pass after pass, and to find the height
+ * of the operand stack on entry to every block, by following the stack effect
+ * of each instruction along the edges of the graph.
+ *
+ * The local slots of the variables are shared once the code is final.  The
+ * slots live on entry to each block are found by the usual backward dataflow,
+ * and the live range of a slot is taken as the stretch of code from the first
+ * to the last entry at which it is live.  The ranges are then packed into as
+ * few slots as they can be by a linear scan in the order in which they start,
+ * with integers and references kept apart.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdio.h>
+#include "boolean.h"
+#include "codegen.h"
+
+/** the absent block */
+#define NO_BLOCK ((unsigned int) -1)
+
+/** a basic block */
+typedef struct {
+	int            start;     /**< the index of the first code entry       */
+	int            end;       /**< the index just past the last entry      */
+	int            last;      /**< the last instruction, or -1 if none     */
+	unsigned int   fall;      /**< the block fallen through to, if any     */
+	unsigned int   jump;      /**< the block jumped to, if any             */
+	unsigned int   preds;     /**< the index of the first predecessor      */
+	unsigned int   npreds;    /**< the number of reachable predecessors    */
+	unsigned int   idom;      /**< the immediate dominator, or NO_BLOCK    */
+	unsigned int   rpo;       /**< the reverse postorder number            */
+	unsigned int   loop;      /**< the innermost loop header, or NO_BLOCK  */
+	unsigned int   depth;     /**< the number of loops around the block    */
+	int            height;    /**< the stack height on entry, or -1        */
+	Boolean        header;    /**< whether it heads a loop                 */
+	Boolean        reachable; /**< whether it is reachable from the entry  */
+} CfgBlock;
+
+/** the stretch of code over which a local slot is live */
+typedef struct {
+	int            start;     /**< the first code entry, or -1 if unused   */
+	int            end;       /**< the last code entry                     */
+	Boolean        reference; /**< whether it holds a reference            */
+	unsigned int   slot;      /**< the slot that it shares                 */
+} CfgRange;
+
+/** the control-flow graph of one body, with the arrays to build it in */
+typedef struct {
+	const struct code_s *code;  /**< the code of the body                  */
+	int            ncode;     /**< the number of code entries              */
+	CfgBlock      *blocks;    /**< the blocks, in layout order             */
+	unsigned int   nblocks;   /**< the number of blocks                    */
+	unsigned int  *preds;     /**< the predecessors, by block              */
+	unsigned int  *order;     /**< the reachable blocks, in reverse postorder */
+	unsigned int   nreachable; /**< the number of reachable blocks         */
+	unsigned int  *scratch;   /**< working storage                         */
+	unsigned int   capacity;  /**< the number of blocks allocated          */
+	unsigned int  *labels;    /**< the block of each label, from the first */
+	Label          base;      /**< the first label of the body             */
+	unsigned int   nlabels;   /**< the number of labels allocated          */
+	unsigned int  *live;      /**< the slots live on entry, by block       */
+	size_t         nlive;     /**< the number of words allocated           */
+	CfgRange      *ranges;    /**< the live range of each slot             */
+	CfgRange     **sorted;    /**< the ranges, by start and by end         */
+	unsigned int  *free;      /**< the slots free to share, by pool        */
+	unsigned int   nranges;   /**< the number of ranges allocated          */
+} Cfg;
+
+/**
+ * Initialises the arrays of a control-flow graph.
+ *
+ * @param[out]  g
+ *     the graph
+ */
+void init_cfg(Cfg *g);
+
+/**
+ * Builds the control-flow graph of the code of a subroutine, and computes its
+ * dominators and loops.
+ *
+ * @param[in,out] g
+ *     the graph, of which the previous contents are discarded
+ * @param[in]   code
+ *     the code
+ * @param[in]   ncode
+ *     the number of code entries
+ */
+void build_cfg(Cfg *g, const struct code_s *code, int ncode);
+
+/**
+ * Returns the block of a label.
+ *
+ * @param[in]   g
+ *     the graph
+ * @param[in]   label
+ *     a label placed in the code of the graph
+ * @return      the block that the label starts
+ */
+unsigned int get_label_block(const Cfg *g, Label label);
+
+/**
+ * Returns whether a block dominates another.  Every block dominates itself.
+ *
+ * @param[in]   g
+ *     the graph
+ * @param[in]   b1
+ *     the dominating block, which must be reachable
+ * @param[in]   b2
+ *     the dominated block, which must be reachable
+ * @return      whether <code>b1</code> dominates <code>b2</code>
+ */
+Boolean dominates(const Cfg *g, unsigned int b1, unsigned int b2);
+
+/**
+ * Writes a control-flow graph as a cluster of a graph in the DOT language of
+ * Graphviz, so that the clusters of several subroutines can be combined in
+ * one <code>digraph</code>.
+ *
+ * @param[in]   g
+ *     the graph
+ * @param[in]   name
+ *     the name of the subroutine
+ * @param[in]   file
+ *     the stream to write to
+ */
+void dump_cfg(const Cfg *g, const char *name, FILE *file);
+
+/**
+ * Removes the dead code of the current subroutine of a code generator: the
+ * blocks that cannot be reached, the jumps to where control flows anyway, and
+ * the labels that no jump refers to.  The graph is rebuilt as the code changes,
+ * and is left stale.
+ *
+ * @param[in,out] g
+ *     the graph to build
+ * @param[in,out] cg
+ *     the code generator, of which the subroutine is still open
+ * @return      the number of instructions removed
+ */
+unsigned int eliminate_dead_code(Cfg *g, CodeGen *cg);
+
+/**
+ * Finds the height of the operand stack on entry to every reachable block of a
+ * graph, and the greatest height that it reaches.  It is a fatal error for
+ * the stack to underflow, or for two edges to bring different heights to the
+ * same block, since the code could not be verified.
+ *
+ * @param[in,out] g
+ *     the graph, which must be up to date with its code
+ * @param[in]   name
+ *     the name of the subroutine, for the error messages
+ * @return      the greatest height of the operand stack
+ */
+int find_max_stack(Cfg *g, const char *name);
+
+/**
+ * Shares the local slots of the variables of the current subroutine of a code
+ * generator between variables that are never live at the same time, and moves
+ * the loads and stores to the shared slots.  The slots of the parameters are
+ * left as they are.
+ *
+ * @param[in,out] g
+ *     the graph, which must be up to date with the code, and stays so
+ * @param[in,out] cg
+ *     the code generator, of which the subroutine is still open
+ * @param[in]   nfixed
+ *     the number of slots that are left as they are, from slot 0
+ * @param[in]   width
+ *     the number of slots that the code uses
+ * @return      the number of slots that it uses once they are shared
+ */
+int share_slots(Cfg *g, CodeGen *cg, int nfixed, int width);
+
+/**
+ * Releases the arrays of a control-flow graph.
+ *
+ * @param[in,out] g
+ *     the graph
+ */
+void release_cfg(Cfg *g);
+
+#endif /* CFG_H */
@@ -0,0 +1,1054 @@
+/**
+ * @file    classfile.c
+ * @brief   A writer of class files in the binary format of the Java virtual
+ *          machine.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boolean.h"
+#include "classfile.h"
+#include "code.h"
+#include "codegen.h"
+#include "error.h"
+#include "hashtable.h"
+#include "jvm.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+#define CLASS_MAGIC    0xcafebabeUL
+#define MINOR_VERSION  3
+#define MAJOR_VERSION  45
+
+#define MAX_U2         0xffff
+#define MAX_CODE       0xffff
+
+#define INITIAL_BYTES  1024
+
+#define IS_LABEL(c)       (((c).type & MASK_TYPE) == CODE_LABEL)
+#define IS_INSTRUCTION(c) (((c).type & MASK_TYPE) == CODE_INSTRUCTION)
+
+/* access flags */
+#define ACC_PUBLIC     0x0001
+#define ACC_PRIVATE    0x0002
+#define ACC_STATIC     0x0008
+#define ACC_FINAL      0x0010
+#define ACC_SUPER      0x0020
+
+/* the tags of constant pool entries */
+typedef enum {
+	CONSTANT_UTF8          = 1,
+	CONSTANT_INTEGER       = 3,
+	CONSTANT_CLASS         = 7,
+	CONSTANT_STRING        = 8,
+	CONSTANT_FIELDREF      = 9,
+	CONSTANT_METHODREF     = 10,
+	CONSTANT_NAME_AND_TYPE = 12
+} ConstantTag;
+
+/* the forms of instructions, by their operands */
+typedef enum {
+	FORM_SIMPLE,                          /* no operand                      */
+	FORM_LOCAL,                           /* a local variable                */
+	FORM_INCREMENT,                       /* a local variable and a constant */
+	FORM_PUSH,                            /* a small integer constant        */
+	FORM_CONSTANT,                        /* a constant in the pool          */
+	FORM_MEMBER,                          /* a field or method in the pool   */
+	FORM_TYPE,                            /* an array type                   */
+	FORM_BRANCH                           /* a label                         */
+} Form;
+
+/* the opcodes that are written besides those of the code generator */
+enum {
+	OP_ICONST_0      = 0x03,
+	OP_ICONST_1      = 0x04,
+	OP_BIPUSH        = 0x10,
+	OP_SIPUSH        = 0x11,
+	OP_LDC           = 0x12,
+	OP_LDC_W         = 0x13,
+	OP_ILOAD_0       = 0x1a,
+	OP_ALOAD_0       = 0x2a,
+	OP_ISTORE_0      = 0x3b,
+	OP_ASTORE_0      = 0x4b,
+	OP_POP           = 0x57,
+	OP_DUP           = 0x59,
+	OP_IFEQ          = 0x99,
+	OP_IRETURN       = 0xac,
+	OP_RETURN        = 0xb1,
+	OP_GETSTATIC     = 0xb2,
+	OP_PUTSTATIC     = 0xb3,
+	OP_INVOKEVIRTUAL = 0xb6,
+	OP_INVOKESPECIAL = 0xb7,
+	OP_NEW           = 0xbb,
+	OP_ATHROW        = 0xbf,
+	OP_WIDE          = 0xc4,
+	OP_GOTO_W        = 0xc8
+};
+
+/* --- global static variables ---------------------------------------------- */
+
+/* the opcodes of the instructions of the code generator */
+static const unsigned char opcodes[] = {
+	[JVM_ALOAD]         = 0x19,
+	[JVM_ARETURN]       = 0xb0,
+	[JVM_ASTORE]        = 0x3a,
+	[JVM_GETSTATIC]     = 0xb2,
+	[JVM_GOTO]          = 0xa7,
+	[JVM_IADD]          = 0x60,
+	[JVM_IALOAD]        = 0x2e,
+	[JVM_IAND]          = 0x7e,
+	[JVM_IASTORE]       = 0x4f,
+	[JVM_IDIV]          = 0x6c,
+	[JVM_IFEQ]          = 0x99,
+	[JVM_IFNE]          = 0x9a,
+	[JVM_IF_ICMPEQ]     = 0x9f,
+	[JVM_IF_ICMPGE]     = 0xa2,
+	[JVM_IF_ICMPGT]     = 0xa3,
+	[JVM_IF_ICMPLE]     = 0xa4,
+	[JVM_IF_ICMPLT]     = 0xa1,
+	[JVM_IF_ICMPNE]     = 0xa0,
+	[JVM_IINC]          = 0x84,
+	[JVM_ILOAD]         = 0x15,
+	[JVM_IMUL]          = 0x68,
+	[JVM_INEG]          = 0x74,
+	[JVM_INVOKESTATIC]  = 0xb8,
+	[JVM_INVOKEVIRTUAL] = 0xb6,
+	[JVM_IOR]           = 0x80,
+	[JVM_ISTORE]        = 0x36,
+	[JVM_ISUB]          = 0x64,
+	[JVM_IREM]          = 0x70,
+	[JVM_IRETURN]       = 0xac,
+	[JVM_IXOR]          = 0x82,
+	[JVM_LDC]           = 0x12,
+	[JVM_NEWARRAY]      = 0xbc,
+	[JVM_POP]           = 0x57,
+	[JVM_POP2]          = 0x58,
+	[JVM_RETURN]        = 0xb1,
+	[JVM_SWAP]          = 0x5f
+};
+
+/* the opcodes of the loads and stores of the first four local variables, of
+ * which the opcodes of the others follow in order */
+static const unsigned char short_forms[] = {
+	[JVM_ALOAD]         = OP_ALOAD_0,
+	[JVM_ASTORE]        = OP_ASTORE_0,
+	[JVM_ILOAD]         = OP_ILOAD_0,
+	[JVM_ISTORE]        = OP_ISTORE_0
+};
+
+#define MAX_SHORT_LOCAL 3
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void add_runtime(ClassFile *cf);
+static unsigned int add_field(ClassFile *cf, const char *name,
+		const char *descriptor);
+static void finish_method(ClassFile *cf, unsigned int flags, const char *name,
+		const char *descriptor, int max_stack, int max_locals);
+static void reserve(ClassFile *cf, const Code *code, int ncode);
+static Form get_form(const Code *code, int ncode, int i);
+static void resolve_operands(ClassFile *cf, const Code *code, int ncode);
+static unsigned int lay_out(ClassFile *cf, const Code *code, int ncode);
+static unsigned int instruction_size(const ClassFile *cf, const Code *code,
+		int ncode, int i);
+static void encode(ClassFile *cf, const Code *code, int ncode, int i);
+static void op(ClassFile *cf, unsigned int opcode);
+static void op_index(ClassFile *cf, unsigned int opcode, unsigned int index);
+static void op_ldc(ClassFile *cf, unsigned int index);
+static void op_push(ClassFile *cf, int n);
+static unsigned int find_constant(ClassFile *cf, ConstantTag tag,
+		const char *a, const char *b, const char *c, Boolean *found);
+static unsigned int utf8_constant(ClassFile *cf, const char *s, size_t n);
+static unsigned int int_constant(ClassFile *cf, int n);
+static unsigned int string_constant(ClassFile *cf, const char *s);
+static unsigned int class_constant(ClassFile *cf, const char *name);
+static unsigned int member_constant(ClassFile *cf, ConstantTag tag,
+		const char *owner, const char *name, const char *descriptor);
+static unsigned int reference_constant(ClassFile *cf, Bytecode opcode,
+		const char *ref);
+static void put_bytes(ByteBuffer *b, const void *p, size_t n);
+static void put_u1(ByteBuffer *b, unsigned int n);
+static void put_u2(ByteBuffer *b, unsigned int n);
+static void put_u4(ByteBuffer *b, unsigned long n);
+static void output_u2(FILE *file, unsigned int n);
+static void output_u4(FILE *file, unsigned long n);
+static unsigned int hash_key(void *key, unsigned int size);
+static int cmp_key(void *v1, void *v2);
+static void keep_index(void *p);
+
+/* --- class file interface ------------------------------------------------- */
+
+void init_class_file(ClassFile *cf, const char *name)
+{
+	memset(cf, 0, sizeof(ClassFile));
+	cf->name = name;
+	cf->npool = 1;
+	if ((cf->constants = ht_init(0.75f, hash_key, cmp_key)) == NULL) {
+		eprintf("Constant pool could not be initialised");
+	}
+	cf->this_class = class_constant(cf, name);
+	cf->super_class = class_constant(cf, "java/lang/Object");
+	add_runtime(cf);
+}
+
+void add_method(ClassFile *cf, const char *name, const char *descriptor,
+		const struct code_s *code, int ncode, int max_stack, int max_locals)
+{
+	unsigned int len;
+	int i;
+
+	reserve(cf, code, ncode);
+	resolve_operands(cf, code, ncode);
+	len = lay_out(cf, code, ncode);
+
+	if (len > MAX_CODE) {
+		eprintf("code of '%s' is too large for a class file", name);
+	}
+
+	for (i = 0; i < ncode; i++) {
+		if (IS_INSTRUCTION(code[i])) {
+			encode(cf, code, ncode, i);
+		}
+	}
+
+	finish_method(cf, ACC_PUBLIC | ACC_STATIC, name, descriptor, max_stack,
+			max_locals);
+}
+
+void output_class(const ClassFile *cf, FILE *file)
+{
+	output_u4(file, CLASS_MAGIC);
+	output_u2(file, MINOR_VERSION);
+	output_u2(file, MAJOR_VERSION);
+	output_u2(file, cf->npool);
+	fwrite(cf->pool.bytes, 1, cf->pool.len, file);
+	output_u2(file, ACC_PUBLIC | ACC_SUPER);
+	output_u2(file, cf->this_class);
+	output_u2(file, cf->super_class);
+	output_u2(file, 0);
+	output_u2(file, cf->nfields);
+	fwrite(cf->fields.bytes, 1, cf->fields.len, file);
+	output_u2(file, cf->nmethods);
+	fwrite(cf->methods.bytes, 1, cf->methods.len, file);
+	output_u2(file, 0);
+}
+
+void release_class_file(ClassFile *cf)
+{
+	ht_free(cf->constants, efree, keep_index);
+	efree(cf->pool.bytes);
+	efree(cf->fields.bytes);
+	efree(cf->methods.bytes);
+	efree(cf->code.bytes);
+	efree(cf->offsets);
+	efree(cf->operands);
+	efree(cf->far);
+	efree(cf->labels);
+	memset(cf, 0, sizeof(ClassFile));
+}
+
+/* --- runtime support ------------------------------------------------------ */
+
+/**
+ * Adds the fields and methods that every compiled program has, as in the
+ * preamble that the code generator writes for Jasmin.  They are added first,
+ * so that their constants are among the first in the pool, and each is loaded
+ * with a plain <code>ldc</code>.
+ *
+ * @param[in,out] cf the class file.
+ */
+static void add_runtime(ClassFile *cf)
+{
+	unsigned int charset, locale, scanner, equals;
+
+	charset = add_field(cf, "charsetName", "Ljava/lang/String;");
+	locale = add_field(cf, "usLocale", "Ljava/util/Locale;");
+	scanner = add_field(cf, "scanner", "Ljava/util/Scanner;");
+
+	/* the static initialiser sets up a scanner over standard input */
+	op_ldc(cf, string_constant(cf, "UTF-8"));
+	op_index(cf, OP_PUTSTATIC, charset);
+	op_index(cf, OP_NEW, class_constant(cf, "java/util/Locale"));
+	op(cf, OP_DUP);
+	op_ldc(cf, string_constant(cf, "en"));
+	op_ldc(cf, string_constant(cf, "US"));
+	op_index(cf, OP_INVOKESPECIAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/util/Locale", "<init>",
+				"(Ljava/lang/String;Ljava/lang/String;)V"));
+	op_index(cf, OP_PUTSTATIC, locale);
+	op_index(cf, OP_NEW, class_constant(cf, "java/util/Scanner"));
+	op(cf, OP_DUP);
+	op_index(cf, OP_NEW, class_constant(cf, "java/io/BufferedInputStream"));
+	op(cf, OP_DUP);
+	op_index(cf, OP_GETSTATIC, member_constant(cf, CONSTANT_FIELDREF,
+				"java/lang/System", "in", "Ljava/io/InputStream;"));
+	op_index(cf, OP_INVOKESPECIAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/io/BufferedInputStream", "<init>",
+				"(Ljava/io/InputStream;)V"));
+	op_index(cf, OP_GETSTATIC, charset);
+	op_index(cf, OP_INVOKESPECIAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/util/Scanner", "<init>",
+				"(Ljava/io/InputStream;Ljava/lang/String;)V"));
+	op_index(cf, OP_PUTSTATIC, scanner);
+	op_index(cf, OP_GETSTATIC, scanner);
+	op_index(cf, OP_GETSTATIC, locale);
+	op_index(cf, OP_INVOKEVIRTUAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/util/Scanner", "useLocale",
+				"(Ljava/util/Locale;)Ljava/util/Scanner;"));
+	op(cf, OP_POP);
+	op(cf, OP_RETURN);
+	finish_method(cf, ACC_PUBLIC | ACC_STATIC, "<clinit>", "()V", 5, 1);
+
+	/* the constructor */
+	op(cf, OP_ALOAD_0);
+	op_index(cf, OP_INVOKESPECIAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/lang/Object", "<init>", "()V"));
+	op(cf, OP_RETURN);
+	finish_method(cf, ACC_PUBLIC, "<init>", "()V", 1, 1);
+
+	/* readInt()I */
+	op_index(cf, OP_GETSTATIC, scanner);
+	op_index(cf, OP_INVOKEVIRTUAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/util/Scanner", "nextInt", "()I"));
+	op(cf, OP_IRETURN);
+	finish_method(cf, ACC_PUBLIC | ACC_STATIC, "readInt", "()I", 1, 1);
+
+	/* readBoolean()Z, of which both branches skip the five bytes of the
+	 * return that follows them */
+	equals = member_constant(cf, CONSTANT_METHODREF, "java/lang/String",
+			"equalsIgnoreCase", "(Ljava/lang/String;)Z");
+	op_index(cf, OP_GETSTATIC, scanner);
+	op_index(cf, OP_INVOKEVIRTUAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/util/Scanner", "next", "()Ljava/lang/String;"));
+	op(cf, OP_ASTORE_0);
+	op(cf, OP_ALOAD_0);
+	op_ldc(cf, string_constant(cf, "true"));
+	op_index(cf, OP_INVOKEVIRTUAL, equals);
+	op_index(cf, OP_IFEQ, 5);
+	op(cf, OP_ICONST_1);
+	op(cf, OP_IRETURN);
+	op(cf, OP_ALOAD_0);
+	op_ldc(cf, string_constant(cf, "false"));
+	op_index(cf, OP_INVOKEVIRTUAL, equals);
+	op_index(cf, OP_IFEQ, 5);
+	op(cf, OP_ICONST_0);
+	op(cf, OP_IRETURN);
+	op_index(cf, OP_NEW, class_constant(cf,
+				"java/util/InputMismatchException"));
+	op(cf, OP_DUP);
+	op_index(cf, OP_INVOKESPECIAL, member_constant(cf, CONSTANT_METHODREF,
+				"java/util/InputMismatchException", "<init>", "()V"));
+	op(cf, OP_ATHROW);
+	finish_method(cf, ACC_PUBLIC | ACC_STATIC, "readBoolean", "()Z", 2, 1);
+}
+
+/**
+ * Adds a private static final field to the class.
+ *
+ * @param[in,out] cf         the class file.
+ * @param[in]     name       the name of the field.
+ * @param[in]     descriptor the descriptor of the field.
+ * @return the pool index of a reference to the field.
+ */
+static unsigned int add_field(ClassFile *cf, const char *name,
+		const char *descriptor)
+{
+	put_u2(&cf->fields, ACC_PRIVATE | ACC_STATIC | ACC_FINAL);
+	put_u2(&cf->fields, utf8_constant(cf, name, strlen(name)));
+	put_u2(&cf->fields, utf8_constant(cf, descriptor, strlen(descriptor)));
+	put_u2(&cf->fields, 0);
+	cf->nfields++;
+
+	return member_constant(cf, CONSTANT_FIELDREF, cf->name, name, descriptor);
+}
+
+/**
+ * Adds a method with the code encoded so far, which is then cleared for the
+ * next method.  The method has a single attribute, its code, which has
+ * neither exception handlers nor attributes of its own.
+ *
+ * @param[in,out] cf         the class file.
+ * @param[in]     flags      the access flags of the method.
+ * @param[in]     name       the name of the method.
+ * @param[in]     descriptor the descriptor of the method.
+ * @param[in]     max_stack  the maximum depth of the operand stack.
+ * @param[in]     max_locals the width of the local variables.
+ */
+static void finish_method(ClassFile *cf, unsigned int flags, const char *name,
+		const char *descriptor, int max_stack, int max_locals)
+{
+	put_u2(&cf->methods, flags);
+	put_u2(&cf->methods, utf8_constant(cf, name, strlen(name)));
+	put_u2(&cf->methods, utf8_constant(cf, descriptor, strlen(descriptor)));
+	put_u2(&cf->methods, 1);
+	put_u2(&cf->methods, utf8_constant(cf, "Code", 4));
+	put_u4(&cf->methods, 12 + cf->code.len);
+	put_u2(&cf->methods, (unsigned int) max_stack);
+	put_u2(&cf->methods, (unsigned int) max_locals);
+	put_u4(&cf->methods, cf->code.len);
+	put_bytes(&cf->methods, cf->code.bytes, cf->code.len);
+	put_u2(&cf->methods, 0);
+	put_u2(&cf->methods, 0);
+	cf->nmethods++;
+	cf->code.len = 0;
+}
+
+/* --- code layout ---------------------------------------------------------- */
+
+/**
+ * Makes room for the layout of a method in the arrays of the class file, and
+ * finds the range of the labels of its code, every branch of which starts out
+ * near.
+ *
+ * @param[in,out] cf    the class file.
+ * @param[in]     code  the code of the method.
+ * @param[in]     ncode the number of code entries.
+ */
+static void reserve(ClassFile *cf, const Code *code, int ncode)
+{
+	Label lo, hi;
+	int i;
+
+	if (ncode > cf->capacity) {
+		cf->offsets = erealloc(cf->offsets, ncode * sizeof(unsigned int));
+		cf->operands = erealloc(cf->operands, ncode * sizeof(unsigned int));
+		cf->far = erealloc(cf->far, ncode * sizeof(Boolean));
+		cf->capacity = ncode;
+	}
+	for (i = 0; i < ncode; i++) {
+		cf->far[i] = FALSE;
+	}
+
+	lo = hi = 0;
+	for (i = 0; i < ncode; i++) {
+		if (!(code[i].type & CODE_LABEL)) {
+			continue;
+		}
+		if (lo == hi) {
+			lo = code[i].label;
+			hi = lo + 1;
+		} else if (code[i].label < lo) {
+			lo = code[i].label;
+		} else if (code[i].label >= hi) {
+			hi = code[i].label + 1;
+		}
+	}
+	cf->base = lo;
+	if (hi - lo > cf->nlabels) {
+		cf->labels = erealloc(cf->labels, (hi - lo) * sizeof(unsigned int));
+		cf->nlabels = hi - lo;
+	}
+}
+
+/**
+ * Returns the form of an instruction, which follows from the type of its
+ * operand, and for an integer operand, from the instruction itself.  An integer
+ * constant that fits in two bytes is pushed without going through the pool.
+ *
+ * @param[in] code  the code.
+ * @param[in] ncode the number of code entries.
+ * @param[in] i     the index of the instruction.
+ * @return the form of the instruction.
+ */
+static Form get_form(const Code *code, int ncode, int i)
+{
+	if (i + 1 >= ncode || !(code[i + 1].type & CODE_OPERAND)) {
+		return FORM_SIMPLE;
+	}
+	if (code[i + 1].type & CODE_LABEL) {
+		return FORM_BRANCH;
+	}
+	if (code[i].code == JVM_IINC) {
+		return FORM_INCREMENT;
+	}
+	switch (code[i + 1].type & MASK_DATA_TYPE) {
+		case CODE_ARRAY_TYPE:
+			return FORM_TYPE;
+		case CODE_REFERENCE:
+			return FORM_MEMBER;
+		case CODE_STRING:
+			return FORM_CONSTANT;
+		default:
+			if (code[i].code != JVM_LDC) {
+				return FORM_LOCAL;
+			} else if (code[i + 1].num >= SHRT_MIN
+					&& code[i + 1].num <= SHRT_MAX) {
+				return FORM_PUSH;
+			}
+			return FORM_CONSTANT;
+	}
+}
+
+/**
+ * Enters the constants that the instructions of a method refer to in the
+ * pool, and records their indices by the instructions.
+ *
+ * @param[in,out] cf    the class file.
+ * @param[in]     code  the code of the method.
+ * @param[in]     ncode the number of code entries.
+ */
+static void resolve_operands(ClassFile *cf, const Code *code, int ncode)
+{
+	int i;
+
+	for (i = 0; i < ncode; i++) {
+		if (!IS_INSTRUCTION(code[i])) {
+			continue;
+		}
+		switch (get_form(code, ncode, i)) {
+			case FORM_CONSTANT:
+				cf->operands[i] = ((code[i + 1].type & MASK_DATA_TYPE)
+						== CODE_STRING
+						? string_constant(cf, code[i + 1].string)
+						: int_constant(cf, code[i + 1].num));
+				break;
+			case FORM_MEMBER:
+				cf->operands[i] = reference_constant(cf, code[i].code,
+						code[i + 1].string);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/**
+ * Lays out the code of a method, by finding the offset of every instruction
+ * and label, until every near branch reaches its label.
+ *
+ * @param[in,out] cf    the class file.
+ * @param[in]     code  the code of the method.
+ * @param[in]     ncode the number of code entries.
+ * @return the length of the code, in bytes.
+ */
+static unsigned int lay_out(ClassFile *cf, const Code *code, int ncode)
+{
+	unsigned int pos;
+	long delta;
+	Boolean changed;
+	int i;
+
+	do {
+		pos = 0;
+		for (i = 0; i < ncode; i++) {
+			if (IS_LABEL(code[i])) {
+				cf->labels[code[i].label - cf->base] = pos;
+			} else if (IS_INSTRUCTION(code[i])) {
+				cf->offsets[i] = pos;
+				pos += instruction_size(cf, code, ncode, i);
+			}
+		}
+
+		/* making a branch far only ever lengthens the code, so that the
+		 * branches that were far stay far, and this comes to an end */
+		changed = FALSE;
+		for (i = 0; i < ncode; i++) {
+			if (IS_INSTRUCTION(code[i]) && !cf->far[i]
+					&& get_form(code, ncode, i) == FORM_BRANCH) {
+				delta = (long) cf->labels[code[i + 1].label - cf->base]
+					- (long) cf->offsets[i];
+				if (delta < SHRT_MIN || delta > SHRT_MAX) {
+					cf->far[i] = TRUE;
+					changed = TRUE;
+				}
+			}
+		}
+	} while (changed);
+
+	return pos;
+}
+
+/**
+ * Returns the number of bytes that an instruction takes up.
+ *
+ * @param[in] cf    the class file.
+ * @param[in] code  the code.
+ * @param[in] ncode the number of code entries.
+ * @param[in] i     the index of the instruction.
+ * @return the size of the instruction.
+ */
+static unsigned int instruction_size(const ClassFile *cf, const Code *code,
+		int ncode, int i)
+{
+	switch (get_form(code, ncode, i)) {
+		case FORM_LOCAL:
+			if (code[i + 1].num <= MAX_SHORT_LOCAL) {
+				return 1;
+			}
+			return (code[i + 1].num > UCHAR_MAX ? 4 : 2);
+		case FORM_INCREMENT:
+			return (code[i + 1].num > UCHAR_MAX || code[i + 2].num < SCHAR_MIN
+					|| code[i + 2].num > SCHAR_MAX ? 6 : 3);
+		case FORM_PUSH:
+			if (code[i + 1].num >= -1 && code[i + 1].num <= 5) {
+				return 1;
+			}
+			return (code[i + 1].num >= SCHAR_MIN && code[i + 1].num <= SCHAR_MAX
+					? 2 : 3);
+		case FORM_CONSTANT:
+			return (cf->operands[i] > UCHAR_MAX ? 3 : 2);
+		case FORM_MEMBER:
+			return 3;
+		case FORM_TYPE:
+			return 2;
+		case FORM_BRANCH:
+			if (!cf->far[i]) {
+				return 3;
+			}
+			return (code[i].code == JVM_GOTO ? 5 : 8);
+		default:
+			return 1;
+	}
+}
+
+/**
+ * Encodes an instruction of the code of a method, which has been laid out.
+ *
+ * @param[in,out] cf    the class file.
+ * @param[in]     code  the code.
+ * @param[in]     ncode the number of code entries.
+ * @param[in]     i     the index of the instruction.
+ */
+static void encode(ClassFile *cf, const Code *code, int ncode, int i)
+{
+	unsigned int opcode;
+	long delta;
+
+	opcode = opcodes[code[i].code];
+	switch (get_form(code, ncode, i)) {
+		case FORM_LOCAL:
+			if (code[i + 1].num <= MAX_SHORT_LOCAL) {
+				op(cf, short_forms[code[i].code] + code[i + 1].num);
+			} else if (code[i + 1].num > UCHAR_MAX) {
+				op(cf, OP_WIDE);
+				op_index(cf, opcode, (unsigned int) code[i + 1].num);
+			} else {
+				op(cf, opcode);
+				put_u1(&cf->code, (unsigned int) code[i + 1].num);
+			}
+			break;
+		case FORM_INCREMENT:
+			if (instruction_size(cf, code, ncode, i) > 3) {
+				op(cf, OP_WIDE);
+				op_index(cf, opcode, (unsigned int) code[i + 1].num);
+				put_u2(&cf->code, (unsigned int) code[i + 2].num & MAX_U2);
+			} else {
+				op(cf, opcode);
+				put_u1(&cf->code, (unsigned int) code[i + 1].num);
+				put_u1(&cf->code, (unsigned int) code[i + 2].num & UCHAR_MAX);
+			}
+			break;
+		case FORM_PUSH:
+			op_push(cf, code[i + 1].num);
+			break;
+		case FORM_CONSTANT:
+			if (cf->operands[i] > UCHAR_MAX) {
+				op_index(cf, OP_LDC_W, cf->operands[i]);
+			} else {
+				op_ldc(cf, cf->operands[i]);
+			}
+			break;
+		case FORM_MEMBER:
+			op_index(cf, opcode, cf->operands[i]);
+			break;
+		case FORM_TYPE:
+			op(cf, opcode);
+			put_u1(&cf->code, code[i + 1].atype);
+			break;
+		case FORM_BRANCH:
+			delta = (long) cf->labels[code[i + 1].label - cf->base]
+				- (long) cf->offsets[i];
+			if (!cf->far[i]) {
+				op_index(cf, opcode, (unsigned int) delta & MAX_U2);
+			} else if (code[i].code == JVM_GOTO) {
+				op(cf, OP_GOTO_W);
+				put_u4(&cf->code, (unsigned long) delta);
+			} else {
+				/* the conditional branches come in pairs of opposites, of
+				 * which the first has an odd opcode; the opposite branch skips
+				 * itself and the goto_w */
+				op_index(cf, ((opcode - OP_IFEQ) ^ 1) + OP_IFEQ, 8);
+				op(cf, OP_GOTO_W);
+				put_u4(&cf->code, (unsigned long) (delta - 3));
+			}
+			break;
+		default:
+			op(cf, opcode);
+			break;
+	}
+}
+
+/**
+ * Encodes an instruction without operands.
+ *
+ * @param[in,out] cf     the class file.
+ * @param[in]     opcode the opcode.
+ */
+static void op(ClassFile *cf, unsigned int opcode)
+{
+	put_u1(&cf->code, opcode);
+}
+
+/**
+ * Encodes an instruction with a two-byte operand, such as a pool index or a
+ * branch offset.
+ *
+ * @param[in,out] cf     the class file.
+ * @param[in]     opcode the opcode.
+ * @param[in]     index  the operand.
+ */
+static void op_index(ClassFile *cf, unsigned int opcode, unsigned int index)
+{
+	put_u1(&cf->code, opcode);
+	put_u2(&cf->code, index);
+}
+
+/**
+ * Encodes an <code>ldc</code> of one of the first 256 constants in the pool.
+ *
+ * @param[in,out] cf    the class file.
+ * @param[in]     index the pool index of the constant.
+ */
+static void op_ldc(ClassFile *cf, unsigned int index)
+{
+	assert(index <= UCHAR_MAX);
+	put_u1(&cf->code, OP_LDC);
+	put_u1(&cf->code, index);
+}
+
+/**
+ * Encodes a push of an integer constant that fits in two bytes, in the
+ * shortest form that takes it.
+ *
+ * @param[in,out] cf the class file.
+ * @param[in]     n  the constant.
+ */
+static void op_push(ClassFile *cf, int n)
+{
+	assert(n >= SHRT_MIN && n <= SHRT_MAX);
+	if (n >= -1 && n <= 5) {
+		put_u1(&cf->code, OP_ICONST_0 + n);
+	} else if (n >= SCHAR_MIN && n <= SCHAR_MAX) {
+		put_u1(&cf->code, OP_BIPUSH);
+		put_u1(&cf->code, (unsigned int) n & UCHAR_MAX);
+	} else {
+		op_index(cf, OP_SIPUSH, (unsigned int) n & MAX_U2);
+	}
+}
+
+/* --- constant pool -------------------------------------------------------- */
+
+/**
+ * Finds a constant in the pool, by its tag and the text of up to three parts,
+ * or enters it with only its tag written, leaving the caller to write the
+ * rest of the entry.  The parts are separated by spaces, which names and
+ * descriptors do not contain, in the key of the constant.
+ *
+ * @param[in,out] cf    the class file.
+ * @param[in]     tag   the tag of the constant.
+ * @param[in]     a     the first part.
+ * @param[in]     b     the second part, or <code>NULL</code>.
+ * @param[in]     c     the third part, or <code>NULL</code>.
+ * @param[out]    found whether the constant was in the pool already.
+ * @return the pool index of the constant.
+ */
+static unsigned int find_constant(ClassFile *cf, ConstantTag tag,
+		const char *a, const char *b, const char *c, Boolean *found)
+{
+	char *key;
+	void *slot;
+	size_t n;
+	int status;
+
+	n = 1 + strlen(a) + (b ? 1 + strlen(b) : 0) + (c ? 1 + strlen(c) : 0);
+	key = emalloc(n + 1);
+	key[0] = (char) tag;
+	strcpy(key + 1, a);
+	if (b != NULL) {
+		strcat(key, " ");
+		strcat(key, b);
+	}
+	if (c != NULL) {
+		strcat(key, " ");
+		strcat(key, c);
+	}
+
+	status = ht_find_or_insert(cf->constants, key,
+			(void *) (uintptr_t) cf->npool, &slot);
+	if (status == HASH_TABLE_KEY_VALUE_PAIR_EXISTS) {
+		efree(key);
+		*found = TRUE;
+		return (unsigned int) (uintptr_t) slot;
+	} else if (status != EXIT_SUCCESS) {
+		eprintf("Constant pool could not be extended");
+	}
+	if (cf->npool >= MAX_U2) {
+		eprintf("too many constants for class '%s'", cf->name);
+	}
+
+	*found = FALSE;
+	put_u1(&cf->pool, tag);
+	return cf->npool++;
+}
+
+/**
+ * Returns the pool index of a string of modified UTF-8.  The strings that the
+ * compiler writes are printable ASCII, which is its own modified UTF-8.
+ *
+ * @param[in,out] cf the class file.
+ * @param[in]     s  the string.
+ * @param[in]     n  the length of the string.
+ * @return the pool index of the string.
+ */
+static unsigned int utf8_constant(ClassFile *cf, const char *s, size_t n)
+{
+	unsigned int index;
+	Boolean found;
+
+	if (n > MAX_U2) {
+		eprintf("string constant of %lu bytes is too long for a class file",
+				(unsigned long) n);
+	}
+	index = find_constant(cf, CONSTANT_UTF8, s, NULL, NULL, &found);
+	if (!found) {
+		put_u2(&cf->pool, (unsigned int) n);
+		put_bytes(&cf->pool, s, n);
+	}
+
+	return index;
+}
+
+/**
+ * Returns the pool index of an integer.
+ *
+ * @param[in,out] cf the class file.
+ * @param[in]     n  the integer.
+ * @return the pool index of the integer.
+ */
+static unsigned int int_constant(ClassFile *cf, int n)
+{
+	char text[sizeof(int) * CHAR_BIT];
+	unsigned int index;
+	Boolean found;
+
+	sprintf(text, "%d", n);
+	index = find_constant(cf, CONSTANT_INTEGER, text, NULL, NULL, &found);
+	if (!found) {
+		put_u4(&cf->pool, (unsigned long) (unsigned int) n);
+	}
+
+	return index;
+}
+
+/**
+ * Returns the pool index of a string, as written in the source, with the
+ * escape codes that the scanner lets through.
+ *
+ * @param[in,out] cf the class file.
+ * @param[in]     s  the string, with its escape codes.
+ * @return the pool index of the string.
+ */
+static unsigned int string_constant(ClassFile *cf, const char *s)
+{
+	char *text;
+	unsigned int index, utf8;
+	size_t i, n;
+	Boolean found;
+
+	text = emalloc(strlen(s) + 1);
+	for (i = n = 0; s[i] != '\0'; i++) {
+		if (s[i] == '\\') {
+			i++;
+			text[n++] = (s[i] == 'n' ? '\n' : s[i] == 't' ? '\t' : s[i]);
+		} else {
+			text[n++] = s[i];
+		}
+	}
+	text[n] = '\0';
+
+	utf8 = utf8_constant(cf, text, n);
+	index = find_constant(cf, CONSTANT_STRING, text, NULL, NULL, &found);
+	if (!found) {
+		put_u2(&cf->pool, utf8);
+	}
+	efree(text);
+
+	return index;
+}
+
+/**
+ * Returns the pool index of a class.
+ *
+ * @param[in,out] cf   the class file.
+ * @param[in]     name the internal name of the class.
+ * @return the pool index of the class.
+ */
+static unsigned int class_constant(ClassFile *cf, const char *name)
+{
+	unsigned int index, utf8;
+	Boolean found;
+
+	utf8 = utf8_constant(cf, name, strlen(name));
+	index = find_constant(cf, CONSTANT_CLASS, name, NULL, NULL, &found);
+	if (!found) {
+		put_u2(&cf->pool, utf8);
+	}
+
+	return index;
+}
+
+/**
+ * Returns the pool index of a field or method, along with its name and type.
+ *
+ * @param[in,out] cf         the class file.
+ * @param[in]     tag        the tag of a field or method reference.
+ * @param[in]     owner      the class of the member.
+ * @param[in]     name       the name of the member.
+ * @param[in]     descriptor the descriptor of the member.
+ * @return the pool index of the member.
+ */
+static unsigned int member_constant(ClassFile *cf, ConstantTag tag,
+		const char *owner, const char *name, const char *descriptor)
+{
+	unsigned int index, class_index, name_index, type_index, name_and_type;
+	Boolean found;
+
+	class_index = class_constant(cf, owner);
+	name_index = utf8_constant(cf, name, strlen(name));
+	type_index = utf8_constant(cf, descriptor, strlen(descriptor));
+	name_and_type = find_constant(cf, CONSTANT_NAME_AND_TYPE, name,
+			descriptor, NULL, &found);
+	if (!found) {
+		put_u2(&cf->pool, name_index);
+		put_u2(&cf->pool, type_index);
+	}
+	index = find_constant(cf, tag, owner, name, descriptor, &found);
+	if (!found) {
+		put_u2(&cf->pool, class_index);
+		put_u2(&cf->pool, name_and_type);
+	}
+
+	return index;
+}
+
+/**
+ * Returns the pool index of a reference in the code, which is written as
+ * Jasmin writes it: a field as <code>owner/name descriptor</code>, and a
+ * method as <code>owner/name(parameters)result</code>.
+ *
+ * @param[in,out] cf     the class file.
+ * @param[in]     opcode the instruction that refers to the member.
+ * @param[in]     ref    the reference.
+ * @return the pool index of the member.
+ */
+static unsigned int reference_constant(ClassFile *cf, Bytecode opcode,
+		const char *ref)
+{
+	const char *split, *name;
+	char *owner, *member;
+	unsigned int index;
+	Boolean field;
+
+	field = (opcode == JVM_GETSTATIC);
+	split = strchr(ref, (field ? ' ' : '('));
+	assert(split != NULL);
+	for (name = split; name > ref && name[-1] != '/'; name--)
+		;
+	assert(name > ref);
+
+	owner = emalloc(name - ref);
+	memcpy(owner, ref, name - ref - 1);
+	owner[name - ref - 1] = '\0';
+	member = emalloc(split - name + 1);
+	memcpy(member, name, split - name);
+	member[split - name] = '\0';
+
+	index = member_constant(cf,
+			(field ? CONSTANT_FIELDREF : CONSTANT_METHODREF), owner, member,
+			(field ? split + 1 : split));
+	efree(owner);
+	efree(member);
+
+	return index;
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+static void put_bytes(ByteBuffer *b, const void *p, size_t n)
+{
+	if (b->len + n > b->cap) {
+		while (b->len + n > b->cap) {
+			b->cap = (b->cap ? b->cap * 2 : INITIAL_BYTES);
+		}
+		b->bytes = erealloc(b->bytes, b->cap);
+	}
+	memcpy(b->bytes + b->len, p, n);
+	b->len += n;
+}
+
+static void put_u1(ByteBuffer *b, unsigned int n)
+{
+	unsigned char u[1];
+
+	u[0] = n & 0xff;
+	put_bytes(b, u, 1);
+}
+
+static void put_u2(ByteBuffer *b, unsigned int n)
+{
+	unsigned char u[2];
+
+	u[0] = (n >> 8) & 0xff;
+	u[1] = n & 0xff;
+	put_bytes(b, u, 2);
+}
+
+static void put_u4(ByteBuffer *b, unsigned long n)
+{
+	unsigned char u[4];
+
+	u[0] = (n >> 24) & 0xff;
+	u[1] = (n >> 16) & 0xff;
+	u[2] = (n >> 8) & 0xff;
+	u[3] = n & 0xff;
+	put_bytes(b, u, 4);
+}
+
+static void output_u2(FILE *file, unsigned int n)
+{
+	fputc((n >> 8) & 0xff, file);
+	fputc(n & 0xff, file);
+}
+
+static void output_u4(FILE *file, unsigned long n)
+{
+	output_u2(file, (n >> 16) & MAX_U2);
+	output_u2(file, n & MAX_U2);
+}
+
+static unsigned int hash_key(void *key, unsigned int size)
+{
+	unsigned char *s = (unsigned char *) key;
+	unsigned int hash;
+
+	for (hash = 0; *s; s++) {
+		hash = (hash << 5) + (hash >> 27) + *s;
+	}
+	return (hash % size);
+}
+
+static int cmp_key(void *v1, void *v2)
+{
+	return strcmp((char *) v1, (char *) v2);
+}
+
+static void keep_index(void *p)
+{
+	(void) p;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file    classfile.h
+ * @brief   A writer of class files in the binary format of the Java virtual
+ *          machine.
+ *
+ * The writer takes the place of the Jasmin assembler.  A class is built up in
+ * memory: its constant pool, its fields, and its methods, of which the code is
+ * taken from the code arrays of the code generator, and it is then written out
+ * in one go.  Every constant is entered in the pool once, however often it is
+ * referred to, by looking up its key in a hash table.
+ *
+ * The labels of a method are resolved to offsets in its code.  A branch is
+ * first assumed to be near, and one that turns out to be out of reach is made
+ * far, after which the offsets are laid out again, until every branch reaches.
+ * A far <code>goto</code> becomes a <code>goto_w</code>, and a far conditional
+ * branch becomes the opposite branch around a <code>goto_w</code>.  Likewise,
+ * <code>ldc</code> becomes <code>ldc_w</code> for a constant beyond the first
+ * 256 of the pool, and a local variable beyond the first 256 is reached with
+ * the <code>wide</code> form of its instruction.  The other way round, an
+ * integer constant that fits in two bytes is pushed by <code>iconst</code>,
+ * <code>bipush</code>, or <code>sipush</code>, without entering it in the
+ * pool, and the first four local variables are reached by the one-byte forms
+ * of their instructions.
+ *
+ * The class file has the version that Jasmin writes by default, which is old
+ * enough that the virtual machine verifies the code without stack maps.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef CLASSFILE_H
+#define CLASSFILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "codegen.h"
+#include "hashtable.h"
+
+/** a growing array of bytes */
+typedef struct {
+	unsigned char *bytes;     /**< the bytes                               */
+	size_t         len;       /**< the number of bytes                     */
+	size_t         cap;       /**< the number of bytes allocated           */
+} ByteBuffer;
+
+/** a class file under construction, with the arrays to lay out code in */
+typedef struct {
+	const char    *name;        /**< the name of the class                   */
+	unsigned int   this_class;  /**< the pool index of the class             */
+	unsigned int   super_class; /**< the pool index of its superclass        */
+	ByteBuffer     pool;        /**< the constant pool entries               */
+	unsigned int   npool;       /**< the next index in the constant pool     */
+	HashTab       *constants;   /**< the pool index of each constant, by key */
+	ByteBuffer     fields;      /**< the fields                              */
+	unsigned int   nfields;     /**< the number of fields                    */
+	ByteBuffer     methods;     /**< the methods                             */
+	unsigned int   nmethods;    /**< the number of methods                   */
+	ByteBuffer     code;        /**< the code of the current method          */
+	unsigned int  *offsets;     /**< the offset of each code entry           */
+	unsigned int  *operands;    /**< the pool index of each operand          */
+	Boolean       *far;         /**< whether each branch is far              */
+	int            capacity;    /**< the number of code entries allocated    */
+	unsigned int  *labels;      /**< the offset of each label from the first */
+	Label          base;        /**< the first label of the method           */
+	unsigned int   nlabels;     /**< the number of labels allocated          */
+} ClassFile;
+
+/**
+ * Initialises a class file, with the fields and methods that every compiled
+ * program has: the static initialiser that sets up the scanner for standard
+ * input, the constructor, and the routines that read integers and booleans.
+ *
+ * @param[out]  cf
+ *     the class file
+ * @param[in]   name
+ *     the name of the class, which must outlive the class file
+ */
+void init_class_file(ClassFile *cf, const char *name);
+
+/**
+ * Adds a public static method to a class file.
+ *
+ * @param[in,out] cf
+ *     the class file
+ * @param[in]   name
+ *     the name of the method
+ * @param[in]   descriptor
+ *     the descriptor of the method
+ * @param[in]   code
+ *     the code of the method
+ * @param[in]   ncode
+ *     the number of code entries
+ * @param[in]   max_stack
+ *     the maximum depth of the operand stack
+ * @param[in]   max_locals
+ *     the width of the local variables
+ */
+void add_method(ClassFile *cf, const char *name, const char *descriptor,
+		const struct code_s *code, int ncode, int max_stack, int max_locals);
+
+/**
+ * Writes a class file to a stream.
+ *
+ * @param[in]   cf
+ *     the class file
+ * @param[in]   file
+ *     the stream to write to
+ */
+void output_class(const ClassFile *cf, FILE *file);
+
+/**
+ * Releases the resources held by a class file.
+ *
+ * @param[in,out] cf
+ *     the class file
+ */
+void release_class_file(ClassFile *cf);
+
+#endif /* CLASSFILE_H */
@@ -0,0 +1,46 @@
+/**
+ * @file    code.h
+ * @brief   The layout of generated code, shared by the code generator and the
+ *          units that analyse the code.
+ *
+ * The code of a subroutine is an array of entries.  An instruction entry is
+ * followed by an entry for each of its operands, and a label entry marks the
+ * position that a label stands for.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef CODE_H
+#define CODE_H
+
+#include "codegen.h"
+#include "jvm.h"
+
+typedef enum {
+	CODE_LABEL       = 0x0001,
+	CODE_INSTRUCTION = 0x0002,
+	CODE_OPERAND     = 0x0004,
+	MASK_TYPE        = 0x000f,
+	CODE_INTEGER     = 0x0010,
+	CODE_ARRAY_TYPE  = 0x0020,
+	CODE_STRING      = 0x0040,
+	CODE_REFERENCE   = 0x0080,
+	MASK_DATA_TYPE   = 0x00f0,
+	CODE_ALLOCATED   = 0x0100,
+	MASK_ALLOCATION  = 0x0f00
+} CodeType;
+
+typedef struct code_s Code;
+struct code_s {
+	CodeType type;
+	union {
+		JVMatype  atype;
+		Bytecode  code;
+		Label     label;
+		int       num;
+		char     *string;
+	};
+};
+
+#endif /* CODE_H */
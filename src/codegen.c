@@ -7,6 +7,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,44 +15,20 @@
 #include <sys/wait.h>
 #include <unistd.h>
 #include "boolean.h"
+#include "classfile.h"
+#include "code.h"
 #include "codegen.h"
 #include "error.h"
 #include "valtypes.h"
 
 /* --- type definitions and constants --------------------------------------- */
 
-typedef enum {
-	CODE_LABEL       = 0x0001,
-	CODE_INSTRUCTION = 0x0002,
-	CODE_OPERAND     = 0x0004,
-	MASK_TYPE        = 0x000f,
-	CODE_INTEGER     = 0x0010,
-	CODE_ARRAY_TYPE  = 0x0020,
-	CODE_STRING      = 0x0040,
-	CODE_REFERENCE   = 0x0080,
-	MASK_DATA_TYPE   = 0x00f0,
-	CODE_ALLOCATED   = 0x0100,
-	MASK_ALLOCATION  = 0x0f00
-} CodeType;
-
 typedef struct {
 	const char *instr;
 	short       pop;
 	short       push;
 } BC;
 
-typedef struct {
-	CodeType type;
-	union {
-		JVMatype  atype;
-		Bytecode  code;
-		Label     label;
-		int       num;
-		char     *string;
-	};
-} Code;
-
-typedef struct body_s Body;
 struct body_s {
 	char   *name;
 	IDprop *idprop;
@@ -59,6 +36,7 @@ struct body_s {
 	int     ip;
 	int     max_stack_depth;
 	int     variables_width;
+	char   *notes[NNOTES];
 	Body   *next;
 	Body   *prev;
 };
@@ -151,8 +129,6 @@ char  ref_print_boolean[] = "java/io/PrintStream/print(Z)V";
 char  ref_print_integer[] = "java/io/PrintStream/print(I)V";
 char  ref_print_stream[]  = "java/lang/System/out Ljava/io/PrintStream;";
 char  ref_print_string[]  = "java/io/PrintStream/print(Ljava/lang/String;)V";
-char *ref_read_boolean;   /* must be set in set_class_name */
-char *ref_read_integer;   /* must be set in set_class_name */
 
 #define REF_READ_BOOLEAN "/readBoolean()Z"
 #define REF_READ_INTEGER "/readInt()I"
@@ -171,17 +147,19 @@ static BC instruction_set[] = {
 	{ "iastore",       3, 0 },
 	{ "idiv",          2, 1 },
 	{ "ifeq",          1, 0 },
+	{ "ifne",          1, 0 },
 	{ "if_icmpeq",     2, 0 },
 	{ "if_icmpge",     2, 0 },
 	{ "if_icmpgt",     2, 0 },
 	{ "if_icmple",     2, 0 },
 	{ "if_icmplt",     2, 0 },
 	{ "if_icmpne",     2, 0 },
+	{ "iinc",          0, 0 },
 	{ "iload",         0, 1 },
 	{ "imul",          2, 1 },
 	{ "ineg",          1, 1 },
-	{ "invokestatic",  0, 1 },
-	{ "invokevirtual", 0, 0 },
+	{ "invokestatic",  0, 0 },  /* and the effect of its descriptor */
+	{ "invokevirtual", 1, 0 },  /* and the effect of its descriptor */
 	{ "ior",           2, 1 },
 	{ "istore",        1, 0 },
 	{ "isub",          2, 1 },
@@ -190,6 +168,8 @@ static BC instruction_set[] = {
 	{ "ixor",          2, 1 },
 	{ "ldc",           0, 1 },
 	{ "newarray",      1, 1 },
+	{ "pop",           1, 0 },
+	{ "pop2",          2, 0 },
 	{ "return",        0, 0 },
 	{ "swap",          2, 2 }
 };
@@ -200,88 +180,158 @@ static const char *java_types[] = {
 
 #define NBYTECODES   (sizeof(instruction_set) / sizeof(BC))
 #define INITIAL_SIZE 1024
-#define JASM_EXT     ".jasmin"
-
-static char   *class_name;    /**< the class name                             */
-static char   *function_name; /**< the name of current function               */
-static char   *jasm_name;     /**< the jasmin file name                       */
-static int     code_size;     /**< the current code array size                */
-static int     ip;            /**< the instruction pointer                    */
-static Body   *bodies;        /**< list of function bodies                    */
-static Code   *code;          /**< the generated code                         */
-static IDprop *idprop;        /**< id properties of the current function      */
-
-int stack_depth, max_stack_depth;
 
 /* --- function prototypes -------------------------------------------------- */
 
-static void ensure_space(int num_instr);
-static void adjust_stack(BC *instr);
+static void ensure_space(CodeGen *cg, int num_instr);
 
 /* --- code generation interface -------------------------------------------- */
 
-void init_code_generation(void)
+void init_code_generation(CodeGen *cg)
 {
-	bodies = NULL;
+	int i;
+
+	cg->class_name = NULL;
+	cg->ref_read_boolean = NULL;
+	cg->ref_read_integer = NULL;
+	cg->shared = FALSE;
+	cg->bodies = NULL;
+	cg->function_name = NULL;
+	cg->idprop = NULL;
+	cg->code = NULL;
+	cg->code_size = cg->ip = 0;
+	cg->max_stack_depth = 0;
+	cg->next_label = 1;
+	for (i = 0; i < NNOTES; i++) {
+		cg->notes[i] = NULL;
+	}
 }
 
-void init_subroutine_codegen(const char *name, IDprop *p)
+void share_code_generation(CodeGen *cg, const CodeGen *owner)
 {
-	max_stack_depth = stack_depth = 0;
-	ip = 0;
-	code = emalloc(sizeof(Code) * INITIAL_SIZE);
-	code_size = INITIAL_SIZE;
-	function_name = estrdup(name);
-	idprop = p;
+	init_code_generation(cg);
+	cg->class_name = owner->class_name;
+	cg->ref_read_boolean = owner->ref_read_boolean;
+	cg->ref_read_integer = owner->ref_read_integer;
+	cg->shared = TRUE;
 }
 
-void close_subroutine_codegen(int varwidth)
+void init_subroutine_codegen(CodeGen *cg, const char *name, IDprop *p)
+{
+	cg->max_stack_depth = 0;
+	cg->ip = 0;
+	cg->code = emalloc(sizeof(Code) * INITIAL_SIZE);
+	cg->code_size = INITIAL_SIZE;
+	cg->function_name = estrdup(name);
+	cg->idprop = p;
+}
+
+void close_subroutine_codegen(CodeGen *cg, int varwidth)
 {
 	Body *body;
+	int i;
 
 	body = emalloc(sizeof(Body));
 
 	/* populate new body */
-	body->name = function_name;
-	body->idprop = idprop;
-	body->code = code;
-	body->ip = ip;
-	body->max_stack_depth = max_stack_depth;
+	body->name = cg->function_name;
+	body->idprop = cg->idprop;
+	body->code = cg->code;
+	body->ip = cg->ip;
+	body->max_stack_depth = cg->max_stack_depth;
 	body->variables_width = varwidth;
+	for (i = 0; i < NNOTES; i++) {
+		body->notes[i] = cg->notes[i];
+		cg->notes[i] = NULL;
+	}
 
 	/* link into list */
-	if (bodies == NULL) {
-		bodies = body;
-		bodies->next = NULL;
-		bodies->prev = NULL;
+	if (cg->bodies == NULL) {
+		cg->bodies = body;
+		cg->bodies->next = NULL;
+		cg->bodies->prev = NULL;
 	} else {
-		bodies->prev = body;
-		body->next = bodies;
-		bodies = body;
+		cg->bodies->prev = body;
+		body->next = cg->bodies;
+		cg->bodies = body;
 	}
 }
 
-void set_class_name(char *cname)
+void set_subroutine_code(CodeGen *cg, struct code_s *code, int ip,
+		int max_stack_depth, unsigned int nlabels)
 {
-	size_t class_name_len;
+	int i;
+
+	for (i = 0; i < cg->ip; i++) {
+		if (cg->code[i].type & CODE_ALLOCATED) {
+			efree(cg->code[i].string);
+		}
+	}
+	efree(cg->code);
+	for (i = 0; i < ip; i++) {
+		if (code[i].type & CODE_LABEL) {
+			code[i].label += cg->next_label;
+		}
+	}
+	cg->next_label += nlabels;
+	cg->code = code;
+	cg->code_size = cg->ip = ip;
+	cg->max_stack_depth = max_stack_depth;
+}
+
+const struct code_s *get_closed_code(const CodeGen *cg, int *ip,
+		int *max_stack_depth, int *variables_width)
+{
+	*ip = cg->bodies->ip;
+	*max_stack_depth = cg->bodies->max_stack_depth;
+	*variables_width = cg->bodies->variables_width;
+
+	return cg->bodies->code;
+}
+
+Body *detach_bodies(CodeGen *cg)
+{
+	Body *list;
+
+	list = cg->bodies;
+	cg->bodies = NULL;
+
+	return list;
+}
+
+void attach_bodies(CodeGen *cg, Body *list)
+{
+	Body *last;
+
+	if (list == NULL) {
+		return;
+	}
+	for (last = list; last->next; last = last->next)
+		;
+	last->next = cg->bodies;
+	if (cg->bodies != NULL) {
+		cg->bodies->prev = last;
+	}
+	cg->bodies = list;
+}
 
-	class_name = estrdup(cname);
-	class_name_len = strlen(class_name);
+void set_class_name(CodeGen *cg, char *cname)
+{
+	size_t class_name_len;
 
-	jasm_name = emalloc(class_name_len + sizeof(JASM_EXT));
-	strcpy(jasm_name, class_name);
-	strncat(jasm_name, JASM_EXT, sizeof(JASM_EXT));
+	cg->class_name = estrdup(cname);
+	class_name_len = strlen(cg->class_name);
 
-	ref_read_boolean = emalloc(class_name_len + sizeof(REF_READ_BOOLEAN));
-	strcpy(ref_read_boolean, class_name);
-	strncat(ref_read_boolean, REF_READ_BOOLEAN, sizeof(REF_READ_BOOLEAN));
+	cg->ref_read_boolean = emalloc(class_name_len + sizeof(REF_READ_BOOLEAN));
+	strcpy(cg->ref_read_boolean, cg->class_name);
+	strncat(cg->ref_read_boolean, REF_READ_BOOLEAN, sizeof(REF_READ_BOOLEAN));
 
-	ref_read_integer = emalloc(class_name_len + sizeof(REF_READ_INTEGER));
-	strcpy(ref_read_integer, class_name);
-	strncat(ref_read_integer, REF_READ_INTEGER, sizeof(REF_READ_INTEGER));
+	cg->ref_read_integer = emalloc(class_name_len + sizeof(REF_READ_INTEGER));
+	strcpy(cg->ref_read_integer, cg->class_name);
+	strncat(cg->ref_read_integer, REF_READ_INTEGER, sizeof(REF_READ_INTEGER));
 }
 
-void assemble(const char *jasmin_path)
+void assemble(const char *jasmin_path, const char *jasm_name)
 {
 	int status;
 	pid_t pid;
@@ -306,48 +356,63 @@ void assemble(const char *jasmin_path)
 	}
 }
 
-void gen_1(Bytecode opcode)
+void gen_1(CodeGen *cg, Bytecode opcode)
 {
-	ensure_space(1);
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = opcode;
-	adjust_stack(&instruction_set[opcode]);
+	ensure_space(cg, 1);
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = opcode;
 }
 
-void gen_2(Bytecode opcode, int operand)
+void gen_2(CodeGen *cg, Bytecode opcode, int operand)
 {
-	ensure_space(2);
+	ensure_space(cg, 2);
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = opcode;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = opcode;
 
-	code[ip].type = CODE_OPERAND | CODE_INTEGER;
-	code[ip++].num = operand;
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_INTEGER;
+	cg->code[cg->ip++].num = operand;
+}
 
-	adjust_stack(&instruction_set[opcode]);
+void gen_3(CodeGen *cg, Bytecode opcode, int operand1, int operand2)
+{
+	ensure_space(cg, 3);
+
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = opcode;
+
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_INTEGER;
+	cg->code[cg->ip++].num = operand1;
+
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_INTEGER;
+	cg->code[cg->ip++].num = operand2;
 }
 
-void gen_call(char *fname, IDprop *idprop)
+void gen_call(CodeGen *cg, char *fname, IDprop *idprop)
 {
 	char *fpath;
+	const char *owner;
 	unsigned int i;
 
-	ensure_space(2);
+	ensure_space(cg, 2);
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_INVOKESTATIC;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_INVOKESTATIC;
+
+	/* routines imported from another module live in that module's class */
+	owner = (idprop->module ? idprop->module : cg->class_name);
 
 	/* 6 + 2 * idprop->nparams:
 	 *  -- 1 for '\0'
 	 *  -- 2 for '(' and ')' of parameter list
-	 *  -- 1 for '.' separating class from method name
+	 *  -- 1 for '/' separating class from method name
 	 *  -- 2 for return type, including possibility of array type
 	 * the multiplier of 2 includes the possibilities of array types
 	 */
-	fpath = emalloc(strlen(class_name) + strlen(fname) +
+	fpath = emalloc(strlen(owner) + strlen(fname) +
 			(6 + 2 * idprop->nparams) * sizeof(char));
-	strcpy(fpath, class_name);
-	strcat(fpath, ".");
+	strcpy(fpath, owner);
+	strcat(fpath, "/");
 	strcat(fpath, fname);
 	strcat(fpath, "(");
 	for (i = 0; i < idprop->nparams; i++) {
@@ -366,145 +431,129 @@ void gen_call(char *fname, IDprop *idprop)
 		strcat(fpath, "I");
 	}
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE | CODE_ALLOCATED;
-	code[ip++].string = fpath;
-
-	adjust_stack(&instruction_set[JVM_INVOKESTATIC]);
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_REFERENCE | CODE_ALLOCATED;
+	cg->code[cg->ip++].string = fpath;
 }
 
-void gen_cmp(Bytecode opcode)
+void gen_cmp(CodeGen *cg, Bytecode opcode)
 {
 	int l1, l2;
 
-	/* unnecessary to adjust stack depth or to ensure space, since both are
-	 * handled in the other gen functions
+	/* unnecessary to ensure space, since that is handled in the other gen
+	 * functions
 	 */
-	l1 = get_label();
-	l2 = get_label();
-	gen_2_label(opcode, l1);
-	gen_2(JVM_LDC, FALSE);
-	gen_2_label(JVM_GOTO, l2);
-	gen_label(l1);
-	gen_2(JVM_LDC, TRUE);
-	gen_label(l2);
+	l1 = get_label(cg);
+	l2 = get_label(cg);
+	gen_2_label(cg, opcode, l1);
+	gen_2(cg, JVM_LDC, FALSE);
+	gen_2_label(cg, JVM_GOTO, l2);
+	gen_label(cg, l1);
+	gen_2(cg, JVM_LDC, TRUE);
+	gen_label(cg, l2);
 }
 
-void gen_label(Label label)
+void gen_label(CodeGen *cg, Label label)
 {
-	ensure_space(1);
+	ensure_space(cg, 1);
 
-	code[ip].type = CODE_LABEL;
-	code[ip++].label = label;
+	cg->code[cg->ip].type = CODE_LABEL;
+	cg->code[cg->ip++].label = label;
 }
 
-void gen_2_label(Bytecode opcode, Label label)
+void gen_2_label(CodeGen *cg, Bytecode opcode, Label label)
 {
-	ensure_space(2);
+	ensure_space(cg, 2);
 	
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = opcode;
-
-	code[ip].type = CODE_LABEL | CODE_OPERAND;
-	code[ip++].label = label;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = opcode;
 
-	adjust_stack(&instruction_set[opcode]);
+	cg->code[cg->ip].type = CODE_LABEL | CODE_OPERAND;
+	cg->code[cg->ip++].label = label;
 }
 
-void gen_newarray(JVMatype atype)
+void gen_newarray(CodeGen *cg, JVMatype atype)
 {
-	ensure_space(2);
+	ensure_space(cg, 2);
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_NEWARRAY;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_NEWARRAY;
 
-	code[ip].type = CODE_OPERAND | CODE_ARRAY_TYPE;
-	code[ip++].atype = atype;
-
-	adjust_stack(&instruction_set[JVM_NEWARRAY]);
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_ARRAY_TYPE;
+	cg->code[cg->ip++].atype = atype;
 }
 
-void gen_print(ValType type)
+void gen_print(CodeGen *cg, ValType type)
 {
-	ensure_space(5);
+	ensure_space(cg, 5);
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_GETSTATIC;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_GETSTATIC;
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	code[ip++].string = ref_print_stream;
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_REFERENCE;
+	cg->code[cg->ip++].string = ref_print_stream;
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_SWAP;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_SWAP;
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_INVOKEVIRTUAL;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_INVOKEVIRTUAL;
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_REFERENCE;
 	if (IS_CALLABLE_TYPE(type)) {
 		SET_RETURN_TYPE(type);
 	}
 	if (type == TYPE_BOOLEAN) {
-		code[ip++].string = ref_print_boolean;
+		cg->code[cg->ip++].string = ref_print_boolean;
 	} else if (type == TYPE_INTEGER) {
-		code[ip++].string = ref_print_integer;
+		cg->code[cg->ip++].string = ref_print_integer;
 	} else {
 		assert(FALSE);
 	}
-
-	adjust_stack(&instruction_set[JVM_GETSTATIC]);
-	adjust_stack(&instruction_set[JVM_SWAP]);
-	adjust_stack(&instruction_set[JVM_INVOKEVIRTUAL]);
 }
 
-void gen_print_string(char *string)
+void gen_print_string(CodeGen *cg, char *string)
 {
-	ensure_space(6);
+	ensure_space(cg, 6);
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_GETSTATIC;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_GETSTATIC;
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	code[ip++].string = ref_print_stream;
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_REFERENCE;
+	cg->code[cg->ip++].string = ref_print_stream;
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_LDC;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_LDC;
 
-	code[ip].type = CODE_OPERAND | CODE_STRING | CODE_ALLOCATED;
-	code[ip++].string = string;
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_STRING | CODE_ALLOCATED;
+	cg->code[cg->ip++].string = string;
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_INVOKEVIRTUAL;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_INVOKEVIRTUAL;
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
-	code[ip++].string = ref_print_string;
-
-	adjust_stack(&instruction_set[JVM_GETSTATIC]);
-	adjust_stack(&instruction_set[JVM_LDC]);
-	adjust_stack(&instruction_set[JVM_INVOKEVIRTUAL]);
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_REFERENCE;
+	cg->code[cg->ip++].string = ref_print_string;
 }
 
-void gen_read(ValType type)
+void gen_read(CodeGen *cg, ValType type)
 {
-	ensure_space(2);
+	ensure_space(cg, 2);
 
-	code[ip].type = CODE_INSTRUCTION;
-	code[ip++].code = JVM_INVOKESTATIC;
+	cg->code[cg->ip].type = CODE_INSTRUCTION;
+	cg->code[cg->ip++].code = JVM_INVOKESTATIC;
 
-	code[ip].type = CODE_OPERAND | CODE_REFERENCE;
+	cg->code[cg->ip].type = CODE_OPERAND | CODE_REFERENCE;
 	if (type == TYPE_BOOLEAN) {
-		code[ip++].string = ref_read_boolean;
+		cg->code[cg->ip++].string = cg->ref_read_boolean;
 	} else if (type == TYPE_INTEGER) {
-		code[ip++].string = ref_read_integer;
+		cg->code[cg->ip++].string = cg->ref_read_integer;
 	} else {
 		assert(FALSE);
 	}
-
-	adjust_stack(&instruction_set[JVM_INVOKESTATIC]);
 }
 
-Label get_label(void) {
-	static Label label = 1;
-	return label++;
+Label get_label(CodeGen *cg)
+{
+	return cg->next_label++;
 }
 
 const char *get_opcode_string(Bytecode opcode)
@@ -516,66 +565,142 @@ const char *get_opcode_string(Bytecode opcode)
 	}
 }
 
+void get_stack_effect(const struct code_s *code, int *pop, int *push)
+{
+	const char *d;
+
+	*pop = instruction_set[code->code].pop;
+	*push = instruction_set[code->code].push;
+	if (code->code != JVM_INVOKESTATIC && code->code != JVM_INVOKEVIRTUAL) {
+		return;
+	}
+
+	/* every parameter and result is an int, a boolean, or a reference, and
+	 * so takes up one entry of the stack
+	 */
+	d = strchr(code[1].string, '(') + 1;
+	for (; *d != ')'; d++) {
+		while (*d == '[') {
+			d++;
+		}
+		if (*d == 'L') {
+			d = strchr(d, ';');
+		}
+		(*pop)++;
+	}
+	*push += (d[1] != 'V');
+}
+
+const char *get_atype_string(JVMatype atype)
+{
+	if (atype >= T_BOOLEAN && atype <= T_LONG) {
+		return java_types[atype - T_BOOLEAN];
+	} else {
+		return "INVALID TYPE";
+	}
+}
+
 /* --- code dumping --------------------------------------------------------- */
 
-static void dump_code(FILE *file);
+static char *make_descriptor(const Body *b);
 static void dump_method(FILE *file, Body *b);
+static Boolean dump_short_form(FILE *file, const Code *c);
 static void dump_preamble(FILE *file, char *name);
 
-void list_code(void)
+void list_code(CodeGen *cg)
+{
+	write_code(cg, stdout);
+}
+
+void set_note(CodeGen *cg, NoteKind kind, char *text)
 {
-	dump_code(stdout);
+	efree(cg->notes[kind]);
+	cg->notes[kind] = text;
+}
+
+void write_notes(CodeGen *cg, NoteKind kind, FILE *file)
+{
+	Body *b;
+
+	for (b = cg->bodies; b; b = b->next) {
+		if (b->notes[kind] != NULL) {
+			fputs(b->notes[kind], file);
+		}
+	}
 }
 
-void dump_code(FILE *obj_file)
+void write_code(CodeGen *cg, FILE *obj_file)
 {
 	Body *b;
 
 	/* preamble */
-	dump_preamble(obj_file, class_name);
+	dump_preamble(obj_file, cg->class_name);
 
 	/* dump the methods */
-	for (b = bodies; b; b = b->next) {
+	for (b = cg->bodies; b; b = b->next) {
 		dump_method(obj_file, b);
 	}
 }
 
-void make_code_file(void)
+void write_class_file(CodeGen *cg, FILE *file)
 {
-	FILE *obj_file;
-
-	if ((obj_file = fopen(jasm_name, "w")) == NULL) {
-		eprintf("Could not open code file:");
+	ClassFile cf;
+	Body *b;
+	char *descriptor;
+
+	init_class_file(&cf, cg->class_name);
+	for (b = cg->bodies; b; b = b->next) {
+		descriptor = make_descriptor(b);
+		add_method(&cf, b->name, descriptor, b->code, b->ip,
+				b->max_stack_depth, b->variables_width);
+		efree(descriptor);
 	}
-
-	dump_code(obj_file);
-
-	fclose(obj_file);
+	output_class(&cf, file);
+	release_class_file(&cf);
 }
 
 /* --- utility functions ---------------------------------------------------- */
 
-static void ensure_space(int num_instr)
+static void ensure_space(CodeGen *cg, int num_instr)
 {
-	if (ip + num_instr > code_size) {
-		code = erealloc(code, code_size * 2 * sizeof(Code));
-		code_size *= 2;
+	if (cg->ip + num_instr > cg->code_size) {
+		cg->code = erealloc(cg->code, cg->code_size * 2 * sizeof(Code));
+		cg->code_size *= 2;
 	}
 }
 
 /**
- * Computes the net change in the stack depth caused by the instruction, and
- * updates the maximum stack depth if necessary.
+ * Makes the descriptor of the method of a body.
  *
- * @param[in] instr the instruction for which to factor in the stack effect.
+ * @param[in] b the body of the method.
+ * @return the descriptor, which the caller must free.
  */
-static void adjust_stack(BC *instr)
+static char *make_descriptor(const Body *b)
 {
-	stack_depth += instr->push;
-	if (stack_depth > max_stack_depth) {
-		max_stack_depth = stack_depth;
+	char *descriptor;
+	unsigned int k;
+
+	if (strcmp(b->name, "main") == 0) {
+		return estrdup("([Ljava/lang/String;)V");
 	}
-	stack_depth -= instr->pop;
+
+	/* 5 + 2 * nparams: the parentheses, the return type, which may be an
+	 * array type, and '\0', and each parameter, which may be an array type */
+	descriptor = emalloc(5 + 2 * b->idprop->nparams);
+	strcpy(descriptor, "(");
+	for (k = 0; k < b->idprop->nparams; k++) {
+		if (IS_ARRAY(b->idprop->params[k])) {
+			strcat(descriptor, "[");
+		}
+		strcat(descriptor, "I");
+	}
+	strcat(descriptor, ")");
+	if (IS_ARRAY_TYPE(b->idprop->type)) {
+		strcat(descriptor, "[");
+	}
+	strcat(descriptor, (b->idprop->type == TYPE_CALLABLE ? "V" : "I"));
+
+	return descriptor;
 }
 
 /**
@@ -586,27 +711,12 @@ static void adjust_stack(BC *instr)
  */
 static void dump_method(FILE *file, Body *b)
 {
+	char *descriptor;
 	int i;
-	unsigned int k;
-
-	if (strcmp(b->name, "main") == 0) {
 
-		fprintf(file, ".method public static main([Ljava/lang/String;)V\n");
-
-	} else {
-
-		fprintf(file, ".method public static %s(", b->name);
-		for (k = 0; k < b->idprop->nparams; k++) {
-			if (IS_ARRAY(b->idprop->params[k])) {
-				fputs("[", file);
-			}
-			fputs("I", file);
-		}
-		fprintf(file, ")%s%s\n",
-				(IS_ARRAY_TYPE(b->idprop->type) ? "[" : ""),
-				(b->idprop->type == TYPE_CALLABLE ? "V" : "I"));
-
-	}
+	descriptor = make_descriptor(b);
+	fprintf(file, ".method public static %s%s\n", b->name, descriptor);
+	efree(descriptor);
 	fprintf(file, ".limit stack %d\n", b->max_stack_depth);
 	fprintf(file, ".limit locals %d\n", b->variables_width);
 
@@ -622,6 +732,10 @@ static void dump_method(FILE *file, Body *b)
 				fprintf(file, " L%d\n", c.label);
 				break;
 			case CODE_INSTRUCTION:
+				if (dump_short_form(file, &b->code[i])) {
+					i++;
+					break;
+				}
 				fprintf(file, "\t%s", get_opcode_string(c.code));
 				switch (c.code) {
 					case JVM_ARETURN:
@@ -637,11 +751,19 @@ static void dump_method(FILE *file, Body *b)
 					case JVM_IREM:
 					case JVM_IRETURN:
 					case JVM_IXOR:
+					case JVM_POP:
+					case JVM_POP2:
 					case JVM_RETURN:
 					case JVM_SWAP:
 						/* emit linefeed */
 						fprintf(file, "\n");
 						break;
+					case JVM_IINC:
+						/* both operands go on the same line */
+						fprintf(file, " %d %d\n", b->code[i + 1].num,
+								b->code[i + 2].num);
+						i += 2;
+						break;
 					default:
 						/* no linefeed */
 						break;
@@ -674,14 +796,54 @@ static void dump_method(FILE *file, Body *b)
 
 	}
 
-	/* guard against a dangling label at the end of the code stream */
-	if ((b->code[b->ip - 1].type & MASK_TYPE) == CODE_LABEL) {
-		fprintf(file, "\tnop\n");
-	}
-
 	fprintf(file, ".end method\n\n");
 }
 
+/**
+ * Writes an instruction in a shorter form than its own, if it has one: an
+ * integer constant that can be pushed without going through the constant pool,
+ * or a load or store of one of the first four local variables.
+ *
+ * @param[in] file the output file.
+ * @param[in] c    the instruction, followed by its operand.
+ * @return whether the instruction was written.
+ */
+static Boolean dump_short_form(FILE *file, const Code *c)
+{
+	int n;
+
+	if ((c[1].type & MASK_DATA_TYPE) != CODE_INTEGER) {
+		return FALSE;
+	}
+	n = c[1].num;
+	switch (c[0].code) {
+		case JVM_LDC:
+			if (n == -1) {
+				fprintf(file, "\ticonst_m1\n");
+			} else if (n >= 0 && n <= 5) {
+				fprintf(file, "\ticonst_%d\n", n);
+			} else if (n >= SCHAR_MIN && n <= SCHAR_MAX) {
+				fprintf(file, "\tbipush %d\n", n);
+			} else if (n >= SHRT_MIN && n <= SHRT_MAX) {
+				fprintf(file, "\tsipush %d\n", n);
+			} else {
+				return FALSE;
+			}
+			return TRUE;
+		case JVM_ALOAD:
+		case JVM_ASTORE:
+		case JVM_ILOAD:
+		case JVM_ISTORE:
+			if (n < 0 || n > 3) {
+				return FALSE;
+			}
+			fprintf(file, "\t%s_%d\n", get_opcode_string(c[0].code), n);
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
 /**
  * Writes the preamble to the Jasmin output file.  The preamble consists of (i)
  * the class name and visibility specifier, (ii) the superclass, and (iii) the
@@ -698,19 +860,37 @@ static void dump_preamble(FILE *file, char *name)
 	fprintf(file, method_readBoolean, name);
 }
 
-void release_code_generation(void)
+void release_code_generation(CodeGen *cg)
 {
-	/*
 	int i;
 	Body *b, *d;
-	*/
 
-	/* remove Jasmin file */
-#ifndef DEBUG_CODEGEN
-	unlink(jasm_name);
-#endif
-
-	/* free bodies */
+	/* free bodies; inside a region, this is subsumed by the bulk release */
+	for (b = cg->bodies; b; b = d) {
+		d = b->next;
+		for (i = 0; i < b->ip; i++) {
+			if (b->code[i].type & CODE_ALLOCATED) {
+				efree(b->code[i].string);
+			}
+		}
+		for (i = 0; i < NNOTES; i++) {
+			efree(b->notes[i]);
+		}
+		efree(b->code);
+		efree(b->name);
+		efree(b);
+	}
+	cg->bodies = NULL;
+	for (i = 0; i < NNOTES; i++) {
+		efree(cg->notes[i]);
+		cg->notes[i] = NULL;
+	}
 
-	/* free strings */
+	/* free strings, which a shared generator borrows from its owner */
+	if (cg->shared) {
+		return;
+	}
+	efree(cg->class_name);
+	efree(cg->ref_read_boolean);
+	efree(cg->ref_read_integer);
 }
@@ -8,122 +8,241 @@
 #ifndef CODEGEN_H
 #define CODEGEN_H
 
+#include <stdio.h>
+#include "boolean.h"
 #include "jvm.h"
 #include "symboltable.h"
 #include "token.h"
 
+/** the extension of a Jasmin file */
+#define JASM_EXT ".jasmin"
+
+/** the extension of the class file that Jasmin assembles */
+#define CLASS_EXT ".class"
+
 typedef unsigned int Label;
 
+/** the kinds of note that can be kept with the code of a subroutine */
+typedef enum {
+	NOTE_IR,                              /**< its intermediate form         */
+	NOTE_CFG,                             /**< its control-flow graph        */
+	NNOTES
+} NoteKind;
+
+/** the code of a subroutine, in a list of such bodies */
+typedef struct body_s Body;
+
+/** an instruction, operand, or label in the code array */
+struct code_s;
+
+/** the state of a code generator */
+typedef struct {
+	char           *class_name;       /**< the class name                 */
+	char           *ref_read_boolean; /**< the boolean read method        */
+	char           *ref_read_integer; /**< the integer read method        */
+	Boolean         shared;           /**< whether the names are borrowed */
+	Body           *bodies;           /**< the closed subroutine bodies   */
+	char           *function_name;    /**< the name of current subroutine */
+	IDprop         *idprop;           /**< its identifier properties      */
+	struct code_s  *code;             /**< its code array                 */
+	int             code_size;        /**< the size of the code array     */
+	int             ip;               /**< the instruction pointer        */
+	int             max_stack_depth;  /**< the maximum stack depth        */
+	Label           next_label;       /**< the next label to hand out     */
+	char           *notes[NNOTES];    /**< its notes, or NULL             */
+} CodeGen;
+
 /**
- * Assembles a Jasmin file.  The file must first be written by calling
- * <code>make_code_file</code>.
+ * Assembles a Jasmin file, as written by <code>write_code</code>, into a
+ * class file in the current directory.
  *
  * @param[in]   jasmin_path
  *     the path to the Jasmin JAR file
+ * @param[in]   jasm_name
+ *     the name of the Jasmin file
  */
-void assemble(const char *jasmin_path);
+void assemble(const char *jasmin_path, const char *jasm_name);
+
+/**
+ * Prepends a list of subroutine bodies, obtained from
+ * <code>detach_bodies</code> on another code generator, to the list of
+ * bodies of this one.
+ *
+ * @param[in,out] cg
+ *     the code generator
+ * @param[in]   list
+ *     the list of bodies, or <code>NULL</code>
+ */
+void attach_bodies(CodeGen *cg, Body *list);
 
 /**
  * Closes the code generation for the current function or procedure.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   varwidth
  *     the length of the local variable array, including space for parameters;
  *     should be read from the symbol table
  */
-void close_subroutine_codegen(int varwidth);
+void close_subroutine_codegen(CodeGen *cg, int varwidth);
+
+/**
+ * Removes the bodies closed so far from the list of a code generator, so
+ * that they can be attached to another.  Since every generator keeps its own
+ * list, bodies compiled by several generators are combined this way before
+ * the code file is written.
+ *
+ * @param[in,out] cg
+ *     the code generator
+ * @return      the list of bodies, most recently closed first
+ */
+Body *detach_bodies(CodeGen *cg);
 
 /**
  * Generates the code for an operation that does not have an operand.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   opcode
  *     the bytecode instruction
  */
-void gen_1(Bytecode opcode);
+void gen_1(CodeGen *cg, Bytecode opcode);
 
 /**
  * Generates a label.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   label
  *     the label
  */
-void gen_label(Label label);
+void gen_label(CodeGen *cg, Label label);
 
 /**
  * Generates the code for an operation with one operand.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   opcode
  *     the bytecode instruction
  * @param[in]   operand
  *     the operand
  */
-void gen_2(Bytecode opcode, int value);
+void gen_2(CodeGen *cg, Bytecode opcode, int value);
+
+/**
+ * Generates the code for an operation with two operands, such as an
+ * increment of a local variable by a constant.
+ *
+ * @param[in,out] cg
+ *     the code generator
+ * @param[in]   opcode
+ *     the bytecode instruction
+ * @param[in]   operand1
+ *     the first operand
+ * @param[in]   operand2
+ *     the second operand
+ */
+void gen_3(CodeGen *cg, Bytecode opcode, int operand1, int operand2);
 
 /**
  * Generates an instruction that takes a label.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   opcode
  *     the bytecode instruction
  * @param[in]   label
  *     the label
  */
-void gen_2_label(Bytecode opcode, Label label);
+void gen_2_label(CodeGen *cg, Bytecode opcode, Label label);
 /**
  * Generates a call.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   fname
  *     the name of the function or procedure
  * @param[in]   idprop
  *     the properties of the function or procedure identifier
  */
-void gen_call(char *fname, IDprop *idprop);
+void gen_call(CodeGen *cg, char *fname, IDprop *idprop);
 
 /**
  * Generates the instructions that handle comparisons, ensuring that either
  * zero or one is pushed onto the stack.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   opcode
  *     the false jump instruction
  */
-void gen_cmp(Bytecode opcode);
+void gen_cmp(CodeGen *cg, Bytecode opcode);
 
 /**
  * Generates the instruction that creates a new array of the specified type.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   atype
  *     the type of array items
  */
-void gen_newarray(JVMatype atype);
+void gen_newarray(CodeGen *cg, JVMatype atype);
 
 /**
  * Generates the instructions for the displaying output on screen.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   type
  *     the operand type
  */
-void gen_print(ValType type);
+void gen_print(CodeGen *cg, ValType type);
 
 /**
  * Generates the instructions for displaying a string on screen.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   string
  *     the string to display
  */
-void gen_print_string(char *string);
+void gen_print_string(CodeGen *cg, char *string);
 
 /**
  * Generates the instructions for reading from standard input into a variable.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   type
  *     the operand type
  */
-void gen_read(ValType type);
+void gen_read(CodeGen *cg, ValType type);
 
 /**
  * Returns the next label integer.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @return      the next label integer.
  */
-Label get_label(void);
+Label get_label(CodeGen *cg);
+
+/**
+ * Returns the code of the most recently closed subroutine.
+ *
+ * @param[in]   cg
+ *     the code generator, which must have closed a subroutine
+ * @param[out]  ip
+ *     the number of code entries
+ * @param[out]  max_stack_depth
+ *     the maximum depth of the operand stack
+ * @param[out]  variables_width
+ *     the width of the local variables
+ * @return      the code array, which still belongs to the code generator
+ */
+const struct code_s *get_closed_code(const CodeGen *cg, int *ip,
+		int *max_stack_depth, int *variables_width);
 
 /**
  * Gets a string representation (mnemonic) of an opcode.  It would
@@ -140,41 +259,156 @@ Label get_label(void);
 const char *get_opcode_string(Bytecode opcode);
 
 /**
- * Initialises the code generation unit.
+ * Gets the effect of an instruction on the operand stack.  The effect of a
+ * method invocation is read off its descriptor.
+ *
+ * @param[in]   code
+ *     the instruction, followed by its operands
+ * @param[out]  pop
+ *     the number of entries that it pops
+ * @param[out]  push
+ *     the number of entries that it pushes after popping them
  */
-void init_code_generation(void);
+void get_stack_effect(const struct code_s *code, int *pop, int *push);
+
+/**
+ * Gets the Java name of an array type.
+ *
+ * @param[in]   atype
+ *     the array type
+ * @return      the name of the array type
+ */
+const char *get_atype_string(JVMatype atype);
+
+/**
+ * Initialises a code generator.
+ *
+ * @param[out]  cg
+ *     the code generator
+ */
+void init_code_generation(CodeGen *cg);
+
+/**
+ * Initialises a code generator that borrows the class name of another, so
+ * that it can compile subroutines alongside it.  Its bodies must be detached
+ * and attached to the owner before the code file is written; releasing it
+ * leaves the borrowed names and the Jasmin file alone.
+ *
+ * @param[out]  cg
+ *     the code generator
+ * @param[in]   owner
+ *     the code generator whose class name has been set
+ */
+void share_code_generation(CodeGen *cg, const CodeGen *owner);
 
 /**
  * Initialises the code array for a function or procedure.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in]   name
  *     the name of the function or procedure
  * @param[in]   p
  *     the properties of the function or procedure identifier
  */
-void init_subroutine_codegen(const char *name, IDprop *p);
+void init_subroutine_codegen(CodeGen *cg, const char *name, IDprop *p);
 
 /**
  * Prints the generated code to screen; for debugging purposes.
+ *
+ * @param[in]   cg
+ *     the code generator
+ */
+void list_code(CodeGen *cg);
+
+/**
+ * Takes code that was generated earlier, for example, by an earlier
+ * compilation, as the code of the current subroutine, in place of any code
+ * generated for it so far.
+ *
+ * @param[in,out] cg
+ *     the code generator
+ * @param[in]   code
+ *     the code array, allocated with <code>emalloc</code>, which is stolen
+ *     along with the strings that it owns
+ * @param[in]   ip
+ *     the number of code entries, at least one
+ * @param[in]   max_stack_depth
+ *     the maximum depth of the operand stack
+ * @param[in]   nlabels
+ *     the number of labels of the code, which are numbered from zero, and are
+ *     renumbered from the next label to hand out
  */
-void list_code(void);
+void set_subroutine_code(CodeGen *cg, struct code_s *code, int ip,
+		int max_stack_depth, unsigned int nlabels);
 
 /**
- * Opens the object file, and write the generated code to it.
+ * Keeps a note with the code of the current subroutine, for example, a dump of
+ * its intermediate form, replacing any earlier note of the same kind.  The note
+ * is closed along with the code.
+ *
+ * @param[in,out] cg
+ *     the code generator
+ * @param[in]   kind
+ *     the kind of note
+ * @param[in]   text
+ *     the text of the note, which is stolen
+ */
+void set_note(CodeGen *cg, NoteKind kind, char *text);
+
+/**
+ * Writes the notes of one kind of every closed subroutine to a stream, in the
+ * same order in which <code>write_code</code> writes their code.
+ *
+ * @param[in]   cg
+ *     the code generator
+ * @param[in]   kind
+ *     the kind of note
+ * @param[in]   file
+ *     the stream to write to
+ */
+void write_notes(CodeGen *cg, NoteKind kind, FILE *file);
+
+/**
+ * Writes the generated code, in Jasmin syntax, to a stream.  A small integer
+ * constant and a load or store of one of the first four local variables are
+ * written in their shortest forms.
+ *
+ * @param[in]   cg
+ *     the code generator
+ * @param[in]   file
+ *     the stream to write to
  */
-void make_code_file(void);
+void write_code(CodeGen *cg, FILE *file);
+
+/**
+ * Writes the generated code, as a class file, to a stream.  The class file is
+ * the one that Jasmin assembles from the code that <code>write_code</code>
+ * writes.
+ *
+ * @param[in]   cg
+ *     the code generator
+ * @param[in]   file
+ *     the stream to write to
+ */
+void write_class_file(CodeGen *cg, FILE *file);
 
 /**
  * Sets the name of the class file.  This must be called after
  * <code>init_code_generation</code>, but before any other code is emitted.
  *
+ * @param[in,out] cg
+ *     the code generator
  * @param[in] cname the name of the class file
  */
-void set_class_name(char *cname);
+void set_class_name(CodeGen *cg, char *cname);
 
 /**
- * Releases the resources allocated or held by the code generation unit.
+ * Releases the resources allocated or held by a code generator.
+ *
+ * @param[in,out] cg
+ *     the code generator
  */
-void release_code_generation(void);
+void release_code_generation(CodeGen *cg);
 
 #endif /* CODEGEN_H */
@@ -0,0 +1,3409 @@
+/**
+ * @file    compiler.c
+ *
+ * A recursive-descent compiler for the SIMPL-2021 language, built as a
+ * library of which the interface is declared in <code>simplc.h</code>.
+ *
+ * All scanning errors are handled in the scanner.  Parser errors MUST be
+ * handled by the <code>abort_c</code> function.  System and environment errors,
+ * for example, running out of memory, MUST be handled in the unit in which they
+ * occur.  Transient errors, for example, non-existent files, MUST be reported
+ * where they occur.  All errors are fatal, and MUST end the compilation: the
+ * compilation sets an error trap, so that the error routines record the error
+ * as a diagnostic, and jump back out of the compilation, instead of
+ * terminating the program.
+ *
+ * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ast.h"
+#include "cache.h"
+#include "cfg.h"
+#include "code.h"
+#include "codegen.h"
+#include "errmsg.h"
+#include "error.h"
+#include "hashtable.h"
+#include "ir.h"
+#include "module.h"
+#include "peephole.h"
+#include "pool.h"
+#include "scanner.h"
+#include "simplc.h"
+#include "symboltable.h"
+#include "token.h"
+#include "valtypes.h"
+
+/* --- debugging ------------------------------------------------------------ */
+
+#ifdef DEBUG_PARSER
+	void debug_start(const SourcePos *pos, const char *fmt, ...);
+	void debug_end(const SourcePos *pos, const char *fmt, ...);
+	void debug_info(const SourcePos *pos, const char *fmt, ...);
+	#define DBG_start(...) debug_start(&c->scanner.position, __VA_ARGS__)
+	#define DBG_end(...) debug_end(&c->scanner.position, __VA_ARGS__)
+	#define DBG_info(...) debug_info(&c->scanner.position, __VA_ARGS__)
+#else
+	#define DBG_start(...)
+	#define DBG_end(...)
+	#define DBG_info(...)
+#endif /* DEBUG_PARSER */
+
+/* --- type definitions ----------------------------------------------------- */
+
+typedef struct variable_s Variable;
+struct variable_s {
+	char      *id;     /**< variable identifier                       */
+	ValType    type;   /**< variable type                             */
+	SourcePos  pos;    /**< variable position in the source           */
+	Variable  *next;   /**< pointer to the next variable in the list  */
+};
+
+typedef struct {
+	CacheKey   key;     /**< the hash of the signature and the tokens  */
+	char      *ids;     /**< the identifiers in the body, terminated   */
+	size_t     len;     /**< the length of the identifiers             */
+	size_t     cap;     /**< the space allocated for them              */
+	Token      begin;   /**< the "begin" token of the body             */
+	ScanState  body;    /**< the scanner state just after "begin"      */
+} Fingerprint;
+
+typedef struct deferred_s Deferred;
+struct deferred_s {
+	char      *id;      /**< routine identifier                        */
+	IDprop    *prop;    /**< routine properties                        */
+	Variable  *params;  /**< the parameters of the routine             */
+	Token      begin;   /**< the "begin" token of the body             */
+	ScanState  body;    /**< the scanner state just after "begin"      */
+	Boolean    reached; /**< whether the routine is reachable          */
+	Deferred  *next;    /**< the next routine, in source order         */
+	Deferred  *work;    /**< the next reached routine still to compile */
+	Body      *code;    /**< the code, once compiled on a worker       */
+	Fingerprint print;  /**< the fingerprint of the body, if cached    */
+};
+
+/* the kinds of entry on the operator stack of the expression parser; the
+ * groups come first */
+typedef enum {
+	OP_TOP,             /**< the expression as a whole                 */
+	OP_PAREN,           /**< an open parenthesis                       */
+	OP_INDEX,           /**< an open index, after its array            */
+	OP_ARGS,            /**< an open argument list, after its callee   */
+	OP_NEG,             /**< a leading minus                           */
+	OP_NOT,             /**< a "not"                                   */
+	OP_BINARY           /**< a binary operator                         */
+} ExprOpKind;
+
+typedef struct {
+	ExprOpKind kind;    /**< the kind of entry                         */
+	TokenType  op;      /**< the operator of a binary entry            */
+	int        prec;    /**< how tightly the operator binds            */
+	SourcePos  pos;     /**< the position of the operator or group     */
+	Node       name;    /**< the array or callee of a group            */
+	Node       first;   /**< the first argument parsed, if any         */
+	Node       last;    /**< the last argument parsed, if any          */
+	Boolean    simple;  /**< whether a group takes no more relops      */
+} ExprOp;
+
+typedef struct {
+	ExprOp       *ops;    /**< the pending operators and open groups   */
+	unsigned int  nops;   /**< the number of operators                 */
+	unsigned int  opcap;  /**< the number of operators allocated       */
+	Node         *vals;   /**< the operands parsed but not yet applied */
+	unsigned int  nvals;  /**< the number of operands                  */
+	unsigned int  valcap; /**< the number of operands allocated        */
+} ExprStack;
+
+/* --- compiler context ----------------------------------------------------- */
+
+/* Everything that a compilation changes as it goes lives in its compiler
+ * context, so that several compilations may run at once in one process.
+ *
+ * When lazy, the bodies of subroutines are skipped on a first pass, and only
+ * those reachable from the main body are compiled; the rest are only parsed.
+ *
+ * With more than one job, the bodies of subroutines are skipped as when lazy,
+ * and then compiled on a pool of worker threads, while the main thread
+ * compiles the main body.  Each worker compiles in a context of its own, in
+ * the crew of the main context: it scans the source buffer through its own
+ * stream, allocates from its own region, and shares the global scope and the
+ * class name of the main context.
+ *
+ * The outcome of the compilation and its diagnostics are kept in the main
+ * context, and are guarded by a lock, since workers report to it as well.  Once
+ * the compilation fails, or is cancelled or timed out, it is marked as
+ * stopped, and every context abandons its work at the next checkpoint.  When
+ * several errors are to be collected, the compilation only stops once it has
+ * reported as many, and recovers from the errors before that.
+ */
+typedef struct simpl_compiler_s SimplCompiler;
+struct simpl_compiler_s {
+	Token           token;          /**< the lookahead token                 */
+	ValType         return_type;    /**< the return type of the subroutine   */
+	FILE           *src_file;       /**< the stream over the source buffer   */
+	Scanner         scanner;        /**< the scanner                         */
+	SymbolTable     symbols;        /**< the symbol table                    */
+	CodeGen         codegen;        /**< the code generator                  */
+	Ast             ast;            /**< the tree of the current body        */
+	Ir              ir;             /**< the intermediate form of the body   */
+	Cfg             cfg;            /**< the control-flow graph of its code  */
+	Peephole        peephole;       /**< the peephole optimiser of the code  */
+	unsigned long   folds;          /**< the operations folded to constants  */
+	unsigned long   identities;     /**< the identities applied              */
+	unsigned long   dead;           /**< the dead instructions removed       */
+	unsigned long   shared;         /**< the local slots saved by sharing    */
+	ExprStack       exprs;          /**< the stacks of the expression parser */
+	Boolean         dump_ir;        /**< whether to keep a dump of the form  */
+	Boolean         dump_cfg;       /**< whether to keep a dump of the graph */
+	Boolean         stats;          /**< whether to count the optimisations  */
+	Boolean         warned;         /**< whether the current body warned     */
+	Boolean         checking;       /**< whether bodies are checked, too     */
+	const char     *cache_dir;      /**< the cache directory, or NULL        */
+	Modules         modules;        /**< the imported and exported modules   */
+	Region         *region;         /**< the allocation region               */
+
+	Boolean         lazy;           /**< whether bodies are compiled lazily  */
+	Deferred       *deferred;       /**< the skipped subroutines, in order   */
+	Deferred      **last_deferred;  /**< the link for the next one           */
+	Deferred       *worklist;       /**< reached subroutines to be compiled  */
+	HashTab        *deferred_table; /**< maps identifiers to skipped ones    */
+
+	unsigned int    jobs;           /**< the number of compilation threads   */
+	ThreadPool     *workers;        /**< the worker threads, if several      */
+	const char     *src;            /**< the source buffer                   */
+	size_t          src_len;        /**< the length of the source buffer     */
+	SimplCompiler  *crew;           /**< the context of each worker          */
+	SimplCompiler  *owner;          /**< the main context, for a worker      */
+	pthread_mutex_t reach_lock;     /**< guards reaching from several bodies */
+
+	SimplCancel    *cancel;         /**< the cancellation token, if any      */
+	Boolean         timed;          /**< whether there is a deadline         */
+	struct timespec deadline;       /**< the deadline, on the monotonic clock */
+	atomic_int      stopped;        /**< whether the compilation must stop   */
+	unsigned int    max_errors;     /**< the errors to collect, at least 1   */
+	atomic_uint     nerrors;        /**< the errors reported so far          */
+	SimplStatus     status;         /**< the outcome of the compilation      */
+	SimplDiagnostic *diagnostics;   /**< the reported errors and warnings    */
+	unsigned int    ndiagnostics;   /**< the number of diagnostics           */
+	pthread_mutex_t report_lock;    /**< guards the outcome and diagnostics  */
+};
+
+/* --- helper macros -------------------------------------------------------- */
+
+#define STARTS_FACTOR(toktype) \
+	(toktype == TOK_ID || toktype == TOK_NUM || \
+     toktype == TOK_LPAR || toktype == TOK_NOT || \
+     toktype == TOK_TRUE || toktype == TOK_FALSE)
+
+#define STARTS_EXPR(toktype) \
+	(toktype == TOK_ID || toktype == TOK_NUM || \
+     toktype == TOK_LPAR || toktype == TOK_NOT || \
+     toktype == TOK_TRUE || toktype == TOK_FALSE || \
+     toktype == TOK_MINUS)
+
+#define IS_ADDOP(toktype) \
+	(toktype >= TOK_MINUS && toktype <= TOK_PLUS)
+
+#define IS_MULOP(toktype) \
+	(toktype >= TOK_AND && toktype <= TOK_MOD) 
+
+#define IS_RELOP(toktype) \
+	(toktype >= TOK_EQ && toktype <= TOK_NE)
+
+#define IS_GROUP(kind) \
+	(kind <= OP_ARGS)
+
+/* the precedences of the operators, from the loosest to the tightest */
+#define PREC_GROUP 0
+#define PREC_REL   1
+#define PREC_ADD   2
+#define PREC_NEG   3
+#define PREC_MUL   4
+#define PREC_NOT   5
+
+#define INITIAL_EXPR_STACK 16
+
+#define IS_TYPE_TOKEN(toktype) \
+	(toktype == TOK_BOOLEAN || toktype == TOK_INTEGER)
+
+#define IS_STATEMENT(toktype) \
+	(toktype == TOK_EXIT || toktype == TOK_IF || \
+     toktype == TOK_ID || toktype == TOK_READ || \
+     toktype == TOK_WHILE || toktype == TOK_WRITE)
+
+/* --- function prototypes: parsing ----------------------------------------- */
+
+void parse_program(SimplCompiler *c);
+void parse_funcdef(SimplCompiler *c);
+void parse_body(SimplCompiler *c, BodyTree *body);
+Node parse_statements(SimplCompiler *c);
+void parse_type(SimplCompiler *c, ValType *type);
+Node parse_vardef(SimplCompiler *c, Node *last);
+Node parse_statement(SimplCompiler *c);
+Node parse_exit(SimplCompiler *c);
+Node parse_if(SimplCompiler *c);
+Node parse_name(SimplCompiler *c);
+Node parse_read(SimplCompiler *c);
+Node parse_while(SimplCompiler *c);
+Node parse_write(SimplCompiler *c);
+Node parse_arglist(SimplCompiler *c);
+Node parse_index(SimplCompiler *c);
+Node parse_expr(SimplCompiler *c);
+Node parse_simple(SimplCompiler *c);
+Node parse_operators(SimplCompiler *c, Boolean simple);
+Node parse_factor(SimplCompiler *c, Boolean *start);
+Boolean parse_operator(SimplCompiler *c, Boolean *start);
+Node close_group(SimplCompiler *c, Boolean *start, Boolean *done);
+ExprOp *push_op(SimplCompiler *c, ExprOpKind kind, TokenType op, int prec,
+		SourcePos pos);
+void push_val(SimplCompiler *c, Node e);
+void apply_ops(SimplCompiler *c, int prec);
+int get_prec(TokenType op);
+void init_exprs(ExprStack *s);
+void release_exprs(ExprStack *s);
+
+/* --- function prototypes: type checking ----------------------------------- */
+
+void check_var(SimplCompiler *c, Node v);
+void check_statement(SimplCompiler *c, Node s);
+void check_items(SimplCompiler *c, Node a);
+void check_arglist(SimplCompiler *c, Node name, Node args);
+void check_index(SimplCompiler *c, Node name, Node index);
+ValType check_expr(SimplCompiler *c, Node e);
+IDprop *resolve(SimplCompiler *c, Node name);
+
+/* --- function prototypes: folding ----------------------------------------- */
+
+void fold_expr(SimplCompiler *c, Node n);
+void fold_binary(SimplCompiler *c, Node n);
+void set_constant(Expr *e, int value);
+void replace_expr(SimplCompiler *c, Expr *e, Node n);
+void apply_unary(Expr *e, ExprKind kind, Node operand);
+Boolean is_constant(const Expr *e, int *value);
+Boolean is_pure(SimplCompiler *c, Node n);
+int fold_operation(TokenType op, int a, int b);
+TokenType invert_relop(TokenType op);
+
+/* --- function prototypes: translation ------------------------------------- */
+
+int translate_body(SimplCompiler *c, BodyTree *body, int width);
+void take_note(SimplCompiler *c, NoteKind kind);
+void collect_notes(SimplCompiler *c, NoteKind kind, char **text, size_t *lenp);
+void collect_stats(SimplCompiler *c, char **text, size_t *lenp);
+
+/* --- function prototypes: lazy compilation -------------------------------- */
+
+void defer_body(SimplCompiler *c, char *id, IDprop *prop, Variable *params);
+void skip_body(SimplCompiler *c, Fingerprint *print);
+void reach(SimplCompiler *c, char *id);
+void compile_deferred(SimplCompiler *c);
+void compile_parallel(SimplCompiler *c);
+void compile_body(SimplCompiler *c, Deferred *d);
+void compile_subroutine(SimplCompiler *c, const char *id, Fingerprint *print);
+void compile_task(void *data, unsigned int id, void *arg);
+void start_worker(void *data, unsigned int id);
+void stop_worker(void *data, unsigned int id);
+void release_deferred(SimplCompiler *c);
+unsigned int hash_id(void *key, unsigned int size);
+int cmp_id(void *v1, void *v2);
+void keep(void *p);
+
+/* --- function prototypes: caching ---------------------------------------- */
+
+void fingerprint_body(SimplCompiler *c, Fingerprint *print, const char *id,
+		IDprop *prop, Variable *params);
+CacheKey make_key(SimplCompiler *c, const char *id, const Fingerprint *print);
+Boolean splice_body(SimplCompiler *c, CacheKey key);
+void reach_calls(SimplCompiler *c, const struct code_s *code, int ip);
+void keep_body(SimplCompiler *c, CacheKey key, Label first);
+void release_fingerprint(Fingerprint *print);
+
+/* --- function prototypes: error recovery ---------------------------------- */
+
+Node guard_statement(SimplCompiler *c);
+void guard_check(SimplCompiler *c, Node s);
+void guard_var(SimplCompiler *c, Node v);
+void guard_funcdef(SimplCompiler *c);
+void guard_body(SimplCompiler *c, Deferred *d);
+void synchronise(SimplCompiler *c, const Token *start, const ScanState *state,
+		Boolean definition);
+void abandon_body(SimplCompiler *c);
+Boolean has_failed(SimplCompiler *c);
+void sort_diagnostics(SimplCompiler *c);
+Boolean diagnostic_after(const SimplDiagnostic *a, const SimplDiagnostic *b);
+
+/* --- function prototypes: compilation control ----------------------------- */
+
+void checkpoint(SimplCompiler *c);
+void halt(SimplCompiler *c, SimplStatus status);
+void report(void *data, Boolean fatal, const SourcePos *pos,
+		const char *message);
+void set_trap(ErrorTrap *trap, SimplCompiler *c);
+
+/* --- function prototypes: helpers ----------------------------------------- */
+
+void check_types(SimplCompiler *c, ValType found, ValType expected,
+		SourcePos *pos, ...);
+void expect(SimplCompiler *c, TokenType type);
+void expect_id(SimplCompiler *c, char **id);
+IDprop *make_idprop(ValType type, unsigned int offset, unsigned int nparams,
+       ValType *params);
+Variable *make_var(char *id, ValType type, SourcePos pos);
+void declare_params(SimplCompiler *c, Variable *head);
+Node make_binary(SimplCompiler *c, TokenType op, SourcePos pos, Node left,
+		Node right);
+
+/* --- function prototypes: error reporting --------------------------------- */
+
+void abort_c(SimplCompiler *c, Error err, ...);
+void abort_cp(SimplCompiler *c, SourcePos *posp, Error err, ...);
+
+/* --- library interface ---------------------------------------------------- */
+
+SimplStatus simpl_compile_buffer(const char *src, size_t len,
+		const SimplOptions *options, SimplResult *result)
+{
+	SimplCompiler compiler, *c;
+	ErrorTrap trap;
+	FILE *code_file;
+	char *interface;
+	const char *phase;
+	size_t interface_len;
+	unsigned int i;
+
+	c = &compiler;
+	memset(result, 0, sizeof(SimplResult));
+
+	/* take the options, of which the defaults are all zero */
+	c->lazy = (options != NULL && options->lazy ? TRUE : FALSE);
+	c->checking = TRUE;
+	c->dump_ir = (options != NULL && options->dump_ir ? TRUE : FALSE);
+	c->dump_cfg = (options != NULL && options->dump_cfg ? TRUE : FALSE);
+	c->stats = (options != NULL && options->stats ? TRUE : FALSE);
+	c->cache_dir = (options != NULL && !c->dump_ir && !c->dump_cfg
+			&& !c->stats ? options->cache_dir : NULL);
+	c->jobs = (options != NULL ? options->jobs : 0);
+	if (c->jobs < 1) {
+		c->jobs = 1;
+	} else if (c->jobs > SIMPL_MAX_JOBS) {
+		c->jobs = SIMPL_MAX_JOBS;
+	}
+	c->cancel = (options != NULL ? options->cancel : NULL);
+	c->timed = (options != NULL && options->deadline != NULL);
+	if (c->timed) {
+		c->deadline = *options->deadline;
+	}
+	c->max_errors = (options != NULL && options->max_errors > 1
+			? options->max_errors : 1);
+	c->src = src;
+	c->src_len = len;
+
+	atomic_init(&c->stopped, 0);
+	atomic_init(&c->nerrors, 0);
+	c->status = SIMPL_OK;
+	c->diagnostics = NULL;
+	c->ndiagnostics = 0;
+	pthread_mutex_init(&c->report_lock, NULL);
+	pthread_mutex_init(&c->reach_lock, NULL);
+	c->src_file = NULL;
+	c->workers = NULL;
+	c->crew = c->owner = NULL;
+	init_modules(&c->modules);
+
+	/* every object of this compilation is owned by one region, which stands in
+	 * for the active region of the caller, if any, until it is released below,
+	 * on every way out of the compilation, and so does the allocation phase
+	 */
+	c->region = region_open();
+	phase = set_alloc_phase("init");
+
+	set_trap(&trap, c);
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+
+		/* open a stream over the source buffer */
+		if ((c->src_file = fmemopen((void *) src, len, "r")) == NULL) {
+			eprintf("source could not be opened:");
+		}
+
+		/* initialise all compiler units */
+		init_scanner(&c->scanner, c->src_file);
+		init_symbol_table(&c->symbols);
+		init_code_generation(&c->codegen);
+		init_ast(&c->ast);
+		init_ir(&c->ir);
+		c->ir.strict = (options != NULL && options->strict ? TRUE : FALSE);
+		init_cfg(&c->cfg);
+		init_peephole(&c->peephole);
+		c->folds = c->identities = c->dead = c->shared = 0;
+		init_exprs(&c->exprs);
+		c->return_type = TYPE_NONE;
+		c->deferred = c->worklist = NULL;
+		c->last_deferred = &c->deferred;
+		c->deferred_table = NULL;
+
+		/* map the interfaces of the imported modules into the global scope */
+		set_alloc_phase("import");
+		for (i = 0; options != NULL && i < options->ninterfaces; i++) {
+			import_interface(&c->modules, &c->symbols, options->interfaces[i]);
+		}
+
+		/* compile, and stop short of the output after any error */
+		set_alloc_phase("parse");
+		get_token(&c->scanner, &c->token);
+		parse_program(c);
+		checkpoint(c);
+		if (has_failed(c)) {
+			spring_error_trap();
+		}
+
+		/* produce the object code, the class file, and the interface, outside
+		 * the region */
+		set_alloc_phase("output");
+		code_file = open_memstream(&result->code, &result->code_len);
+		if (code_file == NULL) {
+			eprintf("Could not open code stream:");
+		}
+		write_code(&c->codegen, code_file);
+		if (fclose(code_file) != 0) {
+			eprintf("Could not write code stream:");
+		}
+		code_file = open_memstream(&result->class_file, &result->class_len);
+		if (code_file == NULL) {
+			eprintf("Could not open class stream:");
+		}
+		write_class_file(&c->codegen, code_file);
+		if (fclose(code_file) != 0) {
+			eprintf("Could not write class stream:");
+		}
+		if (c->dump_ir) {
+			collect_notes(c, NOTE_IR, &result->ir, &result->ir_len);
+		}
+		if (c->dump_cfg) {
+			collect_notes(c, NOTE_CFG, &result->cfg, &result->cfg_len);
+		}
+		if (c->stats) {
+			collect_stats(c, &result->stats, &result->stats_len);
+		}
+		interface = encode_interface(&c->modules, c->codegen.class_name,
+				&interface_len);
+		result->interface = malloc(interface_len);
+		result->class_name = strdup(c->codegen.class_name);
+		if (result->interface == NULL || result->class_name == NULL) {
+			eprintf("Could not allocate compilation result:");
+		}
+		memcpy(result->interface, interface, interface_len);
+		result->interface_len = interface_len;
+
+		release_ast(&c->ast);
+		release_ir(&c->ir);
+		release_cfg(&c->cfg);
+		release_peephole(&c->peephole);
+		release_exprs(&c->exprs);
+		release_symbol_table(&c->symbols);
+		release_code_generation(&c->codegen);
+		clear_error_trap(&trap);
+	} else {
+		/* the trap was sprung, and the outcome has been recorded */
+		free(result->code);
+		free(result->class_file);
+		free(result->interface);
+		free(result->class_name);
+		free(result->ir);
+		free(result->cfg);
+		free(result->stats);
+		result->code = result->interface = result->class_name = NULL;
+		result->class_file = NULL;
+		result->ir = result->cfg = result->stats = NULL;
+		result->code_len = result->class_len = result->interface_len = 0;
+		result->ir_len = result->cfg_len = result->stats_len = 0;
+	}
+
+	/* release what the region does not own, and then the region itself */
+	if (c->workers != NULL) {
+		pool_destroy(c->workers);
+		for (i = 0; i < c->jobs; i++) {
+			region_release(c->crew[i].region);
+		}
+	}
+	if (c->src_file != NULL) {
+		fclose(c->src_file);
+	}
+	release_modules(&c->modules);
+	pthread_mutex_destroy(&c->reach_lock);
+	pthread_mutex_destroy(&c->report_lock);
+	region_release(c->region);
+	set_alloc_phase(phase);
+
+	if (c->max_errors > 1) {
+		sort_diagnostics(c);
+	}
+	result->status = c->status;
+	result->diagnostics = c->diagnostics;
+	result->ndiagnostics = c->ndiagnostics;
+
+#ifdef DEBUG_PARSER
+	if (result->status == SIMPL_OK) {
+		printf("SUCCESS!\n");
+	}
+#endif
+
+	return result->status;
+}
+
+void simpl_release_result(SimplResult *result)
+{
+	unsigned int i;
+
+	for (i = 0; i < result->ndiagnostics; i++) {
+		free(result->diagnostics[i].message);
+	}
+	free(result->diagnostics);
+	free(result->class_name);
+	free(result->class_file);
+	free(result->code);
+	free(result->interface);
+	free(result->ir);
+	free(result->cfg);
+	free(result->stats);
+	memset(result, 0, sizeof(SimplResult));
+}
+
+void simpl_init_cancel(SimplCancel *cancel)
+{
+	atomic_init(&cancel->requested, 0);
+}
+
+void simpl_cancel(SimplCancel *cancel)
+{
+	atomic_store(&cancel->requested, 1);
+}
+
+/* --- parser routines ------------------------------------------------------ */
+
+/* The parser builds the tree of each body, and hands every piece of it to the
+ * type checker further below as soon as the piece is complete: a variable once
+ * its identifier is read, a guard once its expression is, and any other
+ * statement once it ends.  Errors are therefore found in the order of the
+ * source, whether they are syntax or type errors.  Once a body has been
+ * parsed, it is translated to code, after which the tree is discarded.  A body
+ * that is only parsed for its syntax is not checked.
+ */
+
+/* <program> = "program" <id> { <funcdef> } <body> .
+ */
+void parse_program(SimplCompiler *c)
+{
+	char *class_name;
+	BodyTree body;
+	Deferred *d;
+	int width;
+
+	DBG_start("<program>");
+
+	/* For code generation, set the class name inside this function, and
+	 * also handle initialising and closing the "main" function.  But from the
+	 * perspective of simple parsing, this function is complete.
+	 */
+
+	expect(c, TOK_PROGRAM);
+	expect_id(c, &class_name);
+	/* Set the class name here during code generation. */
+	set_class_name(&c->codegen, class_name);
+
+	/* start the workers, which set up their own contexts as they start, and
+	 * borrow the class name from this one
+	 */
+	if (c->jobs > 1) {
+		c->crew = emalloc(c->jobs * sizeof(SimplCompiler));
+		c->workers = pool_create(c->jobs, c, start_worker, stop_worker);
+	}
+
+	while (c->token.type == TOK_DEFINE) {
+		guard_funcdef(c);
+	}
+	/* without lazy compilation, the workers can start on every body at once */
+	if (c->workers != NULL && !c->lazy && c->deferred_table != NULL) {
+		for (d = c->deferred; d; d = d->next) {
+			reach(c, d->id);
+		}
+	}
+	/* the main body gets a local table too, so that the global table is left
+	 * untouched while workers read it, and its variables start after the
+	 * arguments of main
+	 */
+	enter_subroutine(&c->symbols, 1);
+	checkpoint(c);
+	init_subroutine_codegen(&c->codegen, "main", NULL);
+	parse_body(c, &body);
+	width = get_variables_width(&c->symbols);
+	if (!has_failed(c)) {
+		width = translate_body(c, &body, width);
+	}
+	reset_ast(&c->ast);
+	close_subroutine_codegen(&c->codegen, width);
+	close_subroutine(&c->symbols);
+	if (c->workers != NULL) {
+		compile_parallel(c);
+	} else if (c->lazy) {
+		compile_deferred(c);
+	}
+
+	efree(class_name);
+
+	DBG_end("</program>");
+}
+
+/* <funcdef> = "define" <id> "(" [<type> <id> { "," <type> <id> }] ")" 
+               ["->" <type>] <body> .
+ */
+void parse_funcdef(SimplCompiler *c)
+{
+	DBG_start("<funcdef>");
+
+	char *funcid, *id;
+	SourcePos funcpos, pos;
+	ValType t1, *params;
+	Variable *head, *temp, *newvar;
+	unsigned int count, i;
+	IDprop *funcprop;
+	Fingerprint print;
+
+	checkpoint(c);
+	funcpos = c->scanner.position;
+	count = 0;
+	head = NULL;
+	t1 = 0;
+	id = NULL;
+	c->return_type = TYPE_NONE;
+	
+	expect(c, TOK_DEFINE);
+	expect_id(c, &funcid);
+	expect(c, TOK_LPAR);
+	if (IS_TYPE_TOKEN(c->token.type)) {
+		parse_type(c, &t1);
+		pos = c->scanner.position;
+		expect_id(c, &id);
+		head = make_var(id, t1, pos);
+		head->next = NULL;
+		count = 1;
+		temp = head;
+		while (c->token.type == TOK_COMMA) {
+			get_token(&c->scanner, &c->token);
+			t1 = 0;
+			parse_type(c, &t1);
+			pos = c->scanner.position;
+			expect_id(c, &id);
+			newvar = make_var(id, t1, pos); 
+			newvar->next = NULL;
+			temp->next = newvar;
+			temp = temp->next;
+			count++;
+		}
+	}
+	expect(c, TOK_RPAR);
+	params = (count > 0 ? emalloc(count * sizeof(ValType)) : NULL);
+	temp = head;
+	for (i = 0; i < count; i++) {
+		params[i] = temp->type;
+		temp = temp->next;
+	}
+	t1 = TYPE_CALLABLE;
+	if (c->token.type == TOK_TO) {
+		get_token(&c->scanner, &c->token);
+		parse_type(c, &t1);
+	}
+	c->return_type = t1;
+	funcprop = make_idprop(t1, get_variables_width(&c->symbols), count, params);
+	if (c->lazy || c->workers != NULL) {
+		if (!insert_name(&c->symbols, funcid, funcprop)) {
+			abort_cp(c, &funcpos, ERR_MULTIPLE_DEFINITION, funcid);
+		}
+		defer_body(c, funcid, funcprop, head);
+		c->return_type = TYPE_NONE;
+	} else if (open_subroutine(&c->symbols, funcid, funcprop)) {
+		export_name(&c->modules, funcid, funcprop);
+		if (c->cache_dir != NULL) {
+			fingerprint_body(c, &print, funcid, funcprop, head);
+		}
+		declare_params(c, head);
+		init_subroutine_codegen(&c->codegen, funcid, funcprop);
+		compile_subroutine(c, funcid, (c->cache_dir != NULL ? &print : NULL));
+		if (c->cache_dir != NULL) {
+			release_fingerprint(&print);
+		}
+		reset_ast(&c->ast);
+		close_subroutine(&c->symbols);
+		c->return_type = TYPE_NONE;
+	} else {
+		abort_cp(c, &funcpos, ERR_MULTIPLE_DEFINITION, funcid);
+	}
+
+	DBG_end("</funcdef>");
+}
+
+/* <body> = "begin" { <vardef> } <statements> "end" .
+ */
+void parse_body(SimplCompiler *c, BodyTree *body)
+{
+	Node first, last, tail;
+
+	DBG_start("<body>");
+
+	expect(c, TOK_BEGIN);
+	body->vars = last = NO_NODE;
+	while (IS_TYPE_TOKEN(c->token.type)) {
+		first = parse_vardef(c, &tail);
+		if (last == NO_NODE) {
+			body->vars = first;
+		} else {
+			ast_var(&c->ast, last)->next = first;
+		}
+		last = tail;
+	}
+	body->stmts = parse_statements(c);
+	expect(c, TOK_END);
+
+	DBG_end("</body>");
+}
+
+/* <statements> = "chill" | <statement> { ";" <statement> } .
+ *
+ * A statement that had an error, and was skipped, is left out of the list.  A
+ * statement that follows an exit in the same list is never executed, which is
+ * worth a warning, but not an error.  The code for it is generated, and then
+ * removed with the rest of the dead code.
+ */
+Node parse_statements(SimplCompiler *c)
+{
+	Node first, last, n;
+
+	DBG_start("<statements>");
+
+	first = last = NO_NODE;
+	if (c->token.type == TOK_CHILL) {
+		get_token(&c->scanner, &c->token);
+	} else if (IS_STATEMENT(c->token.type)) {
+		for (;;) {
+			if (c->checking && last != NO_NODE
+					&& ast_stmt(&c->ast, last)->kind == STMT_EXIT
+					&& IS_STATEMENT(c->token.type)) {
+				lwprintf(&c->scanner.position,
+						"unreachable statement after exit");
+				c->warned = TRUE;
+			}
+			if ((n = guard_statement(c)) != NO_NODE) {
+				if (last == NO_NODE) {
+					first = n;
+				} else {
+					ast_stmt(&c->ast, last)->next = n;
+				}
+				last = n;
+			}
+			if (c->token.type != TOK_SEMICOLON) {
+				break;
+			}
+			get_token(&c->scanner, &c->token);
+		}
+	} else {
+		abort_c(c, ERR_STATEMENT_EXPECTED, c->token.type); 
+	}
+
+	DBG_end("</statements>");
+
+	return first;
+}
+
+/* <type> = ("boolean" | "integer") ["array"] .
+ */
+void parse_type(SimplCompiler *c, ValType *t0)
+{
+	DBG_start("<type>");
+
+	if (c->token.type == TOK_BOOLEAN) {
+		*t0 |= TYPE_BOOLEAN;
+	} else if (c->token.type == TOK_INTEGER) {
+		*t0 |= TYPE_INTEGER;
+	} else {
+		abort_c(c, ERR_TYPE_EXPECTED, c->token.type);
+	}
+	get_token(&c->scanner, &c->token);
+	if (c->token.type == TOK_ARRAY) {
+		get_token(&c->scanner, &c->token);
+		*t0 |= TYPE_ARRAY;
+	}
+
+	DBG_end("</type>");
+}
+
+/* <vardef> = <type> <id> { "," <id> } ";" .
+ */
+Node parse_vardef(SimplCompiler *c, Node *last)
+{
+	char *vname;
+	ValType t1;
+	SourcePos pos;
+	Node first, n;
+
+	DBG_start("<vardef>");
+	t1 = 0;
+	parse_type(c, &t1);
+	pos = c->scanner.position;
+	expect_id(c, &vname);
+	first = *last = new_var(&c->ast, vname, t1, pos);
+	if (c->checking) {
+		guard_var(c, first);
+	}
+	while (c->token.type == TOK_COMMA) {
+		get_token(&c->scanner, &c->token);
+		pos = c->scanner.position;
+		expect_id(c, &vname);
+		n = new_var(&c->ast, vname, t1, pos);
+		ast_var(&c->ast, *last)->next = n;
+		*last = n;
+		if (c->checking) {
+			guard_var(c, n);
+		}
+	}
+	expect(c, TOK_SEMICOLON);
+
+	DBG_end("</vardef>");
+
+	return first;
+}
+
+/* <statement> = <exit> | <if> | <name> | <read> | <while> | <write> .
+ */
+Node parse_statement(SimplCompiler *c)
+{
+	Node s;
+
+	DBG_start("<statement>");
+
+	checkpoint(c);
+	s = NO_NODE;
+	switch (c->token.type) {
+		case TOK_EXIT:  s = parse_exit(c);   break;
+		case TOK_IF:    s = parse_if(c);     break;
+		case TOK_ID:    s = parse_name(c);   break;
+		case TOK_READ:  s = parse_read(c);   break;
+		case TOK_WHILE: s = parse_while(c);  break;
+		case TOK_WRITE: s = parse_write(c);  break;
+		default:
+			abort_c(c, ERR_STATEMENT_EXPECTED, c->token.type);
+			break;
+	}
+	/* the guards of an if or a while were checked as soon as they were parsed,
+	 * before the statements that they guard
+	 */
+	if (c->checking && ast_stmt(&c->ast, s)->kind != STMT_IF
+			&& ast_stmt(&c->ast, s)->kind != STMT_WHILE) {
+		guard_check(c, s);
+	}
+
+	DBG_end("</statement>");
+
+	return s;
+}
+
+/* <exit> = "exit" [<expr>] .
+ */
+Node parse_exit(SimplCompiler *c)
+{
+	Node s, e;
+
+	DBG_start("<exit>");
+
+	s = new_stmt(&c->ast, STMT_EXIT, c->scanner.position);
+	expect(c, TOK_EXIT);
+	/* only a subroutine takes an expression; the main body does not */
+	if (STARTS_EXPR(c->token.type) && IS_CALLABLE_TYPE(c->return_type)) {
+		e = parse_expr(c);
+		ast_stmt(&c->ast, s)->expr = e;
+	}
+
+	DBG_end("</exit>");
+
+	return s;
+}
+
+/* <if> = "if" <expr> "then" <statements> {"elsif" <expr> "then" <statements>} 
+          ["else" <statements>] "end" . 
+ */
+Node parse_if(SimplCompiler *c)
+{
+	Node s, last, n, e, b;
+
+	DBG_start("<if>");
+
+	s = last = new_stmt(&c->ast, STMT_IF, c->scanner.position);
+	expect(c, TOK_IF);
+	e = parse_expr(c);
+	ast_stmt(&c->ast, s)->expr = e;
+	if (c->checking) {
+		guard_check(c, s);
+	}
+	expect(c, TOK_THEN);
+	b = parse_statements(c);
+	ast_stmt(&c->ast, s)->body = b;
+
+	while (c->token.type == TOK_ELSIF) {
+		n = new_stmt(&c->ast, STMT_ELSIF, c->scanner.position);
+		ast_stmt(&c->ast, last)->alt = n;
+		last = n;
+		get_token(&c->scanner, &c->token);
+		e = parse_expr(c);
+		ast_stmt(&c->ast, n)->expr = e;
+		if (c->checking) {
+			guard_check(c, n);
+		}
+		expect(c, TOK_THEN);
+		b = parse_statements(c);
+		ast_stmt(&c->ast, n)->body = b;
+	}
+	if (c->token.type == TOK_ELSE) {
+		n = new_stmt(&c->ast, STMT_ELSE, c->scanner.position);
+		ast_stmt(&c->ast, last)->alt = n;
+		get_token(&c->scanner, &c->token);
+		b = parse_statements(c);
+		ast_stmt(&c->ast, n)->body = b;
+	}
+	expect(c, TOK_END);
+
+	DBG_end("</if>");
+
+	return s;
+}
+
+/* <name> = <id> (<arglist> | [<index>] "<-" (<expr> | "array" <simple>)) .
+ */
+Node parse_name(SimplCompiler *c)
+{
+	char *id;
+	SourcePos idpos, at;
+	Node s, name, index, e, args;
+	StmtKind kind;
+
+	DBG_start("<name>");
+
+	s = e = NO_NODE;
+	kind = STMT_ASSIGN;
+	idpos = c->scanner.position;
+	expect_id(c, &id);
+	name = new_name(&c->ast, id, idpos);
+	if (c->token.type == TOK_LPAR) {
+		args = parse_arglist(c);
+		s = new_stmt(&c->ast, STMT_CALL, idpos);
+		ast_stmt(&c->ast, s)->name = name;
+		ast_stmt(&c->ast, s)->args = args;
+	} else if (c->token.type == TOK_LBRACK || c->token.type == TOK_GETS) {
+		index = NO_NODE;
+		if (c->token.type == TOK_LBRACK) {
+			index = parse_index(c);
+		}
+		expect(c, TOK_GETS);
+		at = c->scanner.position;
+		if (STARTS_EXPR(c->token.type)) {
+			e = parse_expr(c);
+		} else if (c->token.type == TOK_ARRAY) {
+			kind = STMT_ALLOC;
+			get_token(&c->scanner, &c->token);
+			e = parse_simple(c);
+		} else {
+			abort_c(c, ERR_ARRAY_ALLOCATION_OR_EXPRESSION_EXPECTED,
+					c->token.type);
+		}
+		s = new_stmt(&c->ast, kind, idpos);
+		ast_stmt(&c->ast, s)->at = at;
+		ast_stmt(&c->ast, s)->name = name;
+		ast_stmt(&c->ast, s)->index = index;
+		ast_stmt(&c->ast, s)->expr = e;
+	} else {
+		abort_c(c, ERR_ARGUMENT_LIST_OR_VARIABLE_ASSIGNMENT_EXPECTED,
+				c->token.type);
+	}
+			
+	DBG_end("</name>");
+
+	return s;
+}
+
+/* <read> = "read" <id> [<index>] .
+ */
+Node parse_read(SimplCompiler *c)
+{
+	char *vname; 
+	SourcePos pos;
+	Node s, name, index;
+
+	DBG_start("<read>");
+
+	s = new_stmt(&c->ast, STMT_READ, c->scanner.position);
+	expect(c, TOK_READ);
+	pos = c->scanner.position;
+	expect_id(c, &vname);
+	name = new_name(&c->ast, vname, pos);
+	index = NO_NODE;
+	if (c->token.type == TOK_LBRACK) {
+		index = parse_index(c);
+	}
+	ast_stmt(&c->ast, s)->name = name;
+	ast_stmt(&c->ast, s)->index = index;
+
+	DBG_end("</read>");
+
+	return s;
+}
+
+/* <while> = "while" <expr> "do" <statements> "end" .
+ */
+Node parse_while(SimplCompiler *c)
+{
+	Node s, e, b;
+
+	DBG_start("<while>");
+
+	s = new_stmt(&c->ast, STMT_WHILE, c->scanner.position);
+	expect(c, TOK_WHILE);
+	e = parse_expr(c);
+	ast_stmt(&c->ast, s)->expr = e;
+	if (c->checking) {
+		guard_check(c, s);
+	}
+	expect(c, TOK_DO);
+	b = parse_statements(c);
+	ast_stmt(&c->ast, s)->body = b;
+	expect(c, TOK_END);
+
+	DBG_end("</while>");
+
+	return s;
+}
+
+/* <write> = "write" (<string> | <expr>) {"&" (<string> | <expr>)} .
+ */
+Node parse_write(SimplCompiler *c)
+{
+	SourcePos pos;
+	Node s, item, last, e;
+
+	DBG_start("<write>");
+	
+	pos = c->scanner.position;
+	s = new_stmt(&c->ast, STMT_WRITE, pos);
+	expect(c, TOK_WRITE);
+	last = NO_NODE;
+	for (;;) {
+		item = NO_NODE;
+		if (c->token.type == TOK_STR) {
+			item = new_arg(&c->ast, NO_NODE, c->token.string);
+			get_token(&c->scanner, &c->token);
+		} else if (STARTS_EXPR(c->token.type)) {
+			e = parse_expr(c);
+			item = new_arg(&c->ast, e, NULL);
+		} else {
+			abort_c(c, ERR_EXPRESSION_OR_STRING_EXPECTED, c->token.type);
+		}
+		ast_arg(&c->ast, item)->pos = pos;
+		if (last == NO_NODE) {
+			ast_stmt(&c->ast, s)->args = item;
+		} else {
+			ast_arg(&c->ast, last)->next = item;
+		}
+		last = item;
+
+		if (c->token.type != TOK_AMPERSAND) {
+			break;
+		}
+		pos = c->scanner.position;
+		get_token(&c->scanner, &c->token);
+	}
+
+	DBG_end("</write>");
+
+	return s;
+}
+
+/* <arglist> = "(" [<expr> {"," <expr>}] ")" .
+ */
+Node parse_arglist(SimplCompiler *c)
+{
+	Node first, last, a, e;
+
+	DBG_start("<arglist>");
+
+	first = last = NO_NODE;
+	expect(c, TOK_LPAR);
+	if (STARTS_EXPR(c->token.type)) {
+		e = parse_expr(c);
+		first = last = new_arg(&c->ast, e, NULL);
+		ast_arg(&c->ast, last)->pos = c->scanner.position;
+		while (c->token.type == TOK_COMMA) {
+			get_token(&c->scanner, &c->token);
+			e = parse_expr(c);
+			a = new_arg(&c->ast, e, NULL);
+			ast_arg(&c->ast, a)->pos = c->scanner.position;
+			ast_arg(&c->ast, last)->next = a;
+			last = a;
+		}
+	}
+	expect(c, TOK_RPAR);
+
+	DBG_end("</arglist>");
+
+	return first;
+}
+
+/* <index> = "[" <simple> "]" .
+ */
+Node parse_index(SimplCompiler *c)
+{
+	Node e;
+
+	DBG_start("<index>");
+
+	expect(c, TOK_LBRACK);
+	e = parse_simple(c);
+	expect(c, TOK_RBRACK);
+	
+	DBG_end("</index>");
+
+	return e;
+}
+
+/* <expr>   = <simple> [<relop> <simple>] .
+ * <simple> = ["-"] <term> {<addop> <term>} .
+ * <term>   = <factor> {<mulop> <factor>} .
+ * <factor> = <id> [<index> | <arglist>] | <num> | "not" <factor> | "true" |
+ *            "false" | "(" <expr> ")" .
+ *
+ * Expressions are parsed by operator precedence, on stacks of their own rather
+ * than on the C stack, so that however deeply an expression nests, it costs
+ * the parser no more than a few entries per level.  The operator stack holds
+ * the operators still waiting for their right operands, and marks for the
+ * parentheses, indices, and argument lists still open; the operand stack
+ * holds the subtrees built so far.  An operator is applied to the operands on
+ * top of the stack once an operator that binds no tighter follows it, or its
+ * group closes.
+ *
+ * From loosest to tightest, a relop, an addop, the leading minus of a
+ * <simple>, a mulop, and a "not" bind their operands.  A relop does not
+ * associate, and the minus may only lead a <simple>, so that the trees are
+ * those of the grammar above.
+ */
+Node parse_expr(SimplCompiler *c)
+{
+	return parse_operators(c, FALSE);
+}
+
+Node parse_simple(SimplCompiler *c)
+{
+	return parse_operators(c, TRUE);
+}
+
+/* Parses an expression, or only a <simple>, as described above.
+ */
+Node parse_operators(SimplCompiler *c, Boolean simple)
+{
+	ExprOp *group;
+	Node e;
+	Boolean start, done;
+
+	DBG_start(simple ? "<simple>" : "<expr>");
+
+	c->exprs.nops = c->exprs.nvals = 0;
+	group = push_op(c, OP_TOP, TOK_EOF, PREC_GROUP, c->scanner.position);
+	group->simple = simple;
+	start = TRUE;
+	done = FALSE;
+	while (!done) {
+		/* a prefix operator or an open group awaits its operand */
+		if ((e = parse_factor(c, &start)) == NO_NODE) {
+			continue;
+		}
+		/* otherwise, the factor is followed by an operator, or it closes the
+		 * innermost group, which is itself a factor */
+		do {
+			push_val(c, e);
+			apply_ops(c, PREC_NOT);
+			if (parse_operator(c, &start)) {
+				break;
+			}
+			e = close_group(c, &start, &done);
+		} while (e != NO_NODE && !done);
+	}
+
+	DBG_end(simple ? "</simple>" : "</expr>");
+
+	return e;
+}
+
+/* Parses a factor, or only the prefix operator or open group that starts it,
+ * in which case NO_NODE is returned and its operand is parsed next.  The flag
+ * says whether a <simple> starts here, and is cleared.
+ */
+Node parse_factor(SimplCompiler *c, Boolean *start)
+{
+	char *vname;
+	SourcePos pos;
+	Node e, name;
+	ExprOp *group;
+	Boolean leading;
+
+	e = NO_NODE;
+	pos = c->scanner.position;
+	leading = *start;
+	*start = FALSE;
+	switch (c->token.type) {
+		case TOK_ID:
+			expect_id(c, &vname);
+			name = new_name(&c->ast, vname, pos);
+			if (c->token.type == TOK_LBRACK) {
+				get_token(&c->scanner, &c->token);
+				group = push_op(c, OP_INDEX, TOK_LBRACK, PREC_GROUP, pos);
+				group->name = name;
+				group->simple = TRUE;
+				*start = TRUE;
+				return NO_NODE;
+			} else if (c->token.type == TOK_LPAR) {
+				get_token(&c->scanner, &c->token);
+				if (STARTS_EXPR(c->token.type)) {
+					group = push_op(c, OP_ARGS, TOK_LPAR, PREC_GROUP, pos);
+					group->name = name;
+					*start = TRUE;
+					return NO_NODE;
+				}
+				expect(c, TOK_RPAR);
+				e = new_expr(&c->ast, EXPR_CALL, pos, pos);
+			} else {
+				e = new_expr(&c->ast, EXPR_VAR, pos, pos);
+			}
+			ast_expr(&c->ast, e)->name = name;
+			break;
+
+		case TOK_NUM:
+			e = new_expr(&c->ast, EXPR_NUM, pos, pos);
+			ast_expr(&c->ast, e)->value = c->token.value;
+			get_token(&c->scanner, &c->token);
+			break;
+
+		case TOK_NOT:
+			get_token(&c->scanner, &c->token);
+			push_op(c, OP_NOT, TOK_NOT, PREC_NOT, pos);
+			break;
+
+		case TOK_TRUE:
+			e = new_expr(&c->ast, EXPR_TRUE, pos, pos);
+			get_token(&c->scanner, &c->token);
+			break;
+
+		case TOK_FALSE:
+			e = new_expr(&c->ast, EXPR_FALSE, pos, pos);
+			get_token(&c->scanner, &c->token);
+			break;
+
+		case TOK_LPAR:
+			get_token(&c->scanner, &c->token);
+			push_op(c, OP_PAREN, TOK_LPAR, PREC_GROUP, pos);
+			*start = TRUE;
+			break;
+
+		case TOK_MINUS:
+			if (leading) {
+				get_token(&c->scanner, &c->token);
+				push_op(c, OP_NEG, TOK_MINUS, PREC_NEG, pos);
+				break;
+			}
+			/* FALLTHROUGH */
+
+		default:
+			abort_c(c, ERR_FACTOR_EXPECTED, c->token.type);
+			break;
+	}
+
+	return e;
+}
+
+/* Parses the binary operator after an operand, if there is one that may
+ * continue the innermost group, once the operators that bind at least as
+ * tightly have been applied.
+ */
+Boolean parse_operator(SimplCompiler *c, Boolean *start)
+{
+	TokenType op;
+	ExprOp *group;
+	unsigned int i;
+
+	op = c->token.type;
+	if (IS_RELOP(op)) {
+		for (i = c->exprs.nops - 1; !IS_GROUP(c->exprs.ops[i].kind); i--)
+			;
+		group = &c->exprs.ops[i];
+		if (group->simple) {
+			return FALSE;
+		}
+		group->simple = TRUE;
+	} else if (!IS_ADDOP(op) && !IS_MULOP(op)) {
+		return FALSE;
+	}
+
+	apply_ops(c, get_prec(op));
+	push_op(c, OP_BINARY, op, get_prec(op), c->scanner.position);
+	get_token(&c->scanner, &c->token);
+	*start = IS_RELOP(op);
+
+	return TRUE;
+}
+
+/* Closes the innermost group, once the operand on top of the stack ends it,
+ * and returns the group as a factor, or NO_NODE if another argument follows.
+ */
+Node close_group(SimplCompiler *c, Boolean *start, Boolean *done)
+{
+	ExprOp *group;
+	Node a, e, x;
+
+	apply_ops(c, PREC_GROUP);
+	e = c->exprs.vals[--c->exprs.nvals];
+	group = &c->exprs.ops[c->exprs.nops - 1];
+	x = e;
+
+	switch (group->kind) {
+		case OP_TOP:
+			*done = TRUE;
+			break;
+
+		case OP_PAREN:
+			expect(c, TOK_RPAR);
+			/* the parenthesis starts the factor, for error reporting */
+			ast_expr(&c->ast, e)->start = group->pos;
+			break;
+
+		case OP_INDEX:
+			expect(c, TOK_RBRACK);
+			x = new_expr(&c->ast, EXPR_INDEX, group->pos, group->pos);
+			ast_expr(&c->ast, x)->right = e;
+			ast_expr(&c->ast, x)->name = group->name;
+			break;
+
+		case OP_ARGS:
+			a = new_arg(&c->ast, e, NULL);
+			ast_arg(&c->ast, a)->pos = c->scanner.position;
+			if (group->first == NO_NODE) {
+				group->first = a;
+			} else {
+				ast_arg(&c->ast, group->last)->next = a;
+			}
+			group->last = a;
+			if (c->token.type == TOK_COMMA) {
+				get_token(&c->scanner, &c->token);
+				group->simple = FALSE;
+				*start = TRUE;
+				return NO_NODE;
+			}
+			expect(c, TOK_RPAR);
+			x = new_expr(&c->ast, EXPR_CALL, group->pos, group->pos);
+			ast_expr(&c->ast, x)->args = group->first;
+			ast_expr(&c->ast, x)->name = group->name;
+			break;
+
+		default:
+			break;
+	}
+	c->exprs.nops--;
+
+	return x;
+}
+
+/* Pushes an entry on the operator stack, which is valid until the next push.
+ */
+ExprOp *push_op(SimplCompiler *c, ExprOpKind kind, TokenType op, int prec,
+		SourcePos pos)
+{
+	ExprStack *s = &c->exprs;
+	ExprOp *o;
+
+	if (s->nops == s->opcap) {
+		s->opcap = (s->opcap == 0 ? INITIAL_EXPR_STACK : s->opcap * 2);
+		s->ops = erealloc(s->ops, s->opcap * sizeof(ExprOp));
+	}
+	o = &s->ops[s->nops++];
+	o->kind = kind;
+	o->op = op;
+	o->prec = prec;
+	o->pos = pos;
+	o->name = o->first = o->last = NO_NODE;
+	o->simple = FALSE;
+
+	return o;
+}
+
+void push_val(SimplCompiler *c, Node e)
+{
+	ExprStack *s = &c->exprs;
+
+	if (s->nvals == s->valcap) {
+		s->valcap = (s->valcap == 0 ? INITIAL_EXPR_STACK : s->valcap * 2);
+		s->vals = erealloc(s->vals, s->valcap * sizeof(Node));
+	}
+	s->vals[s->nvals++] = e;
+}
+
+/* Applies the operators on top of the operator stack, down to the innermost
+ * group, that bind at least as tightly as the given precedence.
+ */
+void apply_ops(SimplCompiler *c, int prec)
+{
+	ExprStack *s = &c->exprs;
+	ExprOp *o;
+	Node e;
+
+	for (;;) {
+		o = &s->ops[s->nops - 1];
+		if (IS_GROUP(o->kind) || o->prec < prec) {
+			break;
+		}
+		if (o->kind == OP_BINARY) {
+			e = s->vals[--s->nvals];
+			e = make_binary(c, o->op, o->pos, s->vals[s->nvals - 1], e);
+		} else {
+			e = new_expr(&c->ast, (o->kind == OP_NEG ? EXPR_NEG : EXPR_NOT),
+					o->pos, o->pos);
+			ast_expr(&c->ast, e)->left = s->vals[s->nvals - 1];
+		}
+		s->vals[s->nvals - 1] = e;
+		s->nops--;
+	}
+}
+
+int get_prec(TokenType op)
+{
+	if (IS_MULOP(op)) {
+		return PREC_MUL;
+	} else if (IS_ADDOP(op)) {
+		return PREC_ADD;
+	} else {
+		return PREC_REL;
+	}
+}
+
+void init_exprs(ExprStack *s)
+{
+	s->ops = NULL;
+	s->vals = NULL;
+	s->nops = s->opcap = s->nvals = s->valcap = 0;
+}
+
+void release_exprs(ExprStack *s)
+{
+	efree(s->ops);
+	efree(s->vals);
+	init_exprs(s);
+}
+
+/* --- type checking -------------------------------------------------------- */
+
+/* The checker declares the variables of a body, resolves every name against
+ * the symbol table, and records the type of every expression in the tree for
+ * the translator.  It is called by the parser on each piece of the tree as the
+ * piece is completed, so that a statement is checked without the statements
+ * nested in it, which have been checked already, or are yet to be parsed.
+ * Errors are reported at the positions that the parser recorded in the tree.
+ */
+
+void check_var(SimplCompiler *c, Node v)
+{
+	Var *var;
+	IDprop *prop, *slot;
+
+	var = ast_var(&c->ast, v);
+	prop = make_idprop(var->type, get_variables_width(&c->symbols), 0, NULL);
+	if (!declare_name(&c->symbols, var->id, prop, &slot)) {
+		abort_cp(c, &var->pos, ERR_MULTIPLE_DEFINITION, var->id);
+	}
+	var->id = NULL;
+}
+
+void check_statement(SimplCompiler *c, Node n)
+{
+	Stmt *s;
+	Name *m;
+	Expr *e;
+	IDprop *prop;
+	ValType t1, t2, proptype;
+	Boolean is_array;
+
+	s = ast_stmt(&c->ast, n);
+	switch (s->kind) {
+		case STMT_EXIT:
+			if (s->expr != NO_NODE) {
+				e = ast_expr(&c->ast, s->expr);
+				if (IS_PROCEDURE(c->return_type)) {
+					abort_cp(c, &e->start,
+							ERR_EXIT_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE);
+				}
+				t1 = check_expr(c, s->expr);
+				t2 = c->return_type;
+				SET_RETURN_TYPE(t2);
+				check_types(c, t1, t2, &e->start, "for 'exit' statement");
+			} else if (IS_FUNCTION(c->return_type)) {
+				abort_cp(c, &s->pos, ERR_MISSING_EXIT_EXPRESSION_FOR_FUNCTION);
+			}
+			break;
+
+		case STMT_IF:
+		case STMT_ELSIF:
+			t1 = check_expr(c, s->expr);
+			check_types(c, t1, TYPE_BOOLEAN, &ast_expr(&c->ast, s->expr)->start,
+					(s->kind == STMT_IF ? "for 'if' guard"
+					 : "for 'elsif' guard"));
+			break;
+
+		case STMT_ELSE:
+			break;
+
+		case STMT_CALL:
+			prop = resolve(c, s->name);
+			m = ast_name(&c->ast, s->name);
+			if (!IS_PROCEDURE(prop->type)) {
+				abort_cp(c, &m->pos, ERR_NOT_A_PROCEDURE, m->id);
+			}
+			check_arglist(c, s->name, s->args);
+			break;
+
+		case STMT_ASSIGN:
+		case STMT_ALLOC:
+			prop = resolve(c, s->name);
+			m = ast_name(&c->ast, s->name);
+			if (IS_CALLABLE_TYPE(prop->type)) {
+				abort_cp(c, &m->pos, ERR_NOT_A_VARIABLE, m->id);
+			}
+			proptype = prop->type;
+			is_array = IS_ARRAY(prop->type);
+			if (s->index != NO_NODE) {
+				if (!IS_ARRAY(prop->type)) {
+					abort_cp(c, &m->pos, ERR_NOT_AN_ARRAY, m->id);
+				}
+				proptype ^= TYPE_ARRAY;
+				is_array = FALSE;
+				check_index(c, s->name, s->index);
+			}
+			e = ast_expr(&c->ast, s->expr);
+			if (s->kind == STMT_ALLOC) {
+				if (s->index != NO_NODE) {
+					check_types(c, prop->type, proptype, &s->at,
+					"for allocation to indexed array '%s'", m->id);
+				}
+				if (!IS_ARRAY(prop->type)) {
+					abort_cp(c, &m->pos, ERR_NOT_AN_ARRAY, m->id);
+				}
+				t1 = check_expr(c, s->expr);
+				check_types(c, t1, TYPE_INTEGER, &e->start,
+				"for array size of '%s'", m->id);
+			} else {
+				t1 = check_expr(c, s->expr);
+				if (!IS_VARIABLE(proptype)) {
+					abort_cp(c, &m->pos, ERR_NOT_A_VARIABLE, m->id);
+				}
+				if (!is_array && IS_ARRAY(t1)) {
+					if (s->index != NO_NODE) {
+						check_types(c, t1, proptype, &s->at,
+						"for allocation to indexed array '%s'", m->id);
+					} else {
+						abort_cp(c, &m->pos, ERR_NOT_AN_ARRAY, m->id);
+					}
+				} else {
+					check_types(c, t1, proptype, &s->at,
+					"for assignment to '%s'", m->id);
+				}
+			}
+			break;
+
+		case STMT_READ:
+			prop = resolve(c, s->name);
+			m = ast_name(&c->ast, s->name);
+			if (s->index != NO_NODE) {
+				if (!IS_ARRAY(prop->type)) {
+					abort_cp(c, &m->pos, ERR_NOT_AN_ARRAY, m->id);
+				}
+				check_index(c, s->name, s->index);
+			} else if (IS_ARRAY(prop->type)) {
+				abort_cp(c, &m->pos, ERR_SCALAR_VARIABLE_EXPECTED, m->id);
+			}
+			break;
+
+		case STMT_WHILE:
+			t1 = check_expr(c, s->expr);
+			check_types(c, t1, TYPE_BOOLEAN, &ast_expr(&c->ast, s->expr)->start,
+					"for 'while' guard");
+			break;
+
+		case STMT_WRITE:
+			check_items(c, s->args);
+			break;
+	}
+}
+
+void check_items(SimplCompiler *c, Node a)
+{
+	Arg *item;
+	const char *op;
+
+	for (op = "write"; a != NO_NODE; a = item->next, op = "&") {
+		item = ast_arg(&c->ast, a);
+		if (item->expr != NO_NODE && IS_ARRAY(check_expr(c, item->expr))) {
+			abort_cp(c, &item->pos, ERR_ILLEGAL_ARRAY_OPERATION, op);
+		}
+	}
+}
+
+void check_arglist(SimplCompiler *c, Node name, Node args)
+{
+	Name *m;
+	Arg *a, *prev;
+	IDprop *prop;
+	ValType t1;
+	unsigned int i;
+	char *routine;
+
+	m = ast_name(&c->ast, name);
+	prop = m->prop;
+	if (c->lazy) {
+		reach(c, m->id);
+	}
+	if (IS_FUNCTION(prop->type)) {
+		routine = "function";
+	} else {
+		routine = "procedure";
+	}
+	if (args == NO_NODE) {
+		if (prop->nparams > 0) {
+			abort_cp(c, &m->pos, ERR_TOO_FEW_ARGUMENTS, m->id);
+		}
+		return;
+	}
+	if (prop->nparams == 0) {
+		abort_cp(c, &m->pos, ERR_TAKES_NO_ARGUMENTS, m->id, routine);
+	}
+	for (i = 0, prev = NULL; args != NO_NODE; i++, args = a->next) {
+		a = ast_arg(&c->ast, args);
+		if (i >= prop->nparams) {
+			abort_cp(c, &prev->pos, ERR_TOO_MANY_ARGUMENTS, m->id);
+		}
+		t1 = check_expr(c, a->expr);
+		check_types(c, t1, prop->params[i], &ast_expr(&c->ast, a->expr)->start,
+		"for parameter %d of call to '%s'", i + 1, m->id);
+		prev = a;
+	}
+	if (i < prop->nparams) {
+		abort_cp(c, &prev->pos, ERR_TOO_FEW_ARGUMENTS, m->id);
+	}
+}
+
+void check_index(SimplCompiler *c, Node name, Node index)
+{
+	ValType t1;
+
+	t1 = check_expr(c, index);
+	check_types(c, t1, TYPE_INTEGER, &ast_expr(&c->ast, index)->start,
+	"for array index of '%s'", ast_name(&c->ast, name)->id);
+}
+
+ValType check_expr(SimplCompiler *c, Node n)
+{
+	Expr *e;
+	Name *m;
+	IDprop *prop;
+	ValType t0, t1, t2;
+	const char *op;
+
+	e = ast_expr(&c->ast, n);
+	t0 = TYPE_NONE;
+	switch (e->kind) {
+		case EXPR_VAR:
+			prop = resolve(c, e->name);
+			m = ast_name(&c->ast, e->name);
+			if (IS_FUNCTION(prop->type)) {
+				abort_cp(c, &m->pos, ERR_MISSING_FUNCTION_ARGUMENT_LIST, m->id);
+			}
+			t0 = prop->type;
+			break;
+
+		case EXPR_INDEX:
+			prop = resolve(c, e->name);
+			m = ast_name(&c->ast, e->name);
+			if (!IS_ARRAY(prop->type)) {
+				abort_cp(c, &m->pos, ERR_NOT_AN_ARRAY, m->id);
+			}
+			t0 = prop->type & 6;
+			check_index(c, e->name, e->right);
+			break;
+
+		case EXPR_CALL:
+			prop = resolve(c, e->name);
+			m = ast_name(&c->ast, e->name);
+			if (!IS_FUNCTION(prop->type)) {
+				abort_cp(c, &m->pos, ERR_NOT_A_FUNCTION, m->id);
+			}
+			t0 = prop->type ^ TYPE_CALLABLE;
+			check_arglist(c, e->name, e->args);
+			break;
+
+		case EXPR_NUM:
+			t0 = TYPE_INTEGER;
+			break;
+
+		case EXPR_TRUE:
+		case EXPR_FALSE:
+			t0 = TYPE_BOOLEAN;
+			break;
+
+		case EXPR_NOT:
+			t0 = check_expr(c, e->left);
+			check_types(c, t0, TYPE_BOOLEAN, &ast_expr(&c->ast, e->left)->start,
+					"for 'not'");
+			break;
+
+		case EXPR_NEG:
+			t0 = check_expr(c, e->left);
+			if (IS_ARRAY(t0)) {
+				abort_cp(c, &e->pos, ERR_ILLEGAL_ARRAY_OPERATION,
+						"unary minus");
+			}
+			check_types(c, t0, TYPE_INTEGER, &ast_expr(&c->ast, e->left)->start,
+					"for unary minus");
+			break;
+
+		case EXPR_BINARY:
+			op = get_token_string(e->op);
+			t1 = check_expr(c, e->left);
+			if (IS_ARRAY(t1)) {
+				abort_cp(c, &e->pos, ERR_ILLEGAL_ARRAY_OPERATION, op);
+			}
+			t2 = check_expr(c, e->right);
+			if (IS_ARRAY(t2)) {
+				abort_cp(c, &e->pos, ERR_ILLEGAL_ARRAY_OPERATION, op);
+			}
+			if (e->op == TOK_EQ || e->op == TOK_NE) {
+				check_types(c, t2, t1, &e->pos, "for operator %s", op);
+				t0 = TYPE_BOOLEAN;
+			} else if (e->op == TOK_AND || e->op == TOK_OR) {
+				check_types(c, t1, TYPE_BOOLEAN, &e->pos, "for operator %s",
+						op);
+				check_types(c, t2, TYPE_BOOLEAN, &e->pos, "for operator %s",
+						op);
+				t0 = TYPE_BOOLEAN;
+			} else {
+				check_types(c, t1, TYPE_INTEGER, &e->pos, "for operator %s",
+						op);
+				check_types(c, t2, TYPE_INTEGER, &e->pos, "for operator %s",
+						op);
+				t0 = (IS_RELOP(e->op) ? TYPE_BOOLEAN : TYPE_INTEGER);
+			}
+			break;
+	}
+	e->type = t0;
+	fold_expr(c, n);
+
+	return t0;
+}
+
+IDprop *resolve(SimplCompiler *c, Node name)
+{
+	Name *m;
+
+	m = ast_name(&c->ast, name);
+	if (!find_name(&c->symbols, m->id, &m->prop)) {
+		abort_cp(c, &m->pos, ERR_UNKNOWN_IDENTIFIER, m->id);
+	}
+
+	return m->prop;
+}
+
+/* --- folding -------------------------------------------------------------- */
+
+/* Every expression is folded as soon as it is checked, after its operands, so
+ * that an operand that is constant is a literal by the time its parent is
+ * folded.  An operation on literals is replaced by the literal that it yields,
+ * except for a division by zero, which is left to fail at run time.  An
+ * operation with an identity element is replaced by its other operand, and an
+ * operation with an absorbing element is replaced by that element, but only if
+ * its other operand has no effect and cannot fail, since the operands are
+ * evaluated whatever their values.
+ */
+
+void fold_expr(SimplCompiler *c, Node n)
+{
+	Expr *e, *l;
+	int a;
+
+	e = ast_expr(&c->ast, n);
+	switch (e->kind) {
+		case EXPR_NOT:
+			l = ast_expr(&c->ast, e->left);
+			if (is_constant(l, &a)) {
+				set_constant(e, !a);
+				c->folds++;
+			} else if (l->kind == EXPR_NOT) {
+				replace_expr(c, e, l->left);
+				c->identities++;
+			} else if (l->kind == EXPR_BINARY && IS_RELOP(l->op)) {
+				replace_expr(c, e, e->left);
+				e->op = invert_relop(e->op);
+				c->identities++;
+			}
+			break;
+
+		case EXPR_NEG:
+			l = ast_expr(&c->ast, e->left);
+			if (is_constant(l, &a)) {
+				set_constant(e, fold_operation(TOK_MINUS, 0, a));
+				c->folds++;
+			} else if (l->kind == EXPR_NEG) {
+				replace_expr(c, e, l->left);
+				c->identities++;
+			}
+			break;
+
+		case EXPR_BINARY:
+			fold_binary(c, n);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* Folds a binary operation.  Where an identity turns the operation into a
+ * negation, the negation is folded in turn, since its operand may be a
+ * negation too.
+ */
+void fold_binary(SimplCompiler *c, Node n)
+{
+	Expr *e;
+	Node x, k;
+	Boolean lc, rc;
+	int a, b, v;
+
+	e = ast_expr(&c->ast, n);
+	lc = is_constant(ast_expr(&c->ast, e->left), &a);
+	rc = is_constant(ast_expr(&c->ast, e->right), &b);
+	if (lc && rc) {
+		if ((e->op == TOK_DIV || e->op == TOK_MOD) && b == 0) {
+			return;
+		}
+		set_constant(e, fold_operation(e->op, a, b));
+		c->folds++;
+		return;
+	} else if (!lc && !rc) {
+		return;
+	}
+
+	/* x is the operand that is not constant, and v the value of the other */
+	x = (lc ? e->right : e->left);
+	k = (lc ? e->left : e->right);
+	v = (lc ? a : b);
+	switch (e->op) {
+		case TOK_PLUS:
+		case TOK_OR:
+			if (v != 0) {
+				if (e->op == TOK_PLUS || !is_pure(c, x)) {
+					return;
+				}
+				replace_expr(c, e, k);
+			} else {
+				replace_expr(c, e, x);
+			}
+			break;
+
+		case TOK_MINUS:
+			if (v != 0) {
+				return;
+			} else if (rc) {
+				replace_expr(c, e, x);
+			} else {
+				apply_unary(e, EXPR_NEG, x);
+			}
+			break;
+
+		case TOK_MUL:
+		case TOK_AND:
+			if (v == 1) {
+				replace_expr(c, e, x);
+			} else if (v == 0 && is_pure(c, x)) {
+				replace_expr(c, e, k);
+			} else if (v == -1 && e->op == TOK_MUL) {
+				apply_unary(e, EXPR_NEG, x);
+			} else {
+				return;
+			}
+			break;
+
+		case TOK_DIV:
+			if (rc && v == 1) {
+				replace_expr(c, e, x);
+			} else if (rc && v == -1) {
+				apply_unary(e, EXPR_NEG, x);
+			} else {
+				return;
+			}
+			break;
+
+		case TOK_MOD:
+			if (rc && (v == 1 || v == -1) && is_pure(c, x)) {
+				set_constant(e, 0);
+			} else {
+				return;
+			}
+			break;
+
+		case TOK_EQ:
+		case TOK_NE:
+			/* only a boolean is compared with true or false */
+			if (ast_expr(&c->ast, x)->type != TYPE_BOOLEAN) {
+				return;
+			} else if (v == (e->op == TOK_EQ)) {
+				replace_expr(c, e, x);
+			} else {
+				apply_unary(e, EXPR_NOT, x);
+			}
+			break;
+
+		default:
+			return;
+	}
+	c->identities++;
+	fold_expr(c, n);
+}
+
+/* Turns an expression into a literal, of its own type. */
+void set_constant(Expr *e, int value)
+{
+	if (e->type == TYPE_BOOLEAN) {
+		e->kind = (value ? EXPR_TRUE : EXPR_FALSE);
+	} else {
+		e->kind = EXPR_NUM;
+	}
+	e->value = value;
+	e->name = e->left = e->right = e->args = NO_NODE;
+}
+
+/* Replaces an expression by one of its operands, which keeps its own type and
+ * positions, other than the start of the expression.
+ */
+void replace_expr(SimplCompiler *c, Expr *e, Node n)
+{
+	SourcePos start;
+
+	start = e->start;
+	*e = *ast_expr(&c->ast, n);
+	e->start = start;
+}
+
+/* Turns an expression into a negation of one of its operands. */
+void apply_unary(Expr *e, ExprKind kind, Node operand)
+{
+	e->kind = kind;
+	e->left = operand;
+	e->right = NO_NODE;
+}
+
+Boolean is_constant(const Expr *e, int *value)
+{
+	switch (e->kind) {
+		case EXPR_NUM:
+			*value = e->value;
+			return TRUE;
+		case EXPR_TRUE:
+			*value = 1;
+			return TRUE;
+		case EXPR_FALSE:
+			*value = 0;
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/* Returns whether evaluating an expression has no effect and cannot fail, so
+ * that the expression may be left out.  A call may have effects, and an array
+ * element or a division by anything but a nonzero literal may fail.
+ */
+Boolean is_pure(SimplCompiler *c, Node n)
+{
+	Expr *e;
+	int v;
+
+	e = ast_expr(&c->ast, n);
+	switch (e->kind) {
+		case EXPR_VAR:
+		case EXPR_NUM:
+		case EXPR_TRUE:
+		case EXPR_FALSE:
+			return TRUE;
+		case EXPR_NOT:
+		case EXPR_NEG:
+			return is_pure(c, e->left);
+		case EXPR_BINARY:
+			if ((e->op == TOK_DIV || e->op == TOK_MOD)
+					&& !(is_constant(ast_expr(&c->ast, e->right), &v)
+						&& v != 0)) {
+				return FALSE;
+			}
+			return is_pure(c, e->left) && is_pure(c, e->right);
+		default:
+			return FALSE;
+	}
+}
+
+/* Computes an operation on two values as the virtual machine does, in 32-bit
+ * two's complement: a sum, difference, or product wraps around, and the
+ * quotient of the most negative integer by -1 is that integer again.  The
+ * divisor of a division must not be zero.
+ */
+int fold_operation(TokenType op, int a, int b)
+{
+	switch (op) {
+		case TOK_PLUS:
+			return (int) ((unsigned int) a + (unsigned int) b);
+		case TOK_MINUS:
+			return (int) ((unsigned int) a - (unsigned int) b);
+		case TOK_MUL:
+			return (int) ((unsigned int) a * (unsigned int) b);
+		case TOK_DIV:
+			return (b == -1 ? (int) (0u - (unsigned int) a) : a / b);
+		case TOK_MOD:
+			return (b == -1 ? 0 : a % b);
+		case TOK_AND:
+			return a & b;
+		case TOK_OR:
+			return a | b;
+		case TOK_EQ:
+			return a == b;
+		case TOK_GE:
+			return a >= b;
+		case TOK_GT:
+			return a > b;
+		case TOK_LE:
+			return a <= b;
+		case TOK_LT:
+			return a < b;
+		case TOK_NE:
+			return a != b;
+		default:
+			eprintf("unreachable: %s", get_token_string(op));
+			return 0;
+	}
+}
+
+TokenType invert_relop(TokenType op)
+{
+	switch (op) {
+		case TOK_EQ: return TOK_NE;
+		case TOK_GE: return TOK_LT;
+		case TOK_GT: return TOK_LE;
+		case TOK_LE: return TOK_GT;
+		case TOK_LT: return TOK_GE;
+		default:     return TOK_EQ;
+	}
+}
+
+/* --- translation ---------------------------------------------------------- */
+
+/* A checked and folded tree is translated to the intermediate form, which is
+ * converted to static single assignment form, and then lowered to code, which
+ * the peephole optimiser then rewrites, and from which the dead code is then
+ * removed.  The local slots of the variables are then shared, and the depth of
+ * the operand stack found, over the control-flow graph of what is left.  The
+ * slot of the main body's argument array, and those of the parameters of a
+ * subroutine, are left where they are.  The form of the main body, of which
+ * the return type is none, ends in a return.
+ *
+ * The dumps that were asked for are kept as notes with the code of each body,
+ * and collected once all bodies are closed, so that they come out in the same
+ * order as the code, however many workers compiled it.
+ */
+
+int translate_body(SimplCompiler *c, BodyTree *body, int width)
+{
+	const char *phase;
+	int nfixed, shared;
+
+	phase = set_alloc_phase("ir");
+	build_ir(&c->ir, &c->ast, body, c->return_type);
+	convert_to_ssa(&c->ir);
+	if (c->dump_ir) {
+		take_note(c, NOTE_IR);
+	}
+	lower_ir(&c->ir, &c->codegen);
+	reset_ir(&c->ir);
+	set_alloc_phase("peephole");
+	optimise_code(&c->peephole, &c->codegen);
+	set_alloc_phase("cfg");
+	c->dead += eliminate_dead_code(&c->cfg, &c->codegen);
+	build_cfg(&c->cfg, c->codegen.code, c->codegen.ip);
+	/* the parameters of a subroutine, or the arguments of main, stay put */
+	nfixed = (c->codegen.idprop != NULL ? c->codegen.idprop->nparams : 1);
+	shared = share_slots(&c->cfg, &c->codegen, nfixed, width);
+	c->shared += width - shared;
+	c->codegen.max_stack_depth = find_max_stack(&c->cfg,
+			c->codegen.function_name);
+	if (c->dump_cfg) {
+		take_note(c, NOTE_CFG);
+	}
+	set_alloc_phase(phase);
+
+	return shared;
+}
+
+void take_note(SimplCompiler *c, NoteKind kind)
+{
+	FILE *file;
+	char *text;
+	size_t len;
+
+	if ((file = open_memstream(&text, &len)) == NULL) {
+		eprintf("Could not open dump stream:");
+	}
+	if (kind == NOTE_IR) {
+		dump_ir(&c->ir, c->codegen.function_name, file);
+	} else {
+		dump_cfg(&c->cfg, c->codegen.function_name, file);
+	}
+	if (fclose(file) != 0) {
+		eprintf("Could not write dump stream:");
+	}
+	set_note(&c->codegen, kind, estrdup(text));
+	free(text);
+}
+
+void collect_notes(SimplCompiler *c, NoteKind kind, char **text, size_t *lenp)
+{
+	FILE *file;
+
+	if ((file = open_memstream(text, lenp)) == NULL) {
+		eprintf("Could not open dump stream:");
+	}
+	if (kind == NOTE_CFG) {
+		fprintf(file, "digraph \"%s\" {\n", c->codegen.class_name);
+		fprintf(file, "\tnode [shape=box, fontname=monospace];\n");
+	}
+	write_notes(&c->codegen, kind, file);
+	if (kind == NOTE_CFG) {
+		fprintf(file, "}\n");
+	}
+	if (fclose(file) != 0) {
+		eprintf("Could not write dump stream:");
+	}
+}
+
+/* The optimisations are counted by every context, and the counts of the workers
+ * have been added to those of the main context by the time they are collected.
+ */
+void collect_stats(SimplCompiler *c, char **text, size_t *lenp)
+{
+	FILE *file;
+
+	if ((file = open_memstream(text, lenp)) == NULL) {
+		eprintf("Could not open statistics stream:");
+	}
+	fprintf(file, "%-8s %-18s %8lu\n", "fold", "constants", c->folds);
+	fprintf(file, "%-8s %-18s %8lu\n", "fold", "identities", c->identities);
+	fprintf(file, "%-8s %-18s %8lu\n", "dead", "instructions", c->dead);
+	fprintf(file, "%-8s %-18s %8lu\n", "shared", "slots", c->shared);
+	write_peephole_stats(&c->peephole, file);
+	if (fclose(file) != 0) {
+		eprintf("Could not write statistics stream:");
+	}
+}
+
+/* --- lazy compilation ----------------------------------------------------- */
+
+/* On the first pass, only the signatures of subroutines are parsed, and their
+ * bodies are skipped by matching nested begin, if, and while tokens to their
+ * ends.  Since all signatures are then known by the time the main body is
+ * compiled, every call in it can be checked, and marks its callee as reached.
+ * The reached bodies are compiled from the scanner states recorded when they
+ * were skipped, marking further callees as they go, and the bodies that were
+ * never reached are finally parsed, so that their syntax is still checked.
+ */
+
+void defer_body(SimplCompiler *c, char *id, IDprop *prop, Variable *params)
+{
+	Deferred *d;
+
+	if (c->deferred_table == NULL) {
+		c->deferred = NULL;
+		c->last_deferred = &c->deferred;
+		c->worklist = NULL;
+		if ((c->deferred_table = ht_init(0.75f, hash_id, cmp_id)) == NULL) {
+			eprintf("Deferred subroutine table could not be initialised");
+		}
+	}
+
+	d = emalloc(sizeof(Deferred));
+	d->id = id;
+	d->prop = prop;
+	d->params = params;
+	d->begin = c->token;
+	save_scanner(&c->scanner, &d->body);
+	d->reached = FALSE;
+	d->next = NULL;
+	d->work = NULL;
+	d->code = NULL;
+	d->print.ids = NULL;
+	*c->last_deferred = d;
+	c->last_deferred = &d->next;
+	ht_insert(c->deferred_table, id, d);
+
+	if (c->cache_dir != NULL) {
+		fingerprint_body(c, &d->print, id, prop, params);
+	} else {
+		skip_body(c, NULL);
+	}
+}
+
+/* Skips a body, and if a fingerprint is given, hashes its tokens into it as
+ * they go by, and keeps its identifiers.
+ */
+void skip_body(SimplCompiler *c, Fingerprint *print)
+{
+	unsigned int depth;
+	size_t n;
+
+	expect(c, TOK_BEGIN);
+	for (depth = 1; depth > 0; get_token(&c->scanner, &c->token)) {
+		if (print != NULL) {
+			hash_int(&print->key, c->token.type);
+		}
+		switch (c->token.type) {
+			case TOK_BEGIN:
+			case TOK_IF:
+			case TOK_WHILE:
+				depth++;
+				break;
+			case TOK_END:
+				depth--;
+				break;
+			case TOK_ID:
+				if (print != NULL) {
+					hash_string(&print->key, c->token.lexeme);
+					n = strlen(c->token.lexeme) + 1;
+					if (print->len + n > print->cap) {
+						print->cap = 2 * print->cap + MAX_ID_LENGTH + 1;
+						print->ids = erealloc(print->ids, print->cap);
+					}
+					memcpy(print->ids + print->len, c->token.lexeme, n);
+					print->len += n;
+				}
+				break;
+			case TOK_NUM:
+				if (print != NULL) {
+					hash_int(&print->key, c->token.value);
+				}
+				break;
+			case TOK_STR:
+				if (print != NULL) {
+					hash_string(&print->key, c->token.string);
+				}
+				efree(c->token.string);
+				break;
+			case TOK_EOF:
+				abort_c(c, ERR_EXPECT, TOK_END);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void reach(SimplCompiler *c, char *id)
+{
+	Deferred *d;
+
+	/* a worker reaches routines on behalf of the main context */
+	if (c->owner != NULL) {
+		c = c->owner;
+	}
+	if (c->deferred_table == NULL
+			|| !ht_search(c->deferred_table, id, (void **) &d)) {
+		return;
+	}
+	if (c->workers != NULL) {
+		/* bodies on several workers may reach the same routine at once */
+		pthread_mutex_lock(&c->reach_lock);
+		if (!d->reached) {
+			d->reached = TRUE;
+			pool_submit(c->workers, compile_task, d);
+		}
+		pthread_mutex_unlock(&c->reach_lock);
+	} else if (!d->reached) {
+		d->reached = TRUE;
+		d->work = c->worklist;
+		c->worklist = d;
+	}
+}
+
+void compile_deferred(SimplCompiler *c)
+{
+	Deferred *d;
+	Token resume_token;
+	ScanState resume;
+
+	if (c->deferred_table == NULL) {
+		return;
+	}
+
+	resume_token = c->token;
+	save_scanner(&c->scanner, &resume);
+
+	while (c->worklist != NULL) {
+		d = c->worklist;
+		c->worklist = d->work;
+		export_name(&c->modules, d->id, d->prop);
+		guard_body(c, d);
+	}
+
+	for (d = c->deferred; d; d = d->next) {
+		if (!d->reached) {
+			guard_body(c, d);
+		}
+	}
+
+	c->token = resume_token;
+	restore_scanner(&c->scanner, &resume);
+	release_deferred(c);
+}
+
+/* With several workers, the reached bodies were submitted as they were
+ * reached, and all of them have been compiled once the pool has drained.
+ * Since each body is left in the list of the worker that compiled it, the
+ * bodies are stitched back together here, so that the code file lists them in
+ * the same order as a sequential compilation would.
+ */
+void compile_parallel(SimplCompiler *c)
+{
+	Deferred *d;
+	Body *main_body;
+	unsigned int i;
+
+	if (c->deferred_table == NULL) {
+		return;
+	}
+
+	pool_wait(c->workers);
+	checkpoint(c);
+	for (d = c->deferred; d; d = d->next) {
+		if (!d->reached) {
+			pool_submit(c->workers, compile_task, d);
+		}
+	}
+	pool_wait(c->workers);
+	checkpoint(c);
+	for (i = 0; i < c->jobs; i++) {
+		merge_peephole(&c->peephole, &c->crew[i].peephole);
+		c->folds += c->crew[i].folds;
+		c->identities += c->crew[i].identities;
+		c->dead += c->crew[i].dead;
+		c->shared += c->crew[i].shared;
+	}
+
+	main_body = detach_bodies(&c->codegen);
+	for (d = c->deferred; d; d = d->next) {
+		if (d->reached) {
+			export_name(&c->modules, d->id, d->prop);
+			attach_bodies(&c->codegen, d->code);
+		}
+	}
+	attach_bodies(&c->codegen, main_body);
+
+	release_deferred(c);
+}
+
+void compile_body(SimplCompiler *c, Deferred *d)
+{
+	BodyTree body;
+	Variable *v;
+	Fingerprint *print;
+
+	checkpoint(c);
+	set_alloc_phase("parse");
+	c->token = d->begin;
+	restore_scanner(&c->scanner, &d->body);
+
+	c->return_type = d->prop->type;
+	print = (c->cache_dir != NULL ? &d->print : NULL);
+	if (d->reached) {
+		enter_subroutine(&c->symbols, 0);
+		declare_params(c, d->params);
+		init_subroutine_codegen(&c->codegen, d->id, d->prop);
+		compile_subroutine(c, d->id, print);
+		close_subroutine(&c->symbols);
+	} else {
+		/* an unreachable body is parsed for its syntax, and then dropped,
+		 * unless it is cached, in which case its syntax is known to be sound
+		 */
+		if (print == NULL || !probe_code(c->cache_dir,
+					make_key(c, d->id, print))) {
+			c->checking = FALSE;
+			parse_body(c, &body);
+			c->checking = TRUE;
+		}
+		while ((v = d->params) != NULL) {
+			d->params = v->next;
+			efree(v->id);
+			efree(v);
+		}
+	}
+	d->params = NULL;
+	reset_ast(&c->ast);
+	c->return_type = TYPE_NONE;
+}
+
+/* Compiles the body of the current subroutine, of which the lookahead token is
+ * its "begin", and closes its code.  Given a fingerprint, the code is taken
+ * from the cache if it is there, and is otherwise kept there once compiled,
+ * unless it was warned about.
+ */
+void compile_subroutine(SimplCompiler *c, const char *id, Fingerprint *print)
+{
+	BodyTree body;
+	CacheKey key;
+	Label first;
+	int width;
+
+	key = 0;
+	if (print != NULL) {
+		key = make_key(c, id, print);
+		if (splice_body(c, key)) {
+			return;
+		}
+		c->token = print->begin;
+		restore_scanner(&c->scanner, &print->body);
+	}
+
+	first = c->codegen.next_label;
+	c->warned = FALSE;
+	parse_body(c, &body);
+	width = get_variables_width(&c->symbols);
+	if (!has_failed(c)) {
+		width = translate_body(c, &body, width);
+	}
+	close_subroutine_codegen(&c->codegen, width);
+
+	/* a body taken from the cache would not repeat its warnings */
+	if (print != NULL && !has_failed(c) && !c->warned) {
+		keep_body(c, key, first);
+	}
+}
+
+/* An error on a worker only abandons the body at hand: the error marks the
+ * compilation as stopped, so that the other bodies are abandoned at their next
+ * checkpoint, and the main context springs its own trap once the pool drains.
+ * When several errors are to be collected, the compilation is not stopped
+ * yet, and the worker goes on with the next body.
+ */
+void compile_task(void *data, unsigned int id, void *arg)
+{
+	SimplCompiler *w = &((SimplCompiler *) data)->crew[id];
+	Deferred *d = (Deferred *) arg;
+	ErrorTrap trap;
+
+	set_trap(&trap, (SimplCompiler *) data);
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		compile_body(w, d);
+		d->code = detach_bodies(&w->codegen);
+		clear_error_trap(&trap);
+	} else {
+		abandon_body(w);
+	}
+}
+
+void start_worker(void *data, unsigned int id)
+{
+	SimplCompiler *c = (SimplCompiler *) data;
+	SimplCompiler *w = &c->crew[id];
+	ErrorTrap trap;
+
+	w->region = region_open();
+	set_alloc_phase("init");
+	w->src_file = NULL;
+	w->owner = c;
+	w->crew = NULL;
+	w->lazy = c->lazy;
+	w->checking = TRUE;
+	w->max_errors = c->max_errors;
+	w->jobs = 1;
+	w->workers = NULL;
+	w->deferred = w->worklist = NULL;
+	w->last_deferred = &w->deferred;
+	w->deferred_table = NULL;
+	w->return_type = TYPE_NONE;
+	w->src = c->src;
+	w->src_len = c->src_len;
+	share_symbol_table(&w->symbols, &c->symbols);
+	share_code_generation(&w->codegen, &c->codegen);
+	init_ast(&w->ast);
+	init_ir(&w->ir);
+	w->ir.strict = c->ir.strict;
+	init_cfg(&w->cfg);
+	init_peephole(&w->peephole);
+	w->folds = w->identities = w->dead = w->shared = 0;
+	init_exprs(&w->exprs);
+	w->dump_ir = c->dump_ir;
+	w->dump_cfg = c->dump_cfg;
+	w->stats = c->stats;
+	w->cache_dir = c->cache_dir;
+
+	/* a worker that fails to start leaves its tasks to fail at checkpoints */
+	set_trap(&trap, c);
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		if ((w->src_file = fmemopen((void *) w->src, w->src_len, "r"))
+				== NULL) {
+			eprintf("source could not be opened:");
+		}
+		init_scanner(&w->scanner, w->src_file);
+		clear_error_trap(&trap);
+	}
+}
+
+void stop_worker(void *data, unsigned int id)
+{
+	SimplCompiler *w = &((SimplCompiler *) data)->crew[id];
+
+	release_ast(&w->ast);
+	release_ir(&w->ir);
+	release_cfg(&w->cfg);
+	release_peephole(&w->peephole);
+	release_exprs(&w->exprs);
+	release_code_generation(&w->codegen);
+	release_symbol_table(&w->symbols);
+	if (w->src_file != NULL) {
+		fclose(w->src_file);
+	}
+}
+
+void release_deferred(SimplCompiler *c)
+{
+	Deferred *d, *n;
+
+	for (d = c->deferred; d; d = n) {
+		n = d->next;
+		release_fingerprint(&d->print);
+		efree(d);
+	}
+	ht_free(c->deferred_table, keep, keep);
+	c->deferred_table = NULL;
+}
+
+unsigned int hash_id(void *key, unsigned int size)
+{
+	char *id = (char *) key;
+	unsigned int hash;
+
+	for (hash = 0; *id; id++) {
+		hash = (hash << 5) + (hash >> 27) + *id;
+	}
+	return (hash % size);
+}
+
+int cmp_id(void *v1, void *v2)
+{
+	return strcmp((char *) v1, (char *) v2);
+}
+
+void keep(void *p)
+{
+	(void) p;
+}
+
+/* --- caching ------------------------------------------------------------- */
+
+/* The key of the code of a subroutine hashes everything that the code depends
+ * on: the version of the compiler, whether evaluation is strict, the class
+ * name, which the code refers to in its calls, the signature of the subroutine
+ * and the names of its parameters, the tokens of its body, and the signature
+ * of every routine that the body refers to, or the absence thereof.  The last
+ * is looked up as the body is about to be compiled, since with lazy
+ * compilation, a body may refer to routines that are only defined after it.
+ *
+ * A body is fingerprinted by skipping it, before it is compiled; on a miss,
+ * the scanner is taken back to its start.  Labels are kept relative to the
+ * first label of the body, and are renumbered as the body is spliced in, so
+ * that the code is the same as if the body had been compiled.
+ */
+
+void fingerprint_body(SimplCompiler *c, Fingerprint *print, const char *id,
+		IDprop *prop, Variable *params)
+{
+	Variable *v;
+
+	init_key(&print->key);
+	hash_string(&print->key, SIMPL_VERSION);
+	hash_int(&print->key, c->ir.strict);
+	hash_string(&print->key, c->codegen.class_name);
+	hash_string(&print->key, id);
+	hash_int(&print->key, prop->type);
+	for (v = params; v; v = v->next) {
+		hash_int(&print->key, v->type);
+		hash_string(&print->key, v->id);
+	}
+
+	print->ids = NULL;
+	print->len = print->cap = 0;
+	print->begin = c->token;
+	save_scanner(&c->scanner, &print->body);
+	skip_body(c, print);
+}
+
+CacheKey make_key(SimplCompiler *c, const char *id, const Fingerprint *print)
+{
+	CacheKey key;
+	IDprop *prop;
+	const char *ref;
+	unsigned int i;
+
+	key = print->key;
+	for (ref = print->ids; ref < print->ids + print->len;
+			ref += strlen(ref) + 1) {
+		if (strcmp(ref, id) == 0) {
+			/* the signature of the subroutine itself is already hashed */
+			hash_int(&key, -1);
+		} else if (find_name(&c->symbols, (char *) ref, &prop)
+				&& IS_CALLABLE_TYPE(prop->type)) {
+			hash_int(&key, prop->type);
+			hash_int(&key, prop->nparams);
+			for (i = 0; i < prop->nparams; i++) {
+				hash_int(&key, prop->params[i]);
+			}
+			hash_string(&key, (prop->module ? prop->module : ""));
+		} else {
+			hash_int(&key, 0);
+		}
+	}
+
+	return key;
+}
+
+Boolean splice_body(SimplCompiler *c, CacheKey key)
+{
+	struct code_s *code;
+	int ip, depth, width;
+	unsigned int nlabels;
+
+	if (!fetch_code(c->cache_dir, key, &code, &ip, &depth, &width,
+				&nlabels)) {
+		return FALSE;
+	}
+	if (c->lazy) {
+		reach_calls(c, code, ip);
+	}
+	set_subroutine_code(&c->codegen, code, ip, depth, nlabels);
+	close_subroutine_codegen(&c->codegen, width);
+
+	return TRUE;
+}
+
+/* A body that is spliced in is not checked, so that the routines that it calls
+ * are not reached as it is; instead, they are read off the references of its
+ * calls, in the order in which checking would have reached them.
+ */
+void reach_calls(SimplCompiler *c, const struct code_s *code, int ip)
+{
+	const char *class_name = c->codegen.class_name;
+	size_t n = strlen(class_name), len;
+	const char *ref, *end;
+	char *id;
+	int i;
+
+	for (i = 1; i < ip; i++) {
+		if ((code[i - 1].type & MASK_TYPE) != CODE_INSTRUCTION
+				|| code[i - 1].code != JVM_INVOKESTATIC
+				|| (code[i].type & MASK_DATA_TYPE) != CODE_REFERENCE) {
+			continue;
+		}
+		ref = code[i].string;
+		if (strncmp(ref, class_name, n) != 0 || ref[n] != '/'
+				|| (end = strchr(ref + n + 1, '(')) == NULL) {
+			continue;
+		}
+		len = end - (ref + n + 1);
+		id = emalloc(len + 1);
+		memcpy(id, ref + n + 1, len);
+		id[len] = '\0';
+		reach(c, id);
+		efree(id);
+	}
+}
+
+void keep_body(SimplCompiler *c, CacheKey key, Label first)
+{
+	const struct code_s *code;
+	int ip, depth, width;
+
+	code = get_closed_code(&c->codegen, &ip, &depth, &width);
+	store_code(c->cache_dir, key, code, ip, depth, width, first,
+			c->codegen.next_label - first);
+}
+
+void release_fingerprint(Fingerprint *print)
+{
+	efree(print->ids);
+	print->ids = NULL;
+}
+
+/* --- error recovery ------------------------------------------------------- */
+
+/* When several errors are to be collected, every statement and subroutine
+ * definition, and every body compiled after the first pass, is parsed and
+ * checked inside an error trap of its own.  An error has been reported to the
+ * main context by the time that it springs the innermost of these traps, after
+ * which the compilation carries on after the construct in which the error was
+ * found.  The construct is skipped from its first token, by matching its
+ * nested begin, if, and while tokens to their ends, as a body is skipped on
+ * the first pass: a statement up to the semicolon or "end" that follows it,
+ * and a definition up to the end of its body.  Since a definition cannot be
+ * nested, a "define" ends the skipping of either.  A statement or a variable
+ * that only fails its type check is simply left behind, since the parser is
+ * past it.
+ *
+ * A tree that had an error is never translated, and once any error has been
+ * reported, no more code is generated at all.  Every recovery first checks
+ * whether the compilation was stopped, because enough errors were collected,
+ * or because it was cancelled or timed out, and if so, springs the next trap
+ * out instead.
+ */
+
+/* Parses a statement, and recovers from an error in it.  Returns the
+ * statement, or NO_NODE if it was skipped.
+ */
+Node guard_statement(SimplCompiler *c)
+{
+	ErrorTrap trap;
+	Token start;
+	ScanState state;
+	Node s;
+
+	if (c->max_errors <= 1) {
+		return parse_statement(c);
+	}
+
+	start = c->token;
+	save_scanner(&c->scanner, &state);
+	set_trap(&trap, (c->owner != NULL ? c->owner : c));
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		s = parse_statement(c);
+		clear_error_trap(&trap);
+		return s;
+	}
+	synchronise(c, &start, &state, FALSE);
+
+	return NO_NODE;
+}
+
+/* Checks a statement, and recovers from an error in it.
+ */
+void guard_check(SimplCompiler *c, Node s)
+{
+	ErrorTrap trap;
+
+	if (c->max_errors <= 1) {
+		check_statement(c, s);
+		return;
+	}
+
+	set_trap(&trap, (c->owner != NULL ? c->owner : c));
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		check_statement(c, s);
+		clear_error_trap(&trap);
+	} else {
+		checkpoint(c);
+	}
+}
+
+/* Declares a variable, and recovers from an error in its declaration.
+ */
+void guard_var(SimplCompiler *c, Node v)
+{
+	ErrorTrap trap;
+
+	if (c->max_errors <= 1) {
+		check_var(c, v);
+		return;
+	}
+
+	set_trap(&trap, (c->owner != NULL ? c->owner : c));
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		check_var(c, v);
+		clear_error_trap(&trap);
+	} else {
+		checkpoint(c);
+	}
+}
+
+/* Parses and compiles a subroutine definition, or on the first pass, its
+ * signature, and recovers from an error in it.
+ */
+void guard_funcdef(SimplCompiler *c)
+{
+	ErrorTrap trap;
+	Token start;
+	ScanState state;
+
+	if (c->max_errors <= 1) {
+		parse_funcdef(c);
+		return;
+	}
+
+	start = c->token;
+	save_scanner(&c->scanner, &state);
+	set_trap(&trap, c);
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		parse_funcdef(c);
+		clear_error_trap(&trap);
+	} else {
+		abandon_body(c);
+		synchronise(c, &start, &state, TRUE);
+	}
+}
+
+/* Compiles a body that was skipped on the first pass, and recovers from an
+ * error in it.  Since the body is compiled from the scanner state recorded
+ * when it was skipped, nothing needs to be skipped after an error.
+ */
+void guard_body(SimplCompiler *c, Deferred *d)
+{
+	ErrorTrap trap;
+
+	if (c->max_errors <= 1) {
+		compile_body(c, d);
+		return;
+	}
+
+	set_trap(&trap, c);
+	if (setjmp(trap.env) == 0) {
+		set_error_trap(&trap);
+		compile_body(c, d);
+		clear_error_trap(&trap);
+	} else {
+		checkpoint(c);
+		abandon_body(c);
+	}
+}
+
+/* Skips a statement or a definition that had an error, from the first token,
+ * of which the scanner state is given, as described above.  The tokens are
+ * scanned again, and since the scanner cannot resume after a lexical error,
+ * such an error, which was reported the first time round, ends the
+ * compilation without being reported again.
+ */
+void synchronise(SimplCompiler *c, const Token *start, const ScanState *state,
+		Boolean definition)
+{
+	ErrorTrap quiet;
+	TokenType type;
+	unsigned int depth;
+
+	checkpoint(c);
+	c->token = *start;
+	restore_scanner(&c->scanner, state);
+
+	quiet.report = NULL;
+	quiet.data = NULL;
+	if (setjmp(quiet.env) != 0) {
+		halt((c->owner != NULL ? c->owner : c), SIMPL_FAILED);
+		spring_error_trap();
+	}
+	set_error_trap(&quiet);
+
+	if (definition) {
+		get_token(&c->scanner, &c->token);
+	}
+	for (depth = 0; ; ) {
+		type = c->token.type;
+		if (type == TOK_DEFINE || type == TOK_EOF || (!definition
+					&& depth == 0
+					&& (type == TOK_SEMICOLON || type == TOK_END))) {
+			break;
+		}
+		if (type == TOK_BEGIN || type == TOK_IF || type == TOK_WHILE) {
+			depth++;
+		} else if (type == TOK_END && depth > 0) {
+			depth--;
+		} else if (type == TOK_STR) {
+			efree(c->token.string);
+		}
+		get_token(&c->scanner, &c->token);
+		if (definition && type == TOK_END && depth == 0) {
+			break;
+		}
+	}
+
+	clear_error_trap(&quiet);
+}
+
+/* Leaves the body that was being compiled when an error sprang a trap, which
+ * may still have its local scope open, or may only have been parsed.
+ */
+void abandon_body(SimplCompiler *c)
+{
+	if (in_subroutine(&c->symbols)) {
+		close_subroutine(&c->symbols);
+	}
+	reset_ast(&c->ast);
+	c->return_type = TYPE_NONE;
+	c->checking = TRUE;
+}
+
+Boolean has_failed(SimplCompiler *c)
+{
+	if (c->owner != NULL) {
+		c = c->owner;
+	}
+	return (atomic_load(&c->nerrors) > 0);
+}
+
+/* Sorts the diagnostics by their position, keeping those without one last,
+ * since bodies are compiled out of order when lazily or on several workers,
+ * and are checked only once they have been parsed.  The sort is stable, and
+ * there are only a few diagnostics.
+ */
+void sort_diagnostics(SimplCompiler *c)
+{
+	SimplDiagnostic d, *list;
+	unsigned int i, j;
+
+	list = c->diagnostics;
+	for (i = 1; i < c->ndiagnostics; i++) {
+		d = list[i];
+		for (j = i; j > 0 && diagnostic_after(&list[j - 1], &d); j--) {
+			list[j] = list[j - 1];
+		}
+		list[j] = d;
+	}
+}
+
+Boolean diagnostic_after(const SimplDiagnostic *a, const SimplDiagnostic *b)
+{
+	if (a->line == 0 || b->line == 0) {
+		return (a->line == 0 && b->line != 0);
+	}
+	return (a->line > b->line || (a->line == b->line && a->col > b->col));
+}
+
+/* --- compilation control routines ----------------------------------------- */
+
+/* Abandons the compilation, by springing the error trap of the calling
+ * thread, once it has failed, been cancelled, or run past its deadline.  This
+ * is called at every statement and subroutine definition that is parsed, and
+ * before the code of every subroutine is generated.
+ */
+void checkpoint(SimplCompiler *c)
+{
+	struct timespec now;
+
+	if (c->owner != NULL) {
+		c = c->owner;
+	}
+	if (!atomic_load(&c->stopped)) {
+		if (c->cancel != NULL && atomic_load(&c->cancel->requested)) {
+			halt(c, SIMPL_CANCELLED);
+		} else if (c->timed) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec > c->deadline.tv_sec
+					|| (now.tv_sec == c->deadline.tv_sec
+						&& now.tv_nsec >= c->deadline.tv_nsec)) {
+				halt(c, SIMPL_TIMED_OUT);
+			}
+		}
+	}
+	if (atomic_load(&c->stopped)) {
+		spring_error_trap();
+	}
+}
+
+void halt(SimplCompiler *c, SimplStatus status)
+{
+	pthread_mutex_lock(&c->report_lock);
+	if (c->status == SIMPL_OK) {
+		c->status = status;
+	}
+	atomic_store(&c->stopped, 1);
+	pthread_mutex_unlock(&c->report_lock);
+}
+
+/* Records a diagnostic in the main context.  Every warning is kept, but errors
+ * are only kept until as many as are to be collected have been reported, at
+ * which point the compilation is stopped; normally, the first error stops it.
+ * The diagnostics outlive the region of the compilation, and are allocated
+ * outside of it.
+ */
+void report(void *data, Boolean fatal, const SourcePos *pos,
+		const char *message)
+{
+	SimplCompiler *c = (SimplCompiler *) data;
+	SimplDiagnostic *list, *d;
+
+	pthread_mutex_lock(&c->report_lock);
+	if (!fatal || ((c->status == SIMPL_OK || c->status == SIMPL_FAILED)
+				&& atomic_load(&c->nerrors) < c->max_errors)) {
+		list = realloc(c->diagnostics,
+				(c->ndiagnostics + 1) * sizeof(SimplDiagnostic));
+		if (list != NULL) {
+			c->diagnostics = list;
+			d = &list[c->ndiagnostics];
+			d->severity = (fatal ? SIMPL_ERROR : SIMPL_WARNING);
+			d->line = (pos != NULL ? pos->line : 0);
+			d->col = (pos != NULL ? pos->col : 0);
+			if ((d->message = strdup(message)) != NULL) {
+				c->ndiagnostics++;
+			}
+		}
+	}
+	if (fatal) {
+		if (c->status == SIMPL_OK) {
+			c->status = SIMPL_FAILED;
+		}
+		if (atomic_fetch_add(&c->nerrors, 1) + 1 >= c->max_errors) {
+			atomic_store(&c->stopped, 1);
+		}
+	}
+	pthread_mutex_unlock(&c->report_lock);
+}
+
+void set_trap(ErrorTrap *trap, SimplCompiler *c)
+{
+	trap->report = report;
+	trap->data = c;
+	trap->prev = NULL;
+}
+
+/* --- helper routines ------------------------------------------------------ */
+
+#define MAX_MESSAGE_LENGTH 256
+
+void check_types(SimplCompiler *c, ValType found, ValType expected,
+		SourcePos *pos, ...)
+{
+	char buf[MAX_MESSAGE_LENGTH], *s;
+	va_list ap;
+
+	if (found != expected) {
+		buf[0] = '\0';
+		va_start(ap, pos);
+		s = va_arg(ap, char *);
+		vsnprintf(buf, MAX_MESSAGE_LENGTH, s, ap);
+		va_end(ap);
+		if (pos == NULL) {
+			pos = &c->scanner.position;
+		}
+		leprintf(pos, "incompatible types (expected %s, found %s) %s",
+			get_valtype_string(expected), get_valtype_string(found), buf);
+	}
+}
+
+void expect(SimplCompiler *c, TokenType type)
+{
+	if (c->token.type == type) {
+		get_token(&c->scanner, &c->token);
+	} else {
+		abort_c(c, ERR_EXPECT, type);
+	}
+}
+
+void expect_id(SimplCompiler *c, char **id)
+{
+	if (c->token.type == TOK_ID) {
+		*id = estrdup(c->token.lexeme);
+		get_token(&c->scanner, &c->token);
+	} else {
+		abort_c(c, ERR_EXPECT, TOK_ID);
+	}
+}
+
+IDprop *make_idprop(ValType type, unsigned int offset, unsigned int nparams,
+       ValType *params)
+{
+	IDprop *ip;
+
+	ip = emalloc(sizeof(IDprop));
+	ip->type = type;
+	ip->offset = offset;
+	ip->nparams = nparams;
+	ip->params = params;
+	ip->module = NULL;
+
+	return ip;
+}
+
+void declare_params(SimplCompiler *c, Variable *head)
+{
+	Variable *temp;
+	IDprop *prop, *slot;
+
+	while (head != NULL) {
+		temp = head;
+		prop = make_idprop(temp->type, get_variables_width(&c->symbols), 0,
+				NULL);
+		if (!declare_name(&c->symbols, temp->id, prop, &slot)) {
+			abort_cp(c, &temp->pos, ERR_MULTIPLE_DEFINITION, temp->id);
+		}
+		head = head->next;
+		efree(temp);
+	}
+}
+
+Node make_binary(SimplCompiler *c, TokenType op, SourcePos pos, Node left,
+		Node right)
+{
+	Node e;
+	Expr *x;
+
+	e = new_expr(&c->ast, EXPR_BINARY, pos, ast_expr(&c->ast, left)->start);
+	x = ast_expr(&c->ast, e);
+	x->op = op;
+	x->left = left;
+	x->right = right;
+
+	return e;
+}
+
+Variable *make_var(char *id, ValType type, SourcePos pos)
+{
+	Variable *vp;
+
+	vp = emalloc(sizeof(Variable));
+	vp->id = id;
+	vp->type = type;
+	vp->pos = pos;
+	vp->next = NULL;
+
+	return vp;
+}
+
+/* --- error reporting routines --------------------------------------------- */
+
+void _abort_compile(SimplCompiler *c, SourcePos *posp, Error err,
+		va_list args);
+
+void abort_c(SimplCompiler *c, Error err, ...)
+{
+	va_list args;
+
+	va_start(args, err);
+	_abort_compile(c, NULL, err, args);
+	va_end(args);
+}
+
+void abort_cp(SimplCompiler *c, SourcePos *posp, Error err, ...)
+{
+	va_list args;
+
+	va_start(args, err);
+	_abort_compile(c, posp, err, args);
+	va_end(args);
+}
+
+void _abort_compile(SimplCompiler *c, SourcePos *posp, Error err,
+		va_list args)
+{
+	char expstr[MAX_MESSAGE_LENGTH], *s, *t; 
+	int tok;
+
+	if (posp == NULL) {
+		posp = &c->scanner.position;
+	}
+
+	snprintf(expstr, MAX_MESSAGE_LENGTH, "expected %%s, but found %s",
+		get_token_string(c->token.type));
+
+	switch (err) {
+		case ERR_ARGUMENT_LIST_OR_VARIABLE_ASSIGNMENT_EXPECTED:
+		case ERR_ARRAY_ALLOCATION_OR_EXPRESSION_EXPECTED:
+		case ERR_EXIT_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE:
+		case ERR_EXPECT:
+		case ERR_EXPRESSION_OR_STRING_EXPECTED:
+		case ERR_FACTOR_EXPECTED:
+		case ERR_MISSING_EXIT_EXPRESSION_FOR_FUNCTION:
+		case ERR_STATEMENT_EXPECTED:
+		case ERR_TYPE_EXPECTED:
+			break;
+		case ERR_TAKES_NO_ARGUMENTS:
+			s = va_arg(args, char *);
+			t = va_arg(args, char *);
+			break;	
+		default:
+			s = va_arg(args, char *);
+			break;
+	}
+
+	switch (err) {
+
+		/* Add additional cases here as is necessary, referring to
+		 * errmsg.h for all possible errors.  Some errors only become possible
+		 * to recognise once we add type checking.  Until you get to type
+		 * checking, you can handle such errors by adding the default case.
+		 * However, your final submission *must* handle all cases explicitly.
+		 */
+		case ERR_ARGUMENT_LIST_OR_VARIABLE_ASSIGNMENT_EXPECTED:
+			leprintf(posp, expstr, "argument list or variable assignment");
+			break;
+
+		case ERR_ARRAY_ALLOCATION_OR_EXPRESSION_EXPECTED:
+			leprintf(posp, expstr, "array allocation or expression");
+			break;
+		
+		case ERR_EXIT_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE:
+			leprintf(posp, "an exit expression is not allowed for a procedure");
+			break;
+
+		case ERR_EXPECT:
+			tok = va_arg(args, int);
+			leprintf(posp, expstr, get_token_string(tok));
+			break;
+
+		case ERR_EXPRESSION_OR_STRING_EXPECTED:
+			leprintf(posp, expstr, "expression or string");
+			break;
+
+		case ERR_FACTOR_EXPECTED:
+			leprintf(posp, expstr, "factor");
+			break;
+
+		case ERR_ILLEGAL_ARRAY_OPERATION:
+			leprintf(posp, "%s is an illegal array operation", s);
+			break;
+		
+		case ERR_MISSING_EXIT_EXPRESSION_FOR_FUNCTION:
+			leprintf(posp, "missing exit expression for a function");
+			break;
+
+		case ERR_MISSING_FUNCTION_ARGUMENT_LIST:
+			leprintf(posp, "missing argument list for function '%s'", s);
+			break;
+
+		case ERR_MULTIPLE_DEFINITION:
+			leprintf(posp, "multiple definition of '%s'", s);
+			break;
+
+		case ERR_NOT_A_FUNCTION:
+			leprintf(posp, "'%s' is not a function", s);
+			break;
+
+		case ERR_NOT_A_PROCEDURE:
+			leprintf(posp, "'%s' is not a procedure", s);
+			break;
+		
+		case ERR_NOT_A_VARIABLE:
+			leprintf(posp, "'%s' is not a variable", s);
+			break;
+
+		case ERR_NOT_AN_ARRAY:
+			leprintf(posp, "'%s' is not an array", s);
+			break;
+
+		case ERR_SCALAR_VARIABLE_EXPECTED:
+			leprintf(posp, "expected scalar variable instead of '%s'", s);
+			break;
+
+		case ERR_STATEMENT_EXPECTED:
+			leprintf(posp, expstr, "statement");
+			break;
+		
+		case ERR_TAKES_NO_ARGUMENTS:
+			leprintf(posp, "%s '%s' takes no arguments", s, t); 
+			break;
+
+		case ERR_TOO_FEW_ARGUMENTS:
+			leprintf(posp, "too few arguments for call to '%s'", s);
+			break;
+
+		case ERR_TOO_MANY_ARGUMENTS:
+			leprintf(posp, "too many arguments for call to '%s'", s);
+			break;
+
+		case ERR_TYPE_EXPECTED:
+			leprintf(posp, expstr, "type");
+			break;
+		
+		case ERR_UNKNOWN_IDENTIFIER:
+			leprintf(posp, "unknown identifier '%s'", s);
+			break;
+
+		case ERR_UNREACHABLE:
+			leprintf(posp, "unreachable: %s", s);
+			break;
+
+		default:
+			leprintf(posp, "Error not yet implemented");
+			break;
+		
+	}
+}
+
+/* --- debugging output routines -------------------------------------------- */
+
+#ifdef DEBUG_PARSER
+
+static int indent = 0;
+
+void debug_start(const SourcePos *pos, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	debug_info(pos, fmt, ap);
+	va_end(ap);
+	indent += 2;
+}
+
+void debug_end(const SourcePos *pos, const char *fmt, ...)
+{
+	va_list ap;
+
+	indent -= 2;
+	va_start(ap, fmt);
+	debug_info(pos, fmt, ap);
+	va_end(ap);
+}
+
+void debug_info(const SourcePos *pos, const char *fmt, ...)
+{
+	int i;
+	char buf[MAX_MESSAGE_LENGTH], *buf_ptr;
+	va_list ap;
+
+	buf_ptr = buf;
+
+	va_start(ap, fmt);
+
+	for (i = 0; i < indent; i++) {
+		*buf_ptr++ = ' ';
+	}
+	vsprintf(buf_ptr, fmt, ap);
+
+	buf_ptr += strlen(buf_ptr);
+	snprintf(buf_ptr, MAX_MESSAGE_LENGTH, " in line %d.\n", pos->line);
+	fflush(stdout);
+	fputs(buf, stdout);
+	fflush(NULL);
+
+	va_end(ap);
+}
+
+#endif /* DEBUG_PARSER */
@@ -12,6 +12,7 @@
 /* Copyright (C) 1999 Lucent Technologies                 */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +20,15 @@
 #include <unistd.h>
 #include "error.h"
 
+#ifdef TRACK_ALLOCATIONS
+#undef estrdup
+#undef westrdup
+#undef emalloc
+#undef wemalloc
+#undef erealloc
+#undef werealloc
+#endif
+
 /* --- ASCII colours -------------------------------------------------------- */
 
 #define ESC                      "\033["
@@ -79,17 +89,110 @@
 #define ASCII_BOLD_HIGH_CYAN     ESC BOLD HIGH_CYAN
 #define ASCII_BOLD_HIGH_WHITE    ESC BOLD HIGH_WHITE
 
+/* --- allocation regions --------------------------------------------------- */
+
+#define REGION_CHUNK_SIZE (64 * 1024)
+
+/** the header of every block, padded to the most strictly aligned types */
+typedef union {
+	long double  ld;
+	double       d;
+	long         l;
+	void        *p;
+	struct {
+		size_t   size;  /**< the usable size of the block that follows */
+		Region  *owner; /**< the region that owns the block, or NULL   */
+	} tag;
+} Header;
+
+typedef struct chunk Chunk;
+struct chunk {
+	Chunk   *next;      /**< the next (older) chunk                    */
+	size_t   size;      /**< the number of header units in the chunk   */
+	size_t   used;      /**< the number of header units handed out     */
+	Header   data[];    /**< the memory carved into blocks             */
+};
+
+struct region {
+	Chunk   *chunks;    /**< the chunk list, newest (current) first    */
+	Header  *last;      /**< the header of the most recent block       */
+	Region  *prev;      /**< the region that was active when opened    */
+};
+
+/* the active region of each thread */
+static _Thread_local Region *region = NULL;
+
+static void *region_alloc(size_t n);
+static void *region_realloc(void *vp, size_t n);
+
+/* --- allocation tracking -------------------------------------------------- */
+
+/* the compiler phase of each thread, which tags its allocations if tracked */
+static _Thread_local const char *alloc_phase = NULL;
+
+#ifdef TRACK_ALLOCATIONS
+
+#define MAX_ALLOC_SITES 256
+
+/** the statistics of one call site */
+typedef struct {
+	const char  *phase;      /**< the compiler phase, or NULL         */
+	const char  *site;       /**< the name of the allocating function */
+	size_t       count;      /**< the number of allocations           */
+	size_t       bytes;      /**< the total number of bytes requested */
+	size_t       live;       /**< the number of bytes still live      */
+	size_t       peak;       /**< the peak number of live bytes       */
+} AllocSite;
+
+/** the bookkeeping prepended to every tracked block */
+typedef union {
+	struct {
+		size_t        size;  /**< the requested size                  */
+		unsigned int  site;  /**< the index of the call site          */
+	} info;
+	Header align;
+} TrackHeader;
+
+static AllocSite    sites[MAX_ALLOC_SITES];
+static unsigned int nsites = 0;
+static _Thread_local const char *alloc_site = "(untagged)";
+static AllocSite    total = { NULL, "total", 0, 0, 0, 0 };
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Boolean same_name(const char *a, const char *b);
+static unsigned int find_site(const char *phase, const char *site);
+static void track(unsigned int i, size_t n);
+static void untrack(unsigned int i, size_t n);
+static void untrack_region(const Region *r);
+
+#define EXTRA sizeof(TrackHeader)
+#else
+#define EXTRA 0
+#endif /* TRACK_ALLOCATIONS */
+
+static void *allocate(size_t n);
+static void *reallocate(void *vp, size_t n);
+static void release(void *vp);
+
 /* --- error routines ------------------------------------------------------- */
 
-SourcePos position;
+/* A fatal error exits while holding this lock, so that when errors occur on
+ * several threads at once, only the first is reported.
+ */
+static pthread_mutex_t fatal_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the innermost error trap of each thread, if any */
+static _Thread_local ErrorTrap *trap = NULL;
+
+#define MAX_MESSAGE_LENGTH 512
 
 #ifndef __APPLE__
 static char *pname = NULL;
 #endif
 static char *sname = NULL;
 
-static void _weprintf(const char *pre, const SourcePos *pos, const char *fmt,
-		va_list args)
+static void _weprintf(int err, const char *pre, const SourcePos *pos,
+		const char *fmt, va_list args)
 {
 	int istty = isatty(2);
 	const char *ac_end = (istty ? ASCII_RESET : "");
@@ -113,62 +216,163 @@ static void _weprintf(const char *pre, const SourcePos *pos, const char *fmt,
 	vfprintf(stderr, fmt, args);
 
 	if (fmt[0] != '\0' && fmt[strlen(fmt)-1] == ':')
-		fprintf(stderr, " %s", strerror(errno));
+		fprintf(stderr, " %s", strerror(err));
 	fprintf(stderr, "\n");
 }
 
+/* Hands a message to the report function of the innermost trap of the calling
+ * thread, formatted as it would have been displayed, but without the program
+ * name, source name, position, and prefix.
+ */
+static void _trap_report(int err, Boolean fatal, const SourcePos *pos,
+		const char *fmt, va_list args)
+{
+	char message[MAX_MESSAGE_LENGTH];
+	size_t n;
+
+	vsnprintf(message, MAX_MESSAGE_LENGTH, fmt, args);
+	if (fmt[0] != '\0' && fmt[strlen(fmt)-1] == ':') {
+		n = strlen(message);
+		snprintf(message + n, MAX_MESSAGE_LENGTH - n, " %s", strerror(err));
+	}
+	if (trap->report != NULL)
+		trap->report(trap->data, fatal, pos, message);
+}
+
 void eprintf(const char *fmt, ...)
 {
+	int err = errno;
 	int istty = isatty(2);
 	va_list args;
 	const char *pre =
 		(istty ? ASCII_BOLD_RED "error:" ASCII_RESET : "error:");
 
+	if (trap != NULL) {
+		va_start(args, fmt);
+		_trap_report(err, TRUE, NULL, fmt, args);
+		va_end(args);
+		spring_error_trap();
+	}
+	pthread_mutex_lock(&fatal_lock);
 	va_start(args, fmt);
-	_weprintf(pre, NULL, fmt, args);
+	_weprintf(err, pre, NULL, fmt, args);
 	va_end(args);
 	exit(2);
 }
 
-void leprintf(const char *fmt, ...)
+void leprintf(const SourcePos *pos, const char *fmt, ...)
 {
+	int err = errno;
 	int istty = isatty(2);
 	va_list args;
 	const char *pre =
 		(istty ? ASCII_BOLD_RED "error:" ASCII_RESET : "error:");
 
+	if (trap != NULL) {
+		va_start(args, fmt);
+		_trap_report(err, TRUE, pos, fmt, args);
+		va_end(args);
+		spring_error_trap();
+	}
+	pthread_mutex_lock(&fatal_lock);
 	va_start(args, fmt);
-	_weprintf(pre, &position, fmt, args);
+	_weprintf(err, pre, pos, fmt, args);
 	va_end(args);
 	exit(2);
 }
 
+void ceprintf(const SourcePos *pos, const char *fmt, ...)
+{
+	int err = errno;
+	int istty = isatty(2);
+	va_list args;
+	const char *pre =
+		(istty ? ASCII_BOLD_RED "error:" ASCII_RESET : "error:");
+
+	va_start(args, fmt);
+	if (trap != NULL)
+		_trap_report(err, TRUE, pos, fmt, args);
+	else
+		_weprintf(err, pre, pos, fmt, args);
+	va_end(args);
+}
+
 void weprintf(const char *fmt, ...)
 {
+	int err = errno;
 	int istty = isatty(2);
 	va_list args;
 	const char *pre =
 		(istty ? ASCII_BOLD_YELLOW "warning:" ASCII_RESET : "warning:");
 
 	va_start(args, fmt);
-	_weprintf(pre, NULL, fmt, args);
+	if (trap != NULL)
+		_trap_report(err, FALSE, NULL, fmt, args);
+	else
+		_weprintf(err, pre, NULL, fmt, args);
 	va_end(args);
 }
 
-void teprintf(const char *tag, const char *fmt, ...)
+void lwprintf(const SourcePos *pos, const char *fmt, ...)
 {
+	int err = errno;
+	int istty = isatty(2);
+	va_list args;
+	const char *pre =
+		(istty ? ASCII_BOLD_YELLOW "warning:" ASCII_RESET : "warning:");
+
+	va_start(args, fmt);
+	if (trap != NULL)
+		_trap_report(err, FALSE, pos, fmt, args);
+	else
+		_weprintf(err, pre, pos, fmt, args);
+	va_end(args);
+}
+
+void teprintf(const char *tag, const SourcePos *pos, const char *fmt, ...)
+{
+	int err = errno;
 	va_list args;
 
+	if (trap != NULL) {
+		va_start(args, fmt);
+		_trap_report(err, TRUE, pos, fmt, args);
+		va_end(args);
+		spring_error_trap();
+	}
+	pthread_mutex_lock(&fatal_lock);
 	va_start(args, fmt);
-	_weprintf(tag, &position, fmt, args);
+	_weprintf(err, tag, pos, fmt, args);
 	va_end(args);
 	exit(3);
 }
 
+void set_error_trap(ErrorTrap *t)
+{
+	t->prev = trap;
+	trap = t;
+}
+
+void clear_error_trap(ErrorTrap *t)
+{
+	if (trap == t)
+		trap = t->prev;
+}
+
+void spring_error_trap(void)
+{
+	ErrorTrap *t = trap;
+
+	if (t == NULL)
+		exit(2);
+	trap = t->prev;
+	longjmp(t->env, 1);
+}
+
 char *estrdup(const char *s)
 {
 	char *t;
-	t = malloc((strlen(s) + 1) * sizeof(char));
+	t = allocate((strlen(s) + 1) * sizeof(char));
 	if (t == NULL)
 		eprintf("estrdup(\"%.20s\") failed:", s);
 	strcpy(t, s);
@@ -178,7 +382,7 @@ char *estrdup(const char *s)
 char *westrdup(const char *s)
 {
 	char *t;
-	t = malloc((strlen(s) + 1) * sizeof(char));
+	t = allocate((strlen(s) + 1) * sizeof(char));
 	if (t == NULL)
 		weprintf("estrdup(\"%.20s\") failed:", s);
 	strcpy(t, s);
@@ -189,7 +393,7 @@ void *emalloc(size_t n)
 {
 	void *p;
 
-	p = malloc(n);
+	p = allocate(n);
 	if (p == NULL)
 		eprintf("malloc of %u bytes failed:", n);
 	return p;
@@ -199,7 +403,7 @@ void *wemalloc(size_t n)
 {
 	void *p;
 
-	p = malloc(n);
+	p = allocate(n);
 	if (p == NULL)
 		weprintf("malloc of %u bytes failed:", n);
 	return p;
@@ -209,7 +413,7 @@ void *erealloc(void *vp, size_t n)
 {
 	void *p;
 
-	p = realloc(vp, n);
+	p = reallocate(vp, n);
 	if (p == NULL)
 		eprintf("realloc of %u bytes failed:", n);
 	return p;
@@ -219,12 +423,184 @@ void *werealloc(void *vp, size_t n)
 {
 	void *p;
 
-	p = realloc(vp, n);
+	p = reallocate(vp, n);
 	if (p == NULL)
 		weprintf("realloc of %u bytes failed:", n);
 	return p;
 }
 
+void efree(void *vp)
+{
+	if (vp != NULL)
+		release(vp);
+}
+
+Region *region_open(void)
+{
+	Region *r;
+
+	r = malloc(sizeof(Region));
+	if (r == NULL)
+		eprintf("malloc of %u bytes failed:", sizeof(Region));
+	r->chunks = NULL;
+	r->last = NULL;
+	r->prev = region;
+	region = r;
+	return r;
+}
+
+void region_release(Region *r)
+{
+	Chunk *c, *d;
+
+#ifdef TRACK_ALLOCATIONS
+	untrack_region(r);
+#endif
+	for (c = r->chunks; c != NULL; c = d) {
+		d = c->next;
+		free(c);
+	}
+	if (region == r) {
+		region = r->prev;
+	}
+	free(r);
+}
+
+const char *set_alloc_phase(const char *phase)
+{
+	const char *prev = alloc_phase;
+
+	alloc_phase = phase;
+	return prev;
+}
+
+#ifdef TRACK_ALLOCATIONS
+char *estrdup_at(const char *s, const char *site)
+{
+	const char *prev = alloc_site;
+	char *t;
+
+	alloc_site = site;
+	t = estrdup(s);
+	alloc_site = prev;
+	return t;
+}
+
+char *westrdup_at(const char *s, const char *site)
+{
+	const char *prev = alloc_site;
+	char *t;
+
+	alloc_site = site;
+	t = westrdup(s);
+	alloc_site = prev;
+	return t;
+}
+
+void *emalloc_at(size_t n, const char *site)
+{
+	const char *prev = alloc_site;
+	void *p;
+
+	alloc_site = site;
+	p = emalloc(n);
+	alloc_site = prev;
+	return p;
+}
+
+void *wemalloc_at(size_t n, const char *site)
+{
+	const char *prev = alloc_site;
+	void *p;
+
+	alloc_site = site;
+	p = wemalloc(n);
+	alloc_site = prev;
+	return p;
+}
+
+void *erealloc_at(void *vp, size_t n, const char *site)
+{
+	const char *prev = alloc_site;
+	void *p;
+
+	alloc_site = site;
+	p = erealloc(vp, n);
+	alloc_site = prev;
+	return p;
+}
+
+void *werealloc_at(void *vp, size_t n, const char *site)
+{
+	const char *prev = alloc_site;
+	void *p;
+
+	alloc_site = site;
+	p = werealloc(vp, n);
+	alloc_site = prev;
+	return p;
+}
+
+void print_allocation_report(void)
+{
+	unsigned int i, j, order[MAX_ALLOC_SITES], top;
+	unsigned int phases[MAX_ALLOC_SITES], nphases;
+	size_t count, bytes;
+	char name[64];
+
+	/* selection sort on bytes is plenty for a few dozen call sites */
+	for (i = 0; i < nsites; i++)
+		order[i] = i;
+	top = (nsites < ALLOC_REPORT_TOP ? nsites : ALLOC_REPORT_TOP);
+	for (i = 0; i < top; i++)
+		for (j = i + 1; j < nsites; j++)
+			if (sites[order[j]].bytes > sites[order[i]].bytes) {
+				unsigned int t = order[i];
+				order[i] = order[j];
+				order[j] = t;
+			}
+
+	fflush(stdout);
+	fprintf(stderr, "allocation report: %lu allocations, %lu bytes, "
+			"peak live %lu bytes\n", (unsigned long) total.count,
+			(unsigned long) total.bytes, (unsigned long) total.peak);
+	fprintf(stderr, "  %-32s %10s %12s %12s\n",
+			"call site", "count", "bytes", "peak live");
+	for (i = 0; i < top; i++) {
+		AllocSite *a = &sites[order[i]];
+		if (a->phase != NULL)
+			snprintf(name, sizeof(name), "%s/%s", a->phase, a->site);
+		else
+			snprintf(name, sizeof(name), "%s", a->site);
+		fprintf(stderr, "  %-32s %10lu %12lu %12lu\n", name,
+				(unsigned long) a->count, (unsigned long) a->bytes,
+				(unsigned long) a->peak);
+	}
+
+	/* the phases, in the order in which they first allocated */
+	for (nphases = 0, i = 0; i < nsites; i++) {
+		for (j = 0; j < nphases; j++)
+			if (same_name(sites[phases[j]].phase, sites[i].phase))
+				break;
+		if (j == nphases)
+			phases[nphases++] = i;
+	}
+	fprintf(stderr, "  %-32s %10s %12s\n", "phase", "count", "bytes");
+	for (i = 0; i < nphases; i++) {
+		const char *phase = sites[phases[i]].phase;
+		count = bytes = 0;
+		for (j = 0; j < nsites; j++)
+			if (same_name(sites[j].phase, phase)) {
+				count += sites[j].count;
+				bytes += sites[j].bytes;
+			}
+		fprintf(stderr, "  %-32s %10lu %12lu\n",
+				(phase != NULL ? phase : "(none)"),
+				(unsigned long) count, (unsigned long) bytes);
+	}
+}
+#endif /* TRACK_ALLOCATIONS */
+
 #ifndef __APPLE__
 void setprogname(char *s)
 {
@@ -264,11 +640,301 @@ char *getsrcname(void)
 void freeprogname(void)
 {
 #ifndef __APPLE__
-	free(pname);
+	efree(pname);
 #endif
 }
 
 void freesrcname(void)
 {
-	free(sname);
+	efree(sname);
+}
+
+/* --- allocation utility functions ----------------------------------------- */
+
+/**
+ * Obtains a block from the active region, or from <code>malloc</code> if
+ * there is none, and records it if allocations are tracked.  Either way, the
+ * block starts with a header that names its owner.
+ *
+ * @param[in] n the number of bytes to allocate.
+ * @return      a pointer to the block, or NULL if the allocation failed.
+ */
+static void *allocate(size_t n)
+{
+	Header *h;
+	void *p;
+
+	if (region != NULL) {
+		p = region_alloc(n + EXTRA);
+	} else if ((h = malloc(sizeof(Header) + n + EXTRA)) != NULL) {
+		h->tag.size = n + EXTRA;
+		h->tag.owner = NULL;
+		p = h + 1;
+	} else {
+		p = NULL;
+	}
+#ifdef TRACK_ALLOCATIONS
+	if (p != NULL) {
+		TrackHeader *th = p;
+		th->info.size = n;
+		pthread_mutex_lock(&sites_lock);
+		th->info.site = find_site(alloc_phase, alloc_site);
+		track(th->info.site, n);
+		pthread_mutex_unlock(&sites_lock);
+		p = th + 1;
+	}
+#endif
+	return p;
+}
+
+/**
+ * Resizes a block obtained from <code>allocate</code>.  A block from
+ * <code>malloc</code> stays there, and a block of the active region is resized
+ * in it.  A block of any other region cannot grow, since that region may be in
+ * use by another thread, so it is copied into a new block, and the old one is
+ * left to be released with its region.
+ *
+ * @param[in] vp a pointer to the block, or NULL.
+ * @param[in] n  the new size in bytes.
+ * @return       a pointer to the resized block, or NULL if it failed.
+ */
+static void *reallocate(void *vp, size_t n)
+{
+	Header *h;
+	void *b, *p;
+	size_t size;
+#ifdef TRACK_ALLOCATIONS
+	TrackHeader *th;
+	unsigned int i;
+	size_t old;
+	Region *owner;
+#endif
+
+	if (vp == NULL)
+		return allocate(n);
+	b = (char *) vp - EXTRA;
+	h = (Header *) b - 1;
+	if (h->tag.owner != NULL && h->tag.owner != region) {
+		size = h->tag.size - EXTRA;
+		if ((p = allocate(n)) != NULL)
+			memcpy(p, vp, (n < size ? n : size));
+		return p;
+	}
+#ifdef TRACK_ALLOCATIONS
+	th = b;
+	i = th->info.site;
+	old = th->info.size;
+	owner = h->tag.owner;
+#endif
+	if (h->tag.owner == NULL) {
+		if ((h = realloc(h, sizeof(Header) + n + EXTRA)) == NULL)
+			return NULL;
+		h->tag.size = n + EXTRA;
+		b = h + 1;
+	} else if ((b = region_realloc(b, n + EXTRA)) == NULL) {
+		return NULL;
+	}
+#ifdef TRACK_ALLOCATIONS
+	/* a block that was copied within the region no longer counts when the
+	 * region is released */
+	if (owner != NULL && b != (void *) th)
+		th->info.size = 0;
+	th = b;
+	th->info.size = n;
+	pthread_mutex_lock(&sites_lock);
+	untrack(i, old);
+	th->info.site = find_site(alloc_phase, alloc_site);
+	track(th->info.site, n);
+	pthread_mutex_unlock(&sites_lock);
+#endif
+	return (char *) b + EXTRA;
+}
+
+/**
+ * Releases a block obtained from <code>allocate</code>; blocks owned by a
+ * region are only released in bulk, whether or not the region is active.
+ *
+ * @param[in] vp a pointer to the block.
+ */
+static void release(void *vp)
+{
+	Header *h;
+
+	h = (Header *) ((char *) vp - EXTRA) - 1;
+	if (h->tag.owner != NULL)
+		return;
+#ifdef TRACK_ALLOCATIONS
+	{
+		TrackHeader *th = (TrackHeader *) vp - 1;
+		pthread_mutex_lock(&sites_lock);
+		untrack(th->info.site, th->info.size);
+		pthread_mutex_unlock(&sites_lock);
+	}
+#endif
+	free(h);
+}
+
+#ifdef TRACK_ALLOCATIONS
+/**
+ * Compares two names, either of which may be NULL.
+ *
+ * @param[in] a the first name.
+ * @param[in] b the second name.
+ * @return      whether the names are equal.
+ */
+static Boolean same_name(const char *a, const char *b)
+{
+	return (a == b || (a != NULL && b != NULL && strcmp(a, b) == 0));
+}
+
+/**
+ * Looks up the statistics of a call site in a compiler phase, adding it if it
+ * is new.  The first allocation also registers the exit report.
+ *
+ * @param[in] phase the compiler phase, or NULL.
+ * @param[in] site  the name of the allocating function.
+ * @return          the index of the call site.
+ */
+static unsigned int find_site(const char *phase, const char *site)
+{
+	unsigned int i;
+
+	for (i = 0; i < nsites; i++)
+		if (same_name(sites[i].phase, phase) && same_name(sites[i].site, site))
+			return i;
+	if (nsites == 0)
+		atexit(print_allocation_report);
+	if (nsites == MAX_ALLOC_SITES - 1 && strcmp(site, "(other)") != 0)
+		return find_site(NULL, "(other)");
+	sites[nsites].phase = phase;
+	sites[nsites].site = site;
+	return nsites++;
+}
+
+static void track(unsigned int i, size_t n)
+{
+	AllocSite *s[2];
+	int k;
+
+	s[0] = &sites[i];
+	s[1] = &total;
+	for (k = 0; k < 2; k++) {
+		s[k]->count++;
+		s[k]->bytes += n;
+		s[k]->live += n;
+		if (s[k]->live > s[k]->peak)
+			s[k]->peak = s[k]->live;
+	}
+}
+
+static void untrack(unsigned int i, size_t n)
+{
+	AllocSite *s[2];
+	int k;
+
+	s[0] = &sites[i];
+	s[1] = &total;
+	for (k = 0; k < 2; k++)
+		s[k]->live -= n;
+}
+
+/**
+ * Drops the blocks of a region that is about to be released from the live
+ * bytes of their call sites, by walking the headers of its blocks, so that the
+ * blocks of other regions still count.
+ *
+ * @param[in] r the region.
+ */
+static void untrack_region(const Region *r)
+{
+	const Chunk *c;
+	const Header *h, *end;
+	const TrackHeader *th;
+
+	pthread_mutex_lock(&sites_lock);
+	for (c = r->chunks; c != NULL; c = c->next)
+		for (h = c->data, end = &c->data[c->used]; h < end;
+				h += 1 + h->tag.size / sizeof(Header)) {
+			th = (const TrackHeader *) (h + 1);
+			untrack(th->info.site, th->info.size);
+		}
+	pthread_mutex_unlock(&sites_lock);
+}
+#endif /* TRACK_ALLOCATIONS */
+
+/* --- region utility functions --------------------------------------------- */
+
+/**
+ * Carves a block of the specified size out of the active region.  Blocks are
+ * preceded by a header that records their size, so that they can be resized.
+ * Blocks larger than a quarter chunk get a chunk of their own, which is linked
+ * behind the current chunk so that small allocations can continue to use it.
+ *
+ * @param[in] n the number of bytes to allocate.
+ * @return      a pointer to the block, or NULL if the allocation failed.
+ */
+static void *region_alloc(size_t n)
+{
+	size_t units, size;
+	Chunk *c;
+	Header *h;
+
+	units = 1 + (n + sizeof(Header) - 1) / sizeof(Header);
+	c = region->chunks;
+	if (c == NULL || c->used + units > c->size) {
+		size = REGION_CHUNK_SIZE / sizeof(Header);
+		if (units > size / 4)
+			size = units;
+		c = malloc(sizeof(Chunk) + size * sizeof(Header));
+		if (c == NULL)
+			return NULL;
+		c->size = size;
+		c->used = 0;
+		if (size == units && region->chunks != NULL) {
+			c->next = region->chunks->next;
+			region->chunks->next = c;
+		} else {
+			c->next = region->chunks;
+			region->chunks = c;
+		}
+	}
+	h = &c->data[c->used];
+	h->tag.size = (units - 1) * sizeof(Header);
+	h->tag.owner = region;
+	c->used += units;
+	region->last = h;
+	return h + 1;
+}
+
+/**
+ * Resizes a block in the active region.  The most recent block of the current
+ * chunk is grown in place if there is room; any other block is copied.
+ *
+ * @param[in] vp a pointer to the block, or NULL.
+ * @param[in] n  the new size in bytes.
+ * @return       a pointer to the resized block, or NULL if it failed.
+ */
+static void *region_realloc(void *vp, size_t n)
+{
+	size_t units;
+	Header *h;
+	Chunk *c;
+	void *p;
+
+	if (vp == NULL)
+		return region_alloc(n);
+	h = (Header *) vp - 1;
+	if (n <= h->tag.size)
+		return vp;
+	c = region->chunks;
+	units = (n - h->tag.size + sizeof(Header) - 1) / sizeof(Header);
+	if (h == region->last && c != NULL && h + 1 + h->tag.size / sizeof(Header)
+			== &c->data[c->used] && c->used + units <= c->size) {
+		c->used += units;
+		h->tag.size += units * sizeof(Header);
+		return vp;
+	}
+	if ((p = region_alloc(n)) != NULL)
+		memcpy(p, vp, h->tag.size);
+	return p;
 }
@@ -19,13 +19,48 @@
 #ifndef ERROR_H
 #define ERROR_H
 
+#include <setjmp.h>
+#include <stddef.h>
+#include "boolean.h"
+
 /** a place (position) in the source file */
 typedef struct  {
 	int line;  /**< the line number   */
 	int col;   /**< the column number */
 } SourcePos;
 
-extern SourcePos position;
+/** an allocation region that owns every object of one compilation */
+typedef struct region Region;
+
+/**
+ * An error trap.  While a trap is set on a thread, errors and warnings raised
+ * on that thread are handed to its report function instead of being displayed,
+ * and a fatal error jumps back to where the trap was set instead of terminating
+ * the program.  The caller sets the trap right after calling
+ * <code>setjmp</code> on its environment:
+ *
+ * <pre>
+ *     if (setjmp(trap.env) == 0) {
+ *         set_error_trap(&trap);
+ *         ...
+ *         clear_error_trap(&trap);
+ *     } else {
+ *         ... the trap was sprung, and has been cleared ...
+ *     }
+ * </pre>
+ *
+ * Objects allocated between setting and springing a trap are not released; a
+ * caller normally allocates from a region that it releases afterwards.
+ */
+typedef struct error_trap_s ErrorTrap;
+struct error_trap_s {
+	jmp_buf     env;           /**< where a fatal error resumes            */
+	void      (*report)(void *data, Boolean fatal, const SourcePos *pos,
+	                    const char *message);
+	                           /**< receives every error and warning       */
+	void       *data;          /**< passed to the report function          */
+	ErrorTrap  *prev;          /**< the trap this one was set inside of    */
+};
 
 /**
  * Displays an error message on the standard error stream and exit.
@@ -38,28 +73,45 @@ extern SourcePos position;
 void eprintf(const char *fmt, ...);
 
 /**
- * Displays an error message on the standard error stream, with the current
+ * Displays an error message on the standard error stream, with a source
  * position prepended, and exit.
  *
+ * @param[in]   pos
+ *     the position in the source file
  * @param[in]   fmt
  *     a printf format string
  * @param[in]   ...
  *     the variable arguments to the format string
  */
-void leprintf(const char *fmt, ...);
+void leprintf(const SourcePos *pos, const char *fmt, ...);
 
 /**
- * Displays an error message on the standard error stream, with a tag prepended,
- * and exit.
+ * Displays an error message on the standard error stream, with a source
+ * position prepended, if any, and returns, so that more errors may follow.
+ *
+ * @param[in]   pos
+ *     the position in the source file, or <code>NULL</code>
+ * @param[in]   fmt
+ *     a printf format string
+ * @param[in]   ...
+ *     the variable arguments to the format string
+ */
+void ceprintf(const SourcePos *pos, const char *fmt, ...);
+
+/**
+ * Displays an error message on the standard error stream, with a tag and a
+ * source position prepended, and exit.
  *
  * @param[in]   tag
  *     the tag to prepend to the error message
+ * @param[in]   pos
+ *     the position in the source file
  * @param[in]   fmt
  *     a printf format string
  * @param[in]   ...
  *     the variable arguments to the format string
  */
-void teprintf(const char *tag, const char *fmt, ...);
+void teprintf(const char *tag, const SourcePos *pos, const char *fmt, ...);
 
 /**
  * Displays a warning message on the standard error stream.
@@ -71,6 +123,45 @@ void teprintf(const char *tag, const char *fmt, ...);
  */
 void weprintf(const char *fmt, ...);
 
+/**
+ * Displays a warning message on the standard error stream, with a source
+ * position prepended.
+ *
+ * @param[in]   pos
+ *     the position in the source file
+ * @param[in]   fmt
+ *     a printf format string
+ * @param[in]   ...
+ *     the variable arguments to the format string
+ */
+void lwprintf(const SourcePos *pos, const char *fmt, ...);
+
+/**
+ * Sets an error trap on the calling thread, inside the trap already set, if
+ * any.
+ *
+ * @param[in,out] trap
+ *     the trap, of which the environment has been saved with
+ *     <code>setjmp</code>
+ */
+void set_error_trap(ErrorTrap *trap);
+
+/**
+ * Clears the innermost error trap of the calling thread, which must be the
+ * specified trap, without springing it.
+ *
+ * @param[in]   trap
+ *     the trap
+ */
+void clear_error_trap(ErrorTrap *trap);
+
+/**
+ * Clears the innermost error trap of the calling thread, and jumps back to
+ * where it was set, without reporting anything.  Without a trap, the program
+ * is terminated.
+ */
+void spring_error_trap(void);
+
 /**
  * Duplicates a string, and terminates the program with a message on the
  * standard error stream if the duplication fails.
@@ -139,6 +230,92 @@ void *erealloc(void *vp, size_t n);
  */
 void *werealloc(void *vp, size_t n);
 
+/**
+ * Releases memory obtained from one of the allocation functions above.  If the
+ * memory is owned by a region, whether or not that region is still active, it
+ * is only released with the region, and this is a no-op; otherwise, it is
+ * freed, even while a region is active.
+ *
+ * @param[in]   vp
+ *     a pointer to the memory to release
+ */
+void efree(void *vp);
+
+/**
+ * Opens a new allocation region, and makes it the active region of the calling
+ * thread.  Until the region is released, every allocation that is made through
+ * <code>emalloc</code>, <code>erealloc</code>, <code>estrdup</code>, and their
+ * warning variants on that thread is carved out of the region instead of being
+ * obtained from <code>malloc</code>.  Every block remembers its owner, so that
+ * memory from <code>malloc</code> may still be resized or released while the
+ * region is active, and memory of the region may be resized on a thread on
+ * which it is not active, in which case it is copied out of the region.  A
+ * region may be released by another thread, once the thread that opened it has
+ * stopped allocating from it.
+ *
+ * @return      a pointer to the new region
+ */
+Region *region_open(void);
+
+/**
+ * Releases all memory owned by the specified region in bulk.  If it is the
+ * active region of the calling thread, the region that was active when it was
+ * opened, if any, becomes active again, so that regions that are opened and
+ * released in nested order on a thread leave the active region as they found
+ * it.  Any pointer obtained while the region was active becomes invalid.
+ *
+ * @param[in]   r
+ *     the region to release
+ */
+void region_release(Region *r);
+
+/**
+ * Sets the compiler phase of the calling thread, by which its allocations are
+ * tagged if allocations are tracked.  A phase calls this on entry, and again
+ * with the phase that it returned on exit, so that the allocations of generic
+ * helpers are charged to the phase that called them.
+ *
+ * @param[in]   phase
+ *     the name of the phase, which must outlive the program, or
+ *     <code>NULL</code> for none
+ * @return      the phase that was set before
+ */
+const char *set_alloc_phase(const char *phase);
+
+#ifdef TRACK_ALLOCATIONS
+/* With allocation tracking enabled (add -DTRACK_ALLOCATIONS to DFLAGS), every
+ * allocation is tagged with the name of the function that requested it and
+ * the compiler phase of its thread, and a report of the busiest call sites and
+ * of the phases is printed on the standard error stream when the program
+ * exits.
+ */
+#ifndef ALLOC_REPORT_TOP
+#define ALLOC_REPORT_TOP 10
+#endif
+
+#define estrdup(s)        estrdup_at((s), __func__)
+#define westrdup(s)       westrdup_at((s), __func__)
+#define emalloc(n)        emalloc_at((n), __func__)
+#define wemalloc(n)       wemalloc_at((n), __func__)
+#define erealloc(vp, n)   erealloc_at((vp), (n), __func__)
+#define werealloc(vp, n)  werealloc_at((vp), (n), __func__)
+
+char *estrdup_at(const char *s, const char *site);
+char *westrdup_at(const char *s, const char *site);
+void *emalloc_at(size_t n, const char *site);
+void *wemalloc_at(size_t n, const char *site);
+void *erealloc_at(void *vp, size_t n, const char *site);
+void *werealloc_at(void *vp, size_t n, const char *site);
+
+/**
+ * Prints the allocation count, the number of bytes, and the peak number of
+ * live bytes of the <code>ALLOC_REPORT_TOP</code> call sites that allocated
+ * the most bytes, as well as the totals, and the allocation count and the
+ * number of bytes of every phase, on the standard error stream.
+ */
+void print_allocation_report(void);
+#endif /* TRACK_ALLOCATIONS */
+
 /**
  * Frees the program name.
  */
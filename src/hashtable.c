@@ -79,7 +79,7 @@ HashTab *ht_init(float loadfactor,
 	 *   appropriately.
 	 */
 
-	ht = malloc(sizeof(HashTab));
+	ht = wemalloc(sizeof(HashTab));
 	if (ht == NULL) {
 		return NULL;
 	}
@@ -87,11 +87,14 @@ HashTab *ht_init(float loadfactor,
 	i = (1 << ht->idx) - delta[ht->idx];
 	ht->size = i;
 
-	ht->table = calloc(ht->size, sizeof(HTentry*));
+	ht->table = wemalloc(ht->size * sizeof(HTentry*));
 	if (ht->table == NULL) {
-		free(ht);
+		efree(ht);
 		return NULL;
 	}
+	for (i = 0; i < ht->size; i++) {
+		ht->table[i] = NULL;
+	}
 
 	ht->num_entries = 0;
 	ht->max_loadfactor = loadfactor;
@@ -103,8 +106,7 @@ HashTab *ht_init(float loadfactor,
 
 int ht_insert(HashTab *ht, void *key, void *value)
 {
-	int k;
-	HTentry *p, *q;
+	void *slot;
 
 	/* Insert a new key--value pair, rehashing if necessary.  The best way
 	 * to go about rehashing is to put the necessary elements into a static
@@ -113,32 +115,38 @@ int ht_insert(HashTab *ht, void *key, void *value)
 	 * constants in hashtable.h for return values; remember, unless it runs out
 	 * of memory, no operation on a hash table may terminate the program.
 	 */
+	return ht_find_or_insert(ht, key, value, &slot);
+}
+
+int ht_find_or_insert(HashTab *ht, void *key, void *value, void **slot)
+{
+	int k;
+	HTentry *p;
+
 	k = ht->hash(key, ht->size);
-	for (q = ht->table[k]; q != NULL; q = q->next_ptr) {
-		if (ht->cmp(q->key, key) == 0) {
+	for (p = ht->table[k]; p != NULL; p = p->next_ptr) {
+		if (ht->cmp(p->key, key) == 0) {
+			*slot = p->value;
 			return HASH_TABLE_KEY_VALUE_PAIR_EXISTS;
-		}	
+		}
 	}
-	ht->num_entries++;
-	if (ht->num_entries >= ht->max_loadfactor * ht->size) {
+	if (ht->num_entries + 1 >= ht->max_loadfactor * ht->size) {
 		rehash(ht);
-		if (ht->num_entries > ht->size) {
+		if (ht->num_entries + 1 > ht->size) {
 			return HASH_TABLE_NO_SPACE_FOR_NODE;
 		}
 		k = ht->hash(key, ht->size);
 	}
-	p = malloc(sizeof(HTentry));
+	p = wemalloc(sizeof(HTentry));
 	if (p == NULL) {
 		return EXIT_FAILURE;
 	}
 	p->key = key;
 	p->value = value;
 	p->next_ptr = ht->table[k];
-	
-	ht->table[k] = malloc(sizeof(HTentry));
-
-	*ht->table[k] = *p;
-	free(p);
+	ht->table[k] = p;
+	ht->num_entries++;
+	*slot = value;
 
 	return EXIT_SUCCESS;
 }
@@ -176,12 +184,12 @@ Boolean ht_free(HashTab *ht, void (*freekey)(void *k), void (*freeval)(void *v))
 			p = p->next_ptr;
 			freekey(q->key);
 			freeval(q->value);
-			free(q);
+			efree(q);
 		}
 	}
 	/* free the table and container */
-	free(ht->table);
-	free(ht);
+	efree(ht->table);
+	efree(ht);
 
 	return EXIT_SUCCESS;
 }
@@ -239,7 +247,7 @@ static void rehash(HashTab *ht)
 	
 	new_size = getsize(ht);
 	old_table = ht->table;
-	new_table = malloc(new_size * sizeof(HTentry*));
+	new_table = emalloc(new_size * sizeof(HTentry*));
 
 	for (i = 0; i < new_size; i++) {
 		new_table[i] = NULL;
@@ -254,7 +262,7 @@ static void rehash(HashTab *ht)
 			p = q;
 		}
 	}
-	free(old_table);
+	efree(old_table);
 	ht->idx++;
 	ht->size = new_size;
 	ht->table = new_table;
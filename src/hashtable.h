@@ -55,6 +55,27 @@ HashTab *ht_init(float loadfactor,
  */
 int ht_insert(HashTab *ht, void *key, void *value);
 
+/**
+ * Looks up the specified key in the specified hash table, and associates it
+ * with the specified value only if it is not already present.  The bucket is
+ * walked once, so that a declaration costs a single probe.
+ *
+ * @param[in]   ht
+ *     a pointer to the hash table in which to look up or insert the key
+ * @param[in]   key
+ *     a pointer to the key
+ * @param[in]   value
+ *     a pointer to the value to associate with the key if it is absent
+ * @param[out]  slot
+ *     a pointer to the address of the variable where the value now associated
+ *     with the key, either the existing one or the new one, will be copied
+ * @return      <code>EXIT_SUCCESS</code> if the key was inserted,
+ *              <code>HASH_TABLE_KEY_VALUE_PAIR_EXISTS</code> if it was already
+ *              present, or one of the other designated error codes if the
+ *              insertion failed
+ */
+int ht_find_or_insert(HashTab *ht, void *key, void *value, void **slot);
+
 /**
  * Searches the specified hash table for the value associated with the
  * specified key.
@@ -0,0 +1,1596 @@
+/**
+ * @file    ir.c
+ * @brief   A typed three-address intermediate form of a SIMPL-2021 subroutine.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boolean.h"
+#include "codegen.h"
+#include "error.h"
+#include "ir.h"
+#include "jvm.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+#define INITIAL_ITEMS 64
+
+#define INSTR(ir, i)   (((IrInstr *) (ir)->instrs.items) + (i))
+#define BLOCK(ir, b)   (((IrBlock *) (ir)->blocks.items) + (b))
+#define VAR(ir, v)     (((IrVar *) (ir)->vars.items) + (v))
+#define PHI(ir, p)     (((IrInstr *) (ir)->phis.items) + (p))
+#define UINTS(a)       ((unsigned int *) (a).items)
+
+#define IS_RELOP(op)   ((op) >= TOK_EQ && (op) <= TOK_NE)
+
+/* the uses of the working storage */
+enum {
+	S_ORDER,       /* the reachable blocks, in reverse postorder         */
+	S_STACK,       /* the stack of a depth-first walk                    */
+	S_DF_FIRST,    /* the first frontier block of each block             */
+	S_DF_COUNT,    /* the number of frontier blocks of each block        */
+	S_DF,          /* the frontier blocks, by block                      */
+	S_PAIRS,       /* pairs of blocks or variables, to be sorted         */
+	S_STAMP,       /* per block or variable marks                        */
+	S_WORK,        /* per block marks for the worklist, and the worklist */
+	S_GLOBAL,      /* whether a variable is live across blocks           */
+	S_KIDS_FIRST,  /* the first child of each block in the dominator tree */
+	S_KIDS,        /* the children, by block                             */
+	S_LOG          /* the current versions, and the log of changes       */
+};
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void init_array(IrArray *a, size_t size);
+static unsigned int append(IrArray *a);
+static void resize(IrArray *a, unsigned int count);
+
+static void open_block(Ir *ir, unsigned int label);
+static IrInstr *emit(Ir *ir, IrOpcode opcode, ValType type);
+static IrTemp define(Ir *ir, IrOpcode opcode, ValType type, IrTemp a,
+		IrTemp b);
+static void terminate(Ir *ir, IrOpcode opcode, IrTemp a, unsigned int target,
+		unsigned int other);
+static unsigned int new_label(Ir *ir);
+static void place_label(Ir *ir, unsigned int label);
+static unsigned int variable(Ir *ir, Node name);
+static IrTemp load(Ir *ir, Node name);
+static void store(Ir *ir, Node name, IrTemp a);
+static unsigned int build_args(Ir *ir, Node a, unsigned int *count);
+static void build_statements(Ir *ir, Node s);
+static void build_statement(Ir *ir, Node s);
+static IrTemp build_expr(Ir *ir, Node e);
+static IrTemp build_logical(Ir *ir, Node n);
+static void build_cond(Ir *ir, Node n, unsigned int label, Boolean value);
+
+static unsigned int successors(Ir *ir, unsigned int b, unsigned int s[2]);
+static void find_order(Ir *ir);
+static void find_dominators(Ir *ir);
+static unsigned int intersect(Ir *ir, unsigned int b1, unsigned int b2);
+static void find_frontiers(Ir *ir);
+static void place_phis(Ir *ir);
+static void rename_variables(Ir *ir);
+static void rename_block(Ir *ir, unsigned int b);
+static void set_version(Ir *ir, unsigned int var, unsigned int version);
+static void undo(Ir *ir, unsigned int mark);
+
+static const char *op_name(TokenType op);
+static void dump_instr(Ir *ir, IrInstr *i, FILE *file);
+static void lower_instr(Ir *ir, IrInstr *i, Label *labels, CodeGen *cg);
+static Boolean find_increment(Ir *ir, unsigned int k, unsigned int *var,
+		int *amount);
+static unsigned int find_guard(Ir *ir, IrBlock *b);
+static void lower_guard(Ir *ir, IrBlock *b, unsigned int first, Label *labels,
+		CodeGen *cg);
+static Bytecode compare_opcode(TokenType op, Boolean negate);
+
+/* --- intermediate form interface ------------------------------------------ */
+
+void init_ir(Ir *ir)
+{
+	unsigned int i;
+
+	init_array(&ir->instrs, sizeof(IrInstr));
+	init_array(&ir->blocks, sizeof(IrBlock));
+	init_array(&ir->vars, sizeof(IrVar));
+	init_array(&ir->args, sizeof(IrTemp));
+	init_array(&ir->labels, sizeof(unsigned int));
+	init_array(&ir->slots, sizeof(unsigned int));
+	init_array(&ir->phis, sizeof(IrInstr));
+	init_array(&ir->operands, sizeof(unsigned int));
+	init_array(&ir->preds, sizeof(unsigned int));
+	for (i = 0; i < IR_SCRATCH; i++) {
+		init_array(&ir->scratch[i], sizeof(unsigned int));
+	}
+	ir->ntemps = 0;
+	ir->open = FALSE;
+	ir->ast = NULL;
+	ir->return_type = TYPE_NONE;
+	ir->strict = FALSE;
+}
+
+void build_ir(Ir *ir, Ast *t, BodyTree *body, ValType return_type)
+{
+	IrBlock *b;
+	IrInstr *i;
+	unsigned int k;
+
+	ir->ast = t;
+	ir->return_type = return_type;
+
+	/* the entry block is never the target of a jump */
+	open_block(ir, NO_BLOCK);
+	build_statements(ir, body->stmts);
+	if (return_type == TYPE_NONE) {
+		terminate(ir, IR_RETURN, NO_TEMP, NO_BLOCK, NO_BLOCK);
+	} else if (ir->open) {
+		terminate(ir, (IS_PROCEDURE(return_type) ? IR_RETURN : IR_END),
+				NO_TEMP, NO_BLOCK, NO_BLOCK);
+	}
+
+	/* jumps refer to labels while the body is built, and to blocks after */
+	for (k = 0; k < ir->blocks.count; k++) {
+		b = BLOCK(ir, k);
+		i = INSTR(ir, b->first + b->count - 1);
+		if (i->opcode == IR_JUMP || i->opcode == IR_FALL) {
+			i->target = UINTS(ir->labels)[i->target];
+		} else if (i->opcode == IR_BRANCH) {
+			i->other = UINTS(ir->labels)[i->other];
+		}
+	}
+}
+
+void convert_to_ssa(Ir *ir)
+{
+	find_order(ir);
+	find_dominators(ir);
+	find_frontiers(ir);
+	place_phis(ir);
+	rename_variables(ir);
+}
+
+void dump_ir(Ir *ir, const char *name, FILE *file)
+{
+	IrBlock *b;
+	unsigned int k, j;
+
+	fprintf(file, "define %s\n", name);
+	for (k = 0; k < ir->blocks.count; k++) {
+		b = BLOCK(ir, k);
+		fprintf(file, "B%u:", k);
+		if (!b->reachable) {
+			fprintf(file, "\t; unreachable");
+		} else if (b->npreds > 0) {
+			fprintf(file, "\t; preds");
+			for (j = 0; j < b->npreds; j++) {
+				fprintf(file, " B%u", UINTS(ir->preds)[b->preds + j]);
+			}
+			fprintf(file, "; idom B%u", b->idom);
+		}
+		fputc('\n', file);
+		for (j = 0; j < b->nphis; j++) {
+			dump_instr(ir, PHI(ir, b->phis + j), file);
+		}
+		for (j = 0; j < b->count; j++) {
+			dump_instr(ir, INSTR(ir, b->first + j), file);
+		}
+	}
+	fputc('\n', file);
+}
+
+void lower_ir(Ir *ir, CodeGen *cg)
+{
+	IrBlock *b;
+	Label *labels;
+	unsigned int k, j, n, var;
+	int amount;
+
+	labels = emalloc((ir->labels.count + 1) * sizeof(Label));
+	for (k = 0; k < ir->labels.count; k++) {
+		labels[k] = get_label(cg);
+	}
+
+	for (k = 0; k < ir->blocks.count; k++) {
+		b = BLOCK(ir, k);
+		if (b->label != NO_BLOCK) {
+			gen_label(cg, labels[b->label]);
+		}
+		n = find_guard(ir, b);
+		for (j = 0; j < n; j++) {
+			if (j + 3 < n && find_increment(ir, b->first + j, &var, &amount)) {
+				gen_3(cg, JVM_IINC, VAR(ir, var)->slot, amount);
+				j += 3;
+			} else {
+				lower_instr(ir, INSTR(ir, b->first + j), labels, cg);
+			}
+		}
+		if (n < b->count) {
+			lower_guard(ir, b, n, labels, cg);
+		}
+	}
+
+	efree(labels);
+}
+
+void reset_ir(Ir *ir)
+{
+	IrInstr *i;
+	unsigned int k;
+
+	for (k = 0; k < ir->instrs.count; k++) {
+		i = INSTR(ir, k);
+		if (i->opcode == IR_WRITE_STRING) {
+			efree(i->string);
+		}
+	}
+	ir->instrs.count = ir->blocks.count = ir->vars.count = 0;
+	ir->args.count = ir->labels.count = ir->slots.count = 0;
+	ir->phis.count = ir->operands.count = ir->preds.count = 0;
+	ir->ntemps = 0;
+	ir->open = FALSE;
+	ir->ast = NULL;
+}
+
+void release_ir(Ir *ir)
+{
+	unsigned int i;
+
+	reset_ir(ir);
+	efree(ir->instrs.items);
+	efree(ir->blocks.items);
+	efree(ir->vars.items);
+	efree(ir->args.items);
+	efree(ir->labels.items);
+	efree(ir->slots.items);
+	efree(ir->phis.items);
+	efree(ir->operands.items);
+	efree(ir->preds.items);
+	for (i = 0; i < IR_SCRATCH; i++) {
+		efree(ir->scratch[i].items);
+	}
+	init_ir(ir);
+}
+
+/* --- building ------------------------------------------------------------- */
+
+/* The form is built in the order in which the code is laid out.  A block is
+ * opened when a label is placed, or when code follows a terminator, so that
+ * code after a jump or return lands in a block of its own, which is left
+ * unreachable.  A branch falls through to whichever block is opened next.
+ */
+
+static void open_block(Ir *ir, unsigned int label)
+{
+	unsigned int k;
+	IrBlock *b;
+
+	k = append(&ir->blocks);
+	b = BLOCK(ir, k);
+	b->first = ir->instrs.count;
+	b->count = 0;
+	b->label = label;
+	b->idom = NO_BLOCK;
+	if (label != NO_BLOCK) {
+		UINTS(ir->labels)[label] = k;
+	}
+	ir->open = TRUE;
+}
+
+/**
+ * Appends an instruction to the open block, opening a block if none is open.
+ *
+ * @param[in,out] ir     the intermediate form.
+ * @param[in]     opcode the kind of instruction.
+ * @param[in]     type   the type of the result, or operand.
+ * @return               the instruction, which stays put until the next one is
+ *                       appended.
+ */
+static IrInstr *emit(Ir *ir, IrOpcode opcode, ValType type)
+{
+	unsigned int k;
+	IrInstr *i;
+
+	if (!ir->open) {
+		open_block(ir, NO_BLOCK);
+	}
+	k = append(&ir->instrs);
+	BLOCK(ir, ir->blocks.count - 1)->count++;
+	i = INSTR(ir, k);
+	i->opcode = opcode;
+	i->type = type;
+	i->target = i->other = NO_BLOCK;
+
+	return i;
+}
+
+static IrTemp define(Ir *ir, IrOpcode opcode, ValType type, IrTemp a,
+		IrTemp b)
+{
+	IrInstr *i;
+
+	i = emit(ir, opcode, type);
+	i->dst = ++ir->ntemps;
+	i->a = a;
+	i->b = b;
+
+	return i->dst;
+}
+
+static void terminate(Ir *ir, IrOpcode opcode, IrTemp a, unsigned int target,
+		unsigned int other)
+{
+	IrInstr *i;
+
+	i = emit(ir, opcode, TYPE_NONE);
+	i->a = a;
+	i->target = target;
+	i->other = other;
+	if (opcode == IR_RETURN && a != NO_TEMP) {
+		i->type = ir->return_type;
+		SET_RETURN_TYPE(i->type);
+	}
+	ir->open = FALSE;
+}
+
+static unsigned int new_label(Ir *ir)
+{
+	unsigned int label;
+
+	label = append(&ir->labels);
+	UINTS(ir->labels)[label] = NO_BLOCK;
+
+	return label;
+}
+
+static void place_label(Ir *ir, unsigned int label)
+{
+	if (ir->open) {
+		terminate(ir, IR_FALL, NO_TEMP, label, NO_BLOCK);
+	}
+	open_block(ir, label);
+}
+
+static unsigned int variable(Ir *ir, Node name)
+{
+	Name *m;
+	IrVar *v;
+	unsigned int slot, k;
+
+	m = ast_name(ir->ast, name);
+	slot = m->prop->offset;
+	if (slot >= ir->slots.count) {
+		k = ir->slots.count;
+		resize(&ir->slots, slot + 1);
+		for (; k <= slot; k++) {
+			UINTS(ir->slots)[k] = NO_BLOCK;
+		}
+	}
+	if (UINTS(ir->slots)[slot] == NO_BLOCK) {
+		k = append(&ir->vars);
+		v = VAR(ir, k);
+		v->slot = slot;
+		v->type = m->prop->type;
+		v->id = m->id;
+		v->versions = 0;
+		UINTS(ir->slots)[slot] = k;
+	}
+
+	return UINTS(ir->slots)[slot];
+}
+
+static IrTemp load(Ir *ir, Node name)
+{
+	unsigned int var;
+	IrInstr *i;
+
+	var = variable(ir, name);
+	i = emit(ir, IR_LOAD, VAR(ir, var)->type);
+	i->dst = ++ir->ntemps;
+	i->var = var;
+
+	return i->dst;
+}
+
+static void store(Ir *ir, Node name, IrTemp a)
+{
+	unsigned int var;
+	IrInstr *i;
+
+	var = variable(ir, name);
+	i = emit(ir, IR_STORE, VAR(ir, var)->type);
+	i->a = a;
+	i->var = var;
+}
+
+/* The arguments of a call are reserved before they are built, since the
+ * arguments of calls nested in them are appended to the same array.
+ */
+static unsigned int build_args(Ir *ir, Node a, unsigned int *count)
+{
+	unsigned int first, n, k;
+	Node i;
+	IrTemp t;
+
+	for (n = 0, i = a; i != NO_NODE; i = ast_arg(ir->ast, i)->next) {
+		n++;
+	}
+	first = ir->args.count;
+	resize(&ir->args, first + n);
+	for (k = 0, i = a; i != NO_NODE; i = ast_arg(ir->ast, i)->next, k++) {
+		t = build_expr(ir, ast_arg(ir->ast, i)->expr);
+		((IrTemp *) ir->args.items)[first + k] = t;
+	}
+	*count = n;
+
+	return first;
+}
+
+static void build_statements(Ir *ir, Node s)
+{
+	for (; s != NO_NODE; s = ast_stmt(ir->ast, s)->next) {
+		build_statement(ir, s);
+	}
+}
+
+static void build_statement(Ir *ir, Node n)
+{
+	Stmt *s;
+	Arg *a;
+	IrInstr *i;
+	IDprop *prop;
+	Node k;
+	IrTemp t1, t2, t3;
+	unsigned int l1, l2, first, count;
+
+	s = ast_stmt(ir->ast, n);
+	prop = (s->name != NO_NODE ? ast_name(ir->ast, s->name)->prop : NULL);
+	switch (s->kind) {
+		case STMT_EXIT:
+			t1 = (s->expr != NO_NODE ? build_expr(ir, s->expr) : NO_TEMP);
+			terminate(ir, IR_RETURN, t1, NO_BLOCK, NO_BLOCK);
+			break;
+
+		case STMT_IF:
+			/* every guard that fails jumps to the next elsif or else */
+			l1 = new_label(ir);
+			for (; n != NO_NODE; n = s->alt) {
+				s = ast_stmt(ir->ast, n);
+				if (s->kind == STMT_ELSE) {
+					build_statements(ir, s->body);
+					break;
+				}
+				l2 = new_label(ir);
+				build_cond(ir, s->expr, l2, FALSE);
+				build_statements(ir, s->body);
+				terminate(ir, IR_JUMP, NO_TEMP, l1, NO_BLOCK);
+				place_label(ir, l2);
+			}
+			place_label(ir, l1);
+			break;
+
+		case STMT_ELSIF:
+		case STMT_ELSE:
+			/* built as part of the if */
+			break;
+
+		case STMT_CALL:
+			first = build_args(ir, s->args, &count);
+			i = emit(ir, IR_CALL, prop->type);
+			i->name = ast_name(ir->ast, s->name)->id;
+			i->prop = prop;
+			i->first = first;
+			i->count = count;
+			break;
+
+		case STMT_ASSIGN:
+			if (s->index != NO_NODE) {
+				t1 = load(ir, s->name);
+				t2 = build_expr(ir, s->index);
+				t3 = build_expr(ir, s->expr);
+				i = emit(ir, IR_SETELEM, TYPE_NONE);
+				i->a = t1;
+				i->b = t2;
+				i->c = t3;
+			} else {
+				store(ir, s->name, build_expr(ir, s->expr));
+			}
+			break;
+
+		case STMT_ALLOC:
+			t1 = build_expr(ir, s->expr);
+			t2 = define(ir, IR_NEWARRAY, prop->type, t1, NO_TEMP);
+			store(ir, s->name, t2);
+			break;
+
+		case STMT_READ:
+			t1 = t2 = NO_TEMP;
+			if (s->index != NO_NODE) {
+				t1 = load(ir, s->name);
+				t2 = build_expr(ir, s->index);
+			}
+			t3 = define(ir, IR_READ, (IS_INTEGER_TYPE(prop->type)
+						? TYPE_INTEGER : TYPE_BOOLEAN), NO_TEMP, NO_TEMP);
+			if (s->index != NO_NODE) {
+				i = emit(ir, IR_SETELEM, TYPE_NONE);
+				i->a = t1;
+				i->b = t2;
+				i->c = t3;
+			} else {
+				store(ir, s->name, t3);
+			}
+			break;
+
+		case STMT_WHILE:
+			l1 = new_label(ir);
+			l2 = new_label(ir);
+			place_label(ir, l1);
+			build_cond(ir, s->expr, l2, FALSE);
+			build_statements(ir, s->body);
+			terminate(ir, IR_JUMP, NO_TEMP, l1, NO_BLOCK);
+			place_label(ir, l2);
+			break;
+
+		case STMT_WRITE:
+			for (k = s->args; k != NO_NODE; k = a->next) {
+				a = ast_arg(ir->ast, k);
+				if (a->expr == NO_NODE) {
+					i = emit(ir, IR_WRITE_STRING, TYPE_NONE);
+					i->string = a->string;
+					a->string = NULL;
+				} else {
+					t1 = build_expr(ir, a->expr);
+					i = emit(ir, IR_WRITE, ast_expr(ir->ast, a->expr)->type);
+					i->a = t1;
+				}
+			}
+			break;
+	}
+}
+
+static IrTemp build_expr(Ir *ir, Node n)
+{
+	Expr *e;
+	IrInstr *i;
+	IrTemp t1, t2;
+	unsigned int first, count;
+
+	e = ast_expr(ir->ast, n);
+	switch (e->kind) {
+		case EXPR_VAR:
+			return load(ir, e->name);
+
+		case EXPR_INDEX:
+			t1 = load(ir, e->name);
+			t2 = build_expr(ir, e->right);
+			return define(ir, IR_ELEM, e->type, t1, t2);
+
+		case EXPR_CALL:
+			first = build_args(ir, e->args, &count);
+			t1 = define(ir, IR_CALL, e->type, NO_TEMP, NO_TEMP);
+			i = INSTR(ir, ir->instrs.count - 1);
+			i->name = ast_name(ir->ast, e->name)->id;
+			i->prop = ast_name(ir->ast, e->name)->prop;
+			i->first = first;
+			i->count = count;
+			return t1;
+
+		case EXPR_NUM:
+		case EXPR_TRUE:
+		case EXPR_FALSE:
+			t1 = define(ir, IR_CONST, e->type, NO_TEMP, NO_TEMP);
+			INSTR(ir, ir->instrs.count - 1)->value =
+				(e->kind == EXPR_NUM ? e->value : e->kind == EXPR_TRUE);
+			return t1;
+
+		case EXPR_NOT:
+			t1 = build_expr(ir, e->left);
+			return define(ir, IR_NOT, e->type, t1, NO_TEMP);
+
+		case EXPR_NEG:
+			t1 = build_expr(ir, e->left);
+			return define(ir, IR_NEG, e->type, t1, NO_TEMP);
+
+		case EXPR_BINARY:
+			if (!ir->strict && (e->op == TOK_AND || e->op == TOK_OR)) {
+				return build_logical(ir, n);
+			}
+			t1 = build_expr(ir, e->left);
+			t2 = build_expr(ir, e->right);
+			t1 = define(ir, IR_BINARY, e->type, t1, t2);
+			INSTR(ir, ir->instrs.count - 1)->op = e->op;
+			return t1;
+	}
+
+	return NO_TEMP;
+}
+
+/* Unless evaluation is strict, the right operand of "and" and "or" is only
+ * evaluated if the left operand does not decide the value.  A guard is built
+ * as a condition, which jumps as soon as its value is known, and so is an
+ * operand of "and" or "or", while the value of a condition that is not a guard
+ * is pushed on each of the two paths out of it, and merged where they meet.
+ */
+
+static IrTemp build_logical(Ir *ir, Node n)
+{
+	IrTemp t1, t2;
+	unsigned int l1, l2;
+
+	l1 = new_label(ir);
+	l2 = new_label(ir);
+	build_cond(ir, n, l1, FALSE);
+	t1 = define(ir, IR_CONST, TYPE_BOOLEAN, NO_TEMP, NO_TEMP);
+	INSTR(ir, ir->instrs.count - 1)->value = TRUE;
+	terminate(ir, IR_JUMP, NO_TEMP, l2, NO_BLOCK);
+	place_label(ir, l1);
+	t2 = define(ir, IR_CONST, TYPE_BOOLEAN, NO_TEMP, NO_TEMP);
+	INSTR(ir, ir->instrs.count - 1)->value = FALSE;
+	place_label(ir, l2);
+
+	return define(ir, IR_MERGE, TYPE_BOOLEAN, t1, t2);
+}
+
+/**
+ * Builds a condition, which jumps to a label if an expression has a value, and
+ * falls through if it does not.  A branch falls through if its operand is
+ * true, so that a jump on true branches on the negation of the operand.
+ *
+ * @param[in,out] ir    the intermediate form.
+ * @param[in]     n     the expression.
+ * @param[in]     label the label to jump to.
+ * @param[in]     value the value on which to jump.
+ */
+static void build_cond(Ir *ir, Node n, unsigned int label, Boolean value)
+{
+	Expr *e;
+	IrTemp t;
+	unsigned int skip;
+
+	e = ast_expr(ir->ast, n);
+	if (e->kind == EXPR_NOT) {
+		build_cond(ir, e->left, label, !value);
+	} else if (e->kind == EXPR_BINARY && !ir->strict
+			&& (e->op == TOK_AND || e->op == TOK_OR)) {
+		if ((e->op == TOK_OR) == value) {
+			/* either operand decides the value on which to jump */
+			build_cond(ir, e->left, label, value);
+			build_cond(ir, e->right, label, value);
+		} else {
+			skip = new_label(ir);
+			build_cond(ir, e->left, skip, !value);
+			build_cond(ir, e->right, label, value);
+			place_label(ir, skip);
+		}
+	} else if (e->kind == EXPR_TRUE || e->kind == EXPR_FALSE) {
+		/* a literal guard always jumps, or never does */
+		if ((e->kind == EXPR_TRUE) == value) {
+			terminate(ir, IR_JUMP, NO_TEMP, label, NO_BLOCK);
+		}
+	} else {
+		t = build_expr(ir, n);
+		if (value) {
+			t = define(ir, IR_NOT, TYPE_BOOLEAN, t, NO_TEMP);
+		}
+		terminate(ir, IR_BRANCH, t, ir->blocks.count, label);
+	}
+}
+
+/* --- static single assignment form ---------------------------------------- */
+
+/* The dominators are found by the iterative algorithm of Cooper, Harvey, and
+ * Kennedy, and the phis are placed as by Cytron et al., but only for the
+ * variables that are loaded in some block before they are stored in it, since
+ * no other variable can be live on entry to a block.  Only reachable blocks
+ * take part; the versions in unreachable blocks are numbered as if each such
+ * block were entered with every variable at version 0.
+ */
+
+static unsigned int successors(Ir *ir, unsigned int b, unsigned int s[2])
+{
+	IrBlock *block;
+	IrInstr *i;
+
+	block = BLOCK(ir, b);
+	i = INSTR(ir, block->first + block->count - 1);
+	switch (i->opcode) {
+		case IR_BRANCH:
+			s[0] = i->target;
+			s[1] = i->other;
+			return 2;
+		case IR_JUMP:
+		case IR_FALL:
+			s[0] = i->target;
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static void find_order(Ir *ir)
+{
+	unsigned int nb, top, b, n, k, s[2], *stack, *order, *count;
+	IrBlock *block;
+
+	/* a depth-first walk, of which the stack holds pairs of a block and the
+	 * number of its successors visited so far
+	 */
+	nb = ir->blocks.count;
+	resize(&ir->scratch[S_STACK], 2 * nb);
+	resize(&ir->scratch[S_ORDER], nb);
+	stack = UINTS(ir->scratch[S_STACK]);
+	order = UINTS(ir->scratch[S_ORDER]);
+	for (b = 0; b < nb; b++) {
+		BLOCK(ir, b)->reachable = FALSE;
+	}
+	k = nb;
+	BLOCK(ir, 0)->reachable = TRUE;
+	stack[0] = 0;
+	stack[1] = 0;
+	top = 1;
+	while (top > 0) {
+		b = stack[2 * (top - 1)];
+		n = successors(ir, b, s);
+		if (stack[2 * (top - 1) + 1] < n) {
+			b = s[stack[2 * (top - 1) + 1]++];
+			if (!BLOCK(ir, b)->reachable) {
+				BLOCK(ir, b)->reachable = TRUE;
+				stack[2 * top] = b;
+				stack[2 * top + 1] = 0;
+				top++;
+			}
+		} else {
+			order[--k] = b;
+			top--;
+		}
+	}
+
+	/* move the reverse postorder to the front */
+	n = nb - k;
+	memmove(order, order + k, n * sizeof(unsigned int));
+	ir->scratch[S_ORDER].count = n;
+	for (k = 0; k < n; k++) {
+		BLOCK(ir, order[k])->rpo = k;
+	}
+
+	/* collect the reachable predecessors of each block, in block order */
+	resize(&ir->scratch[S_DF_COUNT], nb);
+	count = UINTS(ir->scratch[S_DF_COUNT]);
+	for (b = 0; b < nb; b++) {
+		BLOCK(ir, b)->npreds = 0;
+	}
+	for (b = 0; b < nb; b++) {
+		if (BLOCK(ir, b)->reachable) {
+			n = successors(ir, b, s);
+			for (k = 0; k < n; k++) {
+				BLOCK(ir, s[k])->npreds++;
+			}
+		}
+	}
+	for (n = 0, b = 0; b < nb; b++) {
+		block = BLOCK(ir, b);
+		block->preds = n;
+		n += block->npreds;
+		count[b] = 0;
+	}
+	resize(&ir->preds, n);
+	for (b = 0; b < nb; b++) {
+		if (BLOCK(ir, b)->reachable) {
+			n = successors(ir, b, s);
+			for (k = 0; k < n; k++) {
+				block = BLOCK(ir, s[k]);
+				UINTS(ir->preds)[block->preds + count[s[k]]++] = b;
+			}
+		}
+	}
+}
+
+static void find_dominators(Ir *ir)
+{
+	unsigned int *order, n, k, j, b, p, idom;
+	IrBlock *block;
+	Boolean changed;
+
+	order = UINTS(ir->scratch[S_ORDER]);
+	n = ir->scratch[S_ORDER].count;
+	BLOCK(ir, 0)->idom = 0;
+	do {
+		changed = FALSE;
+		for (k = 1; k < n; k++) {
+			b = order[k];
+			block = BLOCK(ir, b);
+			idom = NO_BLOCK;
+			for (j = 0; j < block->npreds; j++) {
+				p = UINTS(ir->preds)[block->preds + j];
+				if (BLOCK(ir, p)->idom == NO_BLOCK) {
+					continue;
+				}
+				idom = (idom == NO_BLOCK ? p : intersect(ir, idom, p));
+			}
+			if (block->idom != idom) {
+				block->idom = idom;
+				changed = TRUE;
+			}
+		}
+	} while (changed);
+}
+
+static unsigned int intersect(Ir *ir, unsigned int b1, unsigned int b2)
+{
+	while (b1 != b2) {
+		while (BLOCK(ir, b1)->rpo > BLOCK(ir, b2)->rpo) {
+			b1 = BLOCK(ir, b1)->idom;
+		}
+		while (BLOCK(ir, b2)->rpo > BLOCK(ir, b1)->rpo) {
+			b2 = BLOCK(ir, b2)->idom;
+		}
+	}
+
+	return b1;
+}
+
+/* The frontier of a block is gathered as pairs of a block and a block in its
+ * frontier, which are then sorted by the first block.
+ */
+static void find_frontiers(Ir *ir)
+{
+	unsigned int nb, b, j, r, n, *pairs, *first, *count, *stamp, *df;
+	IrBlock *block;
+
+	nb = ir->blocks.count;
+	resize(&ir->scratch[S_STAMP], nb);
+	stamp = UINTS(ir->scratch[S_STAMP]);
+	for (b = 0; b < nb; b++) {
+		stamp[b] = NO_BLOCK;
+	}
+	ir->scratch[S_PAIRS].count = 0;
+	for (b = 0; b < nb; b++) {
+		block = BLOCK(ir, b);
+		if (!block->reachable || block->npreds < 2) {
+			continue;
+		}
+		for (j = 0; j < block->npreds; j++) {
+			r = UINTS(ir->preds)[block->preds + j];
+			while (r != block->idom && stamp[r] != b) {
+				stamp[r] = b;
+				n = ir->scratch[S_PAIRS].count;
+				resize(&ir->scratch[S_PAIRS], n + 2);
+				UINTS(ir->scratch[S_PAIRS])[n] = r;
+				UINTS(ir->scratch[S_PAIRS])[n + 1] = b;
+				r = BLOCK(ir, r)->idom;
+			}
+		}
+	}
+
+	n = ir->scratch[S_PAIRS].count / 2;
+	resize(&ir->scratch[S_DF_FIRST], nb);
+	resize(&ir->scratch[S_DF_COUNT], nb);
+	resize(&ir->scratch[S_DF], n);
+	pairs = UINTS(ir->scratch[S_PAIRS]);
+	first = UINTS(ir->scratch[S_DF_FIRST]);
+	count = UINTS(ir->scratch[S_DF_COUNT]);
+	df = UINTS(ir->scratch[S_DF]);
+	memset(count, 0, nb * sizeof(unsigned int));
+	for (j = 0; j < n; j++) {
+		count[pairs[2 * j]]++;
+	}
+	for (r = 0, b = 0; b < nb; b++) {
+		first[b] = r;
+		r += count[b];
+		count[b] = 0;
+	}
+	for (j = 0; j < n; j++) {
+		b = pairs[2 * j];
+		df[first[b] + count[b]++] = pairs[2 * j + 1];
+	}
+}
+
+static void place_phis(Ir *ir)
+{
+	unsigned int nb, nv, b, k, j, v, n, top, x, y;
+	unsigned int *global, *stamp, *work, *pairs, *first, *count, *df;
+	IrBlock *block;
+	IrInstr *i, *p;
+
+	nb = ir->blocks.count;
+	nv = ir->vars.count;
+
+	/* find the variables loaded in some block before they are stored in it */
+	resize(&ir->scratch[S_GLOBAL], nv);
+	resize(&ir->scratch[S_STAMP], nv > nb ? nv : nb);
+	global = UINTS(ir->scratch[S_GLOBAL]);
+	stamp = UINTS(ir->scratch[S_STAMP]);
+	for (v = 0; v < nv; v++) {
+		global[v] = FALSE;
+		stamp[v] = NO_BLOCK;
+	}
+	ir->scratch[S_PAIRS].count = 0;
+	for (b = 0; b < nb; b++) {
+		block = BLOCK(ir, b);
+		if (!block->reachable) {
+			continue;
+		}
+		for (k = 0; k < block->count; k++) {
+			i = INSTR(ir, block->first + k);
+			if (i->opcode == IR_LOAD && stamp[i->var] != b) {
+				global[i->var] = TRUE;
+			} else if (i->opcode == IR_STORE) {
+				stamp[i->var] = b;
+				n = ir->scratch[S_PAIRS].count;
+				resize(&ir->scratch[S_PAIRS], n + 2);
+				UINTS(ir->scratch[S_PAIRS])[n] = i->var;
+				UINTS(ir->scratch[S_PAIRS])[n + 1] = b;
+			}
+		}
+	}
+
+	/* sort the blocks that store to each variable by variable, in the
+	 * worklist array, and then use the stamps to mark the blocks that were
+	 * queued, and the blocks that got a phi, for the variable at hand
+	 */
+	n = ir->scratch[S_PAIRS].count / 2;
+	resize(&ir->scratch[S_WORK], n + 2 * nb);
+	resize(&ir->scratch[S_KIDS_FIRST], nv + 1);
+	pairs = UINTS(ir->scratch[S_PAIRS]);
+	work = UINTS(ir->scratch[S_WORK]);
+	first = UINTS(ir->scratch[S_KIDS_FIRST]);
+	memset(first, 0, (nv + 1) * sizeof(unsigned int));
+	for (j = 0; j < n; j++) {
+		first[pairs[2 * j] + 1]++;
+	}
+	for (v = 0; v < nv; v++) {
+		first[v + 1] += first[v];
+	}
+	resize(&ir->scratch[S_KIDS], nv);
+	count = UINTS(ir->scratch[S_KIDS]);
+	memset(count, 0, nv * sizeof(unsigned int));
+	for (j = 0; j < n; j++) {
+		v = pairs[2 * j];
+		work[first[v] + count[v]++] = pairs[2 * j + 1];
+	}
+
+	/* the worklist of each variable follows its definitions in the array */
+	resize(&ir->scratch[S_STAMP], 2 * nb);
+	stamp = UINTS(ir->scratch[S_STAMP]);
+	for (b = 0; b < 2 * nb; b++) {
+		stamp[b] = NO_BLOCK;
+	}
+	first = UINTS(ir->scratch[S_DF_FIRST]);
+	count = UINTS(ir->scratch[S_DF_COUNT]);
+	df = UINTS(ir->scratch[S_DF]);
+	ir->scratch[S_PAIRS].count = 0;
+	for (v = 0; v < nv; v++) {
+		if (!global[v]) {
+			continue;
+		}
+		top = n;
+		for (j = UINTS(ir->scratch[S_KIDS_FIRST])[v];
+				j < UINTS(ir->scratch[S_KIDS_FIRST])[v + 1]; j++) {
+			if (stamp[nb + work[j]] != v) {
+				stamp[nb + work[j]] = v;
+				work[top++] = work[j];
+			}
+		}
+		while (top > n) {
+			x = work[--top];
+			for (j = first[x]; j < first[x] + count[x]; j++) {
+				y = df[j];
+				if (stamp[y] == v) {
+					continue;
+				}
+				stamp[y] = v;
+				k = ir->scratch[S_PAIRS].count;
+				resize(&ir->scratch[S_PAIRS], k + 2);
+				UINTS(ir->scratch[S_PAIRS])[k] = y;
+				UINTS(ir->scratch[S_PAIRS])[k + 1] = v;
+				if (stamp[nb + y] != v) {
+					stamp[nb + y] = v;
+					work[top++] = y;
+				}
+			}
+		}
+	}
+
+	/* sort the phis by block, and give each an operand for every predecessor */
+	n = ir->scratch[S_PAIRS].count / 2;
+	pairs = UINTS(ir->scratch[S_PAIRS]);
+	for (b = 0; b < nb; b++) {
+		BLOCK(ir, b)->nphis = 0;
+	}
+	for (j = 0; j < n; j++) {
+		BLOCK(ir, pairs[2 * j])->nphis++;
+	}
+	for (k = 0, b = 0; b < nb; b++) {
+		block = BLOCK(ir, b);
+		block->phis = k;
+		k += block->nphis;
+		block->nphis = 0;
+	}
+	resize(&ir->phis, n);
+	ir->operands.count = 0;
+	for (j = 0; j < n; j++) {
+		block = BLOCK(ir, pairs[2 * j]);
+		p = PHI(ir, block->phis + block->nphis++);
+		memset(p, 0, sizeof(IrInstr));
+		p->opcode = IR_PHI;
+		p->var = pairs[2 * j + 1];
+		p->type = VAR(ir, p->var)->type;
+		p->first = ir->operands.count;
+		p->count = block->npreds;
+		p->target = p->other = NO_BLOCK;
+		resize(&ir->operands, p->first + p->count);
+	}
+}
+
+/* The variables are renamed in a walk over the dominator tree, of which the
+ * stack holds pairs of a block and the number of its children visited so far.
+ * The current version of each variable heads the log array, and is followed by
+ * the changes made to it, as pairs of a variable and its previous version, so
+ * that they can be undone when the walk leaves a block.
+ */
+static void rename_variables(Ir *ir)
+{
+	unsigned int nb, nv, b, k, n, top, *first, *kids, *stack, mark;
+	IrBlock *block;
+
+	nb = ir->blocks.count;
+	nv = ir->vars.count;
+
+	/* find the children of each block in the dominator tree */
+	resize(&ir->scratch[S_KIDS_FIRST], nb + 1);
+	first = UINTS(ir->scratch[S_KIDS_FIRST]);
+	memset(first, 0, (nb + 1) * sizeof(unsigned int));
+	for (b = 1; b < nb; b++) {
+		block = BLOCK(ir, b);
+		if (block->reachable) {
+			first[block->idom + 1]++;
+		}
+	}
+	for (b = 0; b < nb; b++) {
+		first[b + 1] += first[b];
+	}
+	resize(&ir->scratch[S_KIDS], first[nb]);
+	resize(&ir->scratch[S_DF_COUNT], nb);
+	kids = UINTS(ir->scratch[S_KIDS]);
+	memset(UINTS(ir->scratch[S_DF_COUNT]), 0, nb * sizeof(unsigned int));
+	for (b = 1; b < nb; b++) {
+		block = BLOCK(ir, b);
+		if (block->reachable) {
+			k = UINTS(ir->scratch[S_DF_COUNT])[block->idom]++;
+			kids[first[block->idom] + k] = b;
+		}
+	}
+
+	/* every variable starts out at version 0 */
+	resize(&ir->scratch[S_LOG], nv);
+	memset(UINTS(ir->scratch[S_LOG]), 0, nv * sizeof(unsigned int));
+	for (k = 0; k < nv; k++) {
+		VAR(ir, k)->versions = 0;
+	}
+
+	resize(&ir->scratch[S_STACK], 3 * nb);
+	stack = UINTS(ir->scratch[S_STACK]);
+	stack[0] = 0;
+	stack[1] = 0;
+	stack[2] = ir->scratch[S_LOG].count;
+	rename_block(ir, 0);
+	top = 1;
+	while (top > 0) {
+		b = stack[3 * (top - 1)];
+		n = first[b + 1] - first[b];
+		if (stack[3 * (top - 1) + 1] < n) {
+			k = kids[first[b] + stack[3 * (top - 1) + 1]++];
+			stack[3 * top] = k;
+			stack[3 * top + 1] = 0;
+			stack[3 * top + 2] = ir->scratch[S_LOG].count;
+			rename_block(ir, k);
+			top++;
+		} else {
+			undo(ir, stack[3 * (top - 1) + 2]);
+			top--;
+		}
+	}
+
+	for (b = 0; b < nb; b++) {
+		if (!BLOCK(ir, b)->reachable) {
+			mark = ir->scratch[S_LOG].count;
+			rename_block(ir, b);
+			undo(ir, mark);
+		}
+	}
+}
+
+static void rename_block(Ir *ir, unsigned int b)
+{
+	IrBlock *block, *succ;
+	IrInstr *i;
+	unsigned int k, j, n, m, s[2], *current;
+
+	block = BLOCK(ir, b);
+	for (k = 0; k < block->nphis; k++) {
+		i = PHI(ir, block->phis + k);
+		i->version = ++VAR(ir, i->var)->versions;
+		set_version(ir, i->var, i->version);
+	}
+	for (k = 0; k < block->count; k++) {
+		i = INSTR(ir, block->first + k);
+		if (i->opcode == IR_LOAD) {
+			i->version = UINTS(ir->scratch[S_LOG])[i->var];
+		} else if (i->opcode == IR_STORE) {
+			i->version = ++VAR(ir, i->var)->versions;
+			set_version(ir, i->var, i->version);
+		}
+	}
+
+	/* fill in the operands of the phis of the successors for this edge */
+	if (!block->reachable) {
+		return;
+	}
+	current = UINTS(ir->scratch[S_LOG]);
+	n = successors(ir, b, s);
+	for (k = 0; k < n; k++) {
+		succ = BLOCK(ir, s[k]);
+		for (j = 0; j < succ->npreds; j++) {
+			if (UINTS(ir->preds)[succ->preds + j] != b) {
+				continue;
+			}
+			for (m = 0; m < succ->nphis; m++) {
+				i = PHI(ir, succ->phis + m);
+				UINTS(ir->operands)[i->first + j] = current[i->var];
+			}
+		}
+	}
+}
+
+static void set_version(Ir *ir, unsigned int var, unsigned int version)
+{
+	unsigned int n;
+
+	n = ir->scratch[S_LOG].count;
+	resize(&ir->scratch[S_LOG], n + 2);
+	UINTS(ir->scratch[S_LOG])[n] = var;
+	UINTS(ir->scratch[S_LOG])[n + 1] = UINTS(ir->scratch[S_LOG])[var];
+	UINTS(ir->scratch[S_LOG])[var] = version;
+}
+
+static void undo(Ir *ir, unsigned int mark)
+{
+	unsigned int *log, n;
+
+	log = UINTS(ir->scratch[S_LOG]);
+	for (n = ir->scratch[S_LOG].count; n > mark; n -= 2) {
+		log[log[n - 2]] = log[n - 1];
+	}
+	ir->scratch[S_LOG].count = mark;
+}
+
+/* --- dumping and lowering ------------------------------------------------- */
+
+static const char *op_name(TokenType op)
+{
+	switch (op) {
+		case TOK_EQ:    return "eq";
+		case TOK_GE:    return "ge";
+		case TOK_GT:    return "gt";
+		case TOK_LE:    return "le";
+		case TOK_LT:    return "lt";
+		case TOK_NE:    return "ne";
+		case TOK_MINUS: return "sub";
+		case TOK_OR:    return "or";
+		case TOK_PLUS:  return "add";
+		case TOK_AND:   return "and";
+		case TOK_DIV:   return "div";
+		case TOK_MUL:   return "mul";
+		case TOK_MOD:   return "rem";
+		default:        return "?";
+	}
+}
+
+/**
+ * Writes an instruction on a line of its own.
+ *
+ * @param[in] ir   the intermediate form.
+ * @param[in] i    the instruction.
+ * @param[in] file the stream to write to.
+ */
+static void dump_instr(Ir *ir, IrInstr *i, FILE *file)
+{
+	const char *id;
+	unsigned int k;
+
+	id = (i->opcode == IR_LOAD || i->opcode == IR_STORE
+			|| i->opcode == IR_PHI ? VAR(ir, i->var)->id : NULL);
+	fputc('\t', file);
+	if (i->dst != NO_TEMP) {
+		fprintf(file, "t%u: %s = ", i->dst, get_valtype_string(i->type));
+	}
+	switch (i->opcode) {
+		case IR_CONST:
+			if (IS_BOOLEAN_TYPE(i->type)) {
+				fprintf(file, "%s", i->value ? "true" : "false");
+			} else {
+				fprintf(file, "%d", i->value);
+			}
+			break;
+		case IR_LOAD:
+			fprintf(file, "%s.%u", id, i->version);
+			break;
+		case IR_STORE:
+			fprintf(file, "%s.%u = t%u", id, i->version, i->a);
+			break;
+		case IR_BINARY:
+			fprintf(file, "%s t%u, t%u", op_name(i->op), i->a, i->b);
+			break;
+		case IR_NEG:
+			fprintf(file, "neg t%u", i->a);
+			break;
+		case IR_NOT:
+			fprintf(file, "not t%u", i->a);
+			break;
+		case IR_ELEM:
+			fprintf(file, "t%u[t%u]", i->a, i->b);
+			break;
+		case IR_SETELEM:
+			fprintf(file, "t%u[t%u] = t%u", i->a, i->b, i->c);
+			break;
+		case IR_NEWARRAY:
+			fprintf(file, "newarray t%u", i->a);
+			break;
+		case IR_CALL:
+			fprintf(file, "call %s(", i->name);
+			for (k = 0; k < i->count; k++) {
+				fprintf(file, "%st%u", (k > 0 ? ", " : ""),
+						((IrTemp *) ir->args.items)[i->first + k]);
+			}
+			fputc(')', file);
+			break;
+		case IR_READ:
+			fprintf(file, "read");
+			break;
+		case IR_WRITE:
+			fprintf(file, "write t%u", i->a);
+			break;
+		case IR_WRITE_STRING:
+			fprintf(file, "write \"%s\"", i->string);
+			break;
+		case IR_MERGE:
+			fprintf(file, "merge t%u, t%u", i->a, i->b);
+			break;
+		case IR_PHI:
+			fprintf(file, "%s.%u = phi", id, i->version);
+			for (k = 0; k < i->count; k++) {
+				fprintf(file, "%s %s.%u", (k > 0 ? "," : ""), id,
+						UINTS(ir->operands)[i->first + k]);
+			}
+			break;
+		case IR_JUMP:
+			fprintf(file, "goto B%u", i->target);
+			break;
+		case IR_FALL:
+			fprintf(file, "fall B%u", i->target);
+			break;
+		case IR_BRANCH:
+			fprintf(file, "if t%u then B%u else B%u", i->a, i->target,
+					i->other);
+			break;
+		case IR_RETURN:
+			if (i->a != NO_TEMP) {
+				fprintf(file, "return t%u", i->a);
+			} else {
+				fprintf(file, "return");
+			}
+			break;
+		case IR_END:
+			fprintf(file, "end");
+			break;
+	}
+	fputc('\n', file);
+}
+
+/**
+ * Lowers an instruction to stack code.  The operands of the instruction were
+ * pushed by the instructions that defined them, in the order of the operands.
+ *
+ * @param[in]     ir     the intermediate form.
+ * @param[in,out] i      the instruction.
+ * @param[in]     labels the code label of each label of the form.
+ * @param[in,out] cg     the code generator.
+ */
+static void lower_instr(Ir *ir, IrInstr *i, Label *labels, CodeGen *cg)
+{
+	IrVar *v;
+
+	switch (i->opcode) {
+		case IR_CONST:
+			gen_2(cg, JVM_LDC, i->value);
+			break;
+		case IR_LOAD:
+			v = VAR(ir, i->var);
+			gen_2(cg, (IS_ARRAY_TYPE(v->type) ? JVM_ALOAD : JVM_ILOAD),
+					v->slot);
+			break;
+		case IR_STORE:
+			v = VAR(ir, i->var);
+			gen_2(cg, (IS_ARRAY(v->type) ? JVM_ASTORE : JVM_ISTORE), v->slot);
+			break;
+		case IR_BINARY:
+			switch (i->op) {
+				case TOK_EQ:
+				case TOK_GE:
+				case TOK_GT:
+				case TOK_LE:
+				case TOK_LT:
+				case TOK_NE:
+					gen_cmp(cg, compare_opcode(i->op, FALSE));
+					break;
+				case TOK_MINUS: gen_1(cg, JVM_ISUB);        break;
+				case TOK_OR:    gen_1(cg, JVM_IOR);         break;
+				case TOK_PLUS:  gen_1(cg, JVM_IADD);        break;
+				case TOK_AND:   gen_1(cg, JVM_IAND);        break;
+				case TOK_DIV:   gen_1(cg, JVM_IDIV);        break;
+				case TOK_MUL:   gen_1(cg, JVM_IMUL);        break;
+				case TOK_MOD:   gen_1(cg, JVM_IREM);        break;
+				default:
+					eprintf("unreachable: %s", get_token_string(i->op));
+					break;
+			}
+			break;
+		case IR_NEG:
+			gen_1(cg, JVM_INEG);
+			break;
+		case IR_NOT:
+			gen_2(cg, JVM_LDC, 1);
+			gen_1(cg, JVM_IXOR);
+			break;
+		case IR_ELEM:
+			gen_1(cg, JVM_IALOAD);
+			break;
+		case IR_SETELEM:
+			gen_1(cg, JVM_IASTORE);
+			break;
+		case IR_NEWARRAY:
+			gen_newarray(cg, T_INT);
+			break;
+		case IR_CALL:
+			gen_call(cg, i->name, i->prop);
+			break;
+		case IR_READ:
+			gen_read(cg, i->type);
+			break;
+		case IR_WRITE:
+			gen_print(cg, i->type);
+			break;
+		case IR_WRITE_STRING:
+			gen_print_string(cg, i->string);
+			i->string = NULL;
+			break;
+		case IR_MERGE:
+			/* each path leaves its value on the stack */
+			break;
+		case IR_PHI:
+			/* every version shares the slot of the variable */
+			break;
+		case IR_JUMP:
+			gen_2_label(cg, JVM_GOTO, labels[BLOCK(ir, i->target)->label]);
+			break;
+		case IR_FALL:
+			break;
+		case IR_BRANCH:
+			gen_2_label(cg, JVM_IFEQ, labels[BLOCK(ir, i->other)->label]);
+			break;
+		case IR_RETURN:
+			if (i->a == NO_TEMP) {
+				gen_1(cg, JVM_RETURN);
+			} else if (IS_ARRAY_TYPE(i->type)) {
+				gen_1(cg, JVM_ARETURN);
+			} else {
+				gen_1(cg, JVM_IRETURN);
+			}
+			break;
+		case IR_END:
+			break;
+	}
+}
+
+/**
+ * Checks whether four instructions load an integer variable and a constant,
+ * add them or subtract the constant, and store the result to the variable.
+ * The amount must fit in the signed 16 bits of the wide form of iinc.
+ *
+ * @param[in]  ir     the intermediate form.
+ * @param[in]  k      the index of the first of the instructions.
+ * @param[out] var    the variable stored to, if they do.
+ * @param[out] amount the amount added to the variable, if they do.
+ * @return            whether they do.
+ */
+static Boolean find_increment(Ir *ir, unsigned int k, unsigned int *var,
+		int *amount)
+{
+	IrInstr *x, *y, *op, *st, *load, *con;
+	long n;
+
+	x = INSTR(ir, k);
+	y = INSTR(ir, k + 1);
+	op = INSTR(ir, k + 2);
+	st = INSTR(ir, k + 3);
+	if (op->opcode != IR_BINARY || op->a != x->dst || op->b != y->dst
+			|| (op->op != TOK_PLUS && op->op != TOK_MINUS)
+			|| st->opcode != IR_STORE || st->a != op->dst) {
+		return FALSE;
+	}
+
+	if (x->opcode == IR_LOAD && y->opcode == IR_CONST) {
+		load = x;
+		con = y;
+	} else if (x->opcode == IR_CONST && y->opcode == IR_LOAD
+			&& op->op == TOK_PLUS) {
+		load = y;
+		con = x;
+	} else {
+		return FALSE;
+	}
+	if (load->var != st->var || VAR(ir, load->var)->type != TYPE_INTEGER) {
+		return FALSE;
+	}
+
+	n = (op->op == TOK_PLUS ? (long) con->value : -(long) con->value);
+	if (n < SHRT_MIN || n > SHRT_MAX) {
+		return FALSE;
+	}
+	*var = st->var;
+	*amount = (int) n;
+
+	return TRUE;
+}
+
+/* A branch is lowered together with the instructions that compute its guard,
+ * as far as they are a comparison followed by negations, or only negations.
+ * Rather than pushing a boolean for the branch to test, the comparison jumps
+ * to the else target by the opposite comparison, and every negation flips the
+ * sense of the jump.
+ */
+
+/**
+ * Finds the instructions at the end of a block that are lowered together with
+ * its branch.
+ *
+ * @param[in] ir the intermediate form.
+ * @param[in] b  the block.
+ * @return       the index in the block of the first of them, which is the
+ *               number of instructions in the block if it does not end in a
+ *               branch.
+ */
+static unsigned int find_guard(Ir *ir, IrBlock *b)
+{
+	IrInstr *i;
+	IrTemp t;
+	unsigned int j;
+
+	if (b->count == 0
+			|| (i = INSTR(ir, b->first + b->count - 1))->opcode != IR_BRANCH) {
+		return b->count;
+	}
+
+	/* each instruction must define the operand of the one after it */
+	j = b->count - 1;
+	t = i->a;
+	while (j > 0 && (i = INSTR(ir, b->first + j - 1))->dst == t
+			&& i->opcode == IR_NOT) {
+		t = i->a;
+		j--;
+	}
+	if (j > 0 && (i = INSTR(ir, b->first + j - 1))->dst == t
+			&& i->opcode == IR_BINARY && IS_RELOP(i->op)) {
+		j--;
+	}
+
+	return j;
+}
+
+/**
+ * Lowers the branch at the end of a block, with the instructions of its guard.
+ *
+ * @param[in]     ir     the intermediate form.
+ * @param[in]     b      the block.
+ * @param[in]     first  the index in the block of the first instruction of the
+ *                       guard, as found by <code>find_guard</code>.
+ * @param[in]     labels the code label of each label of the form.
+ * @param[in,out] cg     the code generator.
+ */
+static void lower_guard(Ir *ir, IrBlock *b, unsigned int first, Label *labels,
+		CodeGen *cg)
+{
+	IrInstr *i;
+	TokenType op;
+	Boolean negate;
+	Label label;
+	unsigned int j;
+
+	op = TOK_EOF;
+	negate = FALSE;
+	for (j = first; j < b->count - 1; j++) {
+		i = INSTR(ir, b->first + j);
+		if (i->opcode == IR_NOT) {
+			negate = !negate;
+		} else {
+			op = i->op;
+		}
+	}
+
+	i = INSTR(ir, b->first + b->count - 1);
+	label = labels[BLOCK(ir, i->other)->label];
+	if (op != TOK_EOF) {
+		gen_2_label(cg, compare_opcode(op, !negate), label);
+	} else {
+		gen_2_label(cg, (negate ? JVM_IFNE : JVM_IFEQ), label);
+	}
+}
+
+/**
+ * Returns the instruction that compares two integers and jumps if a relational
+ * operator holds between them, or if it fails.
+ *
+ * @param[in] op     the operator.
+ * @param[in] negate whether to jump if the operator fails.
+ * @return           the instruction.
+ */
+static Bytecode compare_opcode(TokenType op, Boolean negate)
+{
+	switch (op) {
+		case TOK_EQ: return (negate ? JVM_IF_ICMPNE : JVM_IF_ICMPEQ);
+		case TOK_GE: return (negate ? JVM_IF_ICMPLT : JVM_IF_ICMPGE);
+		case TOK_GT: return (negate ? JVM_IF_ICMPLE : JVM_IF_ICMPGT);
+		case TOK_LE: return (negate ? JVM_IF_ICMPGT : JVM_IF_ICMPLE);
+		case TOK_LT: return (negate ? JVM_IF_ICMPGE : JVM_IF_ICMPLT);
+		case TOK_NE: return (negate ? JVM_IF_ICMPEQ : JVM_IF_ICMPNE);
+		default:
+			eprintf("unreachable: %s", get_token_string(op));
+			return JVM_GOTO;
+	}
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+static void init_array(IrArray *a, size_t size)
+{
+	a->items = NULL;
+	a->size = size;
+	a->count = a->capacity = 0;
+}
+
+/**
+ * Appends a cleared item to an array, growing the array if it is full.
+ *
+ * @param[in,out] a the array.
+ * @return          the index of the new item.
+ */
+static unsigned int append(IrArray *a)
+{
+	resize(a, a->count + 1);
+	memset((char *) a->items + (a->count - 1) * a->size, 0, a->size);
+
+	return a->count - 1;
+}
+
+/**
+ * Sets the number of items in use of an array, growing the array if needed.
+ * New items are not cleared.
+ *
+ * @param[in,out] a     the array.
+ * @param[in]     count the number of items.
+ */
+static void resize(IrArray *a, unsigned int count)
+{
+	if (count > a->capacity || a->items == NULL) {
+		if (a->capacity == 0) {
+			a->capacity = INITIAL_ITEMS;
+		}
+		while (count > a->capacity) {
+			a->capacity *= 2;
+		}
+		a->items = erealloc(a->items, a->capacity * a->size);
+	}
+	a->count = count;
+}
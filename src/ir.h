@@ -0,0 +1,225 @@
+/**
+ * @file    ir.h
+ * @brief   A typed three-address intermediate form of a SIMPL-2021 subroutine.
+ *
+ * The intermediate form sits between the checked tree of a body and its stack
+ * code.  It is a list of basic blocks, in the order in which their code is
+ * laid out, and each block is a list of instructions that ends in exactly one
+ * terminator.  Every instruction that computes a value defines a fresh
+ * temporary, and reads its operands from temporaries, so that the value of an
+ * expression can be traced to where it is used.  Variables are only read and
+ * written by explicit load and store instructions.
+ *
+ * Once built, the form is converted to static single assignment form: phi
+ * instructions are placed at the iterated dominance frontiers of the blocks
+ * that store to a variable, and every load and store is tagged with the
+ * version of the variable that it reads or defines.  Version 0 of a variable
+ * is its value on entry to the subroutine.
+ *
+ * The form is lowered back to stack code by the usual <code>gen_*</code>
+ * calls.  Since the temporaries are defined and used in the same order in
+ * which a stack machine pushes and pops them, each temporary is simply left on
+ * the operand stack, and since the versions of a variable never overlap, all
+ * of them share the local slot of the variable, and the phi instructions
+ * vanish.  Likewise, a merge of the values that two paths leave on the stack
+ * vanishes.  A branch on a comparison jumps by the comparison itself, and a
+ * negation of the guard of a branch only flips the sense of the jump, so that
+ * no boolean is pushed for a branch to test.  An assignment that only adds a
+ * constant to an integer variable increments its slot in place.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include "ast.h"
+#include "codegen.h"
+#include "symboltable.h"
+#include "token.h"
+#include "valtypes.h"
+
+/** a temporary, numbered from 1 */
+typedef unsigned int IrTemp;
+
+/** the absent temporary */
+#define NO_TEMP 0
+
+/** the absent block or label */
+#define NO_BLOCK ((unsigned int) -1)
+
+/** the kinds of instruction */
+typedef enum {
+	IR_CONST,          /**< dst = value                              */
+	IR_LOAD,           /**< dst = var.version                        */
+	IR_STORE,          /**< var.version = a                          */
+	IR_BINARY,         /**< dst = a op b                             */
+	IR_NEG,            /**< dst = -a                                 */
+	IR_NOT,            /**< dst = not a                              */
+	IR_ELEM,           /**< dst = a[b]                               */
+	IR_SETELEM,        /**< a[b] = c                                 */
+	IR_NEWARRAY,       /**< dst = array of a integers                */
+	IR_CALL,           /**< [dst =] name(args)                       */
+	IR_READ,           /**< dst = a value read from input            */
+	IR_WRITE,          /**< writes a                                 */
+	IR_WRITE_STRING,   /**< writes string                            */
+	IR_MERGE,          /**< dst = a or b, by the path taken          */
+	IR_PHI,            /**< var.version = phi(versions)              */
+	IR_JUMP,           /**< terminator: jump to target               */
+	IR_FALL,           /**< terminator: fall through to target       */
+	IR_BRANCH,         /**< terminator: if a, to target, else other  */
+	IR_RETURN,         /**< terminator: return [a]                   */
+	IR_END             /**< terminator: the end of the body          */
+} IrOpcode;
+
+/** an instruction */
+typedef struct {
+	IrOpcode       opcode;   /**< the kind of instruction                  */
+	TokenType      op;       /**< the operator of a binary instruction     */
+	ValType        type;     /**< the type of the result, or operand       */
+	IrTemp         dst;      /**< the temporary defined, if any            */
+	IrTemp         a, b, c;  /**< the operands, if any                     */
+	unsigned int   var;      /**< the variable loaded, stored, or merged   */
+	unsigned int   version;  /**< its version, once in SSA form            */
+	int            value;    /**< the value of a constant                  */
+	char          *name;     /**< the callee of a call                     */
+	IDprop        *prop;     /**< its properties                           */
+	char          *string;   /**< the string of a write                    */
+	unsigned int   first;    /**< the first call argument, or phi operand  */
+	unsigned int   count;    /**< the number of arguments                  */
+	unsigned int   target;   /**< the target block of a terminator         */
+	unsigned int   other;    /**< the other target block of a branch       */
+} IrInstr;
+
+/** a basic block */
+typedef struct {
+	unsigned int   first;     /**< the index of the first instruction      */
+	unsigned int   count;     /**< the number of instructions              */
+	unsigned int   label;     /**< the label placed here, or NO_BLOCK      */
+	unsigned int   phis;      /**< the index of the first phi              */
+	unsigned int   nphis;     /**< the number of phis                      */
+	unsigned int   preds;     /**< the index of the first predecessor      */
+	unsigned int   npreds;    /**< the number of reachable predecessors    */
+	unsigned int   idom;      /**< the immediate dominator, or NO_BLOCK    */
+	unsigned int   rpo;       /**< the reverse postorder number            */
+	Boolean        reachable; /**< whether it is reachable from the entry  */
+} IrBlock;
+
+/** a variable, that is, a local slot */
+typedef struct {
+	unsigned int   slot;      /**< the local slot                          */
+	ValType        type;      /**< the type                                */
+	const char    *id;        /**< the identifier, borrowed from the tree  */
+	unsigned int   versions;  /**< the number of versions handed out       */
+} IrVar;
+
+/** a growable array of the items of one kind */
+typedef struct {
+	void          *items;     /**< the items                               */
+	size_t         size;      /**< the size of one item                    */
+	unsigned int   count;     /**< the number of items in use              */
+	unsigned int   capacity;  /**< the number of items allocated           */
+} IrArray;
+
+/** the number of arrays of working storage */
+#define IR_SCRATCH 12
+
+/** the intermediate form of one body, with the arrays to build it in */
+typedef struct {
+	IrArray        instrs;    /**< IrInstr: the instructions, by block     */
+	IrArray        blocks;    /**< IrBlock: the blocks, in layout order    */
+	IrArray        vars;      /**< IrVar: the variables                    */
+	IrArray        args;      /**< IrTemp: the arguments of calls          */
+	IrArray        labels;    /**< unsigned: the block of each label       */
+	IrArray        slots;     /**< unsigned: the variable of each slot     */
+	IrArray        phis;      /**< IrInstr: the phis, by block             */
+	IrArray        operands;  /**< unsigned: the versions merged by phis   */
+	IrArray        preds;     /**< unsigned: the predecessors, by block    */
+	IrArray        scratch[IR_SCRATCH]; /**< unsigned: working storage     */
+	IrTemp         ntemps;    /**< the number of temporaries               */
+	Boolean        open;      /**< whether the last block takes more code  */
+	Ast           *ast;       /**< the tree being translated               */
+	ValType        return_type; /**< the return type of the subroutine     */
+	Boolean        strict;    /**< whether and and or evaluate both sides  */
+} Ir;
+
+/**
+ * Initialises the arrays of an intermediate form, which evaluates the right
+ * operand of <code>and</code> and <code>or</code> only if it has to, unless it
+ * is made strict.
+ *
+ * @param[out]  ir
+ *     the intermediate form
+ */
+void init_ir(Ir *ir);
+
+/**
+ * Builds the intermediate form of a checked body.  The strings of write
+ * statements are stolen from the tree, while identifiers are borrowed, so
+ * that the tree must not be reset before the form is.
+ *
+ * @param[in,out] ir
+ *     the intermediate form, which must be empty
+ * @param[in]   t
+ *     the tree
+ * @param[in]   body
+ *     the body
+ * @param[in]   return_type
+ *     the return type of the subroutine, or <code>TYPE_NONE</code> for the
+ *     main body; the main body and procedures return at their end
+ */
+void build_ir(Ir *ir, Ast *t, BodyTree *body, ValType return_type);
+
+/**
+ * Converts an intermediate form to static single assignment form, by
+ * computing the dominator tree and dominance frontiers of its blocks, placing
+ * phi instructions, and renaming the variables.
+ *
+ * @param[in,out] ir
+ *     the intermediate form
+ */
+void convert_to_ssa(Ir *ir);
+
+/**
+ * Writes an intermediate form in a readable form.
+ *
+ * @param[in]   ir
+ *     the intermediate form
+ * @param[in]   name
+ *     the name of the subroutine
+ * @param[in]   file
+ *     the stream to write to
+ */
+void dump_ir(Ir *ir, const char *name, FILE *file);
+
+/**
+ * Lowers an intermediate form to stack code, in the subroutine being
+ * generated.  The strings of write instructions are handed over to the code
+ * generator.
+ *
+ * @param[in,out] ir
+ *     the intermediate form
+ * @param[in,out] cg
+ *     the code generator
+ */
+void lower_ir(Ir *ir, CodeGen *cg);
+
+/**
+ * Discards the intermediate form, keeping the arrays for the next body.
+ *
+ * @param[in,out] ir
+ *     the intermediate form
+ */
+void reset_ir(Ir *ir);
+
+/**
+ * Releases the arrays of an intermediate form.
+ *
+ * @param[in,out] ir
+ *     the intermediate form
+ */
+void release_ir(Ir *ir);
+
+#endif /* IR_H */
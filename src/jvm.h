@@ -33,12 +33,14 @@ typedef enum {
 	JVM_IASTORE,
 	JVM_IDIV,
 	JVM_IFEQ,
+	JVM_IFNE,
 	JVM_IF_ICMPEQ,
 	JVM_IF_ICMPGE,
 	JVM_IF_ICMPGT,
 	JVM_IF_ICMPLE,
 	JVM_IF_ICMPLT,
 	JVM_IF_ICMPNE,
+	JVM_IINC,
 	JVM_ILOAD,
 	JVM_IMUL,
 	JVM_INEG,
@@ -52,6 +54,8 @@ typedef enum {
 	JVM_IXOR,
 	JVM_LDC,
 	JVM_NEWARRAY,
+	JVM_POP,
+	JVM_POP2,
 	JVM_RETURN,
 	JVM_SWAP
 } Bytecode;
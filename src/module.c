@@ -0,0 +1,283 @@
+/**
+ * @file    module.c
+ * @brief   Binary interface files for separately compiled SIMPL-2021 modules.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "error.h"
+#include "module.h"
+#include "symboltable.h"
+#include "valtypes.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+/* An interface file is laid out so that it can be used in place once it has
+ * been mapped: a header, the NUL-padded module name, and then one entry per
+ * routine, each followed by its NUL-padded name and its parameter types.  Only
+ * the names are copied out, since the symbol table owns its keys.  All fields
+ * are in host byte order; a foreign interface fails the version check and must
+ * be regenerated.
+ */
+
+#define INTERFACE_MAGIC   "SMPI"
+#define INTERFACE_VERSION 1u
+#define ALIGN(n)          (((n) + 3) & ~3u)
+
+typedef struct {
+	char          magic[4];      /**< INTERFACE_MAGIC                        */
+	unsigned int  version;       /**< INTERFACE_VERSION, also the byte order */
+	unsigned int  valtype_size;  /**< sizeof(ValType) of the writer          */
+	unsigned int  nroutines;     /**< the number of routines                 */
+	unsigned int  name_size;     /**< the padded size of the module name     */
+} InterfaceHeader;
+
+typedef struct {
+	unsigned int  type;          /**< the return type of the routine         */
+	unsigned int  nparams;       /**< the number of parameters               */
+	unsigned int  name_size;     /**< the padded size of the routine name    */
+} InterfaceEntry;
+
+struct export_s {
+	char    *id;                 /**< the routine identifier                 */
+	IDprop  *prop;               /**< the routine properties                 */
+	Export  *next;               /**< the next routine, in source order      */
+};
+
+struct mapping_s {
+	void     *base;              /**< the start of the mapped interface      */
+	size_t    size;              /**< the size of the mapping                */
+	Mapping  *next;              /**< the next mapping                       */
+};
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void put(char **buf, size_t *len, size_t *cap, const void *p,
+		size_t n);
+static Boolean same_contents(const char *path, const char *buf, size_t len);
+
+/* --- module interface ----------------------------------------------------- */
+
+void init_modules(Modules *mods)
+{
+	mods->exports = NULL;
+	mods->last_export = &mods->exports;
+	mods->mappings = NULL;
+}
+
+void import_interface(Modules *mods, SymbolTable *symbols, const char *path)
+{
+	int fd;
+	struct stat st;
+	char *base, *p, *end, *module, *id;
+	InterfaceHeader *h;
+	InterfaceEntry *e;
+	IDprop *prop;
+	Mapping *m;
+	unsigned int i;
+
+	if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		eprintf("interface '%s' could not be opened:", path);
+	}
+	if ((size_t) st.st_size < sizeof(InterfaceHeader)) {
+		eprintf("interface '%s' is corrupt", path);
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		eprintf("interface '%s' could not be mapped:", path);
+	}
+	m = emalloc(sizeof(Mapping));
+	m->base = base;
+	m->size = st.st_size;
+	m->next = mods->mappings;
+	mods->mappings = m;
+
+	end = base + st.st_size;
+	h = (InterfaceHeader *) base;
+	if (memcmp(h->magic, INTERFACE_MAGIC, 4) != 0
+			|| h->version != INTERFACE_VERSION
+			|| h->valtype_size != sizeof(ValType)) {
+		eprintf("interface '%s' is stale or was written on another platform; "
+				"recompile its module", path);
+	}
+	module = base + sizeof(InterfaceHeader);
+	p = module + h->name_size;
+	if (p > end || h->name_size == 0 || module[h->name_size - 1] != '\0') {
+		eprintf("interface '%s' is corrupt", path);
+	}
+
+	for (i = 0; i < h->nroutines; i++) {
+		e = (InterfaceEntry *) p;
+		if (p + sizeof(InterfaceEntry) > end) {
+			eprintf("interface '%s' is corrupt", path);
+		}
+		id = p + sizeof(InterfaceEntry);
+		p = id + e->name_size + e->nparams * sizeof(ValType);
+		if (p > end || e->name_size == 0 || id[e->name_size - 1] != '\0') {
+			eprintf("interface '%s' is corrupt", path);
+		}
+		prop = emalloc(sizeof(IDprop));
+		prop->type = e->type;
+		prop->offset = 0;
+		prop->nparams = e->nparams;
+		prop->params = (e->nparams > 0 ? (ValType *) (id + e->name_size)
+				: NULL);
+		prop->module = module;
+		if (!insert_name(symbols, estrdup(id), prop)) {
+			eprintf("multiple definition of '%s' (imported from '%s')", id,
+					path);
+		}
+	}
+}
+
+void export_name(Modules *mods, char *id, IDprop *prop)
+{
+	Export *x;
+
+	x = emalloc(sizeof(Export));
+	x->id = id;
+	x->prop = prop;
+	x->next = NULL;
+	*mods->last_export = x;
+	mods->last_export = &x->next;
+}
+
+char *encode_interface(Modules *mods, const char *module, size_t *lenp)
+{
+	char *buf, pad[4] = { 0 };
+	size_t len, cap, n;
+	InterfaceHeader h;
+	InterfaceEntry e;
+	Export *x;
+
+	buf = NULL;
+	len = cap = 0;
+
+	memcpy(h.magic, INTERFACE_MAGIC, 4);
+	h.version = INTERFACE_VERSION;
+	h.valtype_size = sizeof(ValType);
+	h.nroutines = 0;
+	for (x = mods->exports; x; x = x->next) {
+		h.nroutines++;
+	}
+	n = strlen(module) + 1;
+	h.name_size = ALIGN(n);
+	put(&buf, &len, &cap, &h, sizeof(h));
+	put(&buf, &len, &cap, module, n);
+	put(&buf, &len, &cap, pad, h.name_size - n);
+
+	for (x = mods->exports; x; x = x->next) {
+		n = strlen(x->id) + 1;
+		e.type = x->prop->type;
+		e.nparams = x->prop->nparams;
+		e.name_size = ALIGN(n);
+		put(&buf, &len, &cap, &e, sizeof(e));
+		put(&buf, &len, &cap, x->id, n);
+		put(&buf, &len, &cap, pad, e.name_size - n);
+		put(&buf, &len, &cap, x->prop->params, e.nparams * sizeof(ValType));
+	}
+
+	*lenp = len;
+	return buf;
+}
+
+void save_interface(const char *module, const char *buf, size_t len)
+{
+	char *path;
+	FILE *file;
+
+	path = emalloc(strlen(module) + sizeof(INTERFACE_EXT));
+	strcpy(path, module);
+	strcat(path, INTERFACE_EXT);
+
+	/* leave an unchanged interface alone, so that its clients stay current */
+	if (!same_contents(path, buf, len)) {
+		if ((file = fopen(path, "wb")) == NULL) {
+			eprintf("Could not open interface file:");
+		}
+		if (fwrite(buf, 1, len, file) != len || fclose(file) != 0) {
+			eprintf("Could not write interface file:");
+		}
+	}
+
+	efree(path);
+}
+
+void release_modules(Modules *mods)
+{
+	Mapping *m, *n;
+
+	for (m = mods->mappings; m; m = n) {
+		n = m->next;
+		munmap(m->base, m->size);
+		efree(m);
+	}
+	mods->mappings = NULL;
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * Appends bytes to a growable buffer.
+ *
+ * @param[in,out] buf the buffer.
+ * @param[in,out] len the number of bytes in use.
+ * @param[in,out] cap the capacity of the buffer.
+ * @param[in]     p   the bytes to append.
+ * @param[in]     n   the number of bytes to append.
+ */
+static void put(char **buf, size_t *len, size_t *cap, const void *p, size_t n)
+{
+	if (n == 0) {
+		return;
+	}
+	if (*len + n > *cap) {
+		*cap = (*cap == 0 ? 256 : *cap);
+		while (*len + n > *cap) {
+			*cap *= 2;
+		}
+		*buf = erealloc(*buf, *cap);
+	}
+	memcpy(*buf + *len, p, n);
+	*len += n;
+}
+
+/**
+ * Checks whether a file already holds exactly the specified bytes.
+ *
+ * @param[in] path the path of the file.
+ * @param[in] buf  the bytes.
+ * @param[in] len  the number of bytes.
+ * @return         <code>TRUE</code> if the file exists with the same contents,
+ *                 or <code>FALSE</code> otherwise.
+ */
+static Boolean same_contents(const char *path, const char *buf, size_t len)
+{
+	int fd;
+	struct stat st;
+	void *old;
+	Boolean same;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return FALSE;
+	}
+	same = FALSE;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size == len && len > 0) {
+		old = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (old != MAP_FAILED) {
+			same = (memcmp(old, buf, len) == 0);
+			munmap(old, len);
+		}
+	}
+	close(fd);
+
+	return same;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file    module.h
+ * @brief   Binary interface files for separately compiled SIMPL-2021 modules.
+ *
+ * Compiling a program also writes a compact binary interface, named after the
+ * class with the extension <code>.simpli</code>, that records the name, return
+ * type, and parameter types of every function and procedure it defines.  Other
+ * compilations map such interfaces into their global scope instead of parsing
+ * the source of the module again, and calls to imported routines are emitted
+ * as references to the class of the module.
+ *
+ * An interface is only rewritten when its contents change, so that a build
+ * rule that depends on the interface, rather than on the source of a module,
+ * only recompiles the clients of modules of which the interface changed.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stddef.h>
+#include "symboltable.h"
+
+/** the file extension of interface files */
+#define INTERFACE_EXT ".simpli"
+
+/** a routine recorded for the interface */
+typedef struct export_s Export;
+
+/** an imported interface mapped into memory */
+typedef struct mapping_s Mapping;
+
+/** the interfaces imported and exported by one compilation */
+typedef struct {
+	Export   *exports;      /**< the exported routines, in source order */
+	Export  **last_export;  /**< where to link the next export          */
+	Mapping  *mappings;     /**< the imported interfaces                */
+} Modules;
+
+/**
+ * Initialises the module unit.
+ *
+ * @param[out]  mods
+ *     the modules of the compilation
+ */
+void init_modules(Modules *mods);
+
+/**
+ * Maps the specified interface file into memory, and inserts every routine
+ * it declares into the global symbol table.  This must be called after
+ * <code>init_symbol_table</code>, but before parsing starts.
+ *
+ * @param[in,out] mods
+ *     the modules of the compilation
+ * @param[in,out] symbols
+ *     the symbol table of the compilation
+ * @param[in]   path
+ *     the path of the interface file
+ */
+void import_interface(Modules *mods, SymbolTable *symbols, const char *path);
+
+/**
+ * Records the specified routine for inclusion in the interface of the module
+ * being compiled.
+ *
+ * @param[in,out] mods
+ *     the modules of the compilation
+ * @param[in]   id
+ *     the identifier of the function or procedure
+ * @param[in]   prop
+ *     the properties of the function or procedure
+ */
+void export_name(Modules *mods, char *id, IDprop *prop);
+
+/**
+ * Encodes the interface of the module being compiled into a buffer, which
+ * the caller must free.
+ *
+ * @param[in]   mods
+ *     the modules of the compilation
+ * @param[in]   module
+ *     the name of the module, that is, its class name
+ * @param[out]  lenp
+ *     the length of the encoded interface
+ * @return      the encoded interface
+ */
+char *encode_interface(Modules *mods, const char *module, size_t *lenp);
+
+/**
+ * Writes an encoded interface to the interface file of a module, unless an
+ * identical interface already exists.
+ *
+ * @param[in]   module
+ *     the name of the module, that is, its class name
+ * @param[in]   buf
+ *     the encoded interface
+ * @param[in]   len
+ *     the length of the encoded interface
+ */
+void save_interface(const char *module, const char *buf, size_t len);
+
+/**
+ * Unmaps all imported interfaces.  This must be called after
+ * <code>release_symbol_table</code>, since the symbol table refers to the
+ * mapped parameter types.
+ *
+ * @param[in,out] mods
+ *     the modules of the compilation
+ */
+void release_modules(Modules *mods);
+
+#endif /* MODULE_H */
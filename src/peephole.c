@@ -0,0 +1,479 @@
+/**
+ * @file    peephole.c
+ * @brief   A peephole optimiser over the generated code of a subroutine.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "boolean.h"
+#include "code.h"
+#include "codegen.h"
+#include "error.h"
+#include "jvm.h"
+#include "peephole.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+/* the most items that a pattern or a rewrite may have */
+#define MAX_WINDOW 4
+
+#define INITIAL_CODE 1024
+
+#define IS_LABEL(c)    (((c).type & MASK_TYPE) == CODE_LABEL)
+#define IS_OPERAND(c)  ((c).type & CODE_OPERAND)
+
+/* how an item of the window is matched; an item is a label, or an instruction
+ * along with its operand */
+typedef enum {
+	MATCH_END,          /* the end of the pattern                            */
+	MATCH_OP,           /* an instruction with the opcode                    */
+	MATCH_SAME,         /* an instruction with the opcode and the operand of
+	                     * the item of the argument                          */
+	MATCH_LABEL,        /* the label that the item of the argument jumps to  */
+	MATCH_THREAD        /* a jump to a label that is followed by a goto      */
+} Match;
+
+/* how an item of the rewrite is emitted */
+typedef enum {
+	EMIT_END,           /* the end of the rewrite                            */
+	EMIT_COPY,          /* the item of the argument, as it is                */
+	EMIT_THREAD         /* the jump of the item of the argument, to the end of
+	                     * its chain of jumps                                */
+} Emit;
+
+typedef struct {
+	Match     match;    /* how the item is matched                           */
+	Bytecode  opcode;   /* the opcode of an instruction                      */
+	int       arg;      /* the index of an earlier item                      */
+} Pattern;
+
+typedef struct {
+	Emit      emit;     /* how the item is emitted                           */
+	int       arg;      /* the index of an item of the pattern               */
+} Rewrite;
+
+typedef struct {
+	const char *name;                     /* the name, for the counts        */
+	Pattern     pattern[MAX_WINDOW + 1];  /* the items to match              */
+	Rewrite     rewrite[MAX_WINDOW + 1];  /* the items to replace them with  */
+} Rule;
+
+/* --- global static variables ---------------------------------------------- */
+
+/* the rules, in the order in which they are tried */
+static const Rule rules[] = {
+	/* a jump to the next instruction falls through */
+	{ "goto-next",
+		{ { MATCH_OP, JVM_GOTO, 0 }, { MATCH_LABEL, 0, 0 } },
+		{ { EMIT_COPY, 1 } } },
+
+	/* a jump to a goto goes where the goto goes */
+	{ "thread-jump",
+		{ { MATCH_THREAD, 0, 0 } },
+		{ { EMIT_THREAD, 0 } } },
+
+	/* a variable stored from itself is left as it was */
+	{ "iload-istore",
+		{ { MATCH_OP, JVM_ILOAD, 0 }, { MATCH_SAME, JVM_ISTORE, 0 } },
+		{ { EMIT_END, 0 } } },
+	{ "aload-astore",
+		{ { MATCH_OP, JVM_ALOAD, 0 }, { MATCH_SAME, JVM_ASTORE, 0 } },
+		{ { EMIT_END, 0 } } }
+};
+
+#define NRULES (sizeof(rules) / sizeof(Rule))
+
+/* --- function prototypes -------------------------------------------------- */
+
+static int rewrite_code(Peephole *p, Code *code, int ncode,
+		Boolean *changed);
+static Boolean match(const Peephole *p, const Rule *r, const Code *code,
+		int ncode, int i, int *items);
+static int apply(Peephole *p, const Rule *r, Code *code, int ncode,
+		const int *items, int n);
+static int next_item(const Code *code, int ncode, int i);
+static Label thread(const Peephole *p, const Code *code, int ncode,
+		Label label);
+static Boolean is_jump(Bytecode opcode);
+static void map_labels(Peephole *p, const Code *code, int ncode);
+static void reserve(Peephole *p, int ncode);
+
+/* --- peephole optimiser interface ----------------------------------------- */
+
+void init_peephole(Peephole *p)
+{
+	p->hits = NULL;
+	p->out = NULL;
+	p->capacity = 0;
+	p->labels = NULL;
+	p->base = 0;
+	p->nlabels = 0;
+}
+
+void optimise_code(Peephole *p, CodeGen *cg)
+{
+	Code *code;
+	Boolean changed;
+	int n, size;
+
+	if (p->hits == NULL) {
+		p->hits = emalloc(NRULES * sizeof(unsigned long));
+		memset(p->hits, 0, NRULES * sizeof(unsigned long));
+	}
+
+	/* every pass rewrites into the other array, which then takes the place of
+	 * the code */
+	do {
+		n = rewrite_code(p, cg->code, cg->ip, &changed);
+		if (changed) {
+			code = cg->code;
+			size = cg->code_size;
+			cg->code = p->out;
+			cg->code_size = p->capacity;
+			cg->ip = n;
+			p->out = code;
+			p->capacity = size;
+		}
+	} while (changed);
+}
+
+void merge_peephole(Peephole *p, Peephole *from)
+{
+	unsigned int r;
+
+	if (from->hits == NULL) {
+		return;
+	}
+	if (p->hits == NULL) {
+		p->hits = emalloc(NRULES * sizeof(unsigned long));
+		memset(p->hits, 0, NRULES * sizeof(unsigned long));
+	}
+	for (r = 0; r < NRULES; r++) {
+		p->hits[r] += from->hits[r];
+		from->hits[r] = 0;
+	}
+}
+
+void write_peephole_stats(const Peephole *p, FILE *file)
+{
+	unsigned int r;
+
+	for (r = 0; r < NRULES; r++) {
+		fprintf(file, "peephole %-18s %8lu\n", rules[r].name,
+				(p->hits != NULL ? p->hits[r] : 0));
+	}
+}
+
+void release_peephole(Peephole *p)
+{
+	efree(p->hits);
+	efree(p->out);
+	efree(p->labels);
+	init_peephole(p);
+}
+
+/* --- rewriting ------------------------------------------------------------ */
+
+/**
+ * Rewrites the code into the output array in one pass.  At every item of the
+ * code, the first rule that matches is applied, and the window moves past the
+ * items that it matched; if none matches, the item is copied as it is.
+ *
+ * @param[in,out] p       the optimiser.
+ * @param[in,out] code    the code.
+ * @param[in]     ncode   the number of code entries.
+ * @param[out]    changed whether any rule applied.
+ * @return the number of code entries written to the output array.
+ */
+static int rewrite_code(Peephole *p, Code *code, int ncode,
+		Boolean *changed)
+{
+	int i, j, n, items[MAX_WINDOW + 1];
+	unsigned int r;
+
+	map_labels(p, code, ncode);
+	reserve(p, ncode);
+	*changed = FALSE;
+	for (i = 0, n = 0; i < ncode; i = j) {
+		for (r = 0; r < NRULES; r++) {
+			if (match(p, &rules[r], code, ncode, i, items)) {
+				break;
+			}
+		}
+		if (r < NRULES) {
+			n = apply(p, &rules[r], code, ncode, items, n);
+			j = items[MAX_WINDOW];
+			p->hits[r]++;
+			*changed = TRUE;
+		} else {
+			j = next_item(code, ncode, i);
+			reserve(p, n + (j - i));
+			memcpy(&p->out[n], &code[i], (j - i) * sizeof(Code));
+			n += j - i;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * Matches the pattern of a rule at an item of the code.  The start of every
+ * item of the window is recorded, followed by the end of the window, which is
+ * also recorded in the last of the starts.
+ *
+ * @param[in]  p     the optimiser.
+ * @param[in]  r     the rule.
+ * @param[in]  code  the code.
+ * @param[in]  ncode the number of code entries.
+ * @param[in]  i     the index of the first item.
+ * @param[out] items the index of every item of the window.
+ * @return whether the pattern matched.
+ */
+static Boolean match(const Peephole *p, const Rule *r, const Code *code,
+		int ncode, int i, int *items)
+{
+	const Pattern *m;
+	Boolean ok;
+	int j, k;
+
+	for (j = i, k = 0; k < MAX_WINDOW && r->pattern[k].match != MATCH_END;
+			k++) {
+		m = &r->pattern[k];
+		if (j >= ncode) {
+			return FALSE;
+		}
+		items[k] = j;
+
+		/* only a label that the pattern names may be part of the window */
+		if (m->match == MATCH_LABEL) {
+			if (!IS_LABEL(code[j])
+					|| code[j].label != code[items[m->arg] + 1].label) {
+				return FALSE;
+			}
+			j++;
+			continue;
+		} else if (IS_LABEL(code[j])) {
+			return FALSE;
+		}
+
+		switch (m->match) {
+			case MATCH_OP:
+				ok = (code[j].code == m->opcode);
+				break;
+			case MATCH_SAME:
+				ok = (code[j].code == m->opcode
+						&& code[j + 1].num == code[items[m->arg] + 1].num);
+				break;
+			case MATCH_THREAD:
+				ok = (is_jump(code[j].code) && thread(p, code, ncode,
+							code[j + 1].label) != code[j + 1].label);
+				break;
+			default:
+				ok = FALSE;
+				break;
+		}
+		if (!ok) {
+			return FALSE;
+		}
+		j = next_item(code, ncode, j);
+	}
+	for (; k <= MAX_WINDOW; k++) {
+		items[k] = j;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Applies the rewrite of a rule to the items that its pattern matched.  The
+ * strings of the items that are not copied are freed.
+ *
+ * @param[in,out] p     the optimiser.
+ * @param[in]     r     the rule.
+ * @param[in,out] code  the code.
+ * @param[in]     ncode the number of code entries.
+ * @param[in]     items the index of every item of the window, and its end.
+ * @param[in]     n     the number of code entries written so far.
+ * @return the number of code entries written, with the rewrite.
+ */
+static int apply(Peephole *p, const Rule *r, Code *code, int ncode,
+		const int *items, int n)
+{
+	const Rewrite *w;
+	unsigned int kept;
+	int j, k, len;
+
+	kept = 0;
+	for (k = 0; k < MAX_WINDOW && r->rewrite[k].emit != EMIT_END; k++) {
+		w = &r->rewrite[k];
+		j = items[w->arg];
+		switch (w->emit) {
+			case EMIT_COPY:
+			case EMIT_THREAD:
+				len = items[w->arg + 1] - j;
+				reserve(p, n + len);
+				memcpy(&p->out[n], &code[j], len * sizeof(Code));
+				if (w->emit == EMIT_THREAD) {
+					p->out[n + 1].label = thread(p, code, ncode,
+							code[j + 1].label);
+				}
+				n += len;
+				kept |= 1u << w->arg;
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* the strings of the items that were dropped go with them */
+	for (k = 0; k < MAX_WINDOW && items[k] < items[MAX_WINDOW]; k++) {
+		if (kept & (1u << k)) {
+			continue;
+		}
+		for (j = items[k]; j < items[k + 1]; j++) {
+			if (code[j].type & CODE_ALLOCATED) {
+				efree(code[j].string);
+			}
+		}
+	}
+
+	return n;
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * Finds the item after an item of the code.
+ *
+ * @param[in] code  the code.
+ * @param[in] ncode the number of code entries.
+ * @param[in] i     the index of the item.
+ * @return the index of the next item, or the number of code entries.
+ */
+static int next_item(const Code *code, int ncode, int i)
+{
+	if (IS_LABEL(code[i])) {
+		return i + 1;
+	}
+	for (i++; i < ncode && IS_OPERAND(code[i]); i++)
+		;
+
+	return i;
+}
+
+/**
+ * Follows a chain of jumps from a label, for as long as the label is followed
+ * by a goto.  A chain that runs in a cycle is not followed at all.
+ *
+ * @param[in] p     the optimiser.
+ * @param[in] code  the code.
+ * @param[in] ncode the number of code entries.
+ * @param[in] label the label.
+ * @return the label at the end of the chain.
+ */
+static Label thread(const Peephole *p, const Code *code, int ncode,
+		Label label)
+{
+	Label target;
+	unsigned int hops;
+	int j;
+
+	target = label;
+	for (hops = 0; hops <= p->nlabels; hops++) {
+		j = p->labels[target - p->base];
+		if (j < 0) {
+			return target;
+		}
+		while (j < ncode && IS_LABEL(code[j])) {
+			j++;
+		}
+		if (j >= ncode || code[j].code != JVM_GOTO) {
+			return target;
+		}
+		target = code[j + 1].label;
+		if (target == label) {
+			break;
+		}
+	}
+
+	return label;
+}
+
+static Boolean is_jump(Bytecode opcode)
+{
+	switch (opcode) {
+		case JVM_GOTO:
+		case JVM_IFEQ:
+		case JVM_IFNE:
+		case JVM_IF_ICMPEQ:
+		case JVM_IF_ICMPGE:
+		case JVM_IF_ICMPGT:
+		case JVM_IF_ICMPLE:
+		case JVM_IF_ICMPLT:
+		case JVM_IF_ICMPNE:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+/**
+ * Maps every label of the code to the index of the entry that places it, or
+ * to -1 if the label is not placed.  The labels of a subroutine are handed out
+ * in a run, so that the map is indexed from the first label of the code.
+ *
+ * @param[in,out] p     the optimiser.
+ * @param[in]     code  the code.
+ * @param[in]     ncode the number of code entries.
+ */
+static void map_labels(Peephole *p, const Code *code, int ncode)
+{
+	Label first, last;
+	unsigned int n;
+	int i;
+
+	first = last = 0;
+	for (i = 0, n = 0; i < ncode; i++) {
+		if (!(code[i].type & CODE_LABEL)) {
+			continue;
+		}
+		if (n++ == 0) {
+			first = last = code[i].label;
+		} else if (code[i].label < first) {
+			first = code[i].label;
+		} else if (code[i].label > last) {
+			last = code[i].label;
+		}
+	}
+	n = (n > 0 ? last - first + 1 : 0);
+	if (n > p->nlabels) {
+		p->labels = erealloc(p->labels, n * sizeof(int));
+		p->nlabels = n;
+	}
+	p->base = first;
+	for (i = 0; (unsigned int) i < n; i++) {
+		p->labels[i] = -1;
+	}
+	for (i = 0; i < ncode; i++) {
+		if (IS_LABEL(code[i])) {
+			p->labels[code[i].label - first] = i;
+		}
+	}
+}
+
+static void reserve(Peephole *p, int ncode)
+{
+	if (ncode <= p->capacity) {
+		return;
+	}
+	if (p->capacity == 0) {
+		p->capacity = INITIAL_CODE;
+	}
+	while (ncode > p->capacity) {
+		p->capacity *= 2;
+	}
+	p->out = erealloc(p->out, p->capacity * sizeof(Code));
+}
@@ -0,0 +1,87 @@
+/**
+ * @file    peephole.h
+ * @brief   A peephole optimiser over the generated code of a subroutine.
+ *
+ * The optimiser slides a window over the code, and replaces every sequence of
+ * instructions that matches the pattern of one of its rules by the rewrite of
+ * that rule.  The rules are kept in a table, and are tried in the order of the
+ * table at every position of the code.  A label in the code ends a window,
+ * unless the pattern names it, so that no sequence that is jumped into is ever
+ * rewritten.  Since one rewrite may expose another, the code is rewritten pass
+ * after pass until no rule matches.
+ *
+ * The optimiser counts how often each of its rules was applied.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdio.h>
+#include "codegen.h"
+
+/** the state of a peephole optimiser, with the arrays to rewrite code in */
+typedef struct {
+	unsigned long *hits;      /**< the number of times each rule applied   */
+	struct code_s *out;       /**< the code being rewritten                */
+	int            capacity;  /**< the number of code entries allocated    */
+	int           *labels;    /**< the entry of each label, from the first */
+	Label          base;      /**< the first label of the code             */
+	unsigned int   nlabels;   /**< the number of labels allocated          */
+} Peephole;
+
+/**
+ * Initialises a peephole optimiser, with all of its counts at zero.
+ *
+ * @param[out]  p
+ *     the optimiser
+ */
+void init_peephole(Peephole *p);
+
+/**
+ * Optimises the code of the current subroutine of a code generator.  The code
+ * is rewritten in place, and the strings of the operands that are dropped are
+ * freed.  The maximum depth of the operand stack is left as it is, since no
+ * rule makes the stack any deeper.
+ *
+ * @param[in,out] p
+ *     the optimiser
+ * @param[in,out] cg
+ *     the code generator, of which the subroutine is still open
+ */
+void optimise_code(Peephole *p, CodeGen *cg);
+
+/**
+ * Adds the counts of one peephole optimiser to those of another, for example,
+ * of an optimiser of a worker thread to that of the main thread, and clears
+ * them.
+ *
+ * @param[in,out] p
+ *     the optimiser that takes the counts
+ * @param[in,out] from
+ *     the optimiser that gives them up
+ */
+void merge_peephole(Peephole *p, Peephole *from);
+
+/**
+ * Writes the number of times that each rule of a peephole optimiser applied,
+ * one rule per line.
+ *
+ * @param[in]   p
+ *     the optimiser
+ * @param[in]   file
+ *     the stream to write to
+ */
+void write_peephole_stats(const Peephole *p, FILE *file);
+
+/**
+ * Releases the arrays of a peephole optimiser.
+ *
+ * @param[in,out] p
+ *     the optimiser
+ */
+void release_peephole(Peephole *p);
+
+#endif /* PEEPHOLE_H */
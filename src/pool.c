@@ -0,0 +1,293 @@
+/**
+ * @file    pool.c
+ * @brief   A work-stealing thread pool.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "boolean.h"
+#include "error.h"
+#include "pool.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+typedef struct {
+	void  (*run)(void *, unsigned int, void *); /**< the task function    */
+	void   *arg;                  /**< the argument of the task function  */
+} Task;
+
+/* A deque is a ring buffer: its owner pushes and pops at the tail, and
+ * thieves take from the head.
+ */
+typedef struct {
+	pthread_mutex_t  lock;        /**< guards the deque                   */
+	Task            *tasks;       /**< the ring buffer                    */
+	unsigned int     head;        /**< the index of the oldest task       */
+	unsigned int     count;       /**< the number of queued tasks         */
+	unsigned int     capacity;    /**< the size of the ring buffer        */
+} Deque;
+
+typedef struct {
+	ThreadPool      *pool;        /**< the pool of the worker             */
+	unsigned int     id;          /**< the index of the worker            */
+} Worker;
+
+struct thread_pool {
+	unsigned int     nthreads;    /**< the number of workers              */
+	pthread_t       *threads;     /**< the worker threads                 */
+	Worker          *workers;     /**< the arguments of the threads       */
+	Deque           *deques;      /**< the task queue of each worker      */
+	pthread_mutex_t  lock;        /**< guards the counters below          */
+	pthread_cond_t   work;        /**< signalled when a task is queued    */
+	pthread_cond_t   idle;        /**< signalled when no task is pending  */
+	int              queued;      /**< tasks waiting in some deque        */
+	int              pending;     /**< tasks submitted but not finished   */
+	unsigned int     next;        /**< the deque for the next outside task */
+	Boolean          stop;        /**< whether the workers must stop      */
+	void            *data;        /**< passed to every callback           */
+	void           (*start)(void *, unsigned int);
+	void           (*finish)(void *, unsigned int);
+};
+
+
+#define INITIAL_TASKS 64
+
+/* --- global static variables ---------------------------------------------- */
+
+/* the pool and index of the worker running on this thread, if any */
+static _Thread_local ThreadPool   *own_pool = NULL;
+static _Thread_local unsigned int  own_id;
+
+/* --- function prototypes -------------------------------------------------- */
+
+static void *work(void *vp);
+static Boolean take(ThreadPool *pool, unsigned int id, Task *task);
+static void push(Deque *d, Task task);
+
+/* --- pool interface ------------------------------------------------------- */
+
+ThreadPool *pool_create(unsigned int nthreads, void *data,
+		void (*start)(void *, unsigned int),
+		void (*finish)(void *, unsigned int))
+{
+	ThreadPool *pool;
+	unsigned int i;
+
+	pool = emalloc(sizeof(ThreadPool));
+	pool->nthreads = nthreads;
+	pool->threads = emalloc(nthreads * sizeof(pthread_t));
+	pool->workers = emalloc(nthreads * sizeof(Worker));
+	pool->deques = emalloc(nthreads * sizeof(Deque));
+	pool->queued = pool->pending = 0;
+	pool->next = 0;
+	pool->stop = FALSE;
+	pool->data = data;
+	pool->start = start;
+	pool->finish = finish;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+		pool->deques[i].tasks = emalloc(INITIAL_TASKS * sizeof(Task));
+		pool->deques[i].head = pool->deques[i].count = 0;
+		pool->deques[i].capacity = INITIAL_TASKS;
+	}
+	for (i = 0; i < nthreads; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].id = i;
+		if (pthread_create(&pool->threads[i], NULL, work, &pool->workers[i])
+				!= 0) {
+			eprintf("Could not create worker thread:");
+		}
+	}
+
+	return pool;
+}
+
+void pool_submit(ThreadPool *pool, void (*run)(void *, unsigned int, void *),
+		void *arg)
+{
+	Task task;
+	unsigned int id;
+
+	task.run = run;
+	task.arg = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->pending++;
+	if (own_pool == pool) {
+		id = own_id;
+	} else {
+		id = pool->next;
+		pool->next = (pool->next + 1) % pool->nthreads;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	push(&pool->deques[id], task);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->queued++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_wait(ThreadPool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(ThreadPool *pool)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = TRUE;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nthreads; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+	for (i = 0; i < pool->nthreads; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		efree(pool->deques[i].tasks);
+	}
+	pthread_cond_destroy(&pool->idle);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	efree(pool->deques);
+	efree(pool->workers);
+	efree(pool->threads);
+	efree(pool);
+}
+
+/* --- utility functions ---------------------------------------------------- */
+
+/**
+ * The main loop of a worker thread.
+ *
+ * @param[in] vp the worker.
+ * @return       <code>NULL</code>.
+ */
+static void *work(void *vp)
+{
+	Worker *w = (Worker *) vp;
+	ThreadPool *pool = w->pool;
+	Task task;
+
+	own_pool = pool;
+	own_id = w->id;
+
+	if (pool->start) {
+		pool->start(pool->data, own_id);
+	}
+	for (;;) {
+		if (take(pool, own_id, &task)) {
+			task.run(pool->data, own_id, task.arg);
+			pthread_mutex_lock(&pool->lock);
+			if (--pool->pending == 0) {
+				pthread_cond_broadcast(&pool->idle);
+			}
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+		pthread_mutex_lock(&pool->lock);
+		while (pool->queued == 0 && !pool->stop) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+		if (pool->queued == 0 && pool->stop) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	if (pool->finish) {
+		pool->finish(pool->data, own_id);
+	}
+	own_pool = NULL;
+
+	return NULL;
+}
+
+/**
+ * Takes a task for a worker: the newest task of its own deque, or failing
+ * that, the oldest task of the first other deque that has one.
+ *
+ * @param[in]  pool the pool.
+ * @param[in]  id   the index of the worker.
+ * @param[out] task the task taken.
+ * @return          <code>TRUE</code> if a task was taken, or
+ *                  <code>FALSE</code> if every deque was empty.
+ */
+static Boolean take(ThreadPool *pool, unsigned int id, Task *task)
+{
+	Deque *d;
+	unsigned int i;
+	Boolean found;
+
+	found = FALSE;
+	d = &pool->deques[id];
+	pthread_mutex_lock(&d->lock);
+	if (d->count > 0) {
+		d->count--;
+		*task = d->tasks[(d->head + d->count) % d->capacity];
+		found = TRUE;
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	for (i = 1; !found && i < pool->nthreads; i++) {
+		d = &pool->deques[(id + i) % pool->nthreads];
+		pthread_mutex_lock(&d->lock);
+		if (d->count > 0) {
+			*task = d->tasks[d->head];
+			d->head = (d->head + 1) % d->capacity;
+			d->count--;
+			found = TRUE;
+		}
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	if (found) {
+		pthread_mutex_lock(&pool->lock);
+		pool->queued--;
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return found;
+}
+
+/**
+ * Appends a task at the tail of a deque, growing the ring buffer if it is
+ * full.
+ *
+ * @param[in,out] d    the deque.
+ * @param[in]     task the task.
+ */
+static void push(Deque *d, Task task)
+{
+	Task *tasks;
+	unsigned int i;
+
+	pthread_mutex_lock(&d->lock);
+	if (d->count == d->capacity) {
+		tasks = emalloc(2 * d->capacity * sizeof(Task));
+		for (i = 0; i < d->count; i++) {
+			tasks[i] = d->tasks[(d->head + i) % d->capacity];
+		}
+		efree(d->tasks);
+		d->tasks = tasks;
+		d->head = 0;
+		d->capacity *= 2;
+	}
+	d->tasks[(d->head + d->count) % d->capacity] = task;
+	d->count++;
+	pthread_mutex_unlock(&d->lock);
+}
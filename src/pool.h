@@ -0,0 +1,72 @@
+/**
+ * @file    pool.h
+ * @brief   A work-stealing thread pool.
+ *
+ * Every worker owns a double-ended queue of tasks.  A worker takes its own
+ * most recently submitted task first, and when its queue runs dry, it steals
+ * the oldest task of another worker.  Tasks may submit further tasks, which
+ * are then queued with the worker that runs them; tasks submitted from
+ * outside the pool are dealt out to the workers in turn.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+typedef struct thread_pool ThreadPool;
+
+/**
+ * Creates a pool of worker threads.  Each worker calls <code>start</code>
+ * before it runs any task, and <code>finish</code> once the pool is
+ * destroyed, on its own thread, so that it can set up and tear down state
+ * private to the worker.  Every callback, including the task functions, is
+ * passed the user data of the pool and the index of the worker that runs it.
+ *
+ * @param[in]   nthreads
+ *     the number of worker threads
+ * @param[in]   data
+ *     the user data of the pool
+ * @param[in]   start
+ *     called when a worker starts, or <code>NULL</code>
+ * @param[in]   finish
+ *     called when a worker stops, or <code>NULL</code>
+ * @return      a pointer to the new pool
+ */
+ThreadPool *pool_create(unsigned int nthreads, void *data,
+		void (*start)(void *, unsigned int),
+		void (*finish)(void *, unsigned int));
+
+/**
+ * Submits a task to the pool.  This may be called from inside a task.
+ *
+ * @param[in]   pool
+ *     the pool
+ * @param[in]   run
+ *     the task function
+ * @param[in]   arg
+ *     the argument to pass to the task function
+ */
+void pool_submit(ThreadPool *pool, void (*run)(void *, unsigned int, void *),
+		void *arg);
+
+/**
+ * Waits until every task submitted to the pool, including those submitted by
+ * other tasks in the meantime, has run to completion.
+ *
+ * @param[in]   pool
+ *     the pool
+ */
+void pool_wait(ThreadPool *pool);
+
+/**
+ * Stops and joins the worker threads, and releases the pool.  Tasks that are
+ * still queued are run first.
+ *
+ * @param[in]   pool
+ *     the pool
+ */
+void pool_destroy(ThreadPool *pool);
+
+#endif /* POOL_H */
@@ -24,10 +24,6 @@ typedef struct {
 
 /* -------------------------------------------------------------------------- */
 
-static FILE *src_file;                 /* the source file pointer             */
-static int   ch;                       /* the next source character           */
-static int   column_number;            /* the current column number           */
-
 static ReservedWord reserved[] = {     /* reserved words                      */
 	{"and", TOK_AND},
 	{"array", TOK_ARRAY},
@@ -59,77 +55,78 @@ static ReservedWord reserved[] = {     /* reserved words                      */
 
 /* --- function prototypes -------------------------------------------------- */
 
-static void next_char(void);
-static void process_number(Token *token);
-static void process_string(Token *token);
-static void process_word(Token *token);
-static void skip_comment(void);
+static void next_char(Scanner *s);
+static void process_number(Scanner *s, Token *token);
+static void process_string(Scanner *s, Token *token);
+static void process_word(Scanner *s, Token *token);
+static void skip_comment(Scanner *s);
 
 /* --- scanner interface ---------------------------------------------------- */
 
-void init_scanner(FILE *in_file)
+void init_scanner(Scanner *s, FILE *in_file)
 {
-	src_file = in_file;
-	position.line = 1;
-	position.col = column_number = 0;
-	next_char();
+	s->src_file = in_file;
+	s->position.line = 1;
+	s->position.col = s->column_number = 0;
+	s->last_read = '\0';
+	next_char(s);
 }
 
-void get_token(Token *token)
+void get_token(Scanner *s, Token *token)
 {
 	int ascii;
 	/* remove whitespace */
-	while (isspace(ch)) {
-		next_char();
+	while (isspace(s->ch)) {
+		next_char(s);
 	}
 	/* remember token start */
-	position.col = column_number;
+	s->position.col = s->column_number;
 
 	/* get next token */
-	if (ch != EOF) {
-		if (isalpha(ch) || ch == '_') {
+	if (s->ch != EOF) {
+		if (isalpha(s->ch) || s->ch == '_') {
 
 			/* process a word */
-			process_word(token);
+			process_word(s, token);
 
-		} else if (isdigit(ch)) {
+		} else if (isdigit(s->ch)) {
 
 			/* process a number */
-			process_number(token);
+			process_number(s, token);
 
-		} else switch (ch) {
+		} else switch (s->ch) {
 
 			/* process a string */
 			case '"':
-				position.col = column_number;
-				next_char();
-				process_string(token);
+				s->position.col = s->column_number;
+				next_char(s);
+				process_string(s, token);
 				break;
 
 			/* process the other tokens, and trigger comment skipping. */
 			case '=':
 				token->type = TOK_EQ;
-				next_char();
+				next_char(s);
 				break;
 
 			case '>':
-				next_char();
-				if (ch == '=') {
+				next_char(s);
+				if (s->ch == '=') {
 					token->type = TOK_GE;
-					next_char();
+					next_char(s);
 				} else {
 					token->type = TOK_GT;
 				}
 				break;
 
 			case '<':
-				next_char();
-				if (ch == '=') {
+				next_char(s);
+				if (s->ch == '=') {
 					token->type = TOK_LE;
-					next_char();
-				} else if (ch == '-') {
+					next_char(s);
+				} else if (s->ch == '-') {
 					token->type = TOK_GETS;
-					next_char();
+					next_char(s);
 				} else {
 					token->type = TOK_LT;
 				}
@@ -137,14 +134,14 @@ void get_token(Token *token)
 
 			case '#':
 				token->type = TOK_NE;
-				next_char();
+				next_char(s);
 				break;
 			
 			case '-':
-				next_char();
-				if (ch == '>') {
+				next_char(s);
+				if (s->ch == '>') {
 					token->type = TOK_TO;
-					next_char();
+					next_char(s);
 				} else {
 					token->type = TOK_MINUS;
 				}
@@ -152,45 +149,45 @@ void get_token(Token *token)
 
 			case '+':
 				token->type = TOK_PLUS;
-				next_char();
+				next_char(s);
 				break;
 
 			case '/':
 				token->type = TOK_DIV;
-				next_char();
+				next_char(s);
 				break;
 
 			case '*':
 				token->type = TOK_MUL;
-				next_char();
+				next_char(s);
 				break;
 
 			case '&':
 				token->type = TOK_AMPERSAND;
-				next_char();
+				next_char(s);
 				break;
 
 			case '[':
 				token->type = TOK_LBRACK;
-				next_char();
+				next_char(s);
 				break;
 
 			case ']':
 				token->type = TOK_RBRACK;
-				next_char();
+				next_char(s);
 				break;
 
 			case ',':
 				token->type = TOK_COMMA;
-				next_char();
+				next_char(s);
 				break;
 
 			case '(':
-				next_char();
-				if (ch == '*') { /* trigger comment skipping */
-					next_char();
-					skip_comment();
-					get_token(token);
+				next_char(s);
+				if (s->ch == '*') { /* trigger comment skipping */
+					next_char(s);
+					skip_comment(s);
+					get_token(s, token);
 				} else {
 					token->type = TOK_LPAR;
 				}
@@ -198,17 +195,18 @@ void get_token(Token *token)
 
 			case ')':
 				token->type = TOK_RPAR;
-				next_char();
+				next_char(s);
 				break;
 
 			case ';':
 				token->type = TOK_SEMICOLON;
-				next_char();
+				next_char(s);
 				break;
 
 			default:
-				ascii = (int) ch;
-				leprintf("illegal character '%c' (ASCII #%d)", ch, ascii);
+				ascii = (int) s->ch;
+				leprintf(&s->position, "illegal character '%c' (ASCII #%d)",
+						s->ch, ascii);
 		}
 
 	} else {
@@ -216,34 +214,52 @@ void get_token(Token *token)
 	}
 }
 
+void save_scanner(const Scanner *s, ScanState *state)
+{
+	state->offset = ftell(s->src_file);
+	state->ch = s->ch;
+	state->column = s->column_number;
+	state->last_read = s->last_read;
+	state->position = s->position;
+}
+
+void restore_scanner(Scanner *s, const ScanState *state)
+{
+	if (fseek(s->src_file, state->offset, SEEK_SET) != 0) {
+		eprintf("Could not reposition the source file:");
+	}
+	s->ch = state->ch;
+	s->column_number = state->column;
+	s->last_read = state->last_read;
+	s->position = state->position;
+}
+
 /* --- utility functions ---------------------------------------------------- */
 
-void next_char(void)
+void next_char(Scanner *s)
 {  
-	static char last_read = '\0';
-
-	ch = fgetc(src_file);
-	if (ch == EOF) {
+	s->ch = fgetc(s->src_file);
+	if (s->ch == EOF) {
 		return;
 	}
-	if (last_read == '\n') {
-		position.line++;
-		column_number = 0;
+	if (s->last_read == '\n') {
+		s->position.line++;
+		s->column_number = 0;
 	}
 
-	column_number++;
-	last_read = ch;
+	s->column_number++;
+	s->last_read = s->ch;
 }
 
-void process_number(Token *token)
+void process_number(Scanner *s, Token *token)
 {
 	int digit, num;
-	position.col = column_number;
+	s->position.col = s->column_number;
 	digit = 0;
-	for (num = 0; isdigit(ch); next_char()) {
-		digit = ch - '0';
+	for (num = 0; isdigit(s->ch); next_char(s)) {
+		digit = s->ch - '0';
 		if (num > (INT_MAX - digit) / 10) {
-			leprintf("number too large");
+			leprintf(&s->position, "number too large");
 		} else {
 			num = 10 * num + digit;
 		}
@@ -253,68 +269,71 @@ void process_number(Token *token)
 	token->type = TOK_NUM;
 }
 
-void process_string(Token *token)
+void process_string(Scanner *s, Token *token)
 {
 	size_t i, nstring = MAX_INITIAL_STRLEN;
 	int ascii;
 	SourcePos start_pos;
 
-	char *str = malloc(sizeof(char) * nstring);
-	start_pos.col = column_number - 1;
-	start_pos.line = position.line;
+	char *str = emalloc(sizeof(char) * nstring);
+	start_pos.col = s->column_number - 1;
+	start_pos.line = s->position.line;
 	 
 	for (i = 0; ; i++) {
 		if (i == nstring) { /* double size */
 			nstring *= 2;
-			str = realloc(str, nstring);
+			str = erealloc(str, nstring);
 		}
-		if (ch == EOF) { /* end of file reached - string not closed */
-			position = start_pos;
-			leprintf("string not closed");
-		} else if (ch == '"') { /* end of string */
-			next_char();
+		if (s->ch == EOF) { /* end of file reached - string not closed */
+			s->position = start_pos;
+			leprintf(&s->position, "string not closed");
+		} else if (s->ch == '"') { /* end of string */
+			str[i] = '\0';
+			next_char(s);
 			break; 
-		} else if (ch == '\\') { /* check legibility of escape sequence */
-			next_char();
-			if (ch == 'n' || ch == 't' || ch == '"' || ch == '\\') {
+		} else if (s->ch == '\\') { /* check legibility of escape sequence */
+			next_char(s);
+			if (s->ch == 'n' || s->ch == 't' || s->ch == '"'
+					|| s->ch == '\\') {
 				str[i] = '\\';
-				str[++i] = ch;
-				next_char();
+				str[++i] = s->ch;
+				next_char(s);
 			} else {
-				position.col = column_number - 1;
-				leprintf("illegal escape code '\\%c' in string", ch);
+				s->position.col = s->column_number - 1;
+				leprintf(&s->position, "illegal escape code '\\%c' in string",
+						s->ch);
 			}
-		} else if (isascii(ch) && isprint(ch)) { 
-			str[i] = ch;
-			next_char();
+		} else if (isascii(s->ch) && isprint(s->ch)) { 
+			str[i] = s->ch;
+			next_char(s);
 		} else {
-			ascii = (int) ch;
-			position.col = column_number;
-			leprintf("non-printable character (ASCII #%d) in string", ascii);
+			ascii = (int) s->ch;
+			s->position.col = s->column_number;
+			leprintf(&s->position,
+					"non-printable character (ASCII #%d) in string", ascii);
 			break;
 		}
 	}
 
 	token->type = TOK_STR;
-	token->string = malloc(sizeof(char) * nstring);
 	token->string = str;
 }
 
-void process_word(Token *token)
+void process_word(Scanner *s, Token *token)
 {
 	char lexeme[MAX_ID_LENGTH+1];
 	int i, cmp, low, mid, high;
 
-	position.col = column_number;
+	s->position.col = s->column_number;
 	i = 0;
 
 	/* check that the id length is less than the maximum */
-	while (isdigit(ch) || isalpha(ch) || ch == '_') { 
+	while (isdigit(s->ch) || isalpha(s->ch) || s->ch == '_') { 
 		if (i == MAX_ID_LENGTH) {
-			leprintf("identifier too long");
+			leprintf(&s->position, "identifier too long");
 		}
-		lexeme[i] = ch;
-		next_char();
+		lexeme[i] = s->ch;
+		next_char(s);
 		i++;
 	}
 
@@ -322,7 +341,7 @@ void process_word(Token *token)
 
 	/* do a binary search through the array of reserved words */
 	low = 0;
-	high = NUM_RESERVED_WORDS;
+	high = NUM_RESERVED_WORDS - 1;
 	mid = (low + high) / 2;
 	while (low <= high) {
 		cmp = strcmp(lexeme, reserved[mid].word);
@@ -345,32 +364,32 @@ void process_word(Token *token)
 	}
 }
 
-void skip_comment(void)
+void skip_comment(Scanner *s)
 {
 	SourcePos start_pos;
-	start_pos.line = position.line;
-	start_pos.col = column_number - 2;
-
-	while (ch != EOF) {
-		if (ch == '*') {
-			next_char();
-			if (ch == ')') {
-				next_char();
+	start_pos.line = s->position.line;
+	start_pos.col = s->column_number - 2;
+
+	while (s->ch != EOF) {
+		if (s->ch == '*') {
+			next_char(s);
+			if (s->ch == ')') {
+				next_char(s);
 				return;
 			} 
 			continue;
-		} else if (ch == '(') {
-			next_char();
-			if (ch == '*') {
-				next_char();
-				skip_comment();
+		} else if (s->ch == '(') {
+			next_char(s);
+			if (s->ch == '*') {
+				next_char(s);
+				skip_comment(s);
 				continue;
 			}
 		}
-		next_char();
+		next_char(s);
 	}
 
 	/* force the line number of error reporting */
-	position = start_pos;
-	leprintf("comment not closed");
+	s->position = start_pos;
+	leprintf(&s->position, "comment not closed");
 }
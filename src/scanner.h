@@ -10,22 +10,67 @@
 #define SCANNER_H
 
 #include <stdio.h>
+#include "error.h"
 #include "token.h"
 
+/** the state of a scanner; several scanners may be in use at once */
+typedef struct {
+	FILE      *src_file;       /**< the source file pointer            */
+	int        ch;             /**< the next source character          */
+	int        column_number;  /**< the current column number          */
+	int        last_read;      /**< the previously read character      */
+	SourcePos  position;       /**< the position of the current token  */
+} Scanner;
+
+/** a snapshot of the scanner, from which scanning can later be resumed */
+typedef struct {
+	long       offset;     /**< the file offset after the next character */
+	int        ch;         /**< the next source character                */
+	int        column;     /**< the current column number                */
+	int        last_read;  /**< the previously read character            */
+	SourcePos  position;   /**< the position of the current token        */
+} ScanState;
+
 /**
- * Initialises the scanner.
+ * Initialises a scanner.
  *
+ * @param[out]  s
+ *     the scanner
  * @param[in]   in_file
  *     the (already open) source file
  */
-void init_scanner(FILE *in_file);
+void init_scanner(Scanner *s, FILE *in_file);
 
 /**
  * Gets the next token from the input (source) file.
  *
+ * @param[in,out] s
+ *     the scanner
  * @param[out]  token
  *     contains the token just scanned
  */
-void get_token(Token *token);
+void get_token(Scanner *s, Token *token);
+
+/**
+ * Takes a snapshot of the scanner, so that scanning can later be resumed from
+ * the current point in the source file.
+ *
+ * @param[in]   s
+ *     the scanner
+ * @param[out]  state
+ *     the snapshot
+ */
+void save_scanner(const Scanner *s, ScanState *state);
+
+/**
+ * Resumes scanning from a snapshot taken by <code>save_scanner</code>.  The
+ * snapshot may have been taken by another scanner of the same source file.
+ *
+ * @param[in,out] s
+ *     the scanner
+ * @param[in]   state
+ *     the snapshot
+ */
+void restore_scanner(Scanner *s, const ScanState *state);
 
 #endif /* SCANNER_H */
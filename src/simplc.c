@@ -1,1331 +1,552 @@
 /**
  * @file    simplc.c
  *
- * A recursive-descent compiler for the SIMPL-2021 language.
- *
- * All scanning errors are handled in the scanner.  Parser errors MUST be
- * handled by the <code>abort_c</code> function.  System and environment errors,
- * for example, running out of memory, MUST be handled in the unit in which they
- * occur.  Transient errors, for example, non-existent files, MUST be reported
- * where they occur.  There are no warnings, which is to say, all errors are
- * fatal and MUST cause compilation to terminate with an abnormal error code.
+ * The command-line driver of the SIMPL-2021 compiler.  The driver reads the
+ * source file, compiles it with the compiler library, displays the
+ * diagnostics, and writes the class file and the interface file of the
+ * program.  The compiler writes the class file itself; with
+ * <code>--jasmin</code>, the driver writes the Jasmin file instead, and
+ * assembles it with the Jasmin archive named by <code>JASMIN_JAR</code>.  With
+ * <code>--dump-ir</code>, it also writes the intermediate form of every
+ * subroutine to the standard output, and with <code>--dump-cfg</code>, the
+ * control-flow graphs of their code, as a graph in the DOT language, and with
+ * <code>--opt-stats</code>, how often each optimisation applied, from constant
+ * folding and the rules of the peephole optimiser to the local slots saved by
+ * sharing them.  The right operand of <code>and</code> and <code>or</code> is
+ * only evaluated if the left operand does not decide the value, unless
+ * <code>--strict</code> asks for both operands to be evaluated.  With
+ * <code>--cache</code>, the code of every subroutine is kept in the given
+ * directory, which is created if need be, so that the next compilation only
+ * compiles the subroutines that changed.  The driver keeps the class file of
+ * the whole program there as well: if the source, the imported interfaces, and
+ * the options are those of a program in the cache, the driver writes out the
+ * cached files, and neither compiles nor assembles the program.  The directory
+ * is trimmed to <code>--cache-size</code> megabytes, by removing the entries
+ * that were used least recently, and <code>--cache-stats</code> displays how
+ * many programs were found in it, and how many not.  With
+ * <code>--max-errors</code>, the compiler recovers from errors, and the driver
+ * displays up to that many of them.
  *
  * @author  W.H.K. Bester (whkbester@cs.sun.ac.za)
  * @author  C.H. Langeveldt (23632135@sun.ac.za)
  * @date    2021-08-23
  */
 
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "boolean.h"
+#include "cache.h"
 #include "codegen.h"
-#include "errmsg.h"
 #include "error.h"
-#include "hashtable.h"
-#include "scanner.h"
-#include "symboltable.h"
-#include "token.h"
-#include "valtypes.h"
-
-/* --- debugging ------------------------------------------------------------ */
-
-#ifdef DEBUG_PARSER
-	void debug_start(const char *fmt, ...);
-	void debug_end(const char *fmt, ...);
-	void debug_info(const char *fmt, ...);
-	#define DBG_start(...) debug_start(__VA_ARGS__)
-	#define DBG_end(...) debug_end(__VA_ARGS__)
-	#define DBG_info(...) debug_info(__VA_ARGS__)
-#else
-	#define DBG_start(...)
-	#define DBG_end(...)
-	#define DBG_info(...)
-#endif /* DEBUG_PARSER */
-
-/* --- type definitions ----------------------------------------------------- */
-
-typedef struct variable_s Variable;
-struct variable_s {
-	char      *id;     /**< variable identifier                       */
-	ValType    type;   /**< variable type                             */
-	SourcePos  pos;    /**< variable position in the source           */
-	Variable  *next;   /**< pointer to the next variable in the list  */
-};
-
-/* --- global variables ----------------------------------------------------- */
-
-Token    token;        /**< the lookahead token.type                  */
-FILE    *src_file;     /**< the source code file                      */
-ValType  return_type;  /**< the return type of the current subroutine */
-
-/* --- helper macros -------------------------------------------------------- */
-
-#define STARTS_FACTOR(toktype) \
-	(toktype == TOK_ID || toktype == TOK_NUM || \
-     toktype == TOK_LPAR || toktype == TOK_NOT || \
-     toktype == TOK_TRUE || toktype == TOK_FALSE)
+#include "module.h"
+#include "simplc.h"
 
-#define STARTS_EXPR(toktype) \
-	(toktype == TOK_ID || toktype == TOK_NUM || \
-     toktype == TOK_LPAR || toktype == TOK_NOT || \
-     toktype == TOK_TRUE || toktype == TOK_FALSE || \
-     toktype == TOK_MINUS)
+/* --- command-line options ------------------------------------------------- */
 
-#define IS_ADDOP(toktype) \
-	(toktype >= TOK_MINUS && toktype <= TOK_PLUS)
+#define USAGE "usage: %s [-l] [-j <jobs>] [-i <interface>]... [--dump-ir] " \
+	"[--dump-cfg] [--opt-stats] [--strict] [--cache <dir>] " \
+	"[--cache-size <megabytes>] [--cache-stats] [--max-errors <n>] " \
+	"[--jasmin] <filename>"
 
-#define IS_MULOP(toktype) \
-	(toktype >= TOK_AND && toktype <= TOK_MOD) 
+/* the default size of the cache, in megabytes */
+#define DEFAULT_CACHE_SIZE 256
 
-#define IS_RELOP(toktype) \
-	(toktype >= TOK_EQ && toktype <= TOK_NE)
+/* the most errors that can be asked for */
+#define MAX_ERRORS 1000
 
-#define IS_TYPE_TOKEN(toktype) \
-	(toktype == TOK_BOOLEAN || toktype == TOK_INTEGER)
-
-#define IS_STATEMENT(toktype) \
-	(toktype == TOK_EXIT || toktype == TOK_IF || \
-     toktype == TOK_ID || toktype == TOK_READ || \
-     toktype == TOK_WHILE || toktype == TOK_WRITE)
-
-/* --- function prototypes: parsing ----------------------------------------- */
-
-void parse_program(void);
-void parse_funcdef(void);
-void parse_body(void);
-void parse_statements(void);
-void parse_type(ValType *type);
-void parse_vardef(void);
-void parse_statement(void);
-void parse_exit(void);
-void parse_if(void);
-void parse_name(void);
-void parse_read(void);
-void parse_while(void);
-void parse_write(void);
-void parse_arglist(char *id, SourcePos idpos);
-void parse_index(char *id);
-void parse_expr(ValType *type);
-void parse_simple(ValType *type);
-void parse_term(ValType *type);
-void parse_factor(ValType *type);
-void parse_idf(ValType *type, char *id);
-void parse_param(unsigned int *k, char *id);
-
-/* --- function prototypes: helpers ----------------------------------------- */
-
-void check_types(ValType found, ValType expected, SourcePos *pos, ...);
-void expect(TokenType type);
-void expect_id(char **id);
-IDprop *make_idprop(ValType type, unsigned int offset, unsigned int nparams,
-       ValType *params);
-Variable *make_var(char *id, ValType type, SourcePos pos);
+enum {
+	OPT_DUMP_IR = 256, OPT_DUMP_CFG, OPT_OPT_STATS, OPT_STRICT, OPT_CACHE,
+	OPT_CACHE_SIZE, OPT_CACHE_STATS, OPT_MAX_ERRORS, OPT_JASMIN
+};
 
-/* --- function prototypes: error reporting --------------------------------- */
+static const struct option long_options[] = {
+	{ "dump-ir",     no_argument,       NULL, OPT_DUMP_IR     },
+	{ "dump-cfg",    no_argument,       NULL, OPT_DUMP_CFG    },
+	{ "opt-stats",   no_argument,       NULL, OPT_OPT_STATS   },
+	{ "strict",      no_argument,       NULL, OPT_STRICT      },
+	{ "cache",       required_argument, NULL, OPT_CACHE       },
+	{ "cache-size",  required_argument, NULL, OPT_CACHE_SIZE  },
+	{ "cache-stats", no_argument,       NULL, OPT_CACHE_STATS },
+	{ "max-errors",  required_argument, NULL, OPT_MAX_ERRORS  },
+	{ "jasmin",      no_argument,       NULL, OPT_JASMIN      },
+	{ NULL,          0,                 NULL, 0               }
+};
 
-void abort_c(Error err, ...);
-void abort_cp(SourcePos *posp, Error err, ...);
+/* --- function prototypes -------------------------------------------------- */
+
+char *read_source(const char *path, size_t *lenp);
+char *read_file(const char *path, size_t *lenp);
+char *read_class(const char *class_name, size_t *lenp);
+void display(const SimplDiagnostic *d, int last);
+void write_jasmin(const char *jasm_name, const char *code, size_t len);
+void write_class(const char *class_name, const char *buf, size_t len);
+CacheKey program_key(const char *src, size_t len, const SimplOptions *options,
+		const char *jasmin_path);
+Boolean reuse_program(const char *dir, CacheKey key);
+void keep_program(const char *dir, CacheKey key, const SimplResult *result,
+		const char *class_file, size_t class_len);
+void display_stats(const char *dir);
 
 /* --- main routine --------------------------------------------------------- */
 
 int main(int argc, char *argv[])
 {
-	char *jasmin_path;
-	/* TODO: Uncomment the previous definition for code generation. */
+	SimplOptions options;
+	SimplResult result;
+	CacheKey key;
+	const char **interfaces;
+	const char *class_file;
+	char *jasmin_path, *jasm_name, *assembled, *end, *src;
+	size_t len, class_len;
+	unsigned int i;
+	unsigned long cache_size;
+	long n;
+	int opt, use_cache, show_stats, use_jasmin;
 
-	/* set up global variables */
 	setprogname(argv[0]);
 
 	/* check command-line arguments and environment */
-	if (argc != 2) {
-		eprintf("usage: %s <filename>", getprogname());
-	}
-
-	if ((jasmin_path = getenv("JASMIN_JAR")) == NULL) {
-		eprintf("JASMIN_JAR environment variable not set");
-	}
-
-
-	/* open the source file, and report an error if it could not be opened. */
-	if ((src_file = fopen(argv[1], "r")) == NULL) {
-		eprintf("file '%s' could not be opened:", argv[1]);
-	}
-	setsrcname(argv[1]);
-
-	/* initialise all compiler units */
-	init_scanner(src_file);
-	init_symbol_table();
-	init_code_generation();
-
-	/* compile */
-	get_token(&token);
-	parse_program();
-
-	/* produce the object code, and assemble */
-	make_code_file();
-	assemble(jasmin_path);
-
-	/* release allocated resources */
-	fclose(src_file);
-	freeprogname();
-	freesrcname();
-	release_symbol_table();
-	release_code_generation();
-
-#ifdef DEBUG_PARSER
-	printf("SUCCESS!\n");
-#endif
-
-	return EXIT_SUCCESS;
-}
-
-/* --- parser routines ------------------------------------------------------ */
-
-/* <program> = "program" <id> { <funcdef> } <body> .
- */
-void parse_program(void)
-{
-	char *class_name;
-
-	DBG_start("<program>");
-
-	/* For code generation, set the class name inside this function, and
-	 * also handle initialising and closing the "main" function.  But from the
-	 * perspective of simple parsing, this function is complete.
-	 */
-
-	expect(TOK_PROGRAM);
-	expect_id(&class_name);
-	/* Set the class name here during code generation. */
-	set_class_name(class_name);
-
-	while (token.type == TOK_DEFINE) {
-		parse_funcdef();
-	}
-	init_subroutine_codegen("main", NULL);
-	parse_body();
-	gen_1(JVM_RETURN);
-	close_subroutine_codegen(get_variables_width());
-
-	/* Memory leak strategy? -chris */
-	free(class_name); 
-
-	DBG_end("</program>");
-}
-
-/* <funcdef> = "define" <id> "(" [<type> <id> { "," <type> <id> }] ")" 
-               ["->" <type>] <body> .
- */
-void parse_funcdef(void)
-{
-	DBG_start("<funcdef>");
-
-	char *funcid, *id;
-	SourcePos funcpos, pos;
-	ValType t1, *params;
-	Variable *head, *temp, *newvar;
-	unsigned int count, i;
-	IDprop *prop;
-
-	funcpos = position;
-	count = 0;
-	head = NULL;
-	t1 = 0;
-	id = NULL;
-	return_type = TYPE_NONE;
-	
-	expect(TOK_DEFINE);
-	expect_id(&funcid);
-	expect(TOK_LPAR);
-	if (IS_TYPE_TOKEN(token.type)) {
-		parse_type(&t1);
-		pos = position;
-		expect_id(&id);
-		head = make_var(id, t1, pos);
-		head->next = NULL;
-		count = 1;
-		temp = head;
-		while (token.type == TOK_COMMA) {
-			get_token(&token);
-			t1 = 0;
-			parse_type(&t1);
-			pos = position;
-			expect_id(&id);
-			newvar = make_var(id, t1, pos); 
-			newvar->next = NULL;
-			temp->next = newvar;
-			temp = temp->next;
-			count++;
+	memset(&options, 0, sizeof(SimplOptions));
+	options.jobs = 1;
+	cache_size = (unsigned long) DEFAULT_CACHE_SIZE << 20;
+	show_stats = use_jasmin = 0;
+	interfaces = emalloc(argc * sizeof(char *));
+	while ((opt = getopt_long(argc, argv, "i:j:l", long_options, NULL))
+			!= -1) {
+		if (opt == OPT_DUMP_IR) {
+			options.dump_ir = 1;
+		} else if (opt == OPT_DUMP_CFG) {
+			options.dump_cfg = 1;
+		} else if (opt == OPT_OPT_STATS) {
+			options.stats = 1;
+		} else if (opt == OPT_STRICT) {
+			options.strict = 1;
+		} else if (opt == OPT_CACHE) {
+			if (mkdir(optarg, 0777) != 0 && errno != EEXIST) {
+				eprintf("cache directory '%s' could not be created:", optarg);
+			}
+			options.cache_dir = optarg;
+		} else if (opt == OPT_CACHE_SIZE) {
+			n = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || n < 1
+					|| (unsigned long) n > ULONG_MAX >> 20) {
+				eprintf("cache size must be a positive number of megabytes");
+			}
+			cache_size = (unsigned long) n << 20;
+		} else if (opt == OPT_CACHE_STATS) {
+			show_stats = 1;
+		} else if (opt == OPT_MAX_ERRORS) {
+			n = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || n < 1 || n > MAX_ERRORS) {
+				eprintf("number of errors must be between 1 and %d",
+						MAX_ERRORS);
+			}
+			options.max_errors = (unsigned int) n;
+		} else if (opt == OPT_JASMIN) {
+			use_jasmin = 1;
+		} else if (opt == 'l') {
+			options.lazy = 1;
+		} else if (opt == 'j') {
+			n = strtol(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || n < 1
+					|| n > SIMPL_MAX_JOBS) {
+				eprintf("number of jobs must be between 1 and %d",
+						SIMPL_MAX_JOBS);
+			}
+			options.jobs = (unsigned int) n;
+		} else if (opt == 'i') {
+			interfaces[options.ninterfaces++] = optarg;
+		} else {
+			eprintf(USAGE, getprogname());
 		}
 	}
-	expect(TOK_RPAR);
-	params = emalloc(count * sizeof(Variable)); 
-	temp = head;
-	for (i = 0; i < count; i++) {
-		params[i] = temp->type;
-		temp = temp->next;
+	if (show_stats && options.cache_dir == NULL) {
+		eprintf("--cache-stats needs a cache directory");
 	}
-	t1 = TYPE_CALLABLE;
-	if (token.type == TOK_TO) {
-		get_token(&token);
-		parse_type(&t1);
+	if (show_stats && optind == argc) {
+		display_stats(options.cache_dir);
+		efree(interfaces);
+		freeprogname();
+		return EXIT_SUCCESS;
 	}
-	return_type = t1;
-	prop = make_idprop(t1, get_variables_width(), count, params);
-	if (open_subroutine(funcid, prop)) {
-		while (head != NULL) {
-			temp = head;
-			prop = NULL;
-			if (find_name(temp->id, &prop)) {
-				position = temp->pos;
-				abort_c(ERR_MULTIPLE_DEFINITION, temp->id);
-			}
-			prop = NULL;
-			prop = make_idprop(temp->type, get_variables_width(), 0, NULL);
-			if (!insert_name(temp->id, prop)) {
-				position = temp->pos;
-				abort_c(ERR_MULTIPLE_DEFINITION, temp->id);
-			}
-			head = head->next;
-			free(temp);
-			temp = NULL;
-		}
-		init_subroutine_codegen(funcid, prop);
-		parse_body();
-		close_subroutine_codegen(get_variables_width());
-		close_subroutine();
-		return_type = TYPE_NONE;
-	} else {
-		position = funcpos;
-		abort_c(ERR_MULTIPLE_DEFINITION, funcid);
+	if (optind != argc - 1) {
+		eprintf(USAGE, getprogname());
 	}
+	options.interfaces = interfaces;
 
-	DBG_end("</funcdef>");
-}
-
-/* <body> = "begin" { <vardef> } <statements> "end" .
- */
-void parse_body(void)
-{
-	DBG_start("<body>");
-
-	expect(TOK_BEGIN);
-	while (IS_TYPE_TOKEN(token.type)) {
-		parse_vardef();
+	/* Jasmin is only needed to assemble the class file on request */
+	jasmin_path = NULL;
+	if (use_jasmin && (jasmin_path = getenv("JASMIN_JAR")) == NULL) {
+		eprintf("JASMIN_JAR environment variable not set");
 	}
-	parse_statements();
-	expect(TOK_END);
 
-	DBG_end("</body>");
-}
+	src = read_source(argv[optind], &len);
+	setsrcname(argv[optind]);
 
-/* <statements> = "chill" | <statement> { ";" <statement> } .
- */
-void parse_statements(void)
-{
-	DBG_start("<statements>");
-
-	if (token.type == TOK_CHILL) {
-		get_token(&token);
-	} else if (IS_STATEMENT(token.type)) {
-		parse_statement();
-		while (token.type == TOK_SEMICOLON) {
-			get_token(&token);
-			parse_statement();
+	/* a program that was compiled before is taken from the cache, unless its
+	 * intermediate form must be dumped, or its optimisations counted */
+	use_cache = (options.cache_dir != NULL && !options.dump_ir
+			&& !options.dump_cfg && !options.stats);
+	key = 0;
+	if (use_cache) {
+		key = program_key(src, len, &options, jasmin_path);
+		if (reuse_program(options.cache_dir, key)) {
+			if (show_stats) {
+				display_stats(options.cache_dir);
+			}
+			efree(src);
+			efree(interfaces);
+			freeprogname();
+			freesrcname();
+			return EXIT_SUCCESS;
 		}
-	} else {
-		abort_c(ERR_STATEMENT_EXPECTED, token.type); 
 	}
 
-	DBG_end("</statements>");
-}
-
-/* <type> = ("boolean" | "integer") ["array"] .
- */
-void parse_type(ValType *t0)
-{
-	DBG_start("<type>");
-
-	if (token.type == TOK_BOOLEAN) {
-		*t0 |= TYPE_BOOLEAN;
-	} else if (token.type == TOK_INTEGER) {
-		*t0 |= TYPE_INTEGER;
-	} else {
-		abort_c(ERR_TYPE_EXPECTED, token.type);
+	/* compile, and display the diagnostics as they were reported */
+	simpl_compile_buffer(src, len, &options, &result);
+	for (i = 0; i < result.ndiagnostics; i++) {
+		display(&result.diagnostics[i], i + 1 == result.ndiagnostics);
 	}
-	get_token(&token);
-	if (token.type == TOK_ARRAY) {
-		get_token(&token);
-		*t0 |= TYPE_ARRAY;
+	if (result.status != SIMPL_OK) {
+		exit(EXIT_FAILURE);
 	}
 
-	DBG_end("</type>");
-}
-
-/* <vardef> = <type> <id> { "," <id> } ";" .
- */
-void parse_vardef(void)
-{
-	char *vname;
-	ValType t1;
-	IDprop *prop;
-	SourcePos pos;
-
-	DBG_start("<vardef>");
-	t1 = 0;
-	parse_type(&t1);
-	pos = position;
-	expect_id(&vname);
-	if (find_name(vname, &prop)) {
-		position = pos;
-		abort_c(ERR_MULTIPLE_DEFINITION, vname);
+	if (result.ir != NULL) {
+		fwrite(result.ir, 1, result.ir_len, stdout);
 	}
-	prop = make_idprop(t1, get_variables_width(), 0, NULL);
-	if (!insert_name(vname, prop)) {
-		position = pos;
-		abort_c(ERR_MULTIPLE_DEFINITION, vname);
+	if (result.cfg != NULL) {
+		fwrite(result.cfg, 1, result.cfg_len, stdout);
 	}
-	while (token.type == TOK_COMMA) {
-		get_token(&token);
-		pos = position;
-		expect_id(&vname);
-		if (find_name(vname, &prop)) {
-			position = pos;
-			abort_c(ERR_MULTIPLE_DEFINITION, vname);
-		}
-		prop = make_idprop(t1, get_variables_width(), 0, NULL);
-		if (!insert_name(vname, prop)) {
-			position = pos;
-			abort_c(ERR_MULTIPLE_DEFINITION, vname);
-		}
+	if (result.stats != NULL) {
+		fwrite(result.stats, 1, result.stats_len, stdout);
 	}
-	expect(TOK_SEMICOLON);
-
-	DBG_end("</vardef>");
-}
-
-/* <statement> = <exit> | <if> | <name> | <read> | <while> | <write> .
- */
-void parse_statement(void)
-{
-	DBG_start("<statement>");
 
-	switch (token.type) {
-		case TOK_EXIT:  parse_exit();   break;
-		case TOK_IF:    parse_if();     break;
-		case TOK_ID:    parse_name();   break;
-		case TOK_READ:  parse_read();   break;
-		case TOK_WHILE: parse_while();  break;
-		case TOK_WRITE: parse_write();  break;
-		default:
-			abort_c(ERR_STATEMENT_EXPECTED, token.type);
-			break;
+	/* write the interface and the class file, or assemble the object code */
+	save_interface(result.class_name, result.interface, result.interface_len);
+	jasm_name = emalloc(strlen(result.class_name) + sizeof(JASM_EXT));
+	strcpy(jasm_name, result.class_name);
+	strcat(jasm_name, JASM_EXT);
+	class_file = result.class_file;
+	class_len = result.class_len;
+	assembled = NULL;
+	if (jasmin_path != NULL) {
+		write_jasmin(jasm_name, result.code, result.code_len);
+		assemble(jasmin_path, jasm_name);
+#ifndef DEBUG_CODEGEN
+		unlink(jasm_name);
+#endif
+		/* the class file that Jasmin assembled is the one to keep */
+		class_file = assembled = read_class(result.class_name, &class_len);
+	} else {
+#ifdef DEBUG_CODEGEN
+		write_jasmin(jasm_name, result.code, result.code_len);
+#endif
+		write_class(result.class_name, result.class_file, result.class_len);
 	}
 
-	DBG_end("</statement>");
-}
-
-/* <exit> = "exit" [<expr>] .
- */
-void parse_exit(void)
-{
-	ValType t1, t2;
-	SourcePos pos;
-
-	DBG_start("<exit>");
-	t1 = 0;
-	pos = position;
-	expect(TOK_EXIT);
-	if (STARTS_EXPR(token.type)) {
-		if (IS_PROCEDURE(return_type)) {
-			abort_c(ERR_EXIT_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE);
-		} else if (IS_FUNCTION(return_type)) {
-			pos = position;
-			parse_expr(&t1);
-			if (IS_ARRAY_TYPE(return_type)) {
-				gen_1(JVM_ARETURN);
-			} else {
-				gen_1(JVM_IRETURN);
-			}
-			t2 = return_type;
-			SET_RETURN_TYPE(t2);
-			check_types(t1, t2, &pos, "for 'exit' statement");
+	if (use_cache) {
+		if (class_file != NULL) {
+			keep_program(options.cache_dir, key, &result, class_file,
+					class_len);
+		}
+		trim_cache(options.cache_dir, cache_size);
+		if (show_stats) {
+			display_stats(options.cache_dir);
 		}
-	} else if (IS_FUNCTION(return_type)) {
-		position = pos;
-		abort_c(ERR_MISSING_EXIT_EXPRESSION_FOR_FUNCTION);
-	} else {
-		gen_1(JVM_RETURN);
 	}
 
-	DBG_end("</exit>");
-}
-
-/* <if> = "if" <expr> "then" <statements> {"elsif" <expr> "then" <statements>} 
-          ["else" <statements>] "end" . 
- */
-void parse_if(void)
-{
-	ValType t1;
-	SourcePos pos;
-	int l1, l2, l3;
-
-	DBG_start("<if>");
-	
-	l1 = get_label();
-	l2 = get_label();
-	l3 = get_label();
-	
-	expect(TOK_IF);
-	pos = position;
-	parse_expr(&t1);
-	gen_2_label(JVM_IFEQ, l1); //false, go to l1
-	check_types(t1, TYPE_BOOLEAN, &pos, "for 'if' guard");
-	expect(TOK_THEN);
-	parse_statements();
-	gen_2_label(JVM_GOTO, l3);
-
-	gen_label(l1);
-	while (token.type == TOK_ELSIF) {
-		gen_label(l2);
-		get_token(&token);
-		pos = position;
-		parse_expr(&t1);
-		gen_2_label(JVM_IFEQ, l2);
-		check_types(t1, TYPE_BOOLEAN, &pos, "for 'elsif' guard");
-		expect(TOK_THEN);
-		parse_statements();
-		gen_2_label(JVM_GOTO, l3);
-	}
-	if (token.type == TOK_ELSE) {
-		get_token(&token);
-		parse_statements();
-	}
-	gen_label(l3);
-	expect(TOK_END);
+	/* release allocated resources */
+	efree(assembled);
+	efree(jasm_name);
+	simpl_release_result(&result);
+	efree(src);
+	efree(interfaces);
+	freeprogname();
+	freesrcname();
 
-	DBG_end("</if>");
+	return EXIT_SUCCESS;
 }
 
-/* <name> = <id> (<arglist> | [<index>] "<-" (<expr> | "array" <simple>)) .
+/* --- driver routines ------------------------------------------------------ */
+
+/**
+ * Reads a source file into memory.
+ *
+ * @param[in]  path the path of the source file.
+ * @param[out] lenp the length of the source.
+ * @return          the source, which the caller must free.
  */
-void parse_name(void)
+char *read_source(const char *path, size_t *lenp)
 {
-	char *id;
-	ValType t1, proptype;
-	IDprop *prop;
-	Boolean is_array, is_indexed;
-	SourcePos idpos, pos;
-	
-	DBG_start("<name>");
+	char *buf;
 
-	is_indexed = FALSE;
-	idpos = position;
-	expect_id(&id);
-	if (!find_name(id, &prop)) {
-		position = idpos;
-		abort_c(ERR_UNKNOWN_IDENTIFIER, id);
-	}
-	proptype = prop->type;
-	if (token.type == TOK_LPAR) {
-		if (!IS_PROCEDURE(prop->type)) {
-			position = idpos;
-			abort_c(ERR_NOT_A_PROCEDURE, id);
-		}
-		parse_arglist(id, idpos);
-		gen_call(id, prop);
-	} else if (token.type == TOK_LBRACK || token.type == TOK_GETS) {
-		if (IS_CALLABLE_TYPE(prop->type)) {
-			position = idpos;
-			abort_c(ERR_NOT_A_VARIABLE, id);
-		}
-		if (token.type == TOK_LBRACK) {
-			if (!IS_ARRAY(prop->type)){
-				position = idpos;
-				abort_c(ERR_NOT_AN_ARRAY, id);
-			}
-			proptype ^= TYPE_ARRAY;
-			is_array = FALSE;
-			is_indexed = TRUE;
-			parse_index(id);
-		} else if (IS_ARRAY(prop->type)) {
-			is_array = TRUE;
-		} else {
-			is_array = FALSE;
-		}
-		expect(TOK_GETS);
-		pos = position;
-		if (STARTS_EXPR(token.type)) {
-			parse_expr(&t1);
-			if (!IS_VARIABLE(proptype)) {
-				position = idpos;
-				abort_c(ERR_NOT_A_VARIABLE, id);
-			}
-			if (is_array) {
-				check_types(t1, proptype, &pos, 
-				"for assignment to '%s'", id);
-				gen_2(JVM_ASTORE, prop->offset);
-			} else {
-				if (IS_ARRAY(t1)) {
-					if (is_indexed) {
-						check_types(t1, proptype, &pos, 
-						"for allocation to indexed array '%s'", id);
-					} else {
-						position = idpos;
-						abort_c(ERR_NOT_AN_ARRAY, id);
-					}
-				} else {
-					check_types(t1, proptype, &pos,
-					"for assignment to '%s'", id);
-				}
-			}
-			if (!is_indexed && !is_array) {
-				gen_2(JVM_ISTORE, prop->offset);
-			}
-			if (is_indexed) {
-				gen_1(JVM_IASTORE);
-			}
-		} else if (token.type == TOK_ARRAY) {
-			if (is_indexed) {
-				check_types(prop->type, proptype, &position, 
-				"for allocation to indexed array '%s'", id); 
-			}
-			if (!IS_ARRAY(prop->type)) {
-				position = idpos;
-				abort_c(ERR_NOT_AN_ARRAY, id);
-			}
-			get_token(&token);
-			pos = position;
-			parse_simple(&t1);
-			check_types(t1, TYPE_INTEGER, &pos, "for array size of '%s'", id);
-			gen_newarray(T_INT);
-			gen_2(JVM_ASTORE, prop->offset);
-		} else {
-			abort_c(ERR_ARRAY_ALLOCATION_OR_EXPRESSION_EXPECTED, token.type);
-		}
-	} else {
-		abort_c(ERR_ARGUMENT_LIST_OR_VARIABLE_ASSIGNMENT_EXPECTED, token.type);
+	if ((buf = read_file(path, lenp)) == NULL) {
+		eprintf("file '%s' could not be read:", path);
 	}
-			
-	DBG_end("</name>");
+
+	return buf;
 }
 
-/* <read> = "read" <id> [<index>] .
+/**
+ * Reads a file into memory, if it can.
+ *
+ * @param[in]  path the path of the file.
+ * @param[out] lenp the length of the file.
+ * @return          the contents of the file, which the caller must free, or
+ *                  <code>NULL</code> if the file could not be read.
  */
-void parse_read(void)
+char *read_file(const char *path, size_t *lenp)
 {
-	char *vname; 
-	IDprop *prop;
-	SourcePos pos;
-
-	DBG_start("<read>");
-
-	expect(TOK_READ);
-	pos = position;
-	expect_id(&vname);
-	if (!find_name(vname, &prop)) {
-		position = pos;
-		abort_c(ERR_UNKNOWN_IDENTIFIER, vname);
-	}
-	if (token.type == TOK_LBRACK) {
-		if (!IS_ARRAY(prop->type)) {
-			position = pos;
-			abort_c(ERR_NOT_AN_ARRAY, vname);
+	FILE *file;
+	char *buf;
+	size_t len, cap, n;
+
+	if ((file = fopen(path, "r")) == NULL) {
+		return NULL;
+	}
+	len = 0;
+	cap = BUFSIZ;
+	buf = emalloc(cap);
+	while ((n = fread(buf + len, 1, cap - len, file)) > 0) {
+		len += n;
+		if (len == cap) {
+			cap *= 2;
+			buf = erealloc(buf, cap);
 		}
-		parse_index(vname);
-	} else if (IS_ARRAY(prop->type)) {
-		position = pos;
-		abort_c(ERR_SCALAR_VARIABLE_EXPECTED, vname);
 	}
-	if (IS_INTEGER_TYPE(prop->type)) {
-		gen_read(TYPE_INTEGER);
-	} else {
-		gen_read(TYPE_BOOLEAN);
+	if (ferror(file)) {
+		efree(buf);
+		buf = NULL;
 	}
+	fclose(file);
 
-	if (IS_ARRAY_TYPE(prop->type)) {
-		gen_1(JVM_IASTORE);
-	} else {
-		gen_2(JVM_ISTORE, prop->offset);
-	}	
-
-	DBG_end("</read>");
+	*lenp = len;
+	return buf;
 }
 
-/* <while> = "while" <expr> "do" <statements> "end" .
+/**
+ * Reads the class file of a class from the current directory, if it can.
+ *
+ * @param[in]  class_name the name of the class.
+ * @param[out] lenp       the length of the class file.
+ * @return                the class file, which the caller must free, or
+ *                        <code>NULL</code> if it could not be read.
  */
-void parse_while(void)
+char *read_class(const char *class_name, size_t *lenp)
 {
-	ValType t1;
-	SourcePos pos;
-	int l1, l2;
-
-	DBG_start("<while>");
+	char *class_path, *buf;
 
-	l1 = get_label();
-	l2 = get_label();
+	class_path = emalloc(strlen(class_name) + sizeof(CLASS_EXT));
+	strcpy(class_path, class_name);
+	strcat(class_path, CLASS_EXT);
+	buf = read_file(class_path, lenp);
+	efree(class_path);
 
-	expect(TOK_WHILE);
-	pos = position;
-	gen_label(l1);
-	parse_expr(&t1);
-	gen_2_label(JVM_IFEQ, l2);
-	check_types(t1, TYPE_BOOLEAN, &pos, "for 'while' guard");
-	expect(TOK_DO);
-	parse_statements();
-	expect(TOK_END);
-	gen_2_label(JVM_GOTO, l1);
-
-	gen_label(l2);
-
-	DBG_end("</while>");
+	return buf;
 }
 
-/* <write> = "write" (<string> | <expr>) {"&" (<string> | <expr>)} .
+/**
+ * Displays a diagnostic in the same form as the error routines display
+ * messages, which it was formatted from.  The last error terminates the
+ * program, while the errors before it, if several were collected, do not.
+ *
+ * @param[in] d    the diagnostic.
+ * @param[in] last whether it is the last diagnostic.
  */
-void parse_write(void)
+void display(const SimplDiagnostic *d, int last)
 {
-	ValType t1;
 	SourcePos pos;
 
-	DBG_start("<write>");
-	
-	pos = position;
-	expect(TOK_WRITE);
-	if (token.type == TOK_STR) {
-		gen_print_string(token.string);
-		get_token(&token);
-	} else if (STARTS_EXPR(token.type)) {
-		parse_expr(&t1);
-		gen_print(t1);
-		if (IS_ARRAY(t1)) {
-			position = pos;
-			abort_c(ERR_ILLEGAL_ARRAY_OPERATION, "write");
-		}
+	pos.line = d->line;
+	pos.col = d->col;
+	if (d->severity == SIMPL_WARNING && d->line > 0) {
+		lwprintf(&pos, "%s", d->message);
+	} else if (d->severity == SIMPL_WARNING) {
+		weprintf("%s", d->message);
+	} else if (!last) {
+		ceprintf((d->line > 0 ? &pos : NULL), "%s", d->message);
+	} else if (d->line > 0) {
+		leprintf(&pos, "%s", d->message);
 	} else {
-		abort_c(ERR_EXPRESSION_OR_STRING_EXPECTED, token.type);
-	}
-	while (token.type == TOK_AMPERSAND) {
-		pos = position;
-		get_token(&token);
-		if (token.type == TOK_STR) {
-			gen_print_string(token.string);
-			get_token(&token);
-		} else if (STARTS_EXPR(token.type)) {
-			parse_expr(&t1);
-			gen_print(t1);
-			if (IS_ARRAY(t1)) {
-				position = pos;
-				abort_c(ERR_ILLEGAL_ARRAY_OPERATION, "&");
-			}
-		} else {
-			abort_c(ERR_EXPRESSION_OR_STRING_EXPECTED, token.type);
-		}
+		eprintf("%s", d->message);
 	}
-
-	DBG_end("</write>");
 }
 
-/* <arglist> = "(" [<expr> {"," <expr>}] ")" .
+/**
+ * Writes the Jasmin code of a compilation to a file.
+ *
+ * @param[in] jasm_name the name of the Jasmin file.
+ * @param[in] code      the Jasmin code.
+ * @param[in] len       the length of the code.
  */
-void parse_arglist(char *id, SourcePos idpos)
+void write_jasmin(const char *jasm_name, const char *code, size_t len)
 {
-	ValType t1;
-	unsigned int i;
-	IDprop *prop;
-	char *routine;
-	SourcePos pos;
+	FILE *obj_file;
 
-	DBG_start("<arglist>");
-
-	if (!find_name(id, &prop)) {
-		abort_c(ERR_UNKNOWN_IDENTIFIER, id);
-	}
-	if (IS_FUNCTION(prop->type)) {
-		routine = "function";
-	} else {
-		routine = "procedure";
+	if ((obj_file = fopen(jasm_name, "w")) == NULL) {
+		eprintf("Could not open code file:");
 	}
-	i = 0;
-	
-	expect(TOK_LPAR);
-	if (STARTS_EXPR(token.type)) {
-		if (prop->nparams == 0) {
-			position = idpos;
-			abort_c(ERR_TAKES_NO_ARGUMENTS, id, routine);
-		}
-		pos = position;
-		parse_expr(&t1);
-		check_types(t1, prop->params[i], &pos, 
-		"for parameter %d of call to '%s'", i + 1, id);
-		i++;
-		while (token.type == TOK_COMMA) {
-			if (i >= prop->nparams) {
-				abort_c(ERR_TOO_MANY_ARGUMENTS, id);
-			}
-			get_token(&token);
-			pos = position;
-			parse_expr(&t1);
-			check_types(t1, prop->params[i], &pos, 
-			"for parameter %d of call to '%s'", i + 1, id);
-			i++;
-		}
-		if (i < prop->nparams) {
-			abort_c(ERR_TOO_FEW_ARGUMENTS, id);
-		}
+	if (fwrite(code, 1, len, obj_file) != len || fclose(obj_file) != 0) {
+		eprintf("Could not write code file:");
 	}
-	expect(TOK_RPAR);
-
-	DBG_end("</arglist>");
 }
 
-/* <index> = "[" <simple> "]" .
+/**
+ * Writes the class file of a program, whether it was compiled or taken from the
+ * cache.
+ *
+ * @param[in] class_name the name of the class.
+ * @param[in] buf        the bytes of the class file.
+ * @param[in] len        the length of the class file.
  */
-void parse_index(char *id)
+void write_class(const char *class_name, const char *buf, size_t len)
 {
-	ValType t1;
-	SourcePos pos;
-	IDprop *prop;
+	FILE *class_file;
+	char *class_path;
 
-	DBG_start("<index>");
-	find_name(id, &prop);
-	expect(TOK_LBRACK);
-	pos = position;
-	if (token.type == TOK_NUM) {
-		gen_2(JVM_ALOAD, prop->offset);
+	class_path = emalloc(strlen(class_name) + sizeof(CLASS_EXT));
+	strcpy(class_path, class_name);
+	strcat(class_path, CLASS_EXT);
+	if ((class_file = fopen(class_path, "wb")) == NULL) {
+		eprintf("Could not open class file:");
 	}
-	parse_simple(&t1);
-	check_types(t1, TYPE_INTEGER, &pos, "for array index of '%s'", id); 
-	expect(TOK_RBRACK);
-	
-	DBG_end("</index>");
-}
-
-/* <expr> = <simple> [<relop> <simple>] .
- */
-void parse_expr(ValType *t0)
-{
-	ValType t1, t2;
-	TokenType op;
-	SourcePos pos;
-
-	DBG_start("<expr>");
-
-	parse_simple(&t1);
-	if (IS_RELOP(token.type)) {
-		op = token.type;
-		if (IS_ARRAY(t1)) {
-			abort_c(ERR_ILLEGAL_ARRAY_OPERATION,
-			get_token_string(op));
-		}
-		pos = position;
-		get_token(&token);
-		parse_simple(&t2);
-		if (IS_ARRAY(t2)) {
-			position = pos;
-			abort_c(ERR_ILLEGAL_ARRAY_OPERATION,
-			get_token_string(op));
-		}	
-		if (op == TOK_EQ || op == TOK_NE) {
-			check_types(t2, t1, &pos, "for operator %s", get_token_string(op));
-			if (op == TOK_EQ) {
-				gen_cmp(JVM_IF_ICMPEQ);
-			} else if (op == TOK_NE) {
-				gen_cmp(JVM_IF_ICMPNE);
-			}
-		} else {
-			check_types(t1, TYPE_INTEGER, &pos, "for operator %s",
-			get_token_string(op));
-			check_types(t2, TYPE_INTEGER, &pos, "for operator %s",
-			get_token_string(op));
-			if (op == TOK_GE) {
-				gen_cmp(JVM_IF_ICMPGE); 
-			} else if (op == TOK_GT) {
-				gen_cmp(JVM_IF_ICMPGT);
-			} else if (op == TOK_LE) {
-				gen_cmp(JVM_IF_ICMPLE);
-			} else if (op == TOK_LT) {
-				gen_cmp(JVM_IF_ICMPLT);
-			}
-		}
-		*t0 = TYPE_BOOLEAN;
-	} else {
-		*t0 = t1;
+	if (fwrite(buf, 1, len, class_file) != len || fclose(class_file) != 0) {
+		eprintf("Could not write class file:");
 	}
-
-	DBG_end("</expr>");
+	efree(class_path);
 }
 
-/* <simple> = ["-"] <term> {<addop> <term>} .
- */
-void parse_simple(ValType *t0)
-{
-	ValType t1;
-	SourcePos pos, posterm;
-	TokenType op;
-
-	DBG_start("<simple>");
-
-	t1 = 0;
-	if (token.type == TOK_MINUS) {
-		pos = position;
-		get_token(&token);
-		posterm = position;
-		parse_term(t0);
-		gen_1(JVM_INEG);
-		if (IS_ARRAY(*t0)) {
-			position = pos;
-			abort_c(ERR_ILLEGAL_ARRAY_OPERATION, "unary minus");
-		}
-		check_types(*t0, TYPE_INTEGER, &posterm, "for unary minus");
-	} else {
-		parse_term(t0);
-		if (IS_ADDOP(token.type) && IS_ARRAY(*t0)) {
-			abort_c(ERR_ILLEGAL_ARRAY_OPERATION, get_token_string(token.type));
-		}
-		while (IS_ADDOP(token.type)) {
-			op = token.type;
-			pos = position;
-			get_token(&token);
-			parse_term(&t1);
-			if (IS_ARRAY(t1)) {
-				position = pos;
-				abort_c(ERR_ILLEGAL_ARRAY_OPERATION, get_token_string(op));
-			}
-			if (op == TOK_OR) {
-				check_types(*t0, TYPE_BOOLEAN, &pos, "for operator %s",
-				get_token_string(op));
-				check_types(t1, TYPE_BOOLEAN, &pos, "for operator %s",
-				get_token_string(op));
-				gen_1(JVM_IOR);
-			} else {
-				check_types(*t0, TYPE_INTEGER, &pos, "for operator %s",
-				get_token_string(op));
-				check_types(t1, TYPE_INTEGER, &pos, "for operator %s",
-				get_token_string(op));
-				if (op == TOK_PLUS) {
-					gen_1(JVM_IADD);
-				} else if (op == TOK_MINUS) {
-					gen_1(JVM_ISUB);
-				}
-			}
-		}
-	}
+/* --- cache routines ------------------------------------------------------- */
 
-	DBG_end("</simple>");
-}
-
-/* <term> = <factor> {<mulop> <factor>} .
+/**
+ * Returns the key of a program in the cache, which hashes the version of the
+ * compiler, the assembler, if any, the options that change the class file, the
+ * contents of the imported interfaces, and the source.  The number of jobs
+ * only changes the numbering of labels, and is left out.
+ *
+ * @param[in] src         the source of the program.
+ * @param[in] len         the length of the source.
+ * @param[in] options     the options of the compilation.
+ * @param[in] jasmin_path the path of the Jasmin archive, or <code>NULL</code>
+ *                        if the compiler writes the class file.
+ * @return the key.
  */
-void parse_term(ValType *t0)
+CacheKey program_key(const char *src, size_t len, const SimplOptions *options,
+		const char *jasmin_path)
 {
-	ValType t1;
-	SourcePos pos;
-	TokenType op;
-
-	DBG_start("<term>");
+	CacheKey key;
+	char *buf;
+	size_t n;
+	unsigned int i;
 
-	parse_factor(t0);
-	if (IS_MULOP(token.type) && IS_ARRAY(*t0)) {
-		abort_c(ERR_ILLEGAL_ARRAY_OPERATION, get_token_string(token.type));
-	}
-	while (IS_MULOP(token.type)) {
-		op = token.type;
-		pos = position;
-		get_token(&token);
-		parse_factor(&t1);
-		if (IS_ARRAY(t1)) {
-			position = pos;
-			abort_c(ERR_ILLEGAL_ARRAY_OPERATION, get_token_string(op));
-		}
-		if (op == TOK_AND) {
-			check_types(*t0, TYPE_BOOLEAN, &pos, "for operator %s", 
-			get_token_string(op));
-			check_types(t1, TYPE_BOOLEAN, &pos, "for operator %s",
-			get_token_string(op));
-			gen_1(JVM_IAND);
+	init_key(&key);
+	hash_string(&key, SIMPL_VERSION);
+	hash_string(&key, (jasmin_path != NULL ? jasmin_path : ""));
+	hash_int(&key, options->lazy);
+	hash_int(&key, options->strict);
+	hash_int(&key, (int) options->ninterfaces);
+	for (i = 0; i < options->ninterfaces; i++) {
+		/* an interface that cannot be read fails the compilation anyway */
+		hash_string(&key, options->interfaces[i]);
+		if ((buf = read_file(options->interfaces[i], &n)) != NULL) {
+			hash_int(&key, (int) n);
+			hash_bytes(&key, buf, n);
+			efree(buf);
 		} else {
-			check_types(*t0, TYPE_INTEGER, &pos, "for operator %s",
-			get_token_string(op));
-			check_types(t1, TYPE_INTEGER, &pos, "for operator %s",
-			get_token_string(op));
-			if (op == TOK_MUL) {
-				gen_1(JVM_IMUL);
-			} else if (op == TOK_DIV) {
-				gen_1(JVM_IDIV);
-			} else if (op == TOK_MOD) { 
-				gen_1(JVM_IREM);
-			}
+			hash_int(&key, -1);
 		}
 	}
-	
-	DBG_end("</term>");
-}
+	hash_bytes(&key, src, len);
 
-/* <factor> = <id> [<index> | <arglist>] | <num> | "not" <factor> | "true" |
-              "false" | "(" <expr> ")" .
- */
-void parse_factor(ValType *t0)
-{
-	char *vname;
-	IDprop *prop;
-	SourcePos pos;
-
-	DBG_start("<factor>");
-	vname = NULL;
-	switch (token.type) {
-		case TOK_ID:
-			pos = position;
-			expect_id(&vname);
-			if (!find_name(vname, &prop)) { 
-				position = pos;
-				abort_c(ERR_UNKNOWN_IDENTIFIER, vname);
-			} else if (token.type == TOK_LBRACK) {
-				if (!IS_ARRAY(prop->type)) {
-					position = pos;
-					abort_c(ERR_NOT_AN_ARRAY, vname);
-				}
-				*t0 = prop->type & 6;
-				parse_index(vname);
-				gen_1(JVM_IALOAD);
-			} else if (token.type == TOK_LPAR) {
-				if (!IS_FUNCTION(prop->type)) {
-					position = pos;
-					abort_c(ERR_NOT_A_FUNCTION, vname);
-				}
-				*t0 = (prop->type) ^ TYPE_CALLABLE;
-				parse_arglist(vname, pos);
-				gen_call(vname, prop);
-			} else if (IS_FUNCTION(prop->type)) {
-				position = pos;
-				abort_c(ERR_MISSING_FUNCTION_ARGUMENT_LIST, vname);
-				//abort_c(ERR_NOT_A_VARIABLE, vname);
-			} else {
-				*t0 = prop->type;
-				if (IS_ARRAY_TYPE(*t0)) {
-					gen_2(JVM_ALOAD, prop->offset);
-				} else {
-					gen_2(JVM_ILOAD, prop->offset);
-				}
-			}
-			break;
-
-		case TOK_NUM:
-			gen_2(JVM_LDC, token.value);
-			*t0 = TYPE_INTEGER;
-			get_token(&token);
-			break;
-
-		case TOK_NOT:
-			get_token(&token);
-			pos = position;
-			parse_factor(t0);
-			check_types(*t0, TYPE_BOOLEAN, &pos, "for 'not'");
-			gen_2(JVM_LDC, 1);
-			gen_1(JVM_IXOR);
-			break;
-
-		case TOK_TRUE:
-			gen_2(JVM_LDC, 1);
-			*t0 = TYPE_BOOLEAN;
-			get_token(&token);
-			break;
-
-		case TOK_FALSE:
-			gen_2(JVM_LDC, 0);
-			*t0 = TYPE_BOOLEAN;
-			get_token(&token);
-			break;
-
-		case TOK_LPAR:
-			get_token(&token);
-			parse_expr(t0);
-			expect(TOK_RPAR);
-			break;
-
-		default:
-			abort_c(ERR_FACTOR_EXPECTED, token.type);
-			break;
-	}
-
-	DBG_end("</factor>");
-}
-
-/* --- helper routines ------------------------------------------------------ */
-
-#define MAX_MESSAGE_LENGTH 256
-
-void check_types(ValType found, ValType expected, SourcePos *pos, ...)
-{
-	char buf[MAX_MESSAGE_LENGTH], *s;
-	va_list ap;
-
-	if (found != expected) {
-		buf[0] = '\0';
-		va_start(ap, pos);
-		s = va_arg(ap, char *);
-		vsnprintf(buf, MAX_MESSAGE_LENGTH, s, ap);
-		va_end(ap);
-		if (pos != NULL) {
-			position = *pos;
-		}
-		leprintf("incompatible types (expected %s, found %s) %s",
-			get_valtype_string(expected), get_valtype_string(found), buf);
-	}
+	return key;
 }
 
-void expect(TokenType type)
-{
-	if (token.type == type) {
-		get_token(&token);
-	} else {
-		abort_c(ERR_EXPECT, type);
-	}
-}
-
-void expect_id(char **id)
-{
-	if (token.type == TOK_ID) {
-		*id = strdup(token.lexeme);
-		get_token(&token);
-	} else {
-		abort_c(ERR_EXPECT, TOK_ID);
-	}
-}
-
-IDprop *make_idprop(ValType type, unsigned int offset, unsigned int nparams,
-       ValType *params)
-{
-	IDprop *ip;
-
-	ip = emalloc(sizeof(IDprop));
-	ip->type = type;
-	ip->offset = offset;
-	ip->nparams = nparams;
-	ip->params = params;
-
-	return ip;
-}
-
-Variable *make_var(char *id, ValType type, SourcePos pos)
-{
-	Variable *vp;
-
-	vp = emalloc(sizeof(Variable));
-	vp->id = id;
-	vp->type = type;
-	vp->pos = pos;
-	vp->next = NULL;
-
-	return vp;
-}
-
-/* --- error reporting routines --------------------------------------------- */
-
-void _abort_compile(SourcePos *posp, Error err, va_list args);
-
-void abort_c(Error err, ...)
-{
-	va_list args;
-
-	va_start(args, err);
-	_abort_compile(NULL, err, args);
-	va_end(args);
-}
-
-void abort_cp(SourcePos *posp, Error err, ...)
-{
-	va_list args;
-
-	va_start(args, err);
-	_abort_compile(posp, err, args);
-	va_end(args);
-}
-
-void _abort_compile(SourcePos *posp, Error err, va_list args)
+/**
+ * Takes a program from the cache, if it is there, and writes out its files
+ * and displays its diagnostics, as if it had been compiled.
+ *
+ * @param[in] dir the cache directory.
+ * @param[in] key the key of the program.
+ * @return whether the program was in the cache.
+ */
+Boolean reuse_program(const char *dir, CacheKey key)
 {
-	char expstr[MAX_MESSAGE_LENGTH], *s, *t; 
-	int tok;
+	CachedProgram prog;
+	unsigned int i;
+#ifdef DEBUG_CODEGEN
+	char *jasm_name;
+#endif
 
-	if (posp) {
-		position = *posp;
+	if (!fetch_program(dir, key, &prog)) {
+		count_lookup(dir, FALSE);
+		return FALSE;
 	}
+	count_lookup(dir, TRUE);
 
-	snprintf(expstr, MAX_MESSAGE_LENGTH, "expected %%s, but found %s",
-		get_token_string(token.type));
-
-	switch (err) {
-		case ERR_ARGUMENT_LIST_OR_VARIABLE_ASSIGNMENT_EXPECTED:
-		case ERR_ARRAY_ALLOCATION_OR_EXPRESSION_EXPECTED:
-		case ERR_EXIT_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE:
-		case ERR_EXPECT:
-		case ERR_EXPRESSION_OR_STRING_EXPECTED:
-		case ERR_FACTOR_EXPECTED:
-		case ERR_MISSING_EXIT_EXPRESSION_FOR_FUNCTION:
-		case ERR_STATEMENT_EXPECTED:
-		case ERR_TYPE_EXPECTED:
-			break;
-		case ERR_TAKES_NO_ARGUMENTS:
-			s = va_arg(args, char *);
-			t = va_arg(args, char *);
-			break;	
-		default:
-			s = va_arg(args, char *);
-			break;
+	for (i = 0; i < prog.ndiagnostics; i++) {
+		display(&prog.diagnostics[i], i + 1 == prog.ndiagnostics);
 	}
+	save_interface(prog.class_name, prog.interface, prog.interface_len);
+#ifdef DEBUG_CODEGEN
+	/* the Jasmin file is kept when debugging, as after a compilation */
+	jasm_name = emalloc(strlen(prog.class_name) + sizeof(JASM_EXT));
+	strcpy(jasm_name, prog.class_name);
+	strcat(jasm_name, JASM_EXT);
+	write_jasmin(jasm_name, prog.code, prog.code_len);
+	efree(jasm_name);
+#endif
+	write_class(prog.class_name, prog.class_file, prog.class_len);
+	release_program(&prog);
 
-	switch (err) {
-
-		/* Add additional cases here as is necessary, referring to
-		 * errmsg.h for all possible errors.  Some errors only become possible
-		 * to recognise once we add type checking.  Until you get to type
-		 * checking, you can handle such errors by adding the default case.
-		 * However, your final submission *must* handle all cases explicitly.
-		 */
-		case ERR_ARGUMENT_LIST_OR_VARIABLE_ASSIGNMENT_EXPECTED:
-			leprintf(expstr, "argument list or variable assignment");
-			break;
-
-		case ERR_ARRAY_ALLOCATION_OR_EXPRESSION_EXPECTED:
-			leprintf(expstr, "array allocation or expression");
-			break;
-		
-		case ERR_EXIT_EXPRESSION_NOT_ALLOWED_FOR_PROCEDURE:
-			leprintf("an exit expression is not allowed for a procedure");
-			break;
-
-		case ERR_EXPECT:
-			tok = va_arg(args, int);
-			leprintf(expstr, get_token_string(tok));
-			break;
-
-		case ERR_EXPRESSION_OR_STRING_EXPECTED:
-			leprintf(expstr, "expression or string");
-			break;
-
-		case ERR_FACTOR_EXPECTED:
-			leprintf(expstr, "factor");
-			break;
-
-		case ERR_ILLEGAL_ARRAY_OPERATION:
-			leprintf("%s is an illegal array operation", s);
-			break;
-		
-		case ERR_MISSING_EXIT_EXPRESSION_FOR_FUNCTION:
-			leprintf("missing exit expression for a function");
-			break;
-
-		case ERR_MISSING_FUNCTION_ARGUMENT_LIST:
-			leprintf("missing argument list for function '%s'", s);
-			break;
-
-		case ERR_MULTIPLE_DEFINITION:
-			leprintf("multiple definition of '%s'", s);
-			break;
-
-		case ERR_NOT_A_FUNCTION:
-			leprintf("'%s' is not a function", s);
-			break;
-
-		case ERR_NOT_A_PROCEDURE:
-			leprintf("'%s' is not a procedure", s);
-			break;
-		
-		case ERR_NOT_A_VARIABLE:
-			leprintf("'%s' is not a variable", s);
-			break;
-
-		case ERR_NOT_AN_ARRAY:
-			leprintf("'%s' is not an array", s);
-			break;
-
-		case ERR_SCALAR_VARIABLE_EXPECTED:
-			leprintf("expected scalar variable instead of '%s'", s);
-			break;
-
-		case ERR_STATEMENT_EXPECTED:
-			leprintf(expstr, "statement");
-			break;
-		
-		case ERR_TAKES_NO_ARGUMENTS:
-			leprintf("%s '%s' takes no arguments", s, t); 
-			break;
-
-		case ERR_TOO_FEW_ARGUMENTS:
-			leprintf("too few arguments for call to '%s'", s);
-			break;
-
-		case ERR_TOO_MANY_ARGUMENTS:
-			leprintf("too many arguments for call to '%s'", s);
-			break;
-
-		case ERR_TYPE_EXPECTED:
-			leprintf(expstr, "type");
-			break;
-		
-		case ERR_UNKNOWN_IDENTIFIER:
-			leprintf("unknown identifier '%s'", s);
-			break;
-
-		case ERR_UNREACHABLE:
-			leprintf("unreachable: %s", s);
-			break;
-
-		default:
-			leprintf("Error not yet implemented");
-			break;
-		
-	}
-}
-
-/* --- debugging output routines -------------------------------------------- */
-
-#ifdef DEBUG_PARSER
-
-static int indent = 0;
-
-void debug_start(const char *fmt, ...)
-{
-	va_list ap;
-
-	va_start(ap, fmt);
-	debug_info(fmt, ap);
-	va_end(ap);
-	indent += 2;
+	return TRUE;
 }
 
-void debug_end(const char *fmt, ...)
+/**
+ * Keeps a compiled program in the cache, along with its class file.
+ *
+ * @param[in] dir        the cache directory.
+ * @param[in] key        the key of the program.
+ * @param[in] result     the result of the compilation.
+ * @param[in] class_file the class file that was written.
+ * @param[in] class_len  the length of the class file.
+ */
+void keep_program(const char *dir, CacheKey key, const SimplResult *result,
+		const char *class_file, size_t class_len)
 {
-	va_list ap;
-
-	indent -= 2;
-	va_start(ap, fmt);
-	debug_info(fmt, ap);
-	va_end(ap);
+	CachedProgram prog;
+
+	prog.class_file = (char *) class_file;
+	prog.class_len = class_len;
+	prog.class_name = result->class_name;
+	prog.interface = result->interface;
+	prog.interface_len = result->interface_len;
+	prog.code = result->code;
+	prog.code_len = result->code_len;
+	prog.diagnostics = result->diagnostics;
+	prog.ndiagnostics = result->ndiagnostics;
+	store_program(dir, key, &prog);
 }
 
-void debug_info(const char *fmt, ...)
+/**
+ * Displays the statistics of a cache directory.
+ *
+ * @param[in] dir the cache directory.
+ */
+void display_stats(const char *dir)
 {
-	int i;
-	char buf[MAX_MESSAGE_LENGTH], *buf_ptr;
-	va_list ap;
-
-	buf_ptr = buf;
-
-	va_start(ap, fmt);
-
-	for (i = 0; i < indent; i++) {
-		*buf_ptr++ = ' ';
-	}
-	vsprintf(buf_ptr, fmt, ap);
-
-	buf_ptr += strlen(buf_ptr);
-	snprintf(buf_ptr, MAX_MESSAGE_LENGTH, " in line %d.\n", position.line);
-	fflush(stdout);
-	fputs(buf, stdout);
-	fflush(NULL);
-
-	va_end(ap);
+	CacheStats stats;
+	unsigned long lookups;
+
+	get_cache_stats(dir, &stats);
+	lookups = stats.hits + stats.misses;
+	printf("cache: %lu hits, %lu misses (%.1f%% hit rate), "
+			"%lu entries, %lu bytes\n", stats.hits, stats.misses,
+			(lookups ? 100.0 * stats.hits / lookups : 0.0),
+			stats.entries, stats.bytes);
 }
-
-#endif /* DEBUG_PARSER */
@@ -0,0 +1,179 @@
+/**
+ * @file    simplc.h
+ * @brief   The interface of the SIMPL-2021 compiler library.
+ *
+ * The compiler is built as a library, <code>libsimplc</code>, of which the
+ * <code>simplc</code> program is a thin driver.  A compilation takes the
+ * source of a program from a buffer, and hands back the class file, the Jasmin
+ * code, and the binary interface of the program in memory, along with its
+ * diagnostics.  The class file is written by the compiler itself, so that the
+ * Jasmin code is only needed for reading, or to assemble it with Jasmin.  It
+ * writes no files, other than the entries of a cache when it is given one, and
+ * an error never terminates the calling program, so that an editor or build
+ * server can compile again and again in one process.  Several compilations may
+ * run at once, on different threads.
+ *
+ * Given a cache directory, a compilation keeps the code of every subroutine
+ * that it compiles there, under a hash of the tokens of the subroutine and of
+ * the signatures of the routines that it refers to.  A later compilation in
+ * which a subroutine and those signatures are unchanged takes its code from
+ * the cache instead of compiling it again, so that after an edit, only the
+ * subroutines affected by the edit are compiled.  Since a dump needs the
+ * intermediate form of every subroutine, the cache is not used when dumping.
+ *
+ * A compilation normally stops at its first error.  Given a larger number of
+ * errors to collect, it recovers from an error in a statement by skipping to
+ * the end of the statement, and from an error elsewhere in a subroutine
+ * definition by skipping the definition, and carries on, so that one
+ * compilation reports as many errors as it can, up to that number.  Once an
+ * error is found, no more code is generated.
+ *
+ * On request, a compilation also hands back a dump of the intermediate form of
+ * every subroutine, in which the code is translated to basic blocks of
+ * three-address instructions in static single assignment form, and of the
+ * control-flow graph of the code of every subroutine, in the DOT language.
+ *
+ * Expressions of which the value is known at compile time are folded to
+ * constants, and operations with identity elements are left out, before code
+ * is generated.  The code of every subroutine is then improved by a peephole
+ * optimiser, which rewrites sequences of instructions by the rules of a table.
+ * On request, a compilation hands back how often each of these was applied.
+ * Since the code taken from a cache is not optimised again, the cache is not
+ * used when counting.
+ *
+ * The right operand of <code>and</code> and <code>or</code> is evaluated only
+ * if the left operand does not decide the value, unless the evaluation is made
+ * strict, in which case both operands are always evaluated.
+ *
+ * A compilation can be cancelled from another thread through a cancellation
+ * token, and it can be given a deadline.  Both are checked at every statement
+ * and subroutine definition that is parsed, and before the code of every
+ * subroutine is generated, so that a compilation stops shortly after either.
+ *
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#ifndef SIMPLC_H
+#define SIMPLC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+/** the version of the compiler, which keys the entries of a cache */
+#define SIMPL_VERSION "2021.12"
+
+/** the maximum number of compilation threads */
+#define SIMPL_MAX_JOBS 256
+
+/** a cancellation token, which may be shared by several compilations */
+typedef struct {
+	atomic_int              requested;   /**< whether to cancel             */
+} SimplCancel;
+
+/** the options of a compilation; all-zero options are the defaults */
+typedef struct {
+	int                     lazy;        /**< compile reachable bodies only */
+	unsigned int            jobs;        /**< the number of threads, or 0   */
+	const char *const      *interfaces;  /**< the interface files to import */
+	unsigned int            ninterfaces; /**< the number of interfaces      */
+	SimplCancel            *cancel;      /**< the token, or NULL            */
+	const struct timespec  *deadline;    /**< on CLOCK_MONOTONIC, or NULL   */
+	int                     dump_ir;     /**< dump the intermediate form    */
+	int                     dump_cfg;    /**< dump the control-flow graphs  */
+	int                     stats;       /**< count the optimisations       */
+	int                     strict;      /**< evaluate and/or fully         */
+	const char             *cache_dir;   /**< the cache directory, or NULL  */
+	unsigned int            max_errors;  /**< the errors to collect, or 0   */
+} SimplOptions;
+
+/** the outcome of a compilation */
+typedef enum {
+	SIMPL_OK,                            /**< compiled successfully         */
+	SIMPL_FAILED,                        /**< stopped by an error           */
+	SIMPL_CANCELLED,                     /**< stopped through its token     */
+	SIMPL_TIMED_OUT                      /**< stopped at its deadline       */
+} SimplStatus;
+
+/** the severity of a diagnostic */
+typedef enum {
+	SIMPL_WARNING,
+	SIMPL_ERROR
+} SimplSeverity;
+
+/** a diagnostic, of which the position is 0:0 if it has none */
+typedef struct {
+	SimplSeverity           severity;    /**< the severity                  */
+	int                     line;        /**< the line in the source        */
+	int                     col;         /**< the column in the source      */
+	char                   *message;     /**< the message                   */
+} SimplDiagnostic;
+
+/** the result of a compilation; the outputs are only set on success */
+typedef struct {
+	SimplStatus             status;        /**< the outcome               */
+	char                   *class_name;    /**< the name of the class     */
+	char                   *class_file;    /**< the class file            */
+	size_t                  class_len;     /**< the length of the class file */
+	char                   *code;          /**< the Jasmin code           */
+	size_t                  code_len;      /**< the length of the code    */
+	char                   *interface;     /**< the binary interface      */
+	size_t                  interface_len; /**< the length of the interface */
+	char                   *ir;            /**< the dumped form, if any   */
+	size_t                  ir_len;        /**< the length of the dump    */
+	char                   *cfg;           /**< the dumped graph, if any  */
+	size_t                  cfg_len;       /**< the length of the dump    */
+	char                   *stats;         /**< the counts, if any        */
+	size_t                  stats_len;     /**< the length of the counts  */
+	SimplDiagnostic        *diagnostics;   /**< the diagnostics, in order */
+	unsigned int            ndiagnostics;  /**< the number of diagnostics */
+} SimplResult;
+
+/**
+ * Compiles a program from a buffer.  Compilation stops at the first error,
+ * which is the last of the diagnostics, or when it is cancelled or runs past
+ * its deadline.  If it collects several errors, it stops once it has collected
+ * as many as it was allowed to, or reaches the end of the source, and the
+ * diagnostics are sorted by their position.  The result must be released with
+ * <code>simpl_release_result</code>, whatever the outcome.
+ *
+ * @param[in]   src
+ *     the source of the program, which need not be terminated
+ * @param[in]   len
+ *     the length of the source
+ * @param[in]   options
+ *     the options, or <code>NULL</code> for the defaults
+ * @param[out]  result
+ *     the result
+ * @return      the outcome, as also recorded in the result
+ */
+SimplStatus simpl_compile_buffer(const char *src, size_t len,
+		const SimplOptions *options, SimplResult *result);
+
+/**
+ * Releases the contents of a compilation result.
+ *
+ * @param[in,out] result
+ *     the result
+ */
+void simpl_release_result(SimplResult *result);
+
+/**
+ * Initialises a cancellation token, as not yet cancelled.
+ *
+ * @param[out]  cancel
+ *     the token
+ */
+void simpl_init_cancel(SimplCancel *cancel);
+
+/**
+ * Cancels every compilation that uses the token.  This may be called from any
+ * thread.
+ *
+ * @param[in,out] cancel
+ *     the token
+ */
+void simpl_cancel(SimplCancel *cancel);
+
+#endif /* SIMPLC_H */
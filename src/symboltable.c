@@ -15,16 +15,6 @@
 #include "symboltable.h"
 #include "token.h"
 
-/* --- global static variables ---------------------------------------------- */
-
-static HashTab *table, *saved_table;
-/* Nothing here, but note that the next variable keeps a running count of
- * the number of variables in the current symbol table.  It will be necessary
- * during code generation to compute the size of the local variable array of a
- * method frame in the Java virtual machine.
- */
-static unsigned int curr_offset;
-
 /* --- function prototypes -------------------------------------------------- */
 
 static void valstr(void *key, void *p, char *str);
@@ -34,45 +24,70 @@ static int key_strcmp(void *val1, void *val2);
 
 /* --- symbol table interface ----------------------------------------------- */
 
-void init_symbol_table(void)
+void init_symbol_table(SymbolTable *st)
 {
-	saved_table = NULL;
+	st->saved_table = NULL;
 
-	if ((table = ht_init(0.75f, shift_hash, key_strcmp)) == NULL) { 
+	if ((st->table = ht_init(0.75f, shift_hash, key_strcmp)) == NULL) { 
 		eprintf("Symbol table could not be initialised");
 	}
-	curr_offset = 1;
+	st->global_table = st->table;
+	st->shared = FALSE;
+	/* Note that the offset keeps a running count of the number of variables
+	 * in the current symbol table.  It is necessary during code generation to
+	 * compute the size of the local variable array of a method frame in the
+	 * Java virtual machine.
+	 */
+	st->curr_offset = 1;
 }
 
-Boolean open_subroutine(char *id, IDprop *prop)
+void share_symbol_table(SymbolTable *st, const SymbolTable *owner)
+{
+	st->saved_table = NULL;
+	st->table = st->global_table = owner->global_table;
+	st->shared = TRUE;
+	st->curr_offset = 1;
+}
+
+Boolean open_subroutine(SymbolTable *st, char *id, IDprop *prop)
 {
 	/* - Insert the subroutine name into the global symbol table; return TRUE or
 	 *   FALSE, depending on whether or not the insertion succeeded.
 	 * - Save the global symbol table to saved_table, initialise a new hash
 	 *   table for the subroutine, and reset the current offset.
 	 */
-	if (ht_insert(table, id, prop) != EXIT_SUCCESS) {
+	if (ht_insert(st->table, id, prop) != EXIT_SUCCESS) {
 		return FALSE;
 	}
-	saved_table = table;
+	enter_subroutine(st, 0);
+	return TRUE;
+}
+
+void enter_subroutine(SymbolTable *st, unsigned int first)
+{
+	st->saved_table = st->global_table;
 
-	if ((table = ht_init(0.75f, shift_hash, key_strcmp)) == NULL) {
-		table = saved_table;
+	if ((st->table = ht_init(0.75f, shift_hash, key_strcmp)) == NULL) {
+		st->table = st->saved_table;
 		eprintf("Symbol table could not be initialised"); 
 	}
-	curr_offset = 1;
-	return TRUE;
+	st->curr_offset = first;
 }
 
-void close_subroutine(void)
+void close_subroutine(SymbolTable *st)
 {
 	/* Release the subroutine table, and reactivate the global table. */
-	ht_free(table, free, freeprop);
-	table = saved_table;
+	ht_free(st->table, efree, freeprop);
+	st->table = st->saved_table;
 	//saved_table = NULL;
 }
 
-Boolean insert_name(char *id, IDprop *prop)
+Boolean in_subroutine(const SymbolTable *st)
+{
+	return (st->table != st->global_table);
+}
+
+Boolean insert_name(SymbolTable *st, char *id, IDprop *prop)
 {
 	/* Insert the properties of the identifier into the hash table, and
 	 * remember to increment the current offset pointer if the identifier is a
@@ -82,27 +97,43 @@ Boolean insert_name(char *id, IDprop *prop)
 	 * the header file.
 	*/
 	IDprop *p;
-	if (find_name(id, &p)) {
+
+	return declare_name(st, id, prop, &p);
+}
+
+Boolean declare_name(SymbolTable *st, char *id, IDprop *prop,
+		IDprop **slot)
+{
+	/* Outside a subroutine, the one probe of ht_find_or_insert decides both
+	 * whether the name is taken and where it goes.  Inside a subroutine, the
+	 * local table is probed once, too, but a local may not shadow a callable,
+	 * and callables live in the global table, which therefore has to be
+	 * searched first.  Merging the two probes would require a local table that
+	 * also holds every callable in scope.
+	 */
+	if (in_subroutine(st) && ht_search(st->global_table, id, (void **) slot)
+			&& IS_CALLABLE_TYPE((*slot)->type)) {
 		return FALSE;
 	}
-	if(ht_insert(table, id, prop) != EXIT_SUCCESS) {
+	if (ht_find_or_insert(st->table, id, prop, (void **) slot)
+			!= EXIT_SUCCESS) {
 		return FALSE;
 	}
 	if (IS_VARIABLE(prop->type)) {
-		prop->offset = curr_offset;
-		curr_offset++;
+		prop->offset = st->curr_offset;
+		st->curr_offset++;
 	}
 	return TRUE;
 }
 
-Boolean find_name(char *id, IDprop **prop)
+Boolean find_name(SymbolTable *st, char *id, IDprop **prop)
 {
 	Boolean found;
 
 	/*Nothing, unless you want to.*/
-	found = ht_search(table, id, (void **) prop);
-	if (!found && saved_table) {
-		found = ht_search(saved_table, id, (void **) prop);
+	found = ht_search(st->table, id, (void **) prop);
+	if (!found && st->saved_table) {
+		found = ht_search(st->saved_table, id, (void **) prop);
 		if (found && !IS_CALLABLE_TYPE((*prop)->type)) {
 			found = FALSE;
 		}
@@ -111,21 +142,23 @@ Boolean find_name(char *id, IDprop **prop)
 	return found;
 }
 
-int get_variables_width(void)
+int get_variables_width(SymbolTable *st)
 {
-	return curr_offset;
+	return st->curr_offset;
 }
 
-void release_symbol_table(void)
+void release_symbol_table(SymbolTable *st)
 {
 	/* Free the underlying structures of the symbol table. */
-	ht_free(table, free, freeprop);
-	table = NULL;
+	if (!st->shared) {
+		ht_free(st->global_table, efree, freeprop);
+	}
+	st->table = st->global_table = NULL;
 }
 
-void print_symbol_table(void)
+void print_symbol_table(SymbolTable *st)
 {
-	ht_print(table, valstr);
+	ht_print(st->table, valstr);
 }
 
 /* --- utility functions ---------------------------------------------------- */
@@ -153,11 +186,12 @@ static void valstr(void *key, void *p, char *str)
 static void freeprop(void *p)
 {
 	IDprop *prop = (IDprop *) p;
-	if (IS_CALLABLE_TYPE(prop->type) && prop->nparams > 0) {
-		//free(prop->params);
+	/* the parameter types of an imported routine belong to its interface */
+	if (IS_CALLABLE_TYPE(prop->type) && prop->nparams > 0
+			&& prop->module == NULL) {
+		efree(prop->params);
 	}
-	//free(prop);
-
+	efree(prop);
 }
 
 static unsigned int shift_hash(void *key, unsigned int size)
@@ -9,6 +9,7 @@
 #define SYMBOLTABLE_H
 
 #include "boolean.h"
+#include "hashtable.h"
 #include "token.h"
 #include "valtypes.h"
 
@@ -17,19 +18,51 @@ typedef struct {
 	unsigned int  offset;   /*<< local variable offset for code generation */
 	unsigned int  nparams;  /*<< number of parameters; 0 for variables     */
 	ValType      *params;   /*<< array of parameter types; NULL for vars   */
+	const char   *module;   /*<< class of an imported routine; else NULL   */
 } IDprop;
 
 /**
- * Initialises the global symbol table.
+ * A symbol table: a global table, and while a subroutine is open, the local
+ * table of the subroutine.  Several symbol tables may share one global table,
+ * so that each can compile a different subroutine against the same globals;
+ * the global table must then no longer change.
  */
-void init_symbol_table(void);
+typedef struct {
+	HashTab       *global_table; /**< the global table                     */
+	HashTab       *table;        /**< the current table                    */
+	HashTab       *saved_table;  /**< the global table, inside a subroutine */
+	unsigned int   curr_offset;  /**< the next local variable offset       */
+	Boolean        shared;       /**< whether another owns the global table */
+} SymbolTable;
+
+/**
+ * Initialises a symbol table with a new, empty global table.
+ *
+ * @param[out]  st
+ *     the symbol table
+ */
+void init_symbol_table(SymbolTable *st);
+
+/**
+ * Initialises a symbol table that shares the global table of another, which
+ * remains responsible for releasing it.
+ *
+ * @param[out]  st
+ *     the symbol table
+ * @param[in]   owner
+ *     the symbol table that owns the global table
+ */
+void share_symbol_table(SymbolTable *st, const SymbolTable *owner);
 
 /**
  * Opens a new function or procedure (subroutine) context by (1) inserting the
  * subroutine name and properties into the global symbol table, (2) preserving
  * the global symbol table for later re-use, and (3) initialising a new local
- * symbol table for the subroutine as current symbol table.
+ * symbol table for the subroutine as current symbol table, of which the
+ * variables are numbered from local variable slot 0.
  *
+ * @param[in,out] st
+ *     the symbol table
  * @param[in]   id
  *     the identifier of the new function or procedure
  * @param[in]   prop
@@ -37,14 +70,44 @@ void init_symbol_table(void);
  * @return      <code>TRUE</code> if the local subroutine context was set up
  *              successfully, or <code>FALSE</code> otherwise
  */
-Boolean open_subroutine(char *id, IDprop *prop);
+Boolean open_subroutine(SymbolTable *st, char *id, IDprop *prop);
+
+/**
+ * Opens a local context for a subroutine of which the name is already in the
+ * global symbol table, by preserving the global symbol table and initialising
+ * a new local symbol table as current symbol table.  The local context belongs
+ * to the symbol table context, so that several contexts that share a global
+ * symbol table may each compile a subroutine against it at once.
+ *
+ * @param[in,out] st
+ *     the symbol table
+ * @param[in]   first
+ *     the local variable slot of the first variable declared: 0 for a
+ *     subroutine, whose parameters take the first slots of its static method,
+ *     and 1 for the main body, since slot 0 of <code>main</code> holds its
+ *     arguments
+ */
+void enter_subroutine(SymbolTable *st, unsigned int first);
 
 /**
  * Closes the current subroutine context by (1) releasing memory resources
  * associated with the current local symbol table, and (2) setting the preserved
  * global symbol table as the current symbol table.
+ *
+ * @param[in,out] st
+ *     the symbol table
  */
-void close_subroutine(void);
+void close_subroutine(SymbolTable *st);
+
+/**
+ * Returns whether a subroutine context is open.
+ *
+ * @param[in]   st
+ *     the symbol table
+ * @return      <code>TRUE</code> if a subroutine context is open, or
+ *              <code>FALSE</code> otherwise
+ */
+Boolean in_subroutine(const SymbolTable *st);
 
 /**
  * Inserts the specified identifier with the specified properties into the
@@ -52,6 +115,8 @@ void close_subroutine(void);
  * <code>prop</code> pointers, and assumes responsibility for their
  * deallocation.
  *
+ * @param[in,out] st
+ *     the symbol table
  * @param[in]   id
  *     the identifier to insert
  * @param[in]   prop
@@ -60,12 +125,40 @@ void close_subroutine(void);
  *              symbol table, or if there was not enough space for a new entry,
  *              or <code>TRUE</code> otherwise
  */
-Boolean insert_name(char *id, IDprop *prop);
+Boolean insert_name(SymbolTable *st, char *id, IDprop *prop);
+
+/**
+ * Declares the specified identifier with the specified properties in the
+ * current symbol table, probing the table only once.  In a subroutine, the
+ * global table is searched as well, since a local may not shadow a callable.
+ * If the identifier is not yet defined, this function "steals" the
+ * <code>id</code> and <code>prop</code> pointers, exactly like
+ * <code>insert_name</code>, and sets the local variable offset of a variable.
+ * If it is already defined, the caller retains ownership of both pointers.
+ *
+ * @param[in,out] st
+ *     the symbol table
+ * @param[in]   id
+ *     the identifier to declare
+ * @param[in]   prop
+ *     the properties to be associated with the new identifier
+ * @param[out]  slot
+ *     the pointer to the pointer to which the properties now associated with
+ *     the identifier will be copied: either <code>prop</code>, or the
+ *     properties of the existing definition
+ * @return      <code>TRUE</code> if the identifier was declared, or
+ *              <code>FALSE</code> if it is already defined, or if there was
+ *              not enough space for a new entry
+ */
+Boolean declare_name(SymbolTable *st, char *id, IDprop *prop,
+		IDprop **slot);
 
 /**
  * Retrieves the properties associated with the specified identifier from the
  * current symbol table.
  *
+ * @param[in]   st
+ *     the symbol table
  * @param[in]   id
  *     the identifier to look up in the current symbol table
  * @param[out]  prop
@@ -74,21 +167,31 @@ Boolean insert_name(char *id, IDprop *prop);
  * @return      <code>TRUE</code> if the identifier exists in the current symbol
  *              table, or <code>FALSE</code> otherwise
  */
-Boolean find_name(char *id, IDprop **prop);
+Boolean find_name(SymbolTable *st, char *id, IDprop **prop);
 
 /**
  * Returns the number of the identifiers stored in the current symbol table.
+ *
+ * @param[in]   st
+ *     the symbol table
  */
-int get_variables_width(void);
+int get_variables_width(SymbolTable *st);
 
 /**
- * Releases the memory resources associated with the global symbol table.
+ * Releases the memory resources associated with the global symbol table,
+ * unless it is shared from another symbol table.
+ *
+ * @param[in,out] st
+ *     the symbol table
  */
-void release_symbol_table(void);
+void release_symbol_table(SymbolTable *st);
 
 /**
  * Prints the current symbol table to the standard output stream.
+ *
+ * @param[in]   st
+ *     the symbol table
  */
-void print_symbol_table(void);
+void print_symbol_table(SymbolTable *st);
 
 #endif /* SYMBOLTABLE_H */
@@ -41,14 +41,14 @@ int main()
 	scanf("%s", buffer);
 	while (strcmp(buffer, "search") != 0) {
 		np = emalloc(sizeof(Name));
-		np->id = strdup(buffer);
+		np->id = estrdup(buffer);
 		np->num = i++;
 		if ((ret = ht_insert(ht, np->id, np)) == EXIT_SUCCESS) {
 			printf("Insert %s with %d\n", np->id, np->num);
 		} else {
 			printf("Not inserted...! (%i)\n", ret);
-			free(np->id);
-			free(np);
+			efree(np->id);
+			efree(np);
 		}
 		printf(">> ");
 		scanf("%s", buffer);
@@ -70,7 +70,7 @@ int main()
 	}
 	printf("\n");
 
-	ht_free(ht, free, free);
+	ht_free(ht, efree, efree);
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,166 @@
+/**
+ * @file    testregion.c
+ * @brief   A driver program to stress the allocation regions by compiling
+ *          programs over and over, to be run under a leak checker.
+ * @author  C.H. Langeveldt (23632135@sun.ac.za)
+ * @date    2021-08-23
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "error.h"
+#include "simplc.h"
+
+/* --- type definitions and constants --------------------------------------- */
+
+#define DEFAULT_ROUNDS 100
+
+/* --- function prototypes -------------------------------------------------- */
+
+void cross_regions(void);
+char *read_program(const char *path, size_t *lenp);
+int compile_rounds(const char *path, unsigned int rounds);
+
+/* --- main routine --------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+	unsigned int rounds;
+	int i, first, failed;
+	char *end;
+	long n;
+
+	setprogname(argv[0]);
+
+	/* check command-line arguments */
+	rounds = DEFAULT_ROUNDS;
+	first = 1;
+	if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+		n = strtol(argv[2], &end, 10);
+		if (*end != '\0' || n < 1) {
+			eprintf("invalid number of rounds '%s'", argv[2]);
+		}
+		rounds = (unsigned int) n;
+		first = 3;
+	}
+	if (first >= argc) {
+		eprintf("usage: %s [-n <rounds>] <filename>...", getprogname());
+	}
+
+	cross_regions();
+
+	failed = 0;
+	for (i = first; i < argc; i++) {
+		failed += compile_rounds(argv[i], rounds);
+	}
+
+	freeprogname();
+
+	return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/* --- functions ------------------------------------------------------------ */
+
+/* Passes blocks across region boundaries.  Under a leak checker, a block from
+ * malloc that is released while a region is active shows up as a leak if it is
+ * not freed, and a block that is resized by the wrong owner corrupts the heap.
+ */
+void cross_regions(void)
+{
+	Region *outer, *inner;
+	char *heap, *kept, *moved;
+
+	heap = estrdup("released while a region is active");
+	kept = estrdup("resized while a region is active");
+	outer = region_open();
+	efree(heap);
+	kept = erealloc(kept, 4096);
+	moved = estrdup("owned by the outer region");
+	inner = region_open();
+	moved = erealloc(moved, 4096);
+	if (strcmp(moved, "owned by the outer region") != 0) {
+		eprintf("a block of another region was not copied when resized");
+	}
+	region_release(inner);
+	region_release(outer);
+	if (strcmp(kept, "resized while a region is active") != 0) {
+		eprintf("a block from malloc was not kept when resized");
+	}
+	efree(kept);
+}
+
+char *read_program(const char *path, size_t *lenp)
+{
+	FILE *file;
+	char *buf;
+	long len;
+
+	if ((file = fopen(path, "rb")) == NULL
+			|| fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) < 0
+			|| fseek(file, 0, SEEK_SET) != 0) {
+		eprintf("file '%s' could not be read:", path);
+	}
+	buf = emalloc((size_t) len + 1);
+	if (fread(buf, 1, (size_t) len, file) != (size_t) len) {
+		eprintf("file '%s' could not be read:", path);
+	}
+	fclose(file);
+	buf[len] = '\0';
+	*lenp = (size_t) len;
+
+	return buf;
+}
+
+/* Compiles a program the specified number of times, eagerly, lazily, and on
+ * two threads in turn, and checks that every round has the same outcome as the
+ * first round that compiled it in the same way.  Programs that fail to compile
+ * are as welcome as ones that do, since they leave a compilation through its
+ * error trap.  Every other round is compiled from within a region of the
+ * caller, which must be active again afterwards: a block allocated after the
+ * compilation is left to that region, and shows up as a leak if it was taken
+ * from malloc instead.
+ */
+int compile_rounds(const char *path, unsigned int rounds)
+{
+	SimplOptions options;
+	SimplResult result;
+	SimplStatus status[3];
+	size_t len, class_len[3];
+	unsigned int i, mode;
+	Region *own;
+	char *src;
+	int failed;
+
+	src = read_program(path, &len);
+	failed = 0;
+	for (i = 0; i < rounds && !failed; i++) {
+		mode = i % 3;
+		memset(&options, 0, sizeof(options));
+		options.lazy = (mode == 1);
+		options.jobs = (mode == 2 ? 2 : 0);
+		own = (i % 2 == 1 ? region_open() : NULL);
+		simpl_compile_buffer(src, len, &options, &result);
+		if (own != NULL) {
+			estrdup("owned by the region of the caller");
+			region_release(own);
+		}
+		if (i == mode) {
+			status[mode] = result.status;
+			class_len[mode] = result.class_len;
+		} else if (result.status != status[mode]
+				|| result.class_len != class_len[mode]) {
+			fprintf(stderr, "%s: round %u of %s had another outcome\n",
+					getprogname(), i + 1, path);
+			failed = 1;
+		}
+		simpl_release_result(&result);
+	}
+	efree(src);
+	if (!failed) {
+		printf("%s: %u rounds\n", path, rounds);
+	}
+
+	return failed;
+}
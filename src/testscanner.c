@@ -20,6 +20,7 @@ void print_token(Token *token);
 
 int main(int argc, char *argv[])
 {
+	Scanner scanner;
 	Token token;
 	FILE *in_file;
 
@@ -39,13 +40,13 @@ int main(int argc, char *argv[])
 	}
 
 	/* initialise scanner */
-	init_scanner(in_file);
+	init_scanner(&scanner, in_file);
 
 	/* iterate over tokens in the input file */
-	get_token(&token);
+	get_token(&scanner, &token);
 	while (token.type != TOK_EOF) {
 		print_token(&token);
-		get_token(&token);
+		get_token(&scanner, &token);
 	}
 
 	/* free names */
@@ -69,7 +70,7 @@ void print_token(Token *token)
 			break;
 		case TOK_STR:
 			printf("String: \"%s\"\n", token->string);
-			free(token->string);
+			efree(token->string);
 			break;
 		default:
 			printf("%s\n", get_token_string(token->type));
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "boolean.h"
+#include "error.h"
 #include "symboltable.h"
 
 #define BUFFER_SIZE 1024
@@ -18,8 +19,9 @@ int main()
 	char buffer[BUFFER_SIZE], *id;
 	Boolean main_is_active;
 	IDprop *propts;
+	SymbolTable st;
 
-	init_symbol_table();
+	init_symbol_table(&st);
 	main_is_active = TRUE;
 
 	printf("type \"search <Enter>\" to stop inserting and start searching.\n");
@@ -45,18 +47,18 @@ int main()
 				continue;
 			}
 
-			id = strdup(buffer);
-			propts = malloc(sizeof(IDprop));
+			id = estrdup(buffer);
+			propts = emalloc(sizeof(IDprop));
 			propts->type = TYPE_CALLABLE | TYPE_INTEGER;
 			propts->nparams = 0;
 			propts->params = NULL;
 
-			if (open_subroutine(id, propts)) {
+			if (open_subroutine(&st, id, propts)) {
 				main_is_active = FALSE;
 			} else {
 				printf("Subroutine already exists ... not added.\n");
-				free(id);
-				free(propts);
+				efree(id);
+				efree(propts);
 			}
 
 		} else if (strcmp(buffer, "close") == 0) {
@@ -66,32 +68,32 @@ int main()
 				continue;
 			}
 
-			close_subroutine();
+			close_subroutine(&st);
 			main_is_active = TRUE;
 
 		} else if (strcmp(buffer, "print") == 0) {
 
-			print_symbol_table();
+			print_symbol_table(&st);
 
 		} else if (strcmp(buffer, "insert") == 0) {
 
 			scanf("%s", buffer);
-			id = strdup(buffer);
-			propts = malloc(sizeof(IDprop));
+			id = estrdup(buffer);
+			propts = emalloc(sizeof(IDprop));
 			propts->type = TYPE_INTEGER;
 			propts->nparams = 0;
 			propts->params = NULL;
 
-			if (!insert_name(id, propts)) {
+			if (!insert_name(&st, id, propts)) {
 				printf("Identifier already exists ... not added.\n");
-				free(id);
-				free(propts);
+				efree(id);
+				efree(propts);
 			}
 
 		} else if (strcmp(buffer, "find") == 0) {
 
 			scanf("%s", buffer);
-			if (find_name(buffer, &propts)) {
+			if (find_name(&st, buffer, &propts)) {
 				printf("\"%s\" at offset %i.\n", buffer,
 						propts->offset);
 			} else {
@@ -101,7 +103,7 @@ int main()
 		} else if (strcmp(buffer, "quit") == 0) {
 
 			if (!main_is_active) {
-				close_subroutine();
+				close_subroutine(&st);
 				printf("Closed subroutine.\n");
 			}
 			break;
@@ -112,7 +114,7 @@ int main()
 	}
 
 	printf("Goodbye!\n");
-	release_symbol_table();
+	release_symbol_table(&st);
 
 	return EXIT_SUCCESS;
 }
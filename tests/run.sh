@@ -0,0 +1,79 @@
+#!/bin/sh
+#
+# Runs the regression programs in this directory against a compiler.
+#
+#     usage: run.sh <simplc>
+#
+# For every program X.simpl, X.args, if there is one, holds the arguments to
+# compile it with, X.err holds the diagnostics that the compiler must report on
+# its standard error, in which case compilation must fail, and X.out holds the
+# output that its class file must write, with X.in, if there is one, as its
+# input.  Class files are run under "java -Xverify:all", so that
+# the verifier checks every method; if there is no java on the PATH, they are
+# only compiled.  Every program is compiled in a directory of its own, in the
+# order of their names, and these directories share a parent, so that
+# programs can share a cache through "--cache ../cache".
+#
+
+SIMPLC=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+TESTS=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+if command -v java >/dev/null 2>&1; then
+	JAVA=java
+else
+	JAVA=
+	echo "run.sh: java not found, class files are compiled but not run"
+fi
+
+passed=0
+failed=0
+
+fail() {
+	echo "FAIL $1: $2"
+	failed=$((failed + 1))
+}
+
+for src in "$TESTS"/*.simpl; do
+	name=$(basename "$src" .simpl)
+	dir=$WORK/$name
+	mkdir -p "$dir"
+	cp "$src" "$dir"
+	args=
+	[ -f "$TESTS/$name.args" ] && args=$(cat "$TESTS/$name.args")
+	if [ -f "$TESTS/$name.err" ]; then
+		if (cd "$dir" && "$SIMPLC" $args "$name.simpl" >/dev/null \
+				2>"$dir/err"); then
+			fail "$name" "compiled, but should not have"
+		elif ! diff -u "$TESTS/$name.err" "$dir/err"; then
+			fail "$name" "unexpected diagnostics"
+		else
+			passed=$((passed + 1))
+		fi
+		continue
+	fi
+	if ! (cd "$dir" && "$SIMPLC" $args "$name.simpl" >/dev/null \
+			2>"$dir/err"); then
+		fail "$name" "$(cat "$dir/err")"
+		continue
+	fi
+	if [ -n "$JAVA" ] && [ -f "$TESTS/$name.out" ]; then
+		class=$(basename "$(ls "$dir"/*.class | head -n 1)" .class)
+		input=/dev/null
+		[ -f "$TESTS/$name.in" ] && input=$TESTS/$name.in
+		if ! (cd "$dir" && "$JAVA" -Xverify:all -cp . "$class" <"$input" \
+				>"$dir/out" 2>&1); then
+			fail "$name" "$(cat "$dir/out")"
+			continue
+		fi
+		if ! diff -u "$TESTS/$name.out" "$dir/out"; then
+			fail "$name" "unexpected output"
+			continue
+		fi
+	fi
+	passed=$((passed + 1))
+done
+
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]